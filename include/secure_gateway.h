@@ -13,9 +13,11 @@ typedef enum {
   SG_INIT = 0x01,
   SG_OATH_HANDLE_APDU = 0x02,
   SG_GET_TIME = 0x03,
+  SG_IDLE = 0x04,
   SG_HSM_GEN_KEY = 0x10,
   SG_HSM_GET_PUBKEY = 0x11,
   SG_HSM_SIGN = 0x12,
+  SG_HSM_VERIFY = 0x13,
   SG_GET_CONFIG = 0x20,
   SG_FIDO2_HANDLE_MSG = 0x30,
   SG_OATH_BACKUP = 0x40,
@@ -28,7 +30,48 @@ typedef enum {
 #define SG_ERR_INVALID_PARAM -1
 #define SG_ERR_UNKNOWN_FUNC -2
 #define SG_ERR_BUFFER_TOO_SMALL -3
-#define SG_ERR_TOUCH_REQUIRED -4 // Special case for non-blocking touch
+#define SG_ERR_TOUCH_REQUIRED -4 // User presence pending; submit again
+
+// HSM key algorithms for SG_HSM_GEN_KEY (HSM_ALG_* in the Secure World)
+#define SG_HSM_ALG_P256 0x01
+#define SG_HSM_ALG_ED25519 0x02
+
+// Largest APDU exchanged with the Secure World: a command header plus
+// extended Lc and Le, or response data plus the status word. APDU buffers on
+// both sides are this size. The APDU parser itself accepts the full 16-bit
+// extended Lc/Le range; raise this (up to the 16-bit gateway length) to
+// carry more per exchange.
+#ifndef SG_APDU_MAX_LEN
+#define SG_APDU_MAX_LEN 4096
+#endif
+
+// Period of the wait notification for long Secure World calls. CTAPHID
+// expects a keepalive at least every 100 ms.
+#ifndef SG_WAIT_INTERVAL_MS
+#define SG_WAIT_INTERVAL_MS 100
+#endif
+
+/**
+ * @brief Notification that a Secure World call is still running.
+ *
+ * Secure World calls block the calling core until they return. Non-Secure
+ * interrupts still preempt them, so a driver can keep its host informed
+ * (CCID time extension, CTAPHID keepalive) from this callback.
+ *
+ * Runs in timer interrupt context at the default IRQ priority, the same as
+ * the USB interrupt. It must not call into the Secure World or run
+ * tud_task().
+ */
+typedef void (*secure_gateway_wait_cb_t)(void *ctx);
+
+/**
+ * @brief Arms a wait callback for the next Secure World call.
+ *
+ * The callback fires every SG_WAIT_INTERVAL_MS until that call returns, and
+ * is disarmed afterwards. The APDU, FIDO2 message and HSM key generation,
+ * signing and verification calls honour it.
+ */
+void secure_gateway_on_wait(secure_gateway_wait_cb_t cb, void *ctx);
 
 /**
  * @brief Initializes the Secure World environment.
@@ -38,6 +81,14 @@ typedef enum {
  */
 void secure_gateway_init(void);
 
+/**
+ * @brief Gives the Secure World a slice of idle time.
+ *
+ * Called from the Non-Secure main loop. The Secure World uses it for
+ * deferred work such as flushing buffered storage writes.
+ */
+void secure_gateway_idle(void);
+
 /**
  * @brief Calls the Secure World to handle an OATH APDU command.
  *
@@ -46,7 +97,8 @@ void secure_gateway_init(void);
  *
  * @param apdu_in Pointer to the incoming APDU command buffer.
  * @param len_in Length of the incoming APDU command.
- * @param apdu_out Pointer to the outgoing APDU response buffer.
+ * @param apdu_out Pointer to the outgoing APDU response buffer
+ *                 (SG_APDU_MAX_LEN bytes).
  * @param len_out Pointer to the length of the outgoing APDU response.
  * @return true on success, false on failure.
  */
@@ -55,8 +107,11 @@ bool secure_gateway_oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
 
 /**
  * @brief Calls the Secure World to generate an HSM key.
+ *
+ * @param algorithm SG_HSM_ALG_P256 or SG_HSM_ALG_ED25519.
  */
-bool secure_gateway_hsm_gen_key(uint8_t slot, uint8_t *status);
+bool secure_gateway_hsm_gen_key(uint8_t slot, uint8_t algorithm,
+                                uint8_t *status);
 
 /**
  * @brief Calls the Secure World to get an HSM public key.
@@ -66,12 +121,36 @@ bool secure_gateway_hsm_get_pubkey(uint8_t slot, uint8_t *pubkey,
 
 /**
  * @brief Calls the Secure World to sign data with an HSM key.
+ *
+ * P-256 keys sign the 32-byte hash as ECDSA; Ed25519 keys sign the 32 bytes
+ * as the message.
  */
 bool secure_gateway_hsm_sign(uint8_t slot, const uint8_t *hash, uint8_t *sig,
                              uint16_t *sig_len);
 
-bool secure_gateway_fido2_handle_msg(const uint8_t *msg_in, uint16_t len_in,
-                                     uint8_t *msg_out, uint16_t *len_out);
+/**
+ * @brief Calls the Secure World to verify P-256 ECDSA signatures.
+ *
+ * @param request 64-byte public key followed by count pairs of a 32-byte
+ *                hash and a 64-byte signature.
+ * @param results One byte per pair, set to 1 when the signature is valid.
+ * @return Number of valid signatures, or -1 if the request is malformed or
+ *         the public key is not on the curve.
+ */
+int secure_gateway_hsm_verify(const uint8_t *request, uint16_t count,
+                              uint8_t *results);
+
+/**
+ * @brief Calls the Secure World to process a CTAP message.
+ *
+ * @param msg_out Response buffer (1024 bytes).
+ * @return SG_SUCCESS with the response in msg_out, SG_ERR_TOUCH_REQUIRED if
+ *         the request needs user presence and the button is not pressed (the
+ *         same message should be submitted again later), or another SG_ERR_*
+ *         code.
+ */
+int32_t secure_gateway_fido2_handle_msg(const uint8_t *msg_in, uint16_t len_in,
+                                        uint8_t *msg_out, uint16_t *len_out);
 
 bool secure_gateway_oath_backup(uint8_t *out_buf, uint16_t *out_len);
 bool secure_gateway_oath_restore(const uint8_t *in_buf, uint16_t in_len);
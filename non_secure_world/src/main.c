@@ -47,6 +47,9 @@ int main(void) {
     webusb_task();
     fido2_task();
 
+    // Deferred Secure World work (storage write-back, ECDSA nonce pool)
+    secure_gateway_idle();
+
     // Put core to sleep or run low-priority tasks
     tight_loop_contents();
   }
@@ -1,4 +1,5 @@
 #include "secure_gateway.h"
+#include "pico/time.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -8,15 +9,60 @@ extern int32_t secure_world_handler(secure_gateway_func_id_t func_id,
                                     uint8_t *in_data, uint16_t in_len,
                                     uint8_t *out_data, uint16_t out_max_len);
 
+// Wait callback armed for the next call, and the one of the running call
+static secure_gateway_wait_cb_t wait_cb_next;
+static void *wait_ctx_next;
+static secure_gateway_wait_cb_t volatile wait_cb;
+static void *volatile wait_ctx;
+
+static int64_t wait_alarm(alarm_id_t id, void *user_data) {
+  (void)id;
+  (void)user_data;
+  if (wait_cb)
+    wait_cb(wait_ctx);
+  // Positive: keep the cadence relative to the previous tick
+  return (int64_t)SG_WAIT_INTERVAL_MS * 1000;
+}
+
+// secure_world_handler() with the armed wait callback ticking meanwhile
+static int32_t call_with_wait(secure_gateway_func_id_t func_id,
+                              uint8_t *in_data, uint16_t in_len,
+                              uint8_t *out_data, uint16_t out_max_len) {
+  alarm_id_t alarm = 0;
+  if (wait_cb_next) {
+    wait_cb = wait_cb_next;
+    wait_ctx = wait_ctx_next;
+    wait_cb_next = NULL;
+    alarm = add_alarm_in_ms(SG_WAIT_INTERVAL_MS, wait_alarm, NULL, true);
+  }
+
+  int32_t result =
+      secure_world_handler(func_id, in_data, in_len, out_data, out_max_len);
+
+  if (alarm > 0)
+    cancel_alarm(alarm);
+  wait_cb = NULL;
+  return result;
+}
+
+void secure_gateway_on_wait(secure_gateway_wait_cb_t cb, void *ctx) {
+  wait_cb_next = cb;
+  wait_ctx_next = ctx;
+}
+
 void secure_gateway_init(void) {
   printf("[GATEWAY] Initializing Secure World Connection...\n");
   secure_world_handler(SG_INIT, NULL, 0, NULL, 0);
 }
 
+void secure_gateway_idle(void) {
+  secure_world_handler(SG_IDLE, NULL, 0, NULL, 0);
+}
+
 bool secure_gateway_oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
                                      uint8_t *apdu_out, uint16_t *len_out) {
-  int32_t result = secure_world_handler(SG_OATH_HANDLE_APDU, apdu_in, len_in,
-                                        apdu_out, 1024);
+  int32_t result = call_with_wait(SG_OATH_HANDLE_APDU, apdu_in, len_in,
+                                  apdu_out, SG_APDU_MAX_LEN);
   if (result >= 0) {
     if (len_out)
       *len_out = (uint16_t)result;
@@ -29,11 +75,12 @@ bool secure_gateway_oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
   return false;
 }
 
-bool secure_gateway_hsm_gen_key(uint8_t slot, uint8_t *status) {
-  uint8_t in_data = slot;
+bool secure_gateway_hsm_gen_key(uint8_t slot, uint8_t algorithm,
+                                uint8_t *status) {
+  uint8_t in_data[2] = {slot, algorithm};
   uint8_t out_data[1];
   int32_t result =
-      secure_world_handler(SG_HSM_GEN_KEY, &in_data, 1, out_data, 1);
+      call_with_wait(SG_HSM_GEN_KEY, in_data, 2, out_data, 1);
   if (result < 0)
     return false;
   *status = out_data[0];
@@ -62,7 +109,7 @@ bool secure_gateway_hsm_sign(uint8_t slot, const uint8_t *hash, uint8_t *sig,
   memcpy(in_data + 1, hash, 32);
 
   uint8_t out_data[65]; // 1 byte status + 64 bytes sig
-  int32_t result = secure_world_handler(SG_HSM_SIGN, in_data, 33, out_data, 65);
+  int32_t result = call_with_wait(SG_HSM_SIGN, in_data, 33, out_data, 65);
   if (result < 1)
     return false;
   if (out_data[0] != 0)
@@ -72,6 +119,17 @@ bool secure_gateway_hsm_sign(uint8_t slot, const uint8_t *hash, uint8_t *sig,
   return true;
 }
 
+int secure_gateway_hsm_verify(const uint8_t *request, uint16_t count,
+                              uint8_t *results) {
+  uint32_t len = 64 + (uint32_t)count * 96;
+  if (count == 0 || len > UINT16_MAX)
+    return -1;
+
+  int32_t result = call_with_wait(SG_HSM_VERIFY, (uint8_t *)request,
+                                  (uint16_t)len, results, count);
+  return (result < 0) ? -1 : (int)result;
+}
+
 bool secure_gateway_get_config(uint16_t *vid, uint16_t *pid) {
   uint8_t out_data[4];
   int32_t result = secure_world_handler(SG_GET_CONFIG, NULL, 0, out_data, 4);
@@ -85,16 +143,16 @@ bool secure_gateway_get_config(uint16_t *vid, uint16_t *pid) {
   return false;
 }
 
-bool secure_gateway_fido2_handle_msg(const uint8_t *msg_in, uint16_t len_in,
-                                     uint8_t *msg_out, uint16_t *len_out) {
-  int32_t result = secure_world_handler(SG_FIDO2_HANDLE_MSG, (uint8_t *)msg_in,
-                                        len_in, msg_out, 1024);
+int32_t secure_gateway_fido2_handle_msg(const uint8_t *msg_in, uint16_t len_in,
+                                        uint8_t *msg_out, uint16_t *len_out) {
+  int32_t result = call_with_wait(SG_FIDO2_HANDLE_MSG, (uint8_t *)msg_in,
+                                  len_in, msg_out, 1024);
   if (result >= 0) {
     if (len_out)
       *len_out = (uint16_t)result;
-    return true;
+    return SG_SUCCESS;
   }
-  return false;
+  return result;
 }
 
 bool secure_gateway_oath_backup(uint8_t *out_buf, uint16_t *out_len) {
@@ -42,10 +42,9 @@ extern "C" {
 #define CFG_TUD_CDC_TX_BUFSIZE 64
 
 //------------- HID (FIDO2) -------------//
-// Required for FIDO2/U2F support
-#define CFG_TUD_HID 1
-#define CFG_TUD_HID_RX_BUFSIZE 64
-#define CFG_TUD_HID_TX_BUFSIZE 64
+// The FIDO HID interface has its own class driver (fido2_driver), which can
+// free the IN endpoint from interrupt context for keepalives
+#define CFG_TUD_HID 0
 
 //------------- MSC (Optional for UF2) -------------//
 // Not needed for final firmware, but useful for development
@@ -12,19 +12,95 @@
  *
  * This module emulates a CCID reader and handles communication between the
  * host and the secure world OATH application.
+ *
+ * Commands move through a two-slot pipeline. Bulk-OUT fills a slot and
+ * queues it; ccid_task() runs the queued command (the Secure World call)
+ * outside the USB callbacks and builds its response in the same slot; bulk-IN
+ * drains responses in order. While one slot's response is on the wire the
+ * other slot can already receive the next command. Everything runs in the
+ * main loop (tud_task and ccid_task), so slots need no locking.
+ *
+ * While a command is stuck in a long Secure World call (key generation,
+ * signing, flash erase), the gateway's wait callback queues a time
+ * extension block from timer interrupt context on every tick, so the host
+ * keeps waiting however long the call takes.
  */
 
 #define CCID_INTERFACE_CLASS 0x0B
 #define CCID_DESCRIPTOR_LEN 54
 #define YUBIKEY_ATR_LEN 18
 
+// Bulk endpoint packet size
+#define CCID_EP_SIZE CFG_TUD_CCID_RX_BUFSIZE
+// Responses are queued on bulk-IN in chunks of this many bytes
+#define CCID_TX_CHUNK (CCID_EP_SIZE * 8)
+// Command/response slots in the pipeline
+#define CCID_SLOTS 2
+
+// Slot error reporting (CCID Rev 1.1 section 6.2.6)
+#define CCID_STATUS_COMMAND_FAILED 0x40
+#define CCID_ERROR_CMD_NOT_SUPPORTED 0x00
+#define CCID_ERROR_BAD_LENGTH 0x01 // Offset of dwLength in the header
+#define CCID_ERROR_HW 0xFB
+
+// Time extension (CCID Rev 1.1 section 6.2.7). bError carries the factor
+// the host applies to its response timeout.
+#define CCID_STATUS_TIME_EXTENSION 0x80
+#define CCID_WTX_MULTIPLIER 10
+
+typedef enum {
+  CCID_SLOT_FREE,      // Can take the next command
+  CCID_SLOT_RECEIVING, // Bulk-OUT is filling cmd
+  CCID_SLOT_QUEUED,    // Complete command waiting for ccid_task
+  CCID_SLOT_READY,     // Response built, waiting for bulk-IN
+  CCID_SLOT_SENDING,   // Response on the wire
+} ccid_slot_state_t;
+
+typedef struct {
+  ccid_slot_state_t state;
+  uint8_t rx_error; // Non-zero: reject the command with this bError
+  uint32_t cmd_len;
+  uint32_t rsp_len;
+  uint8_t cmd[CCID_MAX_MESSAGE_LEN];
+  uint8_t rsp[CCID_MAX_MESSAGE_LEN];
+} ccid_slot_t;
+
 // Global state
 typedef struct {
   bool is_card_present;
   uint8_t atr[YUBIKEY_ATR_LEN];
+  uint8_t rhport;
   uint8_t ep_out;
   uint8_t ep_in;
-  uint8_t rx_buffer[CFG_TUD_CCID_RX_BUFSIZE];
+
+  // Slots are used round robin, so commands are received, executed and
+  // answered in order. Each index points at the next slot for its stage.
+  ccid_slot_t slots[CCID_SLOTS];
+  uint8_t rx_slot;
+  uint8_t work_slot;
+  uint8_t tx_slot;
+
+  // Bulk-OUT reassembly. A message spans as many packets as its header's
+  // dwLength says; the first packet is read alone to learn that length and
+  // the rest is requested in one transfer straight behind it.
+  uint32_t rx_len;       // Bytes of the current message received so far
+  uint32_t rx_expected;  // Header plus dwLength, 0 while waiting for a header
+  uint16_t rx_requested; // Length of the transfer in flight
+  bool rx_overflow;      // Longer than a slot: drained, then rejected
+  bool rx_stalled;       // No free slot: bulk-OUT left unarmed (NAKs)
+
+  // Bulk-IN transmission of slots[tx_slot]
+  bool tx_busy;
+  uint32_t tx_off;
+  bool tx_zlp; // Response is a whole number of packets: end with a ZLP
+
+  // Time extension. TinyUSB keeps an endpoint busy until its completion is
+  // handled, and tud_task cannot run during the Secure World call, so the
+  // block's completion is reaped in interrupt context (ccid_user_xfer_isr)
+  // to free bulk-IN for the next tick.
+  ccid_slot_t *volatile wtx_slot; // Command in the Secure World, or NULL
+  volatile bool wtx_sent;         // Block queued on bulk-IN, not yet reaped
+  uint8_t wtx_block[CCID_HEADER_SIZE];
 } ccid_context_t;
 
 static ccid_context_t ccid_ctx = {.is_card_present = true,
@@ -36,7 +112,11 @@ static ccid_context_t ccid_ctx = {.is_card_present = true,
                                   .ep_in = 0};
 
 // Forward declarations
-static void ccid_handle_request(uint8_t const *msg, uint32_t len);
+static void ccid_build_response(ccid_slot_t *slot);
+static void ccid_rx_arm(void);
+static void ccid_tx_kick(void);
+static void ccid_tx_continue(void);
+static void ccid_tx_done(void);
 
 void ccid_init(void) {
   printf("[CCID] Initializing USB Smart Card Interface...\n");
@@ -51,6 +131,20 @@ static void ccid_user_init(void) { ccid_init(); }
 static void ccid_user_reset(uint8_t rhport) {
   (void)rhport;
   ccid_ctx.is_card_present = true;
+  for (int i = 0; i < CCID_SLOTS; i++)
+    ccid_ctx.slots[i].state = CCID_SLOT_FREE;
+  ccid_ctx.rx_slot = 0;
+  ccid_ctx.work_slot = 0;
+  ccid_ctx.tx_slot = 0;
+  ccid_ctx.rx_len = 0;
+  ccid_ctx.rx_expected = 0;
+  ccid_ctx.rx_overflow = false;
+  ccid_ctx.rx_stalled = false;
+  ccid_ctx.tx_busy = false;
+  ccid_ctx.tx_off = 0;
+  ccid_ctx.tx_zlp = false;
+  ccid_ctx.wtx_slot = NULL;
+  ccid_ctx.wtx_sent = false;
 }
 
 static uint16_t ccid_user_open(uint8_t rhport,
@@ -87,8 +181,8 @@ static uint16_t ccid_user_open(uint8_t rhport,
   }
 
   // Start listening
-  usbd_edpt_xfer(rhport, ccid_ctx.ep_out, ccid_ctx.rx_buffer,
-                 sizeof(ccid_ctx.rx_buffer), false);
+  ccid_ctx.rhport = rhport;
+  ccid_rx_arm();
 
   return total_len;
 }
@@ -100,16 +194,189 @@ static bool ccid_user_control_xfer_cb(uint8_t rhport, uint8_t stage,
   return (request->bmRequestType_bit.type == TUSB_REQ_TYPE_CLASS);
 }
 
+//--------------------------------------------------------------------+
+// Bulk Transfers
+//--------------------------------------------------------------------+
+
+// Queues the next OUT transfer into the receiving slot: a header packet, the
+// rest of the current message, or a slice of an oversized message being
+// drained. Leaves bulk-OUT unarmed while both slots are busy.
+static void ccid_rx_arm(void) {
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.rx_slot];
+  if (ccid_ctx.rx_expected == 0) {
+    if (slot->state != CCID_SLOT_FREE) {
+      ccid_ctx.rx_stalled = true;
+      return;
+    }
+    slot->state = CCID_SLOT_RECEIVING;
+  }
+  ccid_ctx.rx_stalled = false;
+
+  uint8_t *dst = slot->cmd;
+  uint32_t len = CCID_EP_SIZE;
+  if (ccid_ctx.rx_expected > 0) {
+    len = ccid_ctx.rx_expected - ccid_ctx.rx_len;
+    if (ccid_ctx.rx_overflow) {
+      // Keep the header for the error reply; discard the payload behind it
+      uint32_t room = sizeof(slot->cmd) - CCID_EP_SIZE;
+      room -= room % CCID_EP_SIZE;
+      dst += CCID_EP_SIZE;
+      if (len > room)
+        len = room;
+    } else {
+      dst += ccid_ctx.rx_len;
+    }
+  }
+
+  ccid_ctx.rx_requested = (uint16_t)len;
+  usbd_edpt_xfer(ccid_ctx.rhport, ccid_ctx.ep_out, dst,
+                 ccid_ctx.rx_requested, false);
+}
+
+static void ccid_rx_reset(void) {
+  ccid_ctx.rx_len = 0;
+  ccid_ctx.rx_expected = 0;
+  ccid_ctx.rx_overflow = false;
+}
+
+// Hands the receiving slot to ccid_task and moves on to the other one
+static void ccid_rx_queue(uint8_t rx_error) {
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.rx_slot];
+  slot->cmd_len = rx_error ? CCID_HEADER_SIZE : ccid_ctx.rx_expected;
+  slot->rx_error = rx_error;
+  slot->state = CCID_SLOT_QUEUED;
+  ccid_ctx.rx_slot = (uint8_t)((ccid_ctx.rx_slot + 1) % CCID_SLOTS);
+  ccid_rx_reset();
+}
+
+static void ccid_rx_complete(uint32_t xferred) {
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.rx_slot];
+  if (ccid_ctx.rx_expected == 0) {
+    if (xferred < CCID_HEADER_SIZE) {
+      // Runt packet, wait for the next header
+      slot->state = CCID_SLOT_FREE;
+      ccid_rx_reset();
+      return;
+    }
+    ccid_msg_header_t const *header = (ccid_msg_header_t const *)slot->cmd;
+    uint32_t payload = header->dwLength;
+    ccid_ctx.rx_overflow = payload > sizeof(slot->cmd) - CCID_HEADER_SIZE;
+    // Oversized messages are drained by count, so the sum must not wrap
+    ccid_ctx.rx_expected =
+        ccid_ctx.rx_overflow && payload > UINT32_MAX - CCID_HEADER_SIZE
+            ? UINT32_MAX
+            : CCID_HEADER_SIZE + payload;
+  }
+  ccid_ctx.rx_len += xferred;
+
+  if (ccid_ctx.rx_len < ccid_ctx.rx_expected) {
+    if (xferred < ccid_ctx.rx_requested) {
+      // A short packet ended the message before dwLength: reject it
+      printf("[CCID] Truncated message (%lu of %lu bytes)\n",
+             (unsigned long)ccid_ctx.rx_len,
+             (unsigned long)ccid_ctx.rx_expected);
+      ccid_rx_queue(CCID_ERROR_BAD_LENGTH);
+    }
+    return;
+  }
+
+  if (ccid_ctx.rx_overflow) {
+    printf("[CCID] Message of %lu bytes exceeds %u\n",
+           (unsigned long)ccid_ctx.rx_expected, CCID_MAX_MESSAGE_LEN);
+    ccid_rx_queue(CCID_ERROR_BAD_LENGTH);
+  } else {
+    ccid_rx_queue(0);
+  }
+}
+
+// Starts sending the oldest built response if bulk-IN is idle
+static void ccid_tx_kick(void) {
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.tx_slot];
+  if (ccid_ctx.tx_busy || ccid_ctx.wtx_sent || slot->state != CCID_SLOT_READY)
+    return;
+
+  slot->state = CCID_SLOT_SENDING;
+  ccid_ctx.tx_busy = true;
+  ccid_ctx.tx_off = 0;
+  ccid_ctx.tx_zlp = (slot->rsp_len % CCID_EP_SIZE) == 0;
+  ccid_tx_continue();
+}
+
+// Recycles the slot on the wire, once its response is sent or abandoned, and
+// moves on to the next response and any command held back for a free slot
+static void ccid_tx_done(void) {
+  ccid_ctx.slots[ccid_ctx.tx_slot].state = CCID_SLOT_FREE;
+  ccid_ctx.tx_slot = (uint8_t)((ccid_ctx.tx_slot + 1) % CCID_SLOTS);
+  ccid_ctx.tx_busy = false;
+  ccid_ctx.tx_zlp = false;
+  ccid_tx_kick();
+  if (ccid_ctx.rx_stalled)
+    ccid_rx_arm();
+}
+
+static void ccid_tx_continue(void) {
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.tx_slot];
+  if (ccid_ctx.tx_off < slot->rsp_len) {
+    uint32_t chunk = slot->rsp_len - ccid_ctx.tx_off;
+    if (chunk > CCID_TX_CHUNK)
+      chunk = CCID_TX_CHUNK;
+    usbd_edpt_xfer(ccid_ctx.rhport, ccid_ctx.ep_in,
+                   slot->rsp + ccid_ctx.tx_off, (uint16_t)chunk, false);
+    ccid_ctx.tx_off += chunk;
+    return;
+  }
+  if (ccid_ctx.tx_zlp) {
+    ccid_ctx.tx_zlp = false;
+    usbd_edpt_xfer(ccid_ctx.rhport, ccid_ctx.ep_in, NULL, 0, false);
+    return;
+  }
+
+  ccid_tx_done();
+}
+
 static bool ccid_user_xfer_cb(uint8_t rhport, uint8_t ep_addr,
                               xfer_result_t result, uint32_t xferred_bytes) {
-  if (result != XFER_RESULT_SUCCESS)
-    return false;
+  (void)rhport;
+  if (ep_addr == ccid_ctx.ep_in) {
+    if (!ccid_ctx.tx_busy)
+      return true;
+    if (result == XFER_RESULT_SUCCESS) {
+      ccid_tx_continue();
+    } else {
+      // The rest of the response cannot follow a failed transfer
+      printf("[CCID] Response abandoned after %lu bytes\n",
+             (unsigned long)ccid_ctx.tx_off);
+      ccid_tx_done();
+    }
+    return true;
+  }
 
   if (ep_addr == ccid_ctx.ep_out) {
-    ccid_handle_request(ccid_ctx.rx_buffer, xferred_bytes);
-    usbd_edpt_xfer(rhport, ccid_ctx.ep_out, ccid_ctx.rx_buffer,
-                   sizeof(ccid_ctx.rx_buffer), false);
+    if (result == XFER_RESULT_SUCCESS) {
+      ccid_rx_complete(xferred_bytes);
+    } else if (ccid_ctx.slots[ccid_ctx.rx_slot].state ==
+               CCID_SLOT_RECEIVING) {
+      ccid_ctx.slots[ccid_ctx.rx_slot].state = CCID_SLOT_FREE;
+      ccid_rx_reset();
+    }
+    ccid_rx_arm();
+    return true;
   }
+  return false;
+}
+
+// Interrupt context. Takes the completion of a time extension block here,
+// since tud_task may be stuck behind the Secure World call it is for; the
+// main loop's next ccid_tx_kick sends the response. Everything else goes to
+// ccid_user_xfer_cb.
+static bool ccid_user_xfer_isr(uint8_t rhport, uint8_t ep_addr,
+                               xfer_result_t result, uint32_t xferred_bytes) {
+  (void)rhport;
+  (void)result;
+  (void)xferred_bytes;
+  if (ep_addr != ccid_ctx.ep_in || !ccid_ctx.wtx_sent)
+    return false;
+  ccid_ctx.wtx_sent = false;
   return true;
 }
 
@@ -120,87 +387,116 @@ const usbd_class_driver_t ccid_driver = {.name = "CCID",
                                          .control_xfer_cb =
                                              ccid_user_control_xfer_cb,
                                          .xfer_cb = ccid_user_xfer_cb,
+                                         .xfer_isr = ccid_user_xfer_isr,
                                          .sof = NULL};
 
 //--------------------------------------------------------------------+
 // CCID Protocol Logic
 //--------------------------------------------------------------------+
 
-static void ccid_handle_request(uint8_t const *msg, uint32_t len) {
-  if (len < CCID_HEADER_SIZE)
+// Writes the 10-byte reader-to-PC header of a slot's response, echoing the
+// command's slot and sequence number. The `data_len` payload bytes are
+// already in place behind it.
+static void ccid_set_response(ccid_slot_t *slot, uint8_t type, uint8_t status,
+                              uint8_t error, uint8_t specific,
+                              uint32_t data_len) {
+  ccid_msg_header_t const *cmd = (ccid_msg_header_t const *)slot->cmd;
+  rdr_to_pc_slotstatus_t header = {.bMessageType = type,
+                                   .dwLength = data_len,
+                                   .bSlot = cmd->bSlot,
+                                   .bSeq = cmd->bSeq,
+                                   .bStatus = status,
+                                   .bError = error,
+                                   .bSpecific = specific};
+  memcpy(slot->rsp, &header, CCID_HEADER_SIZE);
+  slot->rsp_len = CCID_HEADER_SIZE + data_len;
+}
+
+static void ccid_set_slot_error(ccid_slot_t *slot, uint8_t error) {
+  ccid_set_response(slot, RDR_TO_PC_SLOTSTATUS,
+                    CCID_STATUS_COMMAND_FAILED | SLOT_STATUS_ICC_PRESENT,
+                    error, 0, 0);
+}
+
+// Gateway wait callback, timer interrupt context. Tells the host the command
+// is still being processed, unless bulk-IN is already carrying something
+// (the previous block, if the host has not read it yet).
+static void ccid_wtx_tick(void *ctx) {
+  (void)ctx;
+  ccid_slot_t *slot = ccid_ctx.wtx_slot;
+  if (slot == NULL || ccid_ctx.wtx_sent || ccid_ctx.tx_busy ||
+      ccid_ctx.slots[ccid_ctx.tx_slot].state == CCID_SLOT_READY)
     return;
 
-  ccid_msg_header_t const *header = (ccid_msg_header_t const *)msg;
-  uint8_t rhport = 0;
+  ccid_msg_header_t const *cmd = (ccid_msg_header_t const *)slot->cmd;
+  rdr_to_pc_slotstatus_t header = {
+      .bMessageType = RDR_TO_PC_DATABLOCK,
+      .dwLength = 0,
+      .bSlot = cmd->bSlot,
+      .bSeq = cmd->bSeq,
+      .bStatus = CCID_STATUS_TIME_EXTENSION | SLOT_STATUS_ICC_PRESENT,
+      .bError = CCID_WTX_MULTIPLIER,
+      .bSpecific = 0};
+  memcpy(ccid_ctx.wtx_block, &header, CCID_HEADER_SIZE);
+  if (usbd_edpt_xfer(ccid_ctx.rhport, ccid_ctx.ep_in, ccid_ctx.wtx_block,
+                     CCID_HEADER_SIZE, false))
+    ccid_ctx.wtx_sent = true;
+}
+
+// Executes the command in `slot` and builds its response in place
+static void ccid_build_response(ccid_slot_t *slot) {
+  ccid_msg_header_t const *header = (ccid_msg_header_t const *)slot->cmd;
+  uint8_t *payload = slot->rsp + CCID_HEADER_SIZE;
+
+  if (slot->rx_error) {
+    ccid_set_slot_error(slot, slot->rx_error);
+    return;
+  }
 
   switch (header->bMessageType) {
-  case PC_TO_RDR_ICCPOWERON: {
-    rdr_to_pc_datablock_t resp = {.bMessageType = RDR_TO_PC_DATABLOCK,
-                                  .dwLength = sizeof(ccid_ctx.atr),
-                                  .bSlot = header->bSlot,
-                                  .bSeq = header->bSeq,
-                                  .bStatus = SLOT_STATUS_ICC_PRESENT,
-                                  .bError = 0,
-                                  .bChainParameter = 0};
-    memcpy(resp.abData, ccid_ctx.atr, sizeof(ccid_ctx.atr));
-    usbd_edpt_xfer(rhport, ccid_ctx.ep_in, (uint8_t *)&resp,
-                   CCID_HEADER_SIZE + sizeof(ccid_ctx.atr), false);
+  case PC_TO_RDR_ICCPOWERON:
+    memcpy(payload, ccid_ctx.atr, sizeof(ccid_ctx.atr));
+    ccid_set_response(slot, RDR_TO_PC_DATABLOCK, SLOT_STATUS_ICC_PRESENT, 0, 0,
+                      sizeof(ccid_ctx.atr));
     break;
-  }
 
   case PC_TO_RDR_XFRBLOCK: {
-    uint16_t apdu_in_len = (uint16_t)header->dwLength;
-    uint8_t apdu_out[MAX_APDU_SIZE + 2];
+    uint16_t apdu_in_len = (uint16_t)(slot->cmd_len - CCID_HEADER_SIZE);
     uint16_t apdu_out_len = 0;
 
-    // Secure Gateway Call
-    secure_gateway_oath_handle_apdu((uint8_t *)msg + CCID_HEADER_SIZE,
-                                    apdu_in_len, apdu_out, &apdu_out_len);
-
-    rdr_to_pc_datablock_t resp = {.bMessageType = RDR_TO_PC_DATABLOCK,
-                                  .dwLength = apdu_out_len,
-                                  .bSlot = header->bSlot,
-                                  .bSeq = header->bSeq,
-                                  .bStatus = SLOT_STATUS_ICC_PRESENT,
-                                  .bError = 0,
-                                  .bChainParameter = 0};
-    memcpy(resp.abData, apdu_out, apdu_out_len);
-    usbd_edpt_xfer(rhport, ccid_ctx.ep_in, (uint8_t *)&resp,
-                   CCID_HEADER_SIZE + apdu_out_len, false);
+    // Secure Gateway Call. The response lands directly behind the header.
+    ccid_ctx.wtx_slot = slot;
+    secure_gateway_on_wait(ccid_wtx_tick, NULL);
+    bool ok = secure_gateway_oath_handle_apdu(slot->cmd + CCID_HEADER_SIZE,
+                                              apdu_in_len, payload,
+                                              &apdu_out_len);
+    ccid_ctx.wtx_slot = NULL;
+    if (!ok || apdu_out_len > MAX_APDU_SIZE) {
+      ccid_set_slot_error(slot, CCID_ERROR_HW);
+      break;
+    }
+    ccid_set_response(slot, RDR_TO_PC_DATABLOCK, SLOT_STATUS_ICC_PRESENT, 0, 0,
+                      apdu_out_len);
     break;
   }
 
-  case PC_TO_RDR_GETSLOTSTATUS: {
-    rdr_to_pc_slotstatus_t resp = {.bMessageType = RDR_TO_PC_SLOTSTATUS,
-                                   .dwLength = 0,
-                                   .bSlot = header->bSlot,
-                                   .bSeq = header->bSeq,
-                                   .bStatus = SLOT_STATUS_ICC_PRESENT,
-                                   .bError = 0,
-                                   .bSpecific = 0};
-    usbd_edpt_xfer(rhport, ccid_ctx.ep_in, (uint8_t *)&resp, sizeof(resp),
-                   false);
+  case PC_TO_RDR_GETSLOTSTATUS:
+    ccid_set_response(slot, RDR_TO_PC_SLOTSTATUS, SLOT_STATUS_ICC_PRESENT, 0,
+                      0, 0);
     break;
-  }
 
   case PC_TO_RDR_GETPARAMETERS: {
     uint8_t params[] = {0x01, 0x11, 0x10, 0x10,
                         0x4D, 0x20, 0xFE}; // T=1 Protocol Defaults
-    rdr_to_pc_datablock_t resp = {.bMessageType = RDR_TO_PC_PARAMETERS,
-                                  .dwLength = sizeof(params),
-                                  .bSlot = header->bSlot,
-                                  .bSeq = header->bSeq,
-                                  .bStatus = SLOT_STATUS_ICC_PRESENT,
-                                  .bError = 0,
-                                  .bChainParameter = 0};
-    memcpy(resp.abData, params, sizeof(params));
-    usbd_edpt_xfer(rhport, ccid_ctx.ep_in, (uint8_t *)&resp,
-                   CCID_HEADER_SIZE + sizeof(params), false);
+    memcpy(payload, params, sizeof(params));
+    ccid_set_response(slot, RDR_TO_PC_PARAMETERS, SLOT_STATUS_ICC_PRESENT, 0,
+                      0, sizeof(params));
     break;
   }
 
   default:
     printf("[CCID] Unsupported message type: 0x%02X\n", header->bMessageType);
+    ccid_set_slot_error(slot, CCID_ERROR_CMD_NOT_SUPPORTED);
     break;
   }
 }
@@ -213,5 +509,12 @@ bool tud_ccid_get_atr_cb(uint8_t rhport, uint8_t *buffer, uint16_t *len) {
 }
 
 void ccid_task(void) {
-  // Background tasks if needed
+  // Run at most one queued command per pass so other tasks keep their turn
+  ccid_slot_t *slot = &ccid_ctx.slots[ccid_ctx.work_slot];
+  if (slot->state == CCID_SLOT_QUEUED) {
+    ccid_build_response(slot);
+    slot->state = CCID_SLOT_READY;
+    ccid_ctx.work_slot = (uint8_t)((ccid_ctx.work_slot + 1) % CCID_SLOTS);
+  }
+  ccid_tx_kick();
 }
@@ -4,9 +4,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// Max size for APDU command/response
-#define MAX_APDU_SIZE 256
+#include "secure_gateway.h"
+
+// Max size for APDU command/response (extended APDUs included)
+#define MAX_APDU_SIZE SG_APDU_MAX_LEN
 #define CCID_HEADER_SIZE 10
+// Largest bulk message in either direction (dwMaxCCIDMessageLength)
+#define CCID_MAX_MESSAGE_LEN (CCID_HEADER_SIZE + MAX_APDU_SIZE)
 
 // Function prototypes
 void ccid_init(void);
@@ -57,30 +57,28 @@
 #define CAPABILITY_USER_VER 0x02
 #define CAPABILITY_ENROLL 0x04
 
-// CTAP2.1 Status Codes (Extended)
+// CTAP2.1 Status Codes (CTAP 2.1, section 8.2)
 #define CTAP21_ERR_INVALID_COMMAND 0x01
 #define CTAP21_ERR_INVALID_PARAMETER 0x02
 #define CTAP21_ERR_INVALID_LENGTH 0x03
-#define CTAP21_ERR_CREDENTIAL_EXCLUDED 0x22
-#define CTAP21_ERR_PROCESSING 0x23
-#define CTAP21_ERR_INVALID_CREDENTIAL 0x24
-#define CTAP21_ERR_USER_ACTION_PENDING 0x25
-#define CTAP21_ERR_OPERATION_PENDING 0x26
-#define CTAP21_ERR_NO_OPERATIONS 0x27
-#define CTAP21_ERR_AUTHENTICATOR_LOCKED 0x28
-#define CTAP21_ERR_NO_CREDENTIALS 0x29
-#define CTAP21_ERR_USER_ACTION_TIMEOUT 0x2A
-#define CTAP21_ERR_NOT_ALLOWED 0x2B
-#define CTAP21_ERR_PIN_INVALID 0x2C
-#define CTAP21_ERR_PIN_BLOCKED 0x2D
-#define CTAP21_ERR_PIN_AUTH_INVALID 0x2E
-#define CTAP21_ERR_PIN_AUTH_BLOCKED 0x2F
-#define CTAP21_ERR_PIN_REQUIRED 0x30
-#define CTAP21_ERR_PIN_POLICY_VIOLATION 0x31
-#define CTAP21_ERR_PIN_TOKEN_EXPIRED 0x32
-#define CTAP21_ERR_REQUEST_TOO_LARGE 0x33
-#define CTAP21_ERR_ACTION_TIMEOUT 0x34
-#define CTAP21_ERR_UP_REQUIRED 0x35
+#define CTAP21_ERR_CREDENTIAL_EXCLUDED 0x19
+#define CTAP21_ERR_PROCESSING 0x21
+#define CTAP21_ERR_INVALID_CREDENTIAL 0x22
+#define CTAP21_ERR_USER_ACTION_PENDING 0x23
+#define CTAP21_ERR_OPERATION_PENDING 0x24
+#define CTAP21_ERR_NO_OPERATIONS 0x25
+#define CTAP21_ERR_NO_CREDENTIALS 0x2E
+#define CTAP21_ERR_USER_ACTION_TIMEOUT 0x2F
+#define CTAP21_ERR_NOT_ALLOWED 0x30
+#define CTAP21_ERR_PIN_INVALID 0x31
+#define CTAP21_ERR_PIN_BLOCKED 0x32
+#define CTAP21_ERR_PIN_AUTH_INVALID 0x33
+#define CTAP21_ERR_PIN_AUTH_BLOCKED 0x34
+#define CTAP21_ERR_PUAT_REQUIRED 0x36
+#define CTAP21_ERR_PIN_POLICY_VIOLATION 0x37
+#define CTAP21_ERR_REQUEST_TOO_LARGE 0x39
+#define CTAP21_ERR_ACTION_TIMEOUT 0x3A
+#define CTAP21_ERR_UP_REQUIRED 0x3B
 
 // CTAP2.1 Extended Options
 typedef struct __attribute__((packed)) {
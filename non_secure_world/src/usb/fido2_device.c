@@ -1,4 +1,5 @@
 #include "fido2_device.h"
+#include "device/usbd_pvt.h"
 #include "pico/rand.h"
 #include "pico/stdlib.h"
 #include "secure_gateway.h"
@@ -17,14 +18,83 @@ static fido2_state_t fido2_state = {.initialized = false,
                                     .nonce = {0},
                                     .pin_token = {0},
                                     .pin_protocol = 1,
-                                    .max_msg_size = 1024};
-
-// HID Report Buffer
-static uint8_t hid_report_in[FIDO2_REPORT_SIZE];
-static uint8_t hid_report_out[FIDO2_REPORT_SIZE];
-
-// Channel ID management
-static uint32_t next_channel_id = FIDO2_CHANNEL_FIRST;
+                                    .max_msg_size = FIDO2_MAX_MSG_SIZE};
+
+// Reports queued for the IN endpoint. Sized for a full-length message plus a
+// few keepalive or error reports.
+#define FIDO2_TX_QUEUE_LEN 24
+#define FIDO2_MSG_REPORTS(len)                                                 \
+  (1 + (((len) > FIDO2_INIT_PAYLOAD ? (len) - FIDO2_INIT_PAYLOAD : 0) +        \
+        FIDO2_CONT_PAYLOAD - 1) /                                              \
+           FIDO2_CONT_PAYLOAD)
+
+_Static_assert(FIDO2_MSG_REPORTS(FIDO2_MAX_MSG_SIZE) + 2 <= FIDO2_TX_QUEUE_LEN,
+               "TX queue must hold a full-length response");
+_Static_assert(FIDO2_MSG_REPORTS(FIDO2_MAX_MSG_SIZE) <= 129,
+               "message exceeds the continuation sequence range");
+
+typedef struct {
+  uint8_t reports[FIDO2_TX_QUEUE_LEN][FIDO2_REPORT_SIZE];
+  uint8_t head;  // Next report to send
+  uint8_t count; // Reports waiting
+} fido2_tx_queue_t;
+
+static fido2_tx_queue_t tx_queue;
+
+// FIDO HID interface, driven by fido2_driver rather than TinyUSB's HID class
+// so the keepalive tick can reuse the IN endpoint during a Secure World call
+// (see fido2_user_xfer_isr)
+typedef struct {
+  uint8_t rhport;
+  uint8_t ep_in;
+  uint8_t ep_out;
+  uint8_t const *hid_desc; // HID descriptor inside the configuration
+  uint8_t out_report[FIDO2_REPORT_SIZE];
+  // IN carries the head of tx_queue, which is popped on completion, or the
+  // tick's keepalive, which is reaped in interrupt context
+  volatile bool in_busy;
+  volatile bool keepalive_sent;
+  uint8_t keepalive_report[FIDO2_REPORT_SIZE];
+} fido2_hid_t;
+
+static fido2_hid_t hid;
+
+// HID class requests and descriptor types (HID 1.11, 7.1 and 7.2)
+#define HID_DESC_TYPE_HID 0x21
+#define HID_DESC_TYPE_REPORT 0x22
+#define HID_REQ_GET_IDLE 0x02
+#define HID_REQ_SET_IDLE 0x0A
+#define HID_REQ_SET_PROTOCOL 0x0B
+
+// Allocated channel. At most one channel at a time is busy with a request;
+// it owns rx_data until the request is answered, fails, times out or is
+// cancelled, and other channels get CTAP1_ERR_CHANNEL_BUSY meanwhile.
+typedef struct {
+  uint32_t cid;          // 0: entry unused
+  uint32_t allocated_ms; // When INIT handed out the CID
+  uint32_t last_used_ms; // Last request on the channel, for LRU eviction
+  bool busy;
+  // Transaction in flight while busy
+  uint8_t cmd;
+  uint16_t len;         // BCNT of the initialization packet
+  uint16_t received;    // Payload bytes collected so far
+  uint8_t seq;          // Next expected continuation sequence number
+  uint32_t deadline_ms; // Abort unless the request progresses by then
+  // Complete MSG/CBOR request, executed by fido2_task
+  bool ready;
+  bool up_needed;        // Secure World waits for user presence
+  uint32_t keepalive_ms; // Next UPNEEDED keepalive and retry
+} fido2_channel_t;
+
+_Static_assert(FIDO2_MAX_CHANNELS >= 2,
+               "eviction needs a channel besides the busy one");
+
+static fido2_channel_t channels[FIDO2_MAX_CHANNELS];
+static fido2_channel_t *busy_channel;
+static uint8_t rx_data[FIDO2_MAX_MSG_SIZE];
+
+// Secure World response buffer for CTAPHID_MSG / CTAPHID_CBOR
+static uint8_t msg_response[FIDO2_MAX_MSG_SIZE];
 
 // HID Report Descriptor for FIDO2
 // 52 bytes as expected by usb_descriptors.c (0x34)
@@ -48,12 +118,16 @@ uint8_t const desc_hid_report[] = {
 };
 
 // Forward declarations
-void fido2_process_frame(ctaphid_frame_t const *frame);
+static void fido2_process_message(uint32_t cid, uint8_t cmd,
+                                  uint8_t const *data, uint16_t len);
+static void fido2_tx_pump(void);
+static void fido2_send_error_on(uint32_t cid, uint8_t error_code);
+static void fido2_channel_release(void);
+static uint32_t fido2_now_ms(void);
 void fido2_send_response(uint8_t cmd, uint8_t const *data, uint16_t len);
-void fido2_send_init_response(uint8_t const *nonce);
-void fido2_handle_init(ctaphid_frame_t const *frame);
-void fido2_handle_ping(ctaphid_frame_t const *frame);
-void fido2_handle_msg(ctaphid_frame_t const *frame);
+void fido2_handle_init(uint8_t const *data, uint16_t len);
+void fido2_handle_ping(uint8_t const *data, uint16_t len);
+bool fido2_handle_msg(uint8_t cmd, uint8_t const *data, uint16_t len);
 void fido2_handle_cancel(void);
 void fido2_handle_wink(void);
 void fido2_handle_make_credential(uint8_t const *data, uint16_t len);
@@ -135,6 +209,8 @@ void fido2_init(void) {
   fido2_state.initialized = true;
   fido2_state.connected = false;
   fido2_state.current_channel = 0;
+  memset(channels, 0, sizeof(channels));
+  busy_channel = NULL;
 
   // Generate random nonce for init
   for (int i = 0; i < 8; i++) {
@@ -145,64 +221,175 @@ void fido2_init(void) {
 }
 
 void fido2_task(void) {
-  // FIDO2 task handler (if needed)
+  fido2_channel_t *ch = busy_channel;
+  uint32_t now = fido2_now_ms();
+
+  if (ch != NULL && ch->ready) {
+    fido2_state.current_channel = ch->cid;
+    if (ch->up_needed && (int32_t)(now - ch->deadline_ms) >= 0) {
+      printf("FIDO2: User presence timed out\n");
+      uint8_t status = CTAP2_ERR_USER_ACTION_TIMEOUT;
+      fido2_channel_release();
+      fido2_send_response(ch->cmd, &status, 1);
+    } else if ((!ch->up_needed || (int32_t)(now - ch->keepalive_ms) >= 0) &&
+               tx_queue.count == 0 && !hid.in_busy) {
+      // Submitted only once everything queued has left, so the endpoint is
+      // free for the keepalive tick during the call
+      if (fido2_handle_msg(ch->cmd, rx_data, ch->len)) {
+        fido2_channel_release();
+      } else {
+        // Ask again after a keepalive interval; CANCEL may arrive meanwhile
+        if (!ch->up_needed)
+          ch->deadline_ms = now + FIDO2_UP_TIMEOUT_MS;
+        ch->up_needed = true;
+        fido2_send_keepalive(CTAP2_KEEPALIVE_STATUS_UPNEEDED);
+        ch->keepalive_ms = fido2_now_ms() + FIDO2_KEEPALIVE_INTERVAL_MS;
+      }
+    }
+  } else if (ch != NULL && (int32_t)(now - ch->deadline_ms) >= 0) {
+    // A request whose continuation packets stopped arriving frees the
+    // channel
+    printf("FIDO2: Channel 0x%08lX timed out\n", (unsigned long)ch->cid);
+    fido2_channel_release();
+    fido2_send_error_on(ch->cid, CTAP1_ERR_TIMEOUT);
+  }
+
+  // Catch up once a keepalive reaped in interrupt context frees the endpoint
+  fido2_tx_pump();
 }
 
 //--------------------------------------------------------------------+
-// TinyUSB HID Callbacks
+// FIDO HID Class Driver
 //--------------------------------------------------------------------+
 
-// Invoked when received GET HID REPORT DESCRIPTOR
-uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
-  (void)instance;
-  return desc_hid_report;
+static void fido2_rx_arm(void) {
+  usbd_edpt_xfer(hid.rhport, hid.ep_out, hid.out_report, FIDO2_REPORT_SIZE,
+                 false);
 }
 
-// Invoked when received GET_REPORT control request
-uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id,
-                               hid_report_type_t report_type, uint8_t *buffer,
-                               uint16_t reqlen) {
-  (void)instance;
-  (void)report_id;
-  (void)report_type;
-  (void)buffer;
-  (void)reqlen;
-  return 0;
-}
+static void fido2_user_init(void) { fido2_init(); }
 
-// Invoked when received SET_REPORT control request or received data on OUT
-// endpoint
-void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
-                           hid_report_type_t report_type, uint8_t const *buffer,
-                           uint16_t bufsize) {
-  (void)instance;
-  (void)report_id;
-  (void)report_type;
-  fido2_handle_report(buffer, bufsize);
+static void fido2_user_reset(uint8_t rhport) {
+  (void)rhport;
+  memset(&hid, 0, sizeof(hid));
+  tx_queue.head = 0;
+  tx_queue.count = 0;
 }
 
-//--------------------------------------------------------------------+
-// Custom FIDO2 Class Driver
-//--------------------------------------------------------------------+
-
-static void fido2_user_init(void) { fido2_init(); }
-static void fido2_user_reset(uint8_t rhport) { (void)rhport; }
+// Claims the HID interface of TUD_FIDO2_DESCRIPTOR: interface, HID
+// descriptor, interrupt OUT and IN endpoints
 static uint16_t fido2_user_open(uint8_t rhport,
                                 tusb_desc_interface_t const *desc_intf,
                                 uint16_t max_len) {
-  // FIDO2 is handled by standard HID class in this implementation
-  // This custom driver placeholder is for more advanced implementations
-  return 0;
+  if (desc_intf->bInterfaceClass != 0x03 || desc_intf->bNumEndpoints != 2)
+    return 0;
+
+  uint8_t const *p_desc = (uint8_t const *)desc_intf;
+  uint16_t total_len = desc_intf->bLength;
+  p_desc += desc_intf->bLength;
+  if (total_len + 9 + 2 * 7 > max_len || p_desc[1] != HID_DESC_TYPE_HID)
+    return 0;
+
+  hid.hid_desc = p_desc;
+  total_len += p_desc[0];
+  p_desc += p_desc[0];
+
+  for (int i = 0; i < 2; i++) {
+    tusb_desc_endpoint_t const *desc_ep = (tusb_desc_endpoint_t const *)p_desc;
+    if (!usbd_edpt_open(rhport, desc_ep))
+      return 0;
+
+    if (desc_ep->bEndpointAddress & 0x80) {
+      hid.ep_in = desc_ep->bEndpointAddress;
+    } else {
+      hid.ep_out = desc_ep->bEndpointAddress;
+    }
+
+    total_len += desc_ep->bLength;
+    p_desc += desc_ep->bLength;
+  }
+
+  hid.rhport = rhport;
+  fido2_rx_arm();
+  return total_len;
 }
+
+// Descriptor requests and the few class requests hosts send a FIDO device.
+// There is no boot protocol and reports only travel on the interrupt
+// endpoints, so GET_REPORT and SET_REPORT are stalled.
 static bool fido2_user_control_xfer_cb(uint8_t rhport, uint8_t stage,
                                        tusb_control_request_t const *request) {
-  return false;
+  static uint8_t idle_rate;
+  if (stage != CONTROL_STAGE_SETUP)
+    return true;
+
+  if (request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD) {
+    if (request->bRequest != TUSB_REQ_GET_DESCRIPTOR)
+      return false;
+    uint8_t desc_type = (uint8_t)(request->wValue >> 8);
+    if (desc_type == HID_DESC_TYPE_REPORT)
+      return tud_control_xfer(rhport, request, (void *)desc_hid_report,
+                              sizeof(desc_hid_report));
+    if (desc_type == HID_DESC_TYPE_HID && hid.hid_desc)
+      return tud_control_xfer(rhport, request, (void *)hid.hid_desc,
+                              hid.hid_desc[0]);
+    return false;
+  }
+
+  if (request->bmRequestType_bit.type != TUSB_REQ_TYPE_CLASS)
+    return false;
+  switch (request->bRequest) {
+  case HID_REQ_SET_IDLE:
+    idle_rate = (uint8_t)(request->wValue >> 8);
+    return tud_control_xfer(rhport, request, NULL, 0);
+  case HID_REQ_GET_IDLE:
+    return tud_control_xfer(rhport, request, &idle_rate, 1);
+  case HID_REQ_SET_PROTOCOL:
+    return tud_control_xfer(rhport, request, NULL, 0);
+  default:
+    return false;
+  }
 }
+
 static bool fido2_user_xfer_cb(uint8_t rhport, uint8_t ep_addr,
                                xfer_result_t result, uint32_t xferred_bytes) {
+  (void)rhport;
+  if (ep_addr == hid.ep_in) {
+    // The queued report has left, or was lost with the transfer
+    hid.in_busy = false;
+    if (tx_queue.count > 0) {
+      tx_queue.head = (uint8_t)((tx_queue.head + 1) % FIDO2_TX_QUEUE_LEN);
+      tx_queue.count--;
+    }
+    fido2_tx_pump();
+    return true;
+  }
+
+  if (ep_addr == hid.ep_out) {
+    if (result == XFER_RESULT_SUCCESS)
+      fido2_handle_report(hid.out_report, xferred_bytes);
+    fido2_rx_arm();
+    return true;
+  }
   return false;
 }
 
+// Interrupt context. TinyUSB keeps an endpoint busy until tud_task handles
+// its completion, and tud_task cannot run during the Secure World call, so
+// a keepalive sent by the tick is reaped here to free IN for the next tick.
+// Completions of queued reports go to fido2_user_xfer_cb.
+static bool fido2_user_xfer_isr(uint8_t rhport, uint8_t ep_addr,
+                                xfer_result_t result, uint32_t xferred_bytes) {
+  (void)rhport;
+  (void)result;
+  (void)xferred_bytes;
+  if (ep_addr != hid.ep_in || !hid.keepalive_sent)
+    return false;
+  hid.keepalive_sent = false;
+  hid.in_busy = false;
+  return true;
+}
+
 const usbd_class_driver_t fido2_driver = {.name = "FIDO2",
                                           .init = fido2_user_init,
                                           .reset = fido2_user_reset,
@@ -210,34 +397,261 @@ const usbd_class_driver_t fido2_driver = {.name = "FIDO2",
                                           .control_xfer_cb =
                                               fido2_user_control_xfer_cb,
                                           .xfer_cb = fido2_user_xfer_cb,
+                                          .xfer_isr = fido2_user_xfer_isr,
                                           .sof = NULL};
 
-void fido2_handle_report(uint8_t const *report, uint32_t len) {
-  if (len < 3)
-    return; // Minimum frame size
+//--------------------------------------------------------------------+
+// CTAPHID Transport
+//--------------------------------------------------------------------+
+
+static inline uint32_t cid_read(uint8_t const *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
 
-  ctaphid_frame_t const *frame = (ctaphid_frame_t const *)report;
+static inline void cid_write(uint8_t *p, uint32_t cid) {
+  p[0] = (uint8_t)(cid >> 24);
+  p[1] = (uint8_t)(cid >> 16);
+  p[2] = (uint8_t)(cid >> 8);
+  p[3] = (uint8_t)cid;
+}
 
-  printf("FIDO2: RX Cmd=0x%02X, Len=%u\n", frame->cmd,
-         (frame->bcnth << 8) | frame->bcntl);
+// Hands the oldest queued report to the IN endpoint if it is free. The
+// report stays queued until fido2_user_xfer_cb sees it sent, which pumps
+// again, so back-to-back reports leave one per interval.
+static void fido2_tx_pump(void) {
+  if (tx_queue.count == 0 || hid.in_busy || hid.ep_in == 0)
+    return;
+  hid.in_busy = true;
+  if (!usbd_edpt_xfer(hid.rhport, hid.ep_in, tx_queue.reports[tx_queue.head],
+                      FIDO2_REPORT_SIZE, false))
+    hid.in_busy = false;
+}
+
+// Appends a zero-filled report to the queue. The caller checks for room.
+static uint8_t *fido2_tx_alloc(void) {
+  uint8_t slot =
+      (uint8_t)((tx_queue.head + tx_queue.count) % FIDO2_TX_QUEUE_LEN);
+  tx_queue.count++;
+  memset(tx_queue.reports[slot], 0, FIDO2_REPORT_SIZE);
+  return tx_queue.reports[slot];
+}
+
+// Queues a message as an initialization packet followed by as many
+// continuation packets as it needs, then starts draining the queue
+static void fido2_send_on(uint32_t cid, uint8_t cmd, uint8_t const *data,
+                          uint16_t len) {
+  if (!fido2_state.connected)
+    return;
+  if (len > FIDO2_MAX_MSG_SIZE ||
+      FIDO2_MSG_REPORTS(len) > FIDO2_TX_QUEUE_LEN - tx_queue.count) {
+    printf("FIDO2: TX queue full, dropping %u byte message\n", len);
+    return;
+  }
 
-  fido2_process_frame(frame);
+  ctaphid_frame_t *frame = (ctaphid_frame_t *)fido2_tx_alloc();
+  cid_write(frame->cid, cid);
+  frame->init.cmd = cmd | CTAPHID_FRAME;
+  frame->init.bcnth = (uint8_t)(len >> 8);
+  frame->init.bcntl = (uint8_t)len;
+  uint16_t chunk = len < FIDO2_INIT_PAYLOAD ? len : FIDO2_INIT_PAYLOAD;
+  if (chunk > 0)
+    memcpy(frame->init.data, data, chunk);
+
+  uint16_t off = chunk;
+  for (uint8_t seq = 0; off < len; seq++) {
+    frame = (ctaphid_frame_t *)fido2_tx_alloc();
+    cid_write(frame->cid, cid);
+    frame->cont.seq = seq;
+    chunk = (uint16_t)(len - off);
+    if (chunk > FIDO2_CONT_PAYLOAD)
+      chunk = FIDO2_CONT_PAYLOAD;
+    memcpy(frame->cont.data, data + off, chunk);
+    off += chunk;
+  }
+
+  fido2_tx_pump();
 }
 
-void fido2_process_frame(ctaphid_frame_t const *frame) {
-  uint16_t data_len = (frame->bcnth << 8) | frame->bcntl;
+static void fido2_send_error_on(uint32_t cid, uint8_t error_code) {
+  fido2_send_on(cid, CTAPHID_ERROR, &error_code, 1);
+}
 
-  switch (frame->cmd) {
+static uint32_t fido2_now_ms(void) {
+  return to_ms_since_boot(get_absolute_time());
+}
+
+static fido2_channel_t *fido2_channel_find(uint32_t cid) {
+  for (int i = 0; i < FIDO2_MAX_CHANNELS; i++) {
+    if (channels[i].cid == cid)
+      return &channels[i];
+  }
+  return NULL;
+}
+
+// Takes a free entry, or evicts the least recently used idle channel, and
+// gives it a fresh random CID
+static fido2_channel_t *fido2_channel_alloc(void) {
+  fido2_channel_t *victim = NULL;
+  for (int i = 0; i < FIDO2_MAX_CHANNELS; i++) {
+    fido2_channel_t *ch = &channels[i];
+    if (ch->cid == 0) {
+      victim = ch;
+      break;
+    }
+    if (!ch->busy && (victim == NULL || (int32_t)(ch->last_used_ms -
+                                                  victim->last_used_ms) < 0))
+      victim = ch;
+  }
+  if (victim->cid != 0)
+    printf("FIDO2: Evicting channel 0x%08lX\n", (unsigned long)victim->cid);
+
+  uint32_t cid;
+  do {
+    cid = get_rand_32();
+  } while (cid == 0 || cid == FIDO2_BROADCAST_CHANNEL ||
+           fido2_channel_find(cid) != NULL);
+
+  uint32_t now = fido2_now_ms();
+  memset(victim, 0, sizeof(*victim));
+  victim->cid = cid;
+  victim->allocated_ms = now;
+  victim->last_used_ms = now;
+  return victim;
+}
+
+// Ends the busy channel's transaction
+static void fido2_channel_release(void) {
+  if (busy_channel) {
+    busy_channel->busy = false;
+    busy_channel->ready = false;
+    busy_channel->up_needed = false;
+    busy_channel = NULL;
+  }
+}
+
+void fido2_handle_report(uint8_t const *report, uint32_t len) {
+  if (len < 5)
+    return; // Shorter than a continuation header
+
+  // Short reports are treated as zero padded
+  uint8_t buf[FIDO2_REPORT_SIZE] = {0};
+  memcpy(buf, report, len < sizeof(buf) ? len : sizeof(buf));
+  ctaphid_frame_t const *frame = (ctaphid_frame_t const *)buf;
+  uint32_t cid = cid_read(frame->cid);
+  uint32_t now = fido2_now_ms();
+  fido2_channel_t *ch = busy_channel;
+
+  if (!(frame->init.cmd & CTAPHID_FRAME)) {
+    // Continuation packets outside the current request are ignored
+    if (ch == NULL || ch->cid != cid)
+      return;
+    if (frame->cont.seq != ch->seq) {
+      printf("FIDO2: Sequence %u, expected %u\n", frame->cont.seq, ch->seq);
+      fido2_channel_release();
+      fido2_send_error_on(cid, CTAP1_ERR_INVALID_SEQUENCE);
+      return;
+    }
+    uint16_t chunk = (uint16_t)(ch->len - ch->received);
+    if (chunk > FIDO2_CONT_PAYLOAD)
+      chunk = FIDO2_CONT_PAYLOAD;
+    memcpy(rx_data + ch->received, frame->cont.data, chunk);
+    ch->received += chunk;
+    ch->seq++;
+    ch->deadline_ms = now + FIDO2_TRANSACTION_TIMEOUT_MS;
+  } else {
+    uint8_t cmd = frame->init.cmd & (uint8_t)~CTAPHID_FRAME;
+    uint16_t bcnt = (uint16_t)((frame->init.bcnth << 8) | frame->init.bcntl);
+    uint16_t chunk = bcnt < FIDO2_INIT_PAYLOAD ? bcnt : FIDO2_INIT_PAYLOAD;
+
+    printf("FIDO2: RX Cmd=0x%02X, Len=%u\n", cmd, bcnt);
+
+    if (cid == FIDO2_BROADCAST_CHANNEL && cmd == CTAPHID_INIT) {
+      // Channel allocation, answered whatever else is in progress
+      fido2_process_message(cid, cmd, frame->init.data, chunk);
+      return;
+    }
+
+    ch = fido2_channel_find(cid);
+    if (cid == 0 || cid == FIDO2_BROADCAST_CHANNEL || ch == NULL) {
+      fido2_send_error_on(cid, CTAP1_ERR_INVALID_CHANNEL);
+      return;
+    }
+    ch->last_used_ms = now;
+
+    if (cmd == CTAPHID_CANCEL) {
+      fido2_state.current_channel = cid;
+      fido2_handle_cancel();
+      return;
+    }
+
+    if (busy_channel == ch && ch->ready && cmd != CTAPHID_INIT) {
+      // Still executing or waiting for the user; CANCEL is handled above
+      fido2_send_error_on(cid, CTAP1_ERR_CHANNEL_BUSY);
+      return;
+    } else if (busy_channel == ch) {
+      // A new request on the same channel abandons the unfinished one.
+      // Only INIT (resync) may do that.
+      fido2_channel_release();
+      if (cmd != CTAPHID_INIT) {
+        fido2_send_error_on(cid, CTAP1_ERR_INVALID_SEQUENCE);
+        return;
+      }
+    } else if (busy_channel && cmd != CTAPHID_INIT) {
+      // INIT fits one packet, so it can be answered right away
+      fido2_send_error_on(cid, CTAP1_ERR_CHANNEL_BUSY);
+      return;
+    }
+    if (bcnt > FIDO2_MAX_MSG_SIZE) {
+      fido2_send_error_on(cid, CTAP1_ERR_INVALID_LENGTH);
+      return;
+    }
+
+    if (cmd == CTAPHID_INIT) {
+      // Bypasses the reassembly buffer so another channel's request in
+      // progress keeps its state
+      fido2_process_message(cid, cmd, frame->init.data, chunk);
+      return;
+    }
+
+    memcpy(rx_data, frame->init.data, chunk);
+    ch->busy = true;
+    ch->cmd = cmd;
+    ch->len = bcnt;
+    ch->received = chunk;
+    ch->seq = 0;
+    ch->deadline_ms = now + FIDO2_TRANSACTION_TIMEOUT_MS;
+    busy_channel = ch;
+  }
+
+  if (ch->received == ch->len) {
+    if (ch->cmd == CTAPHID_MSG || ch->cmd == CTAPHID_CBOR) {
+      // Executed by fido2_task, outside the USB callbacks, so that CANCEL
+      // and other channels are still heard while it waits for the user
+      ch->ready = true;
+      return;
+    }
+    fido2_channel_release();
+    fido2_process_message(ch->cid, ch->cmd, rx_data, ch->len);
+  }
+}
+
+static void fido2_process_message(uint32_t cid, uint8_t cmd,
+                                  uint8_t const *data, uint16_t len) {
+  fido2_state.current_channel = cid;
+
+  switch (cmd) {
   case CTAPHID_INIT:
-    fido2_handle_init(frame);
+    fido2_handle_init(data, len);
     break;
 
   case CTAPHID_PING:
-    fido2_handle_ping(frame);
+    fido2_handle_ping(data, len);
     break;
 
   case CTAPHID_MSG:
-    fido2_handle_msg(frame);
+  case CTAPHID_CBOR:
+    fido2_handle_msg(cmd, data, len);
     break;
 
   case CTAPHID_CANCEL:
@@ -254,148 +668,135 @@ void fido2_process_frame(ctaphid_frame_t const *frame) {
     break;
 
   default:
-    printf("FIDO2: Unknown command 0x%02X\n", frame->cmd);
+    printf("FIDO2: Unknown command 0x%02X\n", cmd);
     fido2_send_error(CTAP1_ERR_INVALID_COMMAND);
     break;
   }
 }
 
-void fido2_handle_init(ctaphid_frame_t const *frame) {
+void fido2_handle_init(uint8_t const *data, uint16_t len) {
   printf("FIDO2: INIT command received\n");
 
-  // Verify nonce
-  if (memcmp(frame->data, fido2_state.nonce, 8) != 0) {
-    printf("FIDO2: INIT nonce mismatch\n");
+  // INIT answers before any channel exists
+  fido2_state.connected = true;
+
+  if (len != FIDO2_INIT_DATA_SIZE) {
+    fido2_send_error(CTAP1_ERR_INVALID_LENGTH);
     return;
   }
 
-  // Generate new channel ID
-  uint32_t new_channel = next_channel_id++;
-  if (next_channel_id > FIDO2_CHANNEL_LAST) {
-    next_channel_id = FIDO2_CHANNEL_FIRST;
-  }
+  // On the broadcast channel INIT allocates a channel; on an allocated one
+  // it resynchronizes that channel
+  uint32_t channel = fido2_state.current_channel;
+  if (channel == FIDO2_BROADCAST_CHANNEL)
+    channel = fido2_channel_alloc()->cid;
 
   // Build init response
-  ctaphid_init_response_t response = {.cmd = CTAPHID_INIT,
-                                      .bcnth = 0,
-                                      .bcntl = 17,
-                                      .nonce = {0},
+  ctaphid_init_response_t response = {.nonce = {0},
                                       .cid = {0},
-                                      .version =
-                                          0x02, // CTAPHID protocol version
-                                      .capabilities = 0x01, // Supports WINK
-                                      .reserved = {0}};
+                                      .version = 0x02, // CTAPHID version
+                                      .major = 0,
+                                      .minor = 0,
+                                      .build = 0,
+                                      .capabilities = 0x05}; // WINK | CBOR
 
   // Copy nonce from request
-  memcpy(response.nonce, frame->data, 8);
+  memcpy(response.nonce, data, FIDO2_INIT_DATA_SIZE);
+  cid_write(response.cid, channel);
 
-  // Set new channel ID
-  response.cid[0] = (uint8_t)(new_channel >> 24);
-  response.cid[1] = (uint8_t)(new_channel >> 16);
-  response.cid[2] = (uint8_t)(new_channel >> 8);
-  response.cid[3] = (uint8_t)new_channel;
+  printf("FIDO2: INIT response, channel: 0x%08lX\n", (unsigned long)channel);
 
-  fido2_state.current_channel = new_channel;
-  fido2_state.connected = true;
-
-  printf("FIDO2: INIT response, new channel: 0x%08X\n", new_channel);
-
-  fido2_send_report((uint8_t const *)&response, sizeof(response));
+  fido2_send_response(CTAPHID_INIT, (uint8_t const *)&response,
+                      sizeof(response));
 }
 
-void fido2_handle_ping(ctaphid_frame_t const *frame) {
-  uint16_t data_len = (frame->bcnth << 8) | frame->bcntl;
-  printf("FIDO2: PING command, %u bytes\n", data_len);
+void fido2_handle_ping(uint8_t const *data, uint16_t len) {
+  printf("FIDO2: PING command, %u bytes\n", len);
 
   // Echo back the data
-  uint8_t response[64];
-  response[0] = CTAPHID_PING;
-  response[1] = frame->bcnth;
-  response[2] = frame->bcntl;
-  memcpy(response + 3, frame->data, data_len);
+  fido2_send_response(CTAPHID_PING, data, len);
+}
+
+// Gateway wait callback, timer interrupt context, every
+// FIDO2_KEEPALIVE_INTERVAL_MS of a blocking Secure World call. The TX queue
+// is not touched here; the report goes straight to the endpoint if it is
+// free. Calls are only submitted once the queue has drained, and
+// fido2_user_xfer_isr frees the endpoint as soon as the host has read a
+// keepalive, so each tick of a long call sends one.
+static void fido2_keepalive_tick(void *ctx) {
+  (void)ctx;
+  if (hid.in_busy || hid.ep_in == 0)
+    return;
 
-  fido2_send_report(response, 3 + data_len);
+  uint8_t *report = hid.keepalive_report;
+  memset(report, 0, FIDO2_REPORT_SIZE);
+  ctaphid_frame_t *frame = (ctaphid_frame_t *)report;
+  cid_write(frame->cid, fido2_state.current_channel);
+  frame->init.cmd = CTAPHID_KEEPALIVE | CTAPHID_FRAME;
+  frame->init.bcntl = 1;
+  frame->init.data[0] = CTAP2_KEEPALIVE_STATUS_PROCESSING;
+  hid.in_busy = true;
+  hid.keepalive_sent = true;
+  if (!usbd_edpt_xfer(hid.rhport, hid.ep_in, report, FIDO2_REPORT_SIZE,
+                      false)) {
+    hid.keepalive_sent = false;
+    hid.in_busy = false;
+  }
 }
 
-void fido2_handle_msg(ctaphid_frame_t const *frame) {
-  uint16_t data_len = (frame->bcnth << 8) | frame->bcntl;
-  printf("FIDO2: MSG command, %u bytes\n", data_len);
+// Returns false if the Secure World is waiting for user presence and the
+// message has to be submitted again; otherwise the request is answered.
+bool fido2_handle_msg(uint8_t cmd, uint8_t const *data, uint16_t len) {
+  printf("FIDO2: MSG command, %u bytes\n", len);
 
-  if (data_len < 1) {
+  if (len < 1) {
     fido2_send_error(CTAP1_ERR_INVALID_LENGTH);
-    return;
+    return true;
   }
 
   // First byte is CTAP2 command
-  uint8_t ctap_cmd = frame->data[0];
-  uint8_t const *ctap_data = frame->data + 1;
-  uint16_t ctap_len = data_len - 1;
+  printf("FIDO2: CTAP2 command 0x%02X\n", data[0]);
 
-  printf("FIDO2: CTAP2 command 0x%02X\n", ctap_cmd);
+  // Keep the host informed while the Secure World computes
+  secure_gateway_on_wait(fido2_keepalive_tick, NULL);
 
-  // Send processing keepalive
-  fido2_send_keepalive(CTAP2_KEEPALIVE_STATUS_PROCESSING);
-
-  uint8_t response[1024];
   uint16_t response_len = 0;
+  int32_t result =
+      secure_gateway_fido2_handle_msg(data, len, msg_response, &response_len);
+  if (result == SG_ERR_TOUCH_REQUIRED)
+    return false;
 
-  if (secure_gateway_fido2_handle_msg(frame->data, data_len, response,
-                                      &response_len)) {
-    // Send as CTAPHID_MSG
-    // For simplicity, we assume single-packet response for now
-    // In a real implementation, we'd handle fragments
-    uint8_t hid_response[64];
-    memset(hid_response, 0, 64);
-    hid_response[0] = CTAPHID_MSG;
-    hid_response[1] = (response_len >> 8) & 0xFF;
-    hid_response[2] = response_len & 0xFF;
-
-    // Copy first chunk
-    uint16_t chunk_len = (response_len > 61) ? 61 : response_len;
-    memcpy(hid_response + 3, response, chunk_len);
-
-    fido2_send_report(hid_response, 64);
-
-    // TODO: Handle fragments if response_len > 61
+  if (result == SG_SUCCESS && response_len <= sizeof(msg_response)) {
+    // Answered with the command it was sent with (MSG or CBOR)
+    fido2_send_response(cmd, msg_response, response_len);
   } else {
-    fido2_send_error(CTAP2_ERR_OTHER);
+    fido2_send_error(CTAP1_ERR_OTHER);
   }
+  return true;
 }
 
+// CANCEL has no reply of its own. A request on the same channel that is
+// still waiting is answered with CTAP2_ERR_KEEPALIVE_CANCEL; one still being
+// received is dropped.
 void fido2_handle_cancel(void) {
   printf("FIDO2: CANCEL command\n");
-  // Cancel any pending operation
-  fido2_send_error(CTAP1_ERR_SUCCESS);
+
+  fido2_channel_t *ch = busy_channel;
+  if (ch == NULL || ch->cid != fido2_state.current_channel)
+    return;
+
+  bool answer = ch->ready;
+  fido2_channel_release();
+  if (answer) {
+    uint8_t status = CTAP2_ERR_KEEPALIVE_CANCEL;
+    fido2_send_response(ch->cmd, &status, 1);
+  }
 }
 
 void fido2_handle_wink(void) {
   printf("FIDO2: WINK command\n");
   // Wink response (visual feedback)
-  uint8_t response[3];
-  response[0] = CTAPHID_WINK;
-  response[1] = 0;
-  response[2] = 0;
-  fido2_send_report(response, 3);
-}
-
-ptr = cbor_encode_uint(ptr, 0x05);
-ptr = cbor_encode_uint(ptr, fido2_state.max_msg_size);
-
-// Pin protocols
-ptr = cbor_encode_uint(ptr, 0x06);
-ptr = cbor_encode_array(ptr, 1);
-ptr = cbor_encode_uint(ptr, fido2_state.pin_protocol);
-
-uint16_t response_len = ptr - response;
-
-// Send as CTAPHID_MSG
-uint8_t hid_response[64];
-hid_response[0] = CTAPHID_MSG;
-hid_response[1] = (response_len >> 8) & 0xFF;
-hid_response[2] = response_len & 0xFF;
-memcpy(hid_response + 3, response, response_len);
-
-fido2_send_report(hid_response, 3 + response_len);
+  fido2_send_response(CTAPHID_WINK, NULL, 0);
 }
 
 void fido2_handle_client_pin(uint8_t const *data, uint16_t len) {
@@ -404,7 +805,7 @@ void fido2_handle_client_pin(uint8_t const *data, uint16_t len) {
   // Simplified PIN handling
   // In real implementation, this would handle PIN operations
 
-  uint8_t response[16];
+  uint8_t response[40];
   uint8_t *ptr = response;
 
   // CTAP2 command response
@@ -419,13 +820,7 @@ void fido2_handle_client_pin(uint8_t const *data, uint16_t len) {
   uint16_t response_len = ptr - response;
 
   // Send as CTAPHID_MSG
-  uint8_t hid_response[64];
-  hid_response[0] = CTAPHID_MSG;
-  hid_response[1] = (response_len >> 8) & 0xFF;
-  hid_response[2] = response_len & 0xFF;
-  memcpy(hid_response + 3, response, response_len);
-
-  fido2_send_report(hid_response, 3 + response_len);
+  fido2_send_response(CTAPHID_MSG, response, response_len);
 }
 
 void fido2_handle_reset(void) {
@@ -434,50 +829,32 @@ void fido2_handle_reset(void) {
   // Reset all credentials
   // In real implementation, this would clear storage
 
-  uint8_t response[3];
-  response[0] = CTAP2_RESET;
-  response[1] = 0;
-  response[2] = 0;
-
-  fido2_send_report(response, 3);
+  uint8_t status = CTAP1_ERR_SUCCESS;
+  fido2_send_response(CTAPHID_MSG, &status, 1);
 }
 
 void fido2_send_keepalive(uint8_t status) {
-  uint8_t report[64];
-  report[0] = CTAPHID_KEEPALIVE;
-  report[1] = 0;
-  report[2] = 1;
-  report[3] = status;
-
-  fido2_send_report(report, 4);
+  fido2_send_on(fido2_state.current_channel, CTAPHID_KEEPALIVE, &status, 1);
 }
 
 void fido2_send_error(uint8_t error_code) {
-  uint8_t report[64];
-  report[0] = CTAPHID_ERROR;
-  report[1] = 0;
-  report[2] = 1;
-  report[3] = error_code;
-
-  fido2_send_report(report, 4);
+  fido2_send_on(fido2_state.current_channel, CTAPHID_ERROR, &error_code, 1);
 }
 
+// Sends a complete message on the channel of the current transaction
 void fido2_send_response(uint8_t cmd, uint8_t const *data, uint16_t len) {
-  uint8_t report[64];
-  report[0] = cmd;
-  report[1] = (len >> 8) & 0xFF;
-  report[2] = len & 0xFF;
-  memcpy(report + 3, data, len);
-
-  fido2_send_report(report, 3 + len);
+  fido2_send_on(fido2_state.current_channel, cmd, data, len);
 }
 
+// Queues one raw report (CID and header included), zero padded
 bool fido2_send_report(uint8_t const *report, uint32_t len) {
-  if (!fido2_state.connected || len > FIDO2_REPORT_SIZE)
+  if (!fido2_state.connected || len > FIDO2_REPORT_SIZE ||
+      tx_queue.count == FIDO2_TX_QUEUE_LEN)
     return false;
 
-  // Use TinyUSB HID API
-  return tud_hid_report(0, report, len);
+  memcpy(fido2_tx_alloc(), report, len);
+  fido2_tx_pump();
+  return true;
 }
 
 // User verification (simplified - would require button press)
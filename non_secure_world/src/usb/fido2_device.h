@@ -16,6 +16,7 @@
 #define CTAPHID_LOCK 0x04
 #define CTAPHID_INIT 0x06
 #define CTAPHID_WINK 0x08
+#define CTAPHID_CBOR 0x10
 #define CTAPHID_CANCEL 0x11
 #define CTAPHID_ERROR 0x3F
 #define CTAPHID_KEEPALIVE 0x3B
@@ -35,7 +36,7 @@
 #define CTAP2_CONFIG 0x0D
 #define CTAP2_VENDOR_FIRST 0x40
 
-// CTAP Status Codes
+// CTAP Status Codes (CTAP 2.1, section 8.2)
 #define CTAP1_ERR_SUCCESS 0x00
 #define CTAP1_ERR_INVALID_COMMAND 0x01
 #define CTAP1_ERR_INVALID_PARAMETER 0x02
@@ -43,35 +44,46 @@
 #define CTAP1_ERR_INVALID_SEQUENCE 0x04
 #define CTAP1_ERR_TIMEOUT 0x05
 #define CTAP1_ERR_CHANNEL_BUSY 0x06
-#define CTAP2_ERR_CBOR_PARSING 0x10
+#define CTAP1_ERR_LOCK_REQUIRED 0x0A
+#define CTAP1_ERR_INVALID_CHANNEL 0x0B
 #define CTAP2_ERR_CBOR_UNEXPECTED_TYPE 0x11
-#define CTAP2_ERR_CBOR_INVALID_VALUE 0x12
-#define CTAP2_ERR_CBOR_UNKNOWN 0x13
-#define CTAP2_ERR_CBOR_MAP_KEY 0x14
-#define CTAP2_ERR_CBOR_LIMIT_EXCEEDED 0x15
-#define CTAP2_ERR_CBOR_INVALID 0x16
-#define CTAP2_ERR_UNSUPPORTED_OPTION 0x20
-#define CTAP2_ERR_UNSUPPORTED_ALGORITHM 0x21
-#define CTAP2_ERR_CREDENTIAL_EXCLUDED 0x22
-#define CTAP2_ERR_PROCESSING 0x23
-#define CTAP2_ERR_INVALID_CREDENTIAL 0x24
-#define CTAP2_ERR_USER_ACTION_PENDING 0x25
-#define CTAP2_ERR_OPERATION_PENDING 0x26
-#define CTAP2_ERR_NO_OPERATIONS 0x27
-#define CTAP2_ERR_AUTHENTICATOR_LOCKED 0x28
-#define CTAP2_ERR_NO_CREDENTIALS 0x29
-#define CTAP2_ERR_USER_ACTION_TIMEOUT 0x2A
-#define CTAP2_ERR_NOT_ALLOWED 0x2B
-#define CTAP2_ERR_PIN_INVALID 0x2C
-#define CTAP2_ERR_PIN_BLOCKED 0x2D
-#define CTAP2_ERR_PIN_AUTH_INVALID 0x2E
-#define CTAP2_ERR_PIN_AUTH_BLOCKED 0x2F
-#define CTAP2_ERR_PIN_REQUIRED 0x30
-#define CTAP2_ERR_PIN_POLICY_VIOLATION 0x31
-#define CTAP2_ERR_PIN_TOKEN_EXPIRED 0x32
-#define CTAP2_ERR_REQUEST_TOO_LARGE 0x33
-#define CTAP2_ERR_ACTION_TIMEOUT 0x34
-#define CTAP2_ERR_UP_REQUIRED 0x35
+#define CTAP2_ERR_INVALID_CBOR 0x12
+#define CTAP2_ERR_MISSING_PARAMETER 0x14
+#define CTAP2_ERR_LIMIT_EXCEEDED 0x15
+#define CTAP2_ERR_FP_DATABASE_FULL 0x17
+#define CTAP2_ERR_LARGE_BLOB_STORAGE_FULL 0x18
+#define CTAP2_ERR_CREDENTIAL_EXCLUDED 0x19
+#define CTAP2_ERR_PROCESSING 0x21
+#define CTAP2_ERR_INVALID_CREDENTIAL 0x22
+#define CTAP2_ERR_USER_ACTION_PENDING 0x23
+#define CTAP2_ERR_OPERATION_PENDING 0x24
+#define CTAP2_ERR_NO_OPERATIONS 0x25
+#define CTAP2_ERR_UNSUPPORTED_ALGORITHM 0x26
+#define CTAP2_ERR_OPERATION_DENIED 0x27
+#define CTAP2_ERR_KEY_STORE_FULL 0x28
+#define CTAP2_ERR_NO_OPERATION_PENDING 0x2A
+#define CTAP2_ERR_UNSUPPORTED_OPTION 0x2B
+#define CTAP2_ERR_INVALID_OPTION 0x2C
+#define CTAP2_ERR_KEEPALIVE_CANCEL 0x2D
+#define CTAP2_ERR_NO_CREDENTIALS 0x2E
+#define CTAP2_ERR_USER_ACTION_TIMEOUT 0x2F
+#define CTAP2_ERR_NOT_ALLOWED 0x30
+#define CTAP2_ERR_PIN_INVALID 0x31
+#define CTAP2_ERR_PIN_BLOCKED 0x32
+#define CTAP2_ERR_PIN_AUTH_INVALID 0x33
+#define CTAP2_ERR_PIN_AUTH_BLOCKED 0x34
+#define CTAP2_ERR_PIN_NOT_SET 0x35
+#define CTAP2_ERR_PUAT_REQUIRED 0x36
+#define CTAP2_ERR_PIN_POLICY_VIOLATION 0x37
+#define CTAP2_ERR_REQUEST_TOO_LARGE 0x39
+#define CTAP2_ERR_ACTION_TIMEOUT 0x3A
+#define CTAP2_ERR_UP_REQUIRED 0x3B
+#define CTAP2_ERR_UV_BLOCKED 0x3C
+#define CTAP2_ERR_INTEGRITY_FAILURE 0x3D
+#define CTAP2_ERR_INVALID_SUBCOMMAND 0x3E
+#define CTAP2_ERR_UV_INVALID 0x3F
+#define CTAP2_ERR_UNAUTHORIZED_PERMISSION 0x40
+#define CTAP1_ERR_OTHER 0x7F
 
 // Keepalive Status
 #define CTAP2_KEEPALIVE_STATUS_PROCESSING 0x01
@@ -80,41 +92,66 @@
 // FIDO2 HID Report Size
 #define FIDO2_REPORT_SIZE 64
 #define FIDO2_INIT_DATA_SIZE 8
+// Payload bytes of an initialization / continuation packet
+#define FIDO2_INIT_PAYLOAD (FIDO2_REPORT_SIZE - 7)
+#define FIDO2_CONT_PAYLOAD (FIDO2_REPORT_SIZE - 5)
+// Largest CTAPHID message accepted or sent (maxMsgSize in GetInfo). The
+// framing allows up to FIDO2_INIT_PAYLOAD + 128 * FIDO2_CONT_PAYLOAD.
+#define FIDO2_MAX_MSG_SIZE 1024
 
 // Channel IDs
 #define FIDO2_BROADCAST_CHANNEL 0xFFFFFFFF
 #define FIDO2_CHANNEL_FIRST 0x00000001
 #define FIDO2_CHANNEL_LAST 0xFFFFFFFF
+// Channels allocated at once; INIT beyond that evicts the least recently used
+#define FIDO2_MAX_CHANNELS 8
+// A request is dropped with CTAP1_ERR_TIMEOUT when its next continuation
+// packet is this late
+#define FIDO2_TRANSACTION_TIMEOUT_MS 500
+// Keepalive period while a request is processed or waits for user presence
+#define FIDO2_KEEPALIVE_INTERVAL_MS 100
+// A request waiting for user presence fails after this long
+#define FIDO2_UP_TIMEOUT_MS 30000
 
 // FIDO2 Device State
 typedef struct {
   bool initialized;
   bool connected;
-  uint8_t current_channel;
-  uint8_t nonce[8]; // Init nonce
+  uint32_t current_channel; // Channel of the transaction being processed
+  uint8_t nonce[8];         // Init nonce
   uint8_t pin_token[32];
   uint8_t pin_protocol;
   uint16_t max_msg_size;
 } fido2_state_t;
 
-// CTAPHID Frame Structure
+// CTAPHID Frame Structure. The channel ID is big-endian on the wire. An
+// initialization packet has CTAPHID_FRAME set in its first byte after the
+// CID; a continuation packet carries a sequence number (0-127) there.
 typedef struct __attribute__((packed)) {
-  uint8_t cmd;
-  uint8_t bcnth;
-  uint8_t bcntl;
-  uint8_t data[FIDO2_REPORT_SIZE - 3];
+  uint8_t cid[4];
+  union {
+    struct __attribute__((packed)) {
+      uint8_t cmd;
+      uint8_t bcnth;
+      uint8_t bcntl;
+      uint8_t data[FIDO2_INIT_PAYLOAD];
+    } init;
+    struct __attribute__((packed)) {
+      uint8_t seq;
+      uint8_t data[FIDO2_CONT_PAYLOAD];
+    } cont;
+  };
 } ctaphid_frame_t;
 
-// CTAPHID Init Response
+// CTAPHID Init Response payload
 typedef struct __attribute__((packed)) {
-  uint8_t cmd;
-  uint8_t bcnth;
-  uint8_t bcntl;
   uint8_t nonce[8];
   uint8_t cid[4];
   uint8_t version;
+  uint8_t major;
+  uint8_t minor;
+  uint8_t build;
   uint8_t capabilities;
-  uint8_t reserved[7];
 } ctaphid_init_response_t;
 
 // Function prototypes
@@ -126,10 +163,10 @@ void fido2_send_keepalive(uint8_t status);
 void fido2_send_error(uint8_t error_code);
 void fido2_send_response(uint8_t cmd, uint8_t const *data, uint16_t len);
 
-// CTAP2 Command Handlers
-void fido2_handle_init(ctaphid_frame_t const *frame);
-void fido2_handle_ping(ctaphid_frame_t const *frame);
-void fido2_handle_msg(ctaphid_frame_t const *frame);
+// CTAP2 Command Handlers (reassembled message payloads)
+void fido2_handle_init(uint8_t const *data, uint16_t len);
+void fido2_handle_ping(uint8_t const *data, uint16_t len);
+bool fido2_handle_msg(uint8_t cmd, uint8_t const *data, uint16_t len);
 void fido2_handle_cancel(void);
 void fido2_handle_wink(void);
 
@@ -133,7 +133,7 @@ bool crypto_generate_key(uint8_t algorithm, uint8_t key_size,
 
   uint8_t status = 0;
   // For now, use key_count as slot index
-  if (secure_gateway_hsm_gen_key(key_count, &status)) {
+  if (secure_gateway_hsm_gen_key(key_count, SG_HSM_ALG_P256, &status)) {
     key->key_type = algorithm;
     key->key_size = 64; // Public key size
 
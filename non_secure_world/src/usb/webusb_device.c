@@ -19,11 +19,16 @@ typedef struct {
   bool is_configured;
   uint8_t ep_out;
   uint8_t ep_in;
-  uint8_t rx_buffer[1024];     // Increased for general commands
+  uint8_t rx_buffer[WEBUSB_RX_MAX_LEN];
   uint8_t tx_buffer[1024];     // Increased for general commands
-  uint8_t backup_buffer[8192]; // Large buffer for OATH backup/restore
+  uint8_t backup_buffer[32768]; // OATH backup (up to ~200 credentials)
 } webusb_state_t;
 
+// An HSM_VERIFY response (command, status, valid count, one byte per pair)
+// is built in the 64-byte response buffer
+_Static_assert(3 + WEBUSB_HSM_VERIFY_MAX_PAIRS <= 64,
+               "HSM_VERIFY results do not fit one response");
+
 static webusb_state_t webusb_state = {
     .is_connected = false, .is_configured = false, .ep_out = 0, .ep_in = 0};
 
@@ -285,10 +290,11 @@ void webusb_handle_command(uint8_t const *msg, uint32_t len) {
     break;
 
   case WEBUSB_CMD_HSM_GEN_KEY:
-    if (len >= 2) {
+    if (len >= 2) { // 1 (cmd) + 1 (slot) + optional 1 (algorithm)
       uint8_t slot = msg[1];
+      uint8_t algorithm = (len >= 3) ? msg[2] : SG_HSM_ALG_P256;
       uint8_t status = 0;
-      if (secure_gateway_hsm_gen_key(slot, &status)) {
+      if (secure_gateway_hsm_gen_key(slot, algorithm, &status)) {
         response[0] = WEBUSB_CMD_HSM_GEN_KEY;
         response[1] = status;
         response_len = 2;
@@ -332,6 +338,29 @@ void webusb_handle_command(uint8_t const *msg, uint32_t len) {
     }
     break;
 
+  case WEBUSB_CMD_HSM_VERIFY: {
+    // 1 (cmd) + 64 (public key) + N * (32 (hash) + 64 (signature)). The
+    // response carries the number of valid signatures and one byte per pair.
+    uint32_t count = (len > 65) ? (len - 65) / 96 : 0;
+    response[0] = WEBUSB_CMD_HSM_VERIFY;
+    response_len = 2;
+    if (count == 0 || len != 65 + count * 96 ||
+        count > WEBUSB_HSM_VERIFY_MAX_PAIRS) {
+      response[1] = WEBUSB_STATUS_INVALID;
+      break;
+    }
+    int valid = secure_gateway_hsm_verify(msg + 1, (uint16_t)count,
+                                          response + 3);
+    if (valid < 0) {
+      response[1] = WEBUSB_STATUS_ERROR;
+    } else {
+      response[1] = WEBUSB_STATUS_OK;
+      response[2] = (uint8_t)valid;
+      response_len = 3 + count;
+    }
+    break;
+  }
+
   case WEBUSB_CMD_OATH_BACKUP: {
     uint16_t backup_len = sizeof(webusb_state.backup_buffer) - 2;
     if (secure_gateway_oath_backup(webusb_state.backup_buffer + 2,
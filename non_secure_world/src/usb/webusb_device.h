@@ -28,9 +28,24 @@
 #define WEBUSB_CMD_HSM_GEN_KEY 0x10
 #define WEBUSB_CMD_HSM_GET_PUBKEY 0x11
 #define WEBUSB_CMD_HSM_SIGN 0x12
+#define WEBUSB_CMD_HSM_VERIFY 0x13
 #define WEBUSB_CMD_OATH_BACKUP 0x20
 #define WEBUSB_CMD_OATH_RESTORE 0x21
 
+// HSM_VERIFY request: command, 64-byte P-256 public key, then up to
+// WEBUSB_HSM_VERIFY_MAX_PAIRS (32-byte hash, 64-byte signature) pairs in one
+// bulk transfer. The host ends the transfer with a short packet, or a
+// zero-length one when its length is a multiple of WEBUSB_EP_SIZE. The
+// response is command, status, number of valid signatures, then one byte
+// per pair (1 = valid).
+#define WEBUSB_HSM_VERIFY_MAX_PAIRS 32
+
+// Largest command the device takes in one transfer: an HSM_VERIFY with the
+// most pairs, rounded up to whole packets
+#define WEBUSB_RX_MAX_LEN                                                      \
+  (((1 + 64 + WEBUSB_HSM_VERIFY_MAX_PAIRS * 96) + WEBUSB_EP_SIZE - 1) /        \
+   WEBUSB_EP_SIZE * WEBUSB_EP_SIZE)
+
 // WebUSB Response Status
 #define WEBUSB_STATUS_OK 0x00
 #define WEBUSB_STATUS_ERROR 0x01
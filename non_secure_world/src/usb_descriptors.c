@@ -1,6 +1,7 @@
 #include "pico/unique_id.h"
 #include "secure_gateway.h"
 #include "tusb.h"
+#include "usb/ccid_device.h"
 #include <stdio.h>
 
 //--------------------------------------------------------------------+
@@ -60,9 +61,9 @@ uint8_t const *tud_descriptor_device_cb(void) {
       0xFE, 0x00, 0x00, 0x00, /* dwMaxIFSD (254) */                            \
       0x00, 0x00, 0x00, 0x00, /* dwSynchProtocols */                           \
       0x00, 0x00, 0x00, 0x00, /* dwMechanical */                               \
-      0xBA, 0x04, 0x02,                                                        \
-      0x00, /* dwFeatures (Auto config, TPDU, extended APDU) */                \
-      0x00, 0x01, 0x00, 0x00,       /* dwMaxCCIDMessageLength (261) */         \
+      0xBA, 0x04, 0x04,                                                        \
+      0x00, /* dwFeatures (Auto config, extended APDU level exchange) */       \
+      U32_TO_U8S_LE(CCID_MAX_MESSAGE_LEN), /* dwMaxCCIDMessageLength */        \
       0xFF,                         /* bClassGetResponse (Echo) */             \
       0xFF,                         /* bClassEnvelope (Echo) */                \
       0x00, 0x00,                   /* wLcdLayout */                           \
@@ -1,9 +1,11 @@
 #include "applet_manager.h"
 #include "oath/apdu_protocol.h"
 #include "oath/fido2_applet.h"
+#include "oath/iso7816_4.h"
 #include "oath/management_applet.h"
 #include "oath/oath_protocol.h"
 #include "oath/openpgp_applet.h"
+#include "security/hsm.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -48,6 +50,10 @@ void applet_manager_init(void) {
   registered_applets[num_applets].handle_apdu = management_applet_handle_apdu;
   num_applets++;
 
+  // Key slots and the ECDSA RNG come first: the FIDO2 and OpenPGP applets
+  // sign through the HSM
+  hsm_init();
+
   // Initialize all applets
   for (int i = 0; i < num_applets; i++) {
     if (registered_applets[i].init) {
@@ -58,24 +64,18 @@ void applet_manager_init(void) {
 
 void applet_manager_process_apdu(uint8_t *apdu_in, uint16_t len_in,
                                  uint8_t *apdu_out, uint16_t *len_out) {
-  if (len_in < 5) {
-    // Return SW_WRONG_LENGTH (67 00)
-    apdu_out[0] = 0x67;
-    apdu_out[1] = 0x00;
-    *len_out = 2;
+  // Short and extended APDUs alike; applets re-parse with the same helper
+  iso7816_apdu_t apdu;
+  if (!iso7816_parse_apdu(apdu_in, len_in, &apdu)) {
+    iso7816_set_sw(apdu_out, len_out, SW_WRONG_LENGTH);
     return;
   }
 
-  uint8_t ins = apdu_in[APDU_INS_POS];
-
   // Handle SELECT command for AID switching
-  if (ins == INS_SELECT) {
-    uint8_t lc = apdu_in[APDU_LC_POS];
-    uint8_t *target_aid = &apdu_in[APDU_DATA_POS];
-
+  if (apdu.ins == INS_SELECT && apdu.p1 == 0x04) {
     for (int i = 0; i < num_applets; i++) {
-      if (lc == registered_applets[i].aid_len &&
-          memcmp(target_aid, registered_applets[i].aid, lc) == 0) {
+      if (apdu.lc == registered_applets[i].aid_len &&
+          memcmp(apdu.data, registered_applets[i].aid, apdu.lc) == 0) {
 
         selected_applet = &registered_applets[i];
         printf("Applet Manager: Switched to applet %d\n", i);
@@ -87,9 +87,7 @@ void applet_manager_process_apdu(uint8_t *apdu_in, uint16_t len_in,
     }
 
     // AID not found
-    apdu_out[0] = 0x6A;
-    apdu_out[1] = 0x82; // SW_FILE_NOT_FOUND
-    *len_out = 2;
+    iso7816_set_sw(apdu_out, len_out, SW_FILE_NOT_FOUND);
     return;
   }
 
@@ -98,8 +96,6 @@ void applet_manager_process_apdu(uint8_t *apdu_in, uint16_t len_in,
     selected_applet->handle_apdu(apdu_in, len_in, apdu_out, len_out);
   } else {
     // No applet selected
-    apdu_out[0] = 0x69;
-    apdu_out[1] = 0x85; // SW_CONDITIONS_NOT_SATISFIED
-    *len_out = 2;
+    iso7816_set_sw(apdu_out, len_out, SW_CONDITIONS_NOT_SATISFIED);
   }
 }
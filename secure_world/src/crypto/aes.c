@@ -70,6 +70,8 @@ static uint8_t gmul(uint8_t a, uint8_t b) {
   return p;
 }
 
+static void sub_word4(uint8_t *b);
+
 static void KeyExpansion(const uint8_t *key, uint8_t *w) {
   uint8_t temp[4];
   int i = 0;
@@ -93,16 +95,10 @@ static void KeyExpansion(const uint8_t *key, uint8_t *w) {
       temp[1] = temp[2];
       temp[2] = temp[3];
       temp[3] = k;
-      temp[0] = sbox[temp[0]];
-      temp[1] = sbox[temp[1]];
-      temp[2] = sbox[temp[2]];
-      temp[3] = sbox[temp[3]];
+      sub_word4(temp);
       temp[0] ^= Rcon[i / 8];
     } else if (i % 8 == 4) {
-      temp[0] = sbox[temp[0]];
-      temp[1] = sbox[temp[1]];
-      temp[2] = sbox[temp[2]];
-      temp[3] = sbox[temp[3]];
+      sub_word4(temp);
     }
     w[i * 4 + 0] = w[(i - 8) * 4 + 0] ^ temp[0];
     w[i * 4 + 1] = w[(i - 8) * 4 + 1] ^ temp[1];
@@ -232,6 +228,338 @@ static void InvCipher(uint8_t *state, const uint8_t *w) {
     state[i] ^= w[i];
 }
 
+//--------------------------------------------------------------------+
+// Encryption backends (see AES_BACKEND in aes.h)
+//--------------------------------------------------------------------+
+
+// Column c of the state as a little-endian word: row 0 in the low byte
+static inline uint32_t load_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static inline void store_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t rotl32(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+#if AES_BACKEND == AES_BACKEND_TTABLE
+
+// te0[x] = MixColumns applied to S(x) in row 0; other rows are rotations
+static uint32_t te0[256];
+static bool te0_ready;
+
+static void build_tables(void) {
+  if (te0_ready)
+    return;
+  for (int i = 0; i < 256; i++) {
+    uint8_t s = sbox[i];
+    uint8_t s2 = gmul(s, 0x02);
+    te0[i] = (uint32_t)s2 | ((uint32_t)s << 8) | ((uint32_t)s << 16) |
+             ((uint32_t)(s2 ^ s) << 24);
+  }
+  te0_ready = true;
+}
+
+static void sub_word4(uint8_t *b) {
+  for (int i = 0; i < 4; i++)
+    b[i] = sbox[b[i]];
+}
+
+static void encrypt_block(const uint8_t *in, const uint8_t *w, uint8_t *out) {
+  uint32_t s[4], t[4];
+  for (int c = 0; c < 4; c++)
+    s[c] = load_le32(in + 4 * c) ^ load_le32(w + 4 * c);
+
+  for (int round = 1; round < 14; round++) {
+    const uint8_t *rk = w + round * 16;
+    for (int c = 0; c < 4; c++) {
+      t[c] = te0[s[c] & 0xFF] ^
+             rotl32(te0[(s[(c + 1) & 3] >> 8) & 0xFF], 8) ^
+             rotl32(te0[(s[(c + 2) & 3] >> 16) & 0xFF], 16) ^
+             rotl32(te0[s[(c + 3) & 3] >> 24], 24) ^ load_le32(rk + 4 * c);
+    }
+    memcpy(s, t, sizeof(s));
+  }
+
+  // Final round: SubBytes and ShiftRows only
+  for (int c = 0; c < 4; c++) {
+    t[c] = (uint32_t)sbox[s[c] & 0xFF] |
+           ((uint32_t)sbox[(s[(c + 1) & 3] >> 8) & 0xFF] << 8) |
+           ((uint32_t)sbox[(s[(c + 2) & 3] >> 16) & 0xFF] << 16) |
+           ((uint32_t)sbox[s[(c + 3) & 3] >> 24] << 24);
+    store_le32(out + 4 * c, t[c] ^ load_le32(w + 14 * 16 + 4 * c));
+  }
+}
+
+#define AES_LANES 1
+
+static void encrypt_lanes(const uint8_t *in, const uint8_t *w, uint8_t *out,
+                          size_t nblocks) {
+  (void)nblocks;
+  encrypt_block(in, w, out);
+}
+
+#elif AES_BACKEND == AES_BACKEND_CT
+
+// Exchanges the bits selected by `lo` in x with the bits selected by `hi`
+// in y, `s` positions apart
+#define SWAPMOVE(lo, hi, s, x, y)                                              \
+  do {                                                                         \
+    uint32_t a_ = (x), b_ = (y);                                               \
+    (x) = (a_ & (lo)) | ((b_ & (lo)) << (s));                                  \
+    (y) = ((a_ & (hi)) >> (s)) | (b_ & (hi));                                  \
+  } while (0)
+
+// Transposes each byte lane of q[0..7] as an 8x8 bit matrix. Afterwards
+// q[b] holds bit b of every input byte. The transform is its own inverse.
+static void ortho(uint32_t *q) {
+  SWAPMOVE(0x55555555u, 0xAAAAAAAAu, 1, q[0], q[1]);
+  SWAPMOVE(0x55555555u, 0xAAAAAAAAu, 1, q[2], q[3]);
+  SWAPMOVE(0x55555555u, 0xAAAAAAAAu, 1, q[4], q[5]);
+  SWAPMOVE(0x55555555u, 0xAAAAAAAAu, 1, q[6], q[7]);
+
+  SWAPMOVE(0x33333333u, 0xCCCCCCCCu, 2, q[0], q[2]);
+  SWAPMOVE(0x33333333u, 0xCCCCCCCCu, 2, q[1], q[3]);
+  SWAPMOVE(0x33333333u, 0xCCCCCCCCu, 2, q[4], q[6]);
+  SWAPMOVE(0x33333333u, 0xCCCCCCCCu, 2, q[5], q[7]);
+
+  SWAPMOVE(0x0F0F0F0Fu, 0xF0F0F0F0u, 4, q[0], q[4]);
+  SWAPMOVE(0x0F0F0F0Fu, 0xF0F0F0F0u, 4, q[1], q[5]);
+  SWAPMOVE(0x0F0F0F0Fu, 0xF0F0F0F0u, 4, q[2], q[6]);
+  SWAPMOVE(0x0F0F0F0Fu, 0xF0F0F0F0u, 4, q[3], q[7]);
+}
+
+// Bitsliced S-box: the Boyar-Peralta circuit (eprint 2009/191), applied to
+// 32 bytes at once. q[0] holds the low bit of every byte.
+static void bitslice_sbox(uint32_t *q) {
+  uint32_t x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4];
+  uint32_t x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+  // Top linear transformation
+  uint32_t y14 = x3 ^ x5;
+  uint32_t y13 = x0 ^ x6;
+  uint32_t y9 = x0 ^ x3;
+  uint32_t y8 = x0 ^ x5;
+  uint32_t t0 = x1 ^ x2;
+  uint32_t y1 = t0 ^ x7;
+  uint32_t y4 = y1 ^ x3;
+  uint32_t y12 = y13 ^ y14;
+  uint32_t y2 = y1 ^ x0;
+  uint32_t y5 = y1 ^ x6;
+  uint32_t y3 = y5 ^ y8;
+  uint32_t t1 = x4 ^ y12;
+  uint32_t y15 = t1 ^ x5;
+  uint32_t y20 = t1 ^ x1;
+  uint32_t y6 = y15 ^ x7;
+  uint32_t y10 = y15 ^ t0;
+  uint32_t y11 = y20 ^ y9;
+  uint32_t y7 = x7 ^ y11;
+  uint32_t y17 = y10 ^ y11;
+  uint32_t y19 = y10 ^ y8;
+  uint32_t y16 = t0 ^ y11;
+  uint32_t y21 = y13 ^ y16;
+  uint32_t y18 = x0 ^ y16;
+
+  // Non-linear section
+  uint32_t t2 = y12 & y15;
+  uint32_t t3 = y3 & y6;
+  uint32_t t4 = t3 ^ t2;
+  uint32_t t5 = y4 & x7;
+  uint32_t t6 = t5 ^ t2;
+  uint32_t t7 = y13 & y16;
+  uint32_t t8 = y5 & y1;
+  uint32_t t9 = t8 ^ t7;
+  uint32_t t10 = y2 & y7;
+  uint32_t t11 = t10 ^ t7;
+  uint32_t t12 = y9 & y11;
+  uint32_t t13 = y14 & y17;
+  uint32_t t14 = t13 ^ t12;
+  uint32_t t15 = y8 & y10;
+  uint32_t t16 = t15 ^ t12;
+  uint32_t t17 = t4 ^ t14;
+  uint32_t t18 = t6 ^ t16;
+  uint32_t t19 = t9 ^ t14;
+  uint32_t t20 = t11 ^ t16;
+  uint32_t t21 = t17 ^ y20;
+  uint32_t t22 = t18 ^ y19;
+  uint32_t t23 = t19 ^ y21;
+  uint32_t t24 = t20 ^ y18;
+
+  uint32_t t25 = t21 ^ t22;
+  uint32_t t26 = t21 & t23;
+  uint32_t t27 = t24 ^ t26;
+  uint32_t t28 = t25 & t27;
+  uint32_t t29 = t28 ^ t22;
+  uint32_t t30 = t23 ^ t24;
+  uint32_t t31 = t22 ^ t26;
+  uint32_t t32 = t31 & t30;
+  uint32_t t33 = t32 ^ t24;
+  uint32_t t34 = t23 ^ t33;
+  uint32_t t35 = t27 ^ t33;
+  uint32_t t36 = t24 & t35;
+  uint32_t t37 = t36 ^ t34;
+  uint32_t t38 = t27 ^ t36;
+  uint32_t t39 = t29 & t38;
+  uint32_t t40 = t25 ^ t39;
+
+  uint32_t t41 = t40 ^ t37;
+  uint32_t t42 = t29 ^ t33;
+  uint32_t t43 = t29 ^ t40;
+  uint32_t t44 = t33 ^ t37;
+  uint32_t t45 = t42 ^ t41;
+  uint32_t z0 = t44 & y15;
+  uint32_t z1 = t37 & y6;
+  uint32_t z2 = t33 & x7;
+  uint32_t z3 = t43 & y16;
+  uint32_t z4 = t40 & y1;
+  uint32_t z5 = t29 & y7;
+  uint32_t z6 = t42 & y11;
+  uint32_t z7 = t45 & y17;
+  uint32_t z8 = t41 & y10;
+  uint32_t z9 = t44 & y12;
+  uint32_t z10 = t37 & y3;
+  uint32_t z11 = t33 & y4;
+  uint32_t z12 = t43 & y13;
+  uint32_t z13 = t40 & y5;
+  uint32_t z14 = t29 & y2;
+  uint32_t z15 = t42 & y9;
+  uint32_t z16 = t45 & y14;
+  uint32_t z17 = t41 & y8;
+
+  // Bottom linear transformation
+  uint32_t t46 = z15 ^ z16;
+  uint32_t t47 = z10 ^ z11;
+  uint32_t t48 = z5 ^ z13;
+  uint32_t t49 = z9 ^ z10;
+  uint32_t t50 = z2 ^ z12;
+  uint32_t t51 = z2 ^ z5;
+  uint32_t t52 = z7 ^ z8;
+  uint32_t t53 = z0 ^ z3;
+  uint32_t t54 = z6 ^ z7;
+  uint32_t t55 = z16 ^ z17;
+  uint32_t t56 = z12 ^ t48;
+  uint32_t t57 = t50 ^ t53;
+  uint32_t t58 = z4 ^ t46;
+  uint32_t t59 = z3 ^ t54;
+  uint32_t t60 = t46 ^ t57;
+  uint32_t t61 = z14 ^ t57;
+  uint32_t t62 = t52 ^ t58;
+  uint32_t t63 = t49 ^ t58;
+  uint32_t t64 = z4 ^ t59;
+  uint32_t t65 = t61 ^ t62;
+  uint32_t t66 = z1 ^ t63;
+  uint32_t s0 = t59 ^ t63;
+  uint32_t s6 = t56 ^ ~t62;
+  uint32_t s7 = t48 ^ ~t60;
+  uint32_t t67 = t64 ^ t65;
+  uint32_t s3 = t53 ^ t66;
+  uint32_t s4 = t51 ^ t66;
+  uint32_t s5 = t47 ^ t65;
+  uint32_t s1 = t64 ^ ~s3;
+  uint32_t s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+// SubBytes on the 32 bytes held in q (two blocks, four columns each)
+static void sub_bytes(uint32_t *q) {
+  ortho(q);
+  bitslice_sbox(q);
+  ortho(q);
+}
+
+static void sub_word4(uint8_t *b) {
+  uint32_t q[8] = {load_le32(b)};
+  sub_bytes(q);
+  store_le32(b, q[0]);
+}
+
+// Multiplies each byte of x by 2 in GF(2^8), without branches
+static inline uint32_t xtime4(uint32_t x) {
+  return ((x & 0x7F7F7F7Fu) << 1) ^ (((x >> 7) & 0x01010101u) * 0x1Bu);
+}
+
+// ShiftRows and MixColumns on one block (columns s[0..3]).
+// Row r of output column c comes from input column c + r.
+static void shift_mix(uint32_t *s, bool mix) {
+  uint32_t t[4];
+  for (int c = 0; c < 4; c++) {
+    t[c] = (s[c] & 0x000000FFu) | (s[(c + 1) & 3] & 0x0000FF00u) |
+           (s[(c + 2) & 3] & 0x00FF0000u) | (s[(c + 3) & 3] & 0xFF000000u);
+  }
+  for (int c = 0; c < 4; c++) {
+    uint32_t x = t[c];
+    if (mix) {
+      uint32_t r = rotl32(x, 24); // Row r + 1 moved to row r
+      x = xtime4(x ^ r) ^ r ^ rotl32(x, 16) ^ rotl32(x, 8);
+    }
+    s[c] = x;
+  }
+}
+
+#define AES_LANES 2
+
+// Encrypts one or two blocks in a single bitsliced pass
+static void encrypt_lanes(const uint8_t *in, const uint8_t *w, uint8_t *out,
+                          size_t nblocks) {
+  uint32_t q[8] = {0};
+  uint32_t rk[4];
+  for (size_t i = 0; i < 4 * nblocks; i++)
+    q[i] = load_le32(in + 4 * i);
+
+  for (int c = 0; c < 4; c++)
+    rk[c] = load_le32(w + 4 * c);
+  for (int i = 0; i < 8; i++)
+    q[i] ^= rk[i & 3];
+
+  for (int round = 1; round < 15; round++) {
+    sub_bytes(q);
+    shift_mix(q, round < 14);
+    shift_mix(q + 4, round < 14);
+    for (int c = 0; c < 4; c++)
+      rk[c] = load_le32(w + round * 16 + 4 * c);
+    for (int i = 0; i < 8; i++)
+      q[i] ^= rk[i & 3];
+  }
+
+  for (size_t i = 0; i < 4 * nblocks; i++)
+    store_le32(out + 4 * i, q[i]);
+}
+
+#elif AES_BACKEND == AES_BACKEND_REFERENCE
+
+static void sub_word4(uint8_t *b) {
+  for (int i = 0; i < 4; i++)
+    b[i] = sbox[b[i]];
+}
+
+#define AES_LANES 1
+
+static void encrypt_lanes(const uint8_t *in, const uint8_t *w, uint8_t *out,
+                          size_t nblocks) {
+  (void)nblocks;
+  memcpy(out, in, 16);
+  Cipher(out, w);
+}
+
+#else
+#error "Unknown AES_BACKEND"
+#endif
+
 bool aes_encrypt(const uint8_t *key, const uint8_t *iv, const uint8_t *input,
                  size_t input_len, uint8_t *output) {
   if (input_len % 16 != 0)
@@ -269,10 +597,54 @@ bool aes_decrypt(const uint8_t *key, const uint8_t *iv, const uint8_t *input,
   return true;
 }
 
-void aes_key_expansion(const uint8_t *key, uint8_t *w) { KeyExpansion(key, w); }
+void aes_key_expansion(const uint8_t *key, uint8_t *w) {
+#if AES_BACKEND == AES_BACKEND_TTABLE
+  build_tables();
+#endif
+  KeyExpansion(key, w);
+}
 
 void aes_ecb_encrypt_block(const uint8_t *input, const uint8_t *w,
                            uint8_t *output) {
-  memcpy(output, input, 16);
-  Cipher(output, w);
+  encrypt_lanes(input, w, output, 1);
+}
+
+void aes_ecb_encrypt_blocks(const uint8_t *input, const uint8_t *w,
+                            uint8_t *output, size_t nblocks) {
+  while (nblocks > 0) {
+    size_t n = nblocks < AES_LANES ? nblocks : AES_LANES;
+    encrypt_lanes(input, w, output, n);
+    input += 16 * n;
+    output += 16 * n;
+    nblocks -= n;
+  }
+}
+
+void aes_ctr32_xcrypt(const uint8_t *w, uint8_t *cb, uint8_t *data,
+                      size_t len) {
+  uint8_t ctr[AES_CTR_BATCH * 16];
+  uint8_t keystream[AES_CTR_BATCH * 16];
+
+  while (len > 0) {
+    size_t nblocks = (len + 15) / 16;
+    if (nblocks > AES_CTR_BATCH)
+      nblocks = AES_CTR_BATCH;
+
+    for (size_t b = 0; b < nblocks; b++) {
+      memcpy(ctr + 16 * b, cb, 16);
+      // Increment counter (32-bit big-endian at the end of CB)
+      for (int j = 15; j >= 12; j--) {
+        if (++cb[j])
+          break;
+      }
+    }
+    aes_ecb_encrypt_blocks(ctr, w, keystream, nblocks);
+
+    size_t n = len < 16 * nblocks ? len : 16 * nblocks;
+    for (size_t i = 0; i < n; i++)
+      data[i] ^= keystream[i];
+    data += n;
+    len -= n;
+  }
+  memset(keystream, 0, sizeof(keystream));
 }
@@ -11,6 +11,24 @@
 #define AES_IV_SIZE_BYTES 16
 #define AES_BLOCK_SIZE 16
 
+// Block encryption core, selected at build time with AES_BACKEND:
+//   AES_BACKEND_REFERENCE  Byte-oriented reference rounds
+//   AES_BACKEND_TTABLE     32-bit T-table rounds (1 KB RAM table). Fastest,
+//                          but table indexes depend on key and data.
+//   AES_BACKEND_CT         Constant-time: bitsliced S-box over two blocks,
+//                          branch-free ShiftRows/MixColumns (default)
+// Decryption (aes_decrypt) always uses the reference rounds.
+#define AES_BACKEND_REFERENCE 0
+#define AES_BACKEND_TTABLE 1
+#define AES_BACKEND_CT 2
+
+#ifndef AES_BACKEND
+#define AES_BACKEND AES_BACKEND_CT
+#endif
+
+// Counter blocks generated per pass by aes_ctr32_xcrypt()
+#define AES_CTR_BATCH 4
+
 /**
  * @brief Encrypts data using AES-256 CBC mode.
  *
@@ -55,4 +73,33 @@ void aes_key_expansion(const uint8_t *key, uint8_t *w);
 void aes_ecb_encrypt_block(const uint8_t *input, const uint8_t *w,
                            uint8_t *output);
 
+/**
+ * @brief Encrypts consecutive 16-byte blocks using ECB mode.
+ *
+ * Backends that process several blocks per pass fill all their lanes, so
+ * this is cheaper than calling aes_ecb_encrypt_block() in a loop.
+ *
+ * @param input 16 * nblocks input bytes.
+ * @param w 240-byte expanded key.
+ * @param output 16 * nblocks output bytes.
+ * @param nblocks Number of blocks.
+ */
+void aes_ecb_encrypt_blocks(const uint8_t *input, const uint8_t *w,
+                            uint8_t *output, size_t nblocks);
+
+/**
+ * @brief XORs AES-CTR keystream into `data` in place.
+ *
+ * The counter is the last 32 bits of `cb`, big-endian, as in GCM. Up to
+ * AES_CTR_BATCH counter blocks are encrypted per pass. On return `cb`
+ * holds the next unused counter block.
+ *
+ * @param w 240-byte expanded key.
+ * @param cb 16-byte counter block.
+ * @param data Data to encrypt or decrypt.
+ * @param len Length of data (any length).
+ */
+void aes_ctr32_xcrypt(const uint8_t *w, uint8_t *cb, uint8_t *data,
+                      size_t len);
+
 #endif // _AES_H_
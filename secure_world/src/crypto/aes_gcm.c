@@ -7,11 +7,27 @@
  * @brief Software implementation of AES-GCM 256.
  */
 
-// GHASH implementation (simplified for 128-bit blocks)
-static void gmult(uint8_t *x, const uint8_t *h) {
+static uint32_t get_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+#if AES_GCM_GHASH == AES_GCM_GHASH_BITWISE
+
+static void ghash_setup(aes_gcm_ctx_t *ctx) { (void)ctx; }
+
+// x = x * H, one bit of x per iteration
+static void gmult(uint8_t *x, const aes_gcm_ctx_t *ctx) {
   uint8_t z[16] = {0};
   uint8_t v[16];
-  memcpy(v, h, 16);
+  memcpy(v, ctx->h, 16);
 
   for (int i = 0; i < 128; i++) {
     if ((x[i >> 3] >> (7 - (i & 7))) & 1) {
@@ -29,117 +45,236 @@ static void gmult(uint8_t *x, const uint8_t *h) {
   memcpy(x, z, 16);
 }
 
-static void ghash(const uint8_t *h, const uint8_t *data, size_t len,
-                  uint8_t *y) {
-  uint8_t b[16];
-  memset(y, 0, 16);
-  for (size_t i = 0; i < len; i += 16) {
-    size_t n = (len - i) > 16 ? 16 : (len - i);
-    memset(b, 0, 16);
-    memcpy(b, data + i, n);
-    for (int j = 0; j < 16; j++)
-      y[j] ^= b[j];
-    gmult(y, h);
+#elif AES_GCM_GHASH == AES_GCM_GHASH_TABLE4
+
+// Reduction of the four bits shifted out per step, pre-shifted by 48
+static const uint16_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+// hh/hl[i] = i * H for every 4-bit i (in GHASH bit order)
+static void ghash_setup(aes_gcm_ctx_t *ctx) {
+  uint64_t vh = ((uint64_t)get_be32(ctx->h) << 32) | get_be32(ctx->h + 4);
+  uint64_t vl = ((uint64_t)get_be32(ctx->h + 8) << 32) | get_be32(ctx->h + 12);
+
+  ctx->hh[0] = 0;
+  ctx->hl[0] = 0;
+  ctx->hh[8] = vh;
+  ctx->hl[8] = vl;
+  for (int i = 4; i > 0; i >>= 1) {
+    uint64_t t = (vl & 1) * 0xE1000000u;
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ (t << 32);
+    ctx->hh[i] = vh;
+    ctx->hl[i] = vl;
+  }
+  for (int i = 2; i <= 8; i *= 2) {
+    for (int j = 1; j < i; j++) {
+      ctx->hh[i + j] = ctx->hh[i] ^ ctx->hh[j];
+      ctx->hl[i + j] = ctx->hl[i] ^ ctx->hl[j];
+    }
   }
 }
 
-// AES-CTR implementation for GCM
-static void aes_ctr_xcrypt(const uint8_t *w, uint8_t *cb, uint8_t *data,
-                           size_t len) {
-  uint8_t keystream[16];
-  for (size_t i = 0; i < len; i += 16) {
-    aes_ecb_encrypt_block(cb, w, keystream);
-    size_t n = (len - i) > 16 ? 16 : (len - i);
-    for (size_t j = 0; j < n; j++)
-      data[i + j] ^= keystream[j];
+// x = x * H, one nibble of x per step
+static void gmult(uint8_t *x, const aes_gcm_ctx_t *ctx) {
+  uint8_t lo = x[15] & 0x0F;
+  uint64_t zh = ctx->hh[lo];
+  uint64_t zl = ctx->hl[lo];
 
-    // Increment counter (32-bit big-endian at the end of CB)
-    for (int j = 15; j >= 12; j--) {
-      if (++cb[j])
-        break;
+  for (int i = 15; i >= 0; i--) {
+    uint8_t hi = x[i] >> 4;
+    lo = x[i] & 0x0F;
+    uint8_t rem;
+
+    if (i != 15) {
+      rem = (uint8_t)(zl & 0x0F);
+      zl = (zh << 60) | (zl >> 4);
+      zh = (zh >> 4) ^ ((uint64_t)last4[rem] << 48);
+      zh ^= ctx->hh[lo];
+      zl ^= ctx->hl[lo];
     }
+    rem = (uint8_t)(zl & 0x0F);
+    zl = (zh << 60) | (zl >> 4);
+    zh = (zh >> 4) ^ ((uint64_t)last4[rem] << 48);
+    zh ^= ctx->hh[hi];
+    zl ^= ctx->hl[hi];
   }
+
+  put_be32(x, (uint32_t)(zh >> 32));
+  put_be32(x + 4, (uint32_t)zh);
+  put_be32(x + 8, (uint32_t)(zl >> 32));
+  put_be32(x + 12, (uint32_t)zl);
 }
 
-bool aes_gcm_encrypt(const uint8_t *key, const uint8_t *iv,
-                     const uint8_t *plaintext, size_t plaintext_len,
-                     uint8_t *ciphertext, uint8_t *tag) {
-  uint8_t w[240];
-  uint8_t h[16] = {0};
-  uint8_t cb[16];
-  uint8_t j0[16];
+#elif AES_GCM_GHASH == AES_GCM_GHASH_CT32
+
+static void ghash_setup(aes_gcm_ctx_t *ctx) {
+  for (int i = 0; i < 4; i++)
+    ctx->hw[i] = get_be32(ctx->h + 4 * i);
+}
+
+// Carry-less 32x32 -> 64 multiply. Spacing the operand bits four apart
+// keeps the carries of each integer multiply out of the bits that are
+// kept, so the cost does not depend on the operands.
+static uint64_t bmul32(uint32_t x, uint32_t y) {
+  uint32_t x0 = x & 0x11111111u, x1 = x & 0x22222222u;
+  uint32_t x2 = x & 0x44444444u, x3 = x & 0x88888888u;
+  uint32_t y0 = y & 0x11111111u, y1 = y & 0x22222222u;
+  uint32_t y2 = y & 0x44444444u, y3 = y & 0x88888888u;
+
+  uint64_t z0 = ((uint64_t)x0 * y0) ^ ((uint64_t)x1 * y3) ^
+                ((uint64_t)x2 * y2) ^ ((uint64_t)x3 * y1);
+  uint64_t z1 = ((uint64_t)x0 * y1) ^ ((uint64_t)x1 * y0) ^
+                ((uint64_t)x2 * y3) ^ ((uint64_t)x3 * y2);
+  uint64_t z2 = ((uint64_t)x0 * y2) ^ ((uint64_t)x1 * y1) ^
+                ((uint64_t)x2 * y0) ^ ((uint64_t)x3 * y3);
+  uint64_t z3 = ((uint64_t)x0 * y3) ^ ((uint64_t)x1 * y2) ^
+                ((uint64_t)x2 * y1) ^ ((uint64_t)x3 * y0);
 
-  aes_key_expansion(key, w);
-  aes_ecb_encrypt_block(h, w, h); // H = E(K, 0^128)
+  return (z0 & 0x1111111111111111ull) | (z1 & 0x2222222222222222ull) |
+         (z2 & 0x4444444444444444ull) | (z3 & 0x8888888888888888ull);
+}
+
+// x = x * H. Blocks are read as big-endian integers, which reverses the
+// GHASH bit order; the product is shifted left by one to compensate and
+// reduced modulo x^128 + x^7 + x^2 + x + 1 in that reflected form.
+static void gmult(uint8_t *x, const aes_gcm_ctx_t *ctx) {
+  uint32_t a[4];
+  uint32_t p[8] = {0}; // 256-bit product, p[0] most significant
+  for (int i = 0; i < 4; i++)
+    a[i] = get_be32(x + 4 * i);
+
+  // Schoolbook: a[i] * h[j] lands in words i+j (high) and i+j+1 (low)
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      uint64_t t = bmul32(a[i], ctx->hw[j]);
+      p[i + j] ^= (uint32_t)(t >> 32);
+      p[i + j + 1] ^= (uint32_t)t;
+    }
+  }
+
+  // Shift the 255-bit product left by one
+  for (int i = 0; i < 7; i++)
+    p[i] = (p[i] << 1) | (p[i + 1] >> 31);
+  p[7] <<= 1;
+
+  // Fold the high-degree half l = p[4..7] into p[0..3] as
+  // l * (1 + x + x^2 + x^7). Bits pushed past the end by the shifts are
+  // collected in d and folded once more.
+  const uint32_t *l = &p[4];
+  uint32_t d = (l[3] << 31) ^ (l[3] << 30) ^ (l[3] << 25);
+  uint32_t r[4];
+  for (int i = 0; i < 4; i++) {
+    uint32_t prev = i ? l[i - 1] : 0;
+    r[i] = l[i] ^ ((l[i] >> 1) | (prev << 31)) ^
+           ((l[i] >> 2) | (prev << 30)) ^ ((l[i] >> 7) | (prev << 25));
+  }
+  r[0] ^= d ^ (d >> 1) ^ (d >> 2) ^ (d >> 7);
+
+  for (int i = 0; i < 4; i++)
+    put_be32(x + 4 * i, p[i] ^ r[i]);
+}
+
+#else
+#error "Unknown AES_GCM_GHASH backend"
+#endif
+
+// Absorbs `data` into the running GHASH state `y`, zero-padding the last
+// block
+static void ghash_update(const aes_gcm_ctx_t *ctx, uint8_t *y,
+                         const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i += 16) {
+    size_t n = (len - i) > 16 ? 16 : (len - i);
+    for (size_t j = 0; j < n; j++)
+      y[j] ^= data[i + j];
+    gmult(y, ctx);
+  }
+}
 
-  // J0 = IV || 0^31 || 1 (assuming 96-bit IV)
+// J0 = IV || 0^31 || 1 (96-bit IV)
+static void make_j0(const uint8_t *iv, uint8_t *j0) {
   memcpy(j0, iv, 12);
   memset(j0 + 12, 0, 3);
   j0[15] = 1;
+}
 
-  memcpy(cb, j0, 16);
-  // Increment for first block of data
-  for (int j = 15; j >= 12; j--) {
-    if (++cb[j])
-      break;
-  }
-
-  memcpy(ciphertext, plaintext, plaintext_len);
-  aes_ctr_xcrypt(w, cb, ciphertext, plaintext_len);
+// tag = E(K, J0) ^ GHASH(H, A, C)
+static void compute_tag(const aes_gcm_ctx_t *ctx, const uint8_t *j0,
+                        const uint8_t *aad, size_t aad_len,
+                        const uint8_t *ciphertext, size_t ciphertext_len,
+                        uint8_t *tag) {
+  uint8_t y[16] = {0};
+  uint8_t len_block[16];
+  uint64_t aad_bits = (uint64_t)aad_len * 8;
+  uint64_t ct_bits = (uint64_t)ciphertext_len * 8;
 
-  // Compute Tag
-  uint8_t y[16];
-  uint8_t len_block[16] = {0};
-  uint64_t bit_len = (uint64_t)plaintext_len * 8;
-  // Assuming AAD is empty for now as per current use case
-  ghash(h, ciphertext, plaintext_len, y);
+  ghash_update(ctx, y, aad, aad_len);
+  ghash_update(ctx, y, ciphertext, ciphertext_len);
 
   // Final block with lengths (AAD len, Ciphertext len)
-  // For now OATH storage doesn't use AAD
-  for (int i = 0; i < 8; i++)
-    len_block[15 - i] = (uint8_t)(bit_len >> (i * 8));
-  for (int j = 0; j < 16; j++)
-    y[j] ^= len_block[j];
-  gmult(y, h);
+  for (int i = 0; i < 8; i++) {
+    len_block[7 - i] = (uint8_t)(aad_bits >> (i * 8));
+    len_block[15 - i] = (uint8_t)(ct_bits >> (i * 8));
+  }
+  ghash_update(ctx, y, len_block, sizeof(len_block));
 
   uint8_t t0[16];
-  aes_ecb_encrypt_block(j0, w, t0);
+  aes_ecb_encrypt_block(j0, ctx->w, t0);
   for (int i = 0; i < 16; i++)
     tag[i] = y[i] ^ t0[i];
+}
 
-  return true;
+void aes_gcm_ctx_init(aes_gcm_ctx_t *ctx, const uint8_t *key) {
+  uint8_t zero[16] = {0};
+  aes_key_expansion(key, ctx->w);
+  aes_ecb_encrypt_block(zero, ctx->w, ctx->h); // H = E(K, 0^128)
+  ghash_setup(ctx);
+  ctx->ready = true;
 }
 
-bool aes_gcm_decrypt(const uint8_t *key, const uint8_t *iv,
-                     const uint8_t *ciphertext, size_t ciphertext_len,
-                     const uint8_t *tag, uint8_t *plaintext) {
-  uint8_t w[240];
-  uint8_t h[16] = {0};
+void aes_gcm_ctx_wipe(aes_gcm_ctx_t *ctx) {
+  // Volatile stores so the wipe is not optimised away
+  volatile uint8_t *p = (volatile uint8_t *)ctx;
+  for (size_t i = 0; i < sizeof(*ctx); i++)
+    p[i] = 0;
+}
+
+bool aes_gcm_ctx_encrypt(const aes_gcm_ctx_t *ctx, const uint8_t *iv,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *plaintext, size_t plaintext_len,
+                         uint8_t *ciphertext, uint8_t *tag) {
+  if (!ctx->ready)
+    return false;
+
   uint8_t j0[16];
-  uint8_t expected_tag[16];
+  uint8_t cb[16];
+  make_j0(iv, j0);
 
-  aes_key_expansion(key, w);
-  aes_ecb_encrypt_block(h, w, h);
+  // Data blocks start at inc32(J0)
+  memcpy(cb, j0, 16);
+  cb[15]++;
 
-  memcpy(j0, iv, 12);
-  memset(j0 + 12, 0, 3);
-  j0[15] = 1;
+  memmove(ciphertext, plaintext, plaintext_len);
+  aes_ctr32_xcrypt(ctx->w, cb, ciphertext, plaintext_len);
+  compute_tag(ctx, j0, aad, aad_len, ciphertext, plaintext_len, tag);
+  return true;
+}
 
-  // Verify tag before decryption (encrypt ciphertext and check tag)
-  uint8_t y[16];
-  uint8_t len_block[16] = {0};
-  uint64_t bit_len = (uint64_t)ciphertext_len * 8;
-  ghash(h, ciphertext, ciphertext_len, y);
-  for (int i = 0; i < 8; i++)
-    len_block[15 - i] = (uint8_t)(bit_len >> (i * 8));
-  for (int j = 0; j < 16; j++)
-    y[j] ^= len_block[j];
-  gmult(y, h);
+bool aes_gcm_ctx_decrypt(const aes_gcm_ctx_t *ctx, const uint8_t *iv,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *ciphertext, size_t ciphertext_len,
+                         const uint8_t *tag, uint8_t *plaintext) {
+  if (!ctx->ready)
+    return false;
 
-  uint8_t t0[16];
-  aes_ecb_encrypt_block(j0, w, t0);
-  for (int i = 0; i < 16; i++)
-    expected_tag[i] = y[i] ^ t0[i];
+  uint8_t j0[16];
+  uint8_t expected_tag[16];
+  make_j0(iv, j0);
+
+  // Verify tag before decryption
+  compute_tag(ctx, j0, aad, aad_len, ciphertext, ciphertext_len,
+              expected_tag);
 
   // Constant time comparison
   uint8_t diff = 0;
@@ -148,16 +283,33 @@ bool aes_gcm_decrypt(const uint8_t *key, const uint8_t *iv,
   if (diff != 0)
     return false;
 
-  // Decrypt
   uint8_t cb[16];
   memcpy(cb, j0, 16);
-  for (int j = 15; j >= 12; j--) {
-    if (++cb[j])
-      break;
-  }
-
-  memcpy(plaintext, ciphertext, ciphertext_len);
-  aes_ctr_xcrypt(w, cb, plaintext, ciphertext_len);
+  cb[15]++;
 
+  memmove(plaintext, ciphertext, ciphertext_len);
+  aes_ctr32_xcrypt(ctx->w, cb, plaintext, ciphertext_len);
   return true;
 }
+
+bool aes_gcm_encrypt(const uint8_t *key, const uint8_t *iv,
+                     const uint8_t *plaintext, size_t plaintext_len,
+                     uint8_t *ciphertext, uint8_t *tag) {
+  aes_gcm_ctx_t ctx;
+  aes_gcm_ctx_init(&ctx, key);
+  bool ok = aes_gcm_ctx_encrypt(&ctx, iv, NULL, 0, plaintext, plaintext_len,
+                                ciphertext, tag);
+  aes_gcm_ctx_wipe(&ctx);
+  return ok;
+}
+
+bool aes_gcm_decrypt(const uint8_t *key, const uint8_t *iv,
+                     const uint8_t *ciphertext, size_t ciphertext_len,
+                     const uint8_t *tag, uint8_t *plaintext) {
+  aes_gcm_ctx_t ctx;
+  aes_gcm_ctx_init(&ctx, key);
+  bool ok = aes_gcm_ctx_decrypt(&ctx, iv, NULL, 0, ciphertext, ciphertext_len,
+                                tag, plaintext);
+  aes_gcm_ctx_wipe(&ctx);
+  return ok;
+}
@@ -6,8 +6,82 @@
 #include <stdint.h>
 
 
+// GHASH multiplier, selected at build time with AES_GCM_GHASH:
+//   AES_GCM_GHASH_BITWISE  Reference bit-serial loop (slowest)
+//   AES_GCM_GHASH_TABLE4   4-bit Shoup tables, 256 bytes per key. Indexes
+//                          tables with key-dependent values.
+//   AES_GCM_GHASH_CT32     Constant-time 32x32 carry-less multiply built
+//                          from integer multiplies (default)
+#define AES_GCM_GHASH_BITWISE 0
+#define AES_GCM_GHASH_TABLE4 1
+#define AES_GCM_GHASH_CT32 2
+
+#ifndef AES_GCM_GHASH
+#define AES_GCM_GHASH AES_GCM_GHASH_CT32
+#endif
+
+// Precomputed per-key state: the expanded round keys and the GHASH key.
+// Keep instances in secure SRAM and wipe them with aes_gcm_ctx_wipe().
+typedef struct {
+  uint8_t w[240]; // AES-256 round keys
+  uint8_t h[16];  // GHASH key H = E(K, 0^128)
+#if AES_GCM_GHASH == AES_GCM_GHASH_TABLE4
+  uint64_t hh[16]; // Multiples of H by every 4-bit value, high halves
+  uint64_t hl[16]; // ... and low halves
+#elif AES_GCM_GHASH == AES_GCM_GHASH_CT32
+  uint32_t hw[4]; // H as big-endian words, most significant first
+#endif
+  bool ready;
+} aes_gcm_ctx_t;
+
+/**
+ * @brief Expand `key` into a reusable context
+ * @param ctx Context to initialise
+ * @param key Encryption key (32 bytes for AES-256)
+ */
+void aes_gcm_ctx_init(aes_gcm_ctx_t *ctx, const uint8_t *key);
+
+/**
+ * @brief Erase all key material held by a context
+ */
+void aes_gcm_ctx_wipe(aes_gcm_ctx_t *ctx);
+
+/**
+ * @brief Encrypt data with a prepared context
+ * @param ctx Context from aes_gcm_ctx_init()
+ * @param iv Initialization vector (12 bytes)
+ * @param aad Additional authenticated data (may be NULL if aad_len is 0)
+ * @param aad_len Length of aad
+ * @param plaintext Data to encrypt
+ * @param plaintext_len Length of plaintext
+ * @param ciphertext Output buffer for encrypted data
+ * @param tag Output buffer for authentication tag (16 bytes)
+ * @return true if successful
+ */
+bool aes_gcm_ctx_encrypt(const aes_gcm_ctx_t *ctx, const uint8_t *iv,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *plaintext, size_t plaintext_len,
+                         uint8_t *ciphertext, uint8_t *tag);
+
+/**
+ * @brief Decrypt data with a prepared context
+ * @param ctx Context from aes_gcm_ctx_init()
+ * @param iv Initialization vector (12 bytes)
+ * @param aad Additional authenticated data (may be NULL if aad_len is 0)
+ * @param aad_len Length of aad
+ * @param ciphertext Encrypted data
+ * @param ciphertext_len Length of ciphertext
+ * @param tag Authentication tag (16 bytes)
+ * @param plaintext Output buffer for decrypted data
+ * @return true if successful and tag matches
+ */
+bool aes_gcm_ctx_decrypt(const aes_gcm_ctx_t *ctx, const uint8_t *iv,
+                         const uint8_t *aad, size_t aad_len,
+                         const uint8_t *ciphertext, size_t ciphertext_len,
+                         const uint8_t *tag, uint8_t *plaintext);
+
 /**
- * @brief Encrypt data using AES-GCM
+ * @brief Encrypt data using AES-GCM (one-shot, expands the key per call)
  * @param key Encryption key (32 bytes for AES-256)
  * @param iv Initialization vector (12 bytes)
  * @param plaintext Data to encrypt
@@ -21,7 +95,7 @@ bool aes_gcm_encrypt(const uint8_t *key, const uint8_t *iv,
                      uint8_t *ciphertext, uint8_t *tag);
 
 /**
- * @brief Decrypt data using AES-GCM
+ * @brief Decrypt data using AES-GCM (one-shot, expands the key per call)
  * @param key Encryption key (32 bytes for AES-256)
  * @param iv Initialization vector (12 bytes)
  * @param ciphertext Encrypted data
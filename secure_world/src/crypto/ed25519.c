@@ -0,0 +1,658 @@
+#include "ed25519.h"
+#include "sha512.h"
+#include <string.h>
+
+/**
+ * @file ed25519.c
+ * @brief Ed25519 signing for 32-bit cores with a single-cycle 32x32->64
+ * multiplier (Cortex-M33).
+ *
+ * Field elements mod p = 2^255 - 19 use ten signed limbs in radix 2^25.5
+ * (alternately 26 and 25 bits). A product is 100 SMLAL-friendly 32x32->64
+ * multiply-accumulates with the 19 * 2^255 wrap folded into the operands,
+ * and the limbs leave enough headroom that additions and subtractions need
+ * no carry propagation.
+ *
+ * Scalar multiplication by the base point uses 32 x 8 precomputed multiples
+ * (ed25519_base_table.inc) and signed radix-16 digits: 64 mixed additions and
+ * 4 doublings, each table lookup reading all eight candidates of a row.
+ * Scalars mod L use 21-bit limbs. Only signing is implemented; the device
+ * never verifies Ed25519 signatures.
+ */
+
+typedef int32_t fe[10];
+
+typedef struct {
+  fe X, Y, Z;
+} ge_p2;
+
+typedef struct {
+  fe X, Y, Z, T;
+} ge_p3;
+
+typedef struct {
+  fe X, Y, Z, T;
+} ge_p1p1;
+
+typedef struct {
+  fe yplusx, yminusx, xy2d;
+} ge_precomp;
+
+#include "ed25519_base_table.inc"
+
+static void wipe(void *buf, size_t len) {
+  volatile uint8_t *p = buf;
+  while (len--)
+    *p++ = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Field arithmetic mod 2^255 - 19
+// ---------------------------------------------------------------------------
+
+static void fe_0(fe h) { memset(h, 0, sizeof(fe)); }
+
+static void fe_1(fe h) {
+  fe_0(h);
+  h[0] = 1;
+}
+
+static void fe_copy(fe h, const fe f) { memcpy(h, f, sizeof(fe)); }
+
+static void fe_add(fe h, const fe f, const fe g) {
+  for (int i = 0; i < 10; i++)
+    h[i] = f[i] + g[i];
+}
+
+static void fe_sub(fe h, const fe f, const fe g) {
+  for (int i = 0; i < 10; i++)
+    h[i] = f[i] - g[i];
+}
+
+static void fe_neg(fe h, const fe f) {
+  for (int i = 0; i < 10; i++)
+    h[i] = -f[i];
+}
+
+// h = b ? g : h, for b in {0, 1}, without branching on b
+static void fe_cmov(fe h, const fe g, uint32_t b) {
+  int32_t mask = -(int32_t)b;
+  for (int i = 0; i < 10; i++)
+    h[i] ^= (h[i] ^ g[i]) & mask;
+}
+
+// Carries the 64-bit column sums into ten limbs of at most 26 / 25 bits
+// (plus a small excess in h1)
+static void fe_carry(fe h, int64_t *c) {
+  int64_t carry;
+
+  carry = (c[0] + (1 << 25)) >> 26;
+  c[1] += carry;
+  c[0] -= carry * (1 << 26);
+  carry = (c[4] + (1 << 25)) >> 26;
+  c[5] += carry;
+  c[4] -= carry * (1 << 26);
+
+  carry = (c[1] + (1 << 24)) >> 25;
+  c[2] += carry;
+  c[1] -= carry * (1 << 25);
+  carry = (c[5] + (1 << 24)) >> 25;
+  c[6] += carry;
+  c[5] -= carry * (1 << 25);
+
+  carry = (c[2] + (1 << 25)) >> 26;
+  c[3] += carry;
+  c[2] -= carry * (1 << 26);
+  carry = (c[6] + (1 << 25)) >> 26;
+  c[7] += carry;
+  c[6] -= carry * (1 << 26);
+
+  carry = (c[3] + (1 << 24)) >> 25;
+  c[4] += carry;
+  c[3] -= carry * (1 << 25);
+  carry = (c[7] + (1 << 24)) >> 25;
+  c[8] += carry;
+  c[7] -= carry * (1 << 25);
+
+  carry = (c[4] + (1 << 25)) >> 26;
+  c[5] += carry;
+  c[4] -= carry * (1 << 26);
+  carry = (c[8] + (1 << 25)) >> 26;
+  c[9] += carry;
+  c[8] -= carry * (1 << 26);
+
+  carry = (c[9] + (1 << 24)) >> 25;
+  c[0] += carry * 19;
+  c[9] -= carry * (1 << 25);
+
+  carry = (c[0] + (1 << 25)) >> 26;
+  c[1] += carry;
+  c[0] -= carry * (1 << 26);
+
+  for (int i = 0; i < 10; i++)
+    h[i] = (int32_t)c[i];
+}
+
+static void fe_mul(fe h, const fe f, const fe g) {
+  int32_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  int32_t f5 = f[5], f6 = f[6], f7 = f[7], f8 = f[8], f9 = f[9];
+  int32_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+  int32_t g5 = g[5], g6 = g[6], g7 = g[7], g8 = g[8], g9 = g[9];
+  // Limb k sits at 2^ceil(25.5 k): odd x odd products carry an extra factor
+  // of 2, and columns past limb 9 wrap around times 19.
+  int32_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3;
+  int32_t g4_19 = 19 * g4, g5_19 = 19 * g5, g6_19 = 19 * g6;
+  int32_t g7_19 = 19 * g7, g8_19 = 19 * g8, g9_19 = 19 * g9;
+  int32_t f1_2 = 2 * f1, f3_2 = 2 * f3, f5_2 = 2 * f5;
+  int32_t f7_2 = 2 * f7, f9_2 = 2 * f9;
+  int64_t c[10];
+
+  c[0] = (int64_t)f0 * g0 + (int64_t)f1_2 * g9_19 + (int64_t)f2 * g8_19 +
+         (int64_t)f3_2 * g7_19 + (int64_t)f4 * g6_19 + (int64_t)f5_2 * g5_19 +
+         (int64_t)f6 * g4_19 + (int64_t)f7_2 * g3_19 + (int64_t)f8 * g2_19 +
+         (int64_t)f9_2 * g1_19;
+  c[1] = (int64_t)f0 * g1 + (int64_t)f1 * g0 + (int64_t)f2 * g9_19 +
+         (int64_t)f3 * g8_19 + (int64_t)f4 * g7_19 + (int64_t)f5 * g6_19 +
+         (int64_t)f6 * g5_19 + (int64_t)f7 * g4_19 + (int64_t)f8 * g3_19 +
+         (int64_t)f9 * g2_19;
+  c[2] = (int64_t)f0 * g2 + (int64_t)f1_2 * g1 + (int64_t)f2 * g0 +
+         (int64_t)f3_2 * g9_19 + (int64_t)f4 * g8_19 + (int64_t)f5_2 * g7_19 +
+         (int64_t)f6 * g6_19 + (int64_t)f7_2 * g5_19 + (int64_t)f8 * g4_19 +
+         (int64_t)f9_2 * g3_19;
+  c[3] = (int64_t)f0 * g3 + (int64_t)f1 * g2 + (int64_t)f2 * g1 +
+         (int64_t)f3 * g0 + (int64_t)f4 * g9_19 + (int64_t)f5 * g8_19 +
+         (int64_t)f6 * g7_19 + (int64_t)f7 * g6_19 + (int64_t)f8 * g5_19 +
+         (int64_t)f9 * g4_19;
+  c[4] = (int64_t)f0 * g4 + (int64_t)f1_2 * g3 + (int64_t)f2 * g2 +
+         (int64_t)f3_2 * g1 + (int64_t)f4 * g0 + (int64_t)f5_2 * g9_19 +
+         (int64_t)f6 * g8_19 + (int64_t)f7_2 * g7_19 + (int64_t)f8 * g6_19 +
+         (int64_t)f9_2 * g5_19;
+  c[5] = (int64_t)f0 * g5 + (int64_t)f1 * g4 + (int64_t)f2 * g3 +
+         (int64_t)f3 * g2 + (int64_t)f4 * g1 + (int64_t)f5 * g0 +
+         (int64_t)f6 * g9_19 + (int64_t)f7 * g8_19 + (int64_t)f8 * g7_19 +
+         (int64_t)f9 * g6_19;
+  c[6] = (int64_t)f0 * g6 + (int64_t)f1_2 * g5 + (int64_t)f2 * g4 +
+         (int64_t)f3_2 * g3 + (int64_t)f4 * g2 + (int64_t)f5_2 * g1 +
+         (int64_t)f6 * g0 + (int64_t)f7_2 * g9_19 + (int64_t)f8 * g8_19 +
+         (int64_t)f9_2 * g7_19;
+  c[7] = (int64_t)f0 * g7 + (int64_t)f1 * g6 + (int64_t)f2 * g5 +
+         (int64_t)f3 * g4 + (int64_t)f4 * g3 + (int64_t)f5 * g2 +
+         (int64_t)f6 * g1 + (int64_t)f7 * g0 + (int64_t)f8 * g9_19 +
+         (int64_t)f9 * g8_19;
+  c[8] = (int64_t)f0 * g8 + (int64_t)f1_2 * g7 + (int64_t)f2 * g6 +
+         (int64_t)f3_2 * g5 + (int64_t)f4 * g4 + (int64_t)f5_2 * g3 +
+         (int64_t)f6 * g2 + (int64_t)f7_2 * g1 + (int64_t)f8 * g0 +
+         (int64_t)f9_2 * g9_19;
+  c[9] = (int64_t)f0 * g9 + (int64_t)f1 * g8 + (int64_t)f2 * g7 +
+         (int64_t)f3 * g6 + (int64_t)f4 * g5 + (int64_t)f5 * g4 +
+         (int64_t)f6 * g3 + (int64_t)f7 * g2 + (int64_t)f8 * g1 +
+         (int64_t)f9 * g0;
+
+  fe_carry(h, c);
+}
+
+// h = f^2, or 2 f^2 when dbl is set. The symmetric products are computed
+// once and doubled, 55 multiplications instead of 100.
+static void fe_sq_common(fe h, const fe f, int dbl) {
+  int32_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  int32_t f5 = f[5], f6 = f[6], f7 = f[7], f8 = f[8], f9 = f[9];
+  int32_t f0_2 = 2 * f0, f1_2 = 2 * f1, f2_2 = 2 * f2, f3_2 = 2 * f3;
+  int32_t f4_2 = 2 * f4, f5_2 = 2 * f5, f6_2 = 2 * f6, f7_2 = 2 * f7;
+  int32_t f5_38 = 38 * f5, f6_19 = 19 * f6, f7_38 = 38 * f7;
+  int32_t f8_19 = 19 * f8, f9_38 = 38 * f9;
+  int64_t c[10];
+
+  c[0] = (int64_t)f0 * f0 + (int64_t)f1_2 * f9_38 + (int64_t)f2_2 * f8_19 +
+         (int64_t)f3_2 * f7_38 + (int64_t)f4_2 * f6_19 + (int64_t)f5 * f5_38;
+  c[1] = (int64_t)f0_2 * f1 + (int64_t)f2 * f9_38 + (int64_t)f3_2 * f8_19 +
+         (int64_t)f4 * f7_38 + (int64_t)f5_2 * f6_19;
+  c[2] = (int64_t)f0_2 * f2 + (int64_t)f1_2 * f1 + (int64_t)f3_2 * f9_38 +
+         (int64_t)f4_2 * f8_19 + (int64_t)f5_2 * f7_38 + (int64_t)f6 * f6_19;
+  c[3] = (int64_t)f0_2 * f3 + (int64_t)f1_2 * f2 + (int64_t)f4 * f9_38 +
+         (int64_t)f5_2 * f8_19 + (int64_t)f6 * f7_38;
+  c[4] = (int64_t)f0_2 * f4 + (int64_t)f1_2 * f3_2 + (int64_t)f2 * f2 +
+         (int64_t)f5_2 * f9_38 + (int64_t)f6_2 * f8_19 + (int64_t)f7 * f7_38;
+  c[5] = (int64_t)f0_2 * f5 + (int64_t)f1_2 * f4 + (int64_t)f2_2 * f3 +
+         (int64_t)f6 * f9_38 + (int64_t)f7_2 * f8_19;
+  c[6] = (int64_t)f0_2 * f6 + (int64_t)f1_2 * f5_2 + (int64_t)f2_2 * f4 +
+         (int64_t)f3_2 * f3 + (int64_t)f7_2 * f9_38 + (int64_t)f8 * f8_19;
+  c[7] = (int64_t)f0_2 * f7 + (int64_t)f1_2 * f6 + (int64_t)f2_2 * f5 +
+         (int64_t)f3_2 * f4 + (int64_t)f8 * f9_38;
+  c[8] = (int64_t)f0_2 * f8 + (int64_t)f1_2 * f7_2 + (int64_t)f2_2 * f6 +
+         (int64_t)f3_2 * f5_2 + (int64_t)f4 * f4 + (int64_t)f9 * f9_38;
+  c[9] = (int64_t)f0_2 * f9 + (int64_t)f1_2 * f8 + (int64_t)f2_2 * f7 +
+         (int64_t)f3_2 * f6 + (int64_t)f4_2 * f5;
+
+  if (dbl) {
+    for (int i = 0; i < 10; i++)
+      c[i] += c[i];
+  }
+  fe_carry(h, c);
+}
+
+static void fe_sq(fe h, const fe f) { fe_sq_common(h, f, 0); }
+
+static void fe_sq2(fe h, const fe f) { fe_sq_common(h, f, 1); }
+
+// h = f^(2^n), n >= 1
+static void fe_sq_n(fe h, const fe f, int n) {
+  fe_sq(h, f);
+  while (--n)
+    fe_sq(h, h);
+}
+
+// Limb k covers bits [ceil(25.5 k), ceil(25.5 (k + 1))) of the 255-bit value
+static const uint8_t fe_limb_shift[10] = {0,   26,  51,  77,  102,
+                                          128, 153, 179, 204, 230};
+
+// Unpacks a 255-bit little-endian value (bit 255 ignored) given as words
+static void fe_from_words(fe h, const uint32_t *w) {
+  for (int i = 0; i < 10; i++) {
+    int shift = fe_limb_shift[i];
+    int width = (i & 1) ? 25 : 26;
+    int word = shift >> 5;
+    uint64_t v = w[word];
+    if (word < 7)
+      v |= (uint64_t)w[word + 1] << 32;
+    h[i] = (int32_t)((v >> (shift & 31)) & ((1u << width) - 1));
+  }
+}
+
+// Fully reduces h mod p and packs it little-endian
+static void fe_tobytes(uint8_t *s, const fe h) {
+  int32_t t[10];
+  int32_t q, carry;
+  uint64_t acc = 0;
+  int bits = 0;
+
+  // q = floor(h / p), 0 or 1 for a carried element
+  q = (19 * h[9] + (1 << 24)) >> 25;
+  for (int i = 0; i < 10; i++)
+    q = (h[i] + q) >> ((i & 1) ? 25 : 26);
+
+  // h - q p = h + 19 q - q 2^255, the last term dropped with the top carry
+  memcpy(t, h, sizeof(t));
+  t[0] += 19 * q;
+  for (int i = 0; i < 9; i++) {
+    int width = (i & 1) ? 25 : 26;
+    carry = t[i] >> width;
+    t[i + 1] += carry;
+    t[i] -= carry * (1 << width);
+  }
+  t[9] &= (1 << 25) - 1;
+
+  for (int i = 0; i < 10; i++) {
+    acc |= (uint64_t)(uint32_t)t[i] << bits;
+    bits += (i & 1) ? 25 : 26;
+    while (bits >= 8) {
+      *s++ = (uint8_t)acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  *s = (uint8_t)acc;
+}
+
+static int fe_isnegative(const fe f) {
+  uint8_t s[32];
+  fe_tobytes(s, f);
+  return s[0] & 1;
+}
+
+// out = z^(p - 2) = 1 / z: 254 squarings and 11 multiplications
+static void fe_invert(fe out, const fe z) {
+  fe t0, t1, t2, t3;
+
+  fe_sq(t0, z);            // z^2
+  fe_sq_n(t1, t0, 2);      // z^8
+  fe_mul(t1, z, t1);       // z^9
+  fe_mul(t0, t0, t1);      // z^11
+  fe_sq(t2, t0);           // z^22
+  fe_mul(t1, t1, t2);      // z^(2^5 - 1)
+  fe_sq_n(t2, t1, 5);
+  fe_mul(t1, t2, t1);      // z^(2^10 - 1)
+  fe_sq_n(t2, t1, 10);
+  fe_mul(t2, t2, t1);      // z^(2^20 - 1)
+  fe_sq_n(t3, t2, 20);
+  fe_mul(t2, t3, t2);      // z^(2^40 - 1)
+  fe_sq_n(t2, t2, 10);
+  fe_mul(t1, t2, t1);      // z^(2^50 - 1)
+  fe_sq_n(t2, t1, 50);
+  fe_mul(t2, t2, t1);      // z^(2^100 - 1)
+  fe_sq_n(t3, t2, 100);
+  fe_mul(t2, t3, t2);      // z^(2^200 - 1)
+  fe_sq_n(t2, t2, 50);
+  fe_mul(t1, t2, t1);      // z^(2^250 - 1)
+  fe_sq_n(t1, t1, 5);
+  fe_mul(out, t1, t0);     // z^(2^255 - 21)
+}
+
+// ---------------------------------------------------------------------------
+// Group arithmetic (twisted Edwards, extended coordinates)
+// ---------------------------------------------------------------------------
+
+static void ge_p1p1_to_p2(ge_p2 *r, const ge_p1p1 *p) {
+  fe_mul(r->X, p->X, p->T);
+  fe_mul(r->Y, p->Y, p->Z);
+  fe_mul(r->Z, p->Z, p->T);
+}
+
+static void ge_p1p1_to_p3(ge_p3 *r, const ge_p1p1 *p) {
+  fe_mul(r->X, p->X, p->T);
+  fe_mul(r->Y, p->Y, p->Z);
+  fe_mul(r->Z, p->Z, p->T);
+  fe_mul(r->T, p->X, p->Y);
+}
+
+static void ge_p3_0(ge_p3 *h) {
+  fe_0(h->X);
+  fe_1(h->Y);
+  fe_1(h->Z);
+  fe_0(h->T);
+}
+
+// r = 2 p
+static void ge_p2_dbl(ge_p1p1 *r, const ge_p2 *p) {
+  fe t0;
+
+  fe_sq(r->X, p->X);
+  fe_sq(r->Z, p->Y);
+  fe_sq2(r->T, p->Z);
+  fe_add(r->Y, p->X, p->Y);
+  fe_sq(t0, r->Y);
+  fe_add(r->Y, r->Z, r->X);
+  fe_sub(r->Z, r->Z, r->X);
+  fe_sub(r->X, t0, r->Y);
+  fe_sub(r->T, r->T, r->Z);
+}
+
+// r = p + q, q affine
+static void ge_madd(ge_p1p1 *r, const ge_p3 *p, const ge_precomp *q) {
+  fe t0;
+
+  fe_add(r->X, p->Y, p->X);
+  fe_sub(r->Y, p->Y, p->X);
+  fe_mul(r->Z, r->X, q->yplusx);
+  fe_mul(r->Y, r->Y, q->yminusx);
+  fe_mul(r->T, q->xy2d, p->T);
+  fe_add(t0, p->Z, p->Z);
+  fe_sub(r->X, r->Z, r->Y);
+  fe_add(r->Y, r->Z, r->Y);
+  fe_add(r->Z, t0, r->T);
+  fe_sub(r->T, t0, r->T);
+}
+
+static void ge_p3_tobytes(uint8_t *s, const ge_p3 *h) {
+  fe recip, x, y;
+
+  fe_invert(recip, h->Z);
+  fe_mul(x, h->X, recip);
+  fe_mul(y, h->Y, recip);
+  fe_tobytes(s, y);
+  s[31] ^= fe_isnegative(x) << 7;
+}
+
+// t = b * 256^pos * B for -8 <= b <= 8. Every entry of the row is read and
+// the sign is applied by a conditional move, so neither the digit nor its
+// sign shows in the memory access pattern.
+static void ge_select(ge_precomp *t, int pos, int8_t b) {
+  uint32_t packed[24];
+  int32_t bi = b;
+  uint32_t negative = (uint32_t)bi >> 31;
+  uint32_t babs = (uint32_t)(bi - 2 * (-(int32_t)negative & bi));
+  fe minus;
+
+  // Identity: y + x = y - x = 1, 2dxy = 0
+  memset(packed, 0, sizeof(packed));
+  packed[0] = 1;
+  packed[8] = 1;
+  for (uint32_t j = 0; j < 8; j++) {
+    uint32_t diff = babs ^ (j + 1);
+    uint32_t mask = ((diff | (0 - diff)) >> 31) - 1; // All ones when equal
+    for (int i = 0; i < 24; i++)
+      packed[i] ^= (packed[i] ^ ed25519_base[pos][j][i]) & mask;
+  }
+  fe_from_words(t->yplusx, packed);
+  fe_from_words(t->yminusx, packed + 8);
+  fe_from_words(t->xy2d, packed + 16);
+
+  // -P swaps y + x and y - x and negates 2dxy
+  fe_copy(minus, t->yplusx);
+  fe_cmov(t->yplusx, t->yminusx, negative);
+  fe_cmov(t->yminusx, minus, negative);
+  fe_neg(minus, t->xy2d);
+  fe_cmov(t->xy2d, minus, negative);
+}
+
+// h = a * B, a[31] <= 127. Not inlined, like sc_reduce and sc_muladd, so
+// their frames do not add up in ed25519_sign's.
+__attribute__((noinline)) static void ge_scalarmult_base(ge_p3 *h, const uint8_t *a) {
+  int8_t e[64];
+  int8_t carry = 0;
+  ge_p1p1 r;
+  ge_p2 s;
+  ge_precomp t;
+
+  for (int i = 0; i < 32; i++) {
+    e[2 * i] = a[i] & 15;
+    e[2 * i + 1] = (a[i] >> 4) & 15;
+  }
+  // Recode to signed digits in [-8, 8)
+  for (int i = 0; i < 63; i++) {
+    e[i] += carry;
+    carry = (e[i] + 8) >> 4;
+    e[i] -= carry * 16;
+  }
+  e[63] += carry;
+
+  // Odd digits first, shifted up by 16 with four doublings, then even ones
+  ge_p3_0(h);
+  for (int i = 1; i < 64; i += 2) {
+    ge_select(&t, i / 2, e[i]);
+    ge_madd(&r, h, &t);
+    ge_p1p1_to_p3(h, &r);
+  }
+
+  memcpy(&s, h, sizeof(s)); // p3 to p2: drop T
+  ge_p2_dbl(&r, &s);
+  ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s);
+  ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s);
+  ge_p1p1_to_p2(&s, &r);
+  ge_p2_dbl(&r, &s);
+  ge_p1p1_to_p3(h, &r);
+
+  for (int i = 0; i < 64; i += 2) {
+    ge_select(&t, i / 2, e[i]);
+    ge_madd(&r, h, &t);
+    ge_p1p1_to_p3(h, &r);
+  }
+
+  wipe(e, sizeof(e));
+  wipe(&t, sizeof(t));
+}
+
+// ---------------------------------------------------------------------------
+// Scalars mod L = 2^252 + 27742317777372353535851937790883648493
+// ---------------------------------------------------------------------------
+
+// 2^252 = -(27742317777372353535851937790883648493) mod L, as signed 21-bit
+// limbs
+static const int32_t sc_fold[6] = {666643, 470296,  654183,
+                                   -997805, 136657, -683901};
+
+// Splits len bytes into 21-bit limbs; the last limb keeps the top bits
+static void sc_load(int64_t *limbs, int count, const uint8_t *s, int len) {
+  for (int i = 0; i < count; i++) {
+    int shift = 21 * i;
+    int byte = shift >> 3;
+    uint32_t v = 0;
+    for (int k = 0; k < 4 && byte + k < len; k++)
+      v |= (uint32_t)s[byte + k] << (8 * k);
+    v >>= shift & 7;
+    limbs[i] = (i == count - 1) ? v : v & ((1 << 21) - 1);
+  }
+}
+
+// Replaces limb i (weight 2^(21 i)) by its fold into limbs i - 12 .. i - 7
+static void sc_fold_limb(int64_t *s, int i) {
+  for (int k = 0; k < 6; k++)
+    s[i - 12 + k] += s[i] * sc_fold[k];
+  s[i] = 0;
+}
+
+// Rounded carry: leaves limb i in [-2^20, 2^20)
+static void sc_carry_round(int64_t *s, int i) {
+  int64_t carry = (s[i] + (1 << 20)) >> 21;
+  s[i + 1] += carry;
+  s[i] -= carry * (1 << 21);
+}
+
+// Floor carry: leaves limb i in [0, 2^21)
+static void sc_carry_floor(int64_t *s, int i) {
+  int64_t carry = s[i] >> 21;
+  s[i + 1] += carry;
+  s[i] -= carry * (1 << 21);
+}
+
+// Reduces 24 limbs (up to 2^512) mod L into 32 little-endian bytes
+static void sc_reduce_limbs(uint8_t *out, int64_t *s) {
+  uint64_t acc = 0;
+  int bits = 0;
+  int i;
+
+  for (i = 23; i >= 18; i--)
+    sc_fold_limb(s, i);
+  for (i = 6; i <= 16; i += 2)
+    sc_carry_round(s, i);
+  for (i = 7; i <= 15; i += 2)
+    sc_carry_round(s, i);
+
+  for (i = 17; i >= 12; i--)
+    sc_fold_limb(s, i);
+  for (i = 0; i <= 10; i += 2)
+    sc_carry_round(s, i);
+  for (i = 1; i <= 11; i += 2)
+    sc_carry_round(s, i);
+
+  sc_fold_limb(s, 12);
+  for (i = 0; i <= 11; i++)
+    sc_carry_floor(s, i);
+
+  sc_fold_limb(s, 12);
+  for (i = 0; i <= 10; i++)
+    sc_carry_floor(s, i);
+
+  for (i = 0; i < 12; i++) {
+    acc |= (uint64_t)s[i] << bits;
+    bits += 21;
+    while (bits >= 8) {
+      *out++ = (uint8_t)acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  *out = (uint8_t)acc;
+}
+
+// s = s mod L for a 64-byte s; the result is in the first 32 bytes
+__attribute__((noinline)) static void sc_reduce(uint8_t *s) {
+  int64_t limbs[24];
+  sc_load(limbs, 24, s, 64);
+  sc_reduce_limbs(s, limbs);
+  wipe(limbs, sizeof(limbs));
+}
+
+// s = (a b + c) mod L
+__attribute__((noinline)) static void sc_muladd(uint8_t *s, const uint8_t *a, const uint8_t *b,
+                      const uint8_t *c) {
+  int64_t al[12], bl[12], limbs[24];
+  int i;
+
+  sc_load(al, 12, a, 32);
+  sc_load(bl, 12, b, 32);
+  sc_load(limbs, 12, c, 32);
+  for (i = 12; i < 24; i++)
+    limbs[i] = 0;
+  for (i = 0; i < 12; i++) {
+    for (int j = 0; j < 12; j++)
+      limbs[i + j] += al[i] * bl[j];
+  }
+
+  for (i = 0; i <= 22; i += 2)
+    sc_carry_round(limbs, i);
+  for (i = 1; i <= 21; i += 2)
+    sc_carry_round(limbs, i);
+  sc_reduce_limbs(s, limbs);
+
+  wipe(al, sizeof(al));
+  wipe(bl, sizeof(bl));
+  wipe(limbs, sizeof(limbs));
+}
+
+// ---------------------------------------------------------------------------
+// Ed25519
+// ---------------------------------------------------------------------------
+
+// az = SHA-512(seed) with the scalar half clamped
+static void expand_seed(uint8_t *az, const uint8_t *seed) {
+  SHA512_CTX ctx;
+
+  SHA512Init(&ctx);
+  SHA512Update(&ctx, seed, ED25519_SEED_SIZE);
+  SHA512Final(&ctx, az);
+  wipe(&ctx, sizeof(ctx));
+  az[0] &= 248;
+  az[31] &= 63;
+  az[31] |= 64;
+}
+
+void ed25519_public_key(uint8_t *public_key, const uint8_t *seed) {
+  uint8_t az[64];
+  ge_p3 A;
+
+  expand_seed(az, seed);
+  ge_scalarmult_base(&A, az);
+  ge_p3_tobytes(public_key, &A);
+  wipe(az, sizeof(az));
+  wipe(&A, sizeof(A));
+}
+
+void ed25519_sign(uint8_t *signature, const uint8_t *message,
+                  size_t message_len, const uint8_t *seed,
+                  const uint8_t *public_key) {
+  SHA512_CTX ctx;
+  uint8_t az[64];
+  uint8_t h[64];  // The nonce hash, then k
+  uint8_t rs[64]; // R || S, copied out last so signature may alias message
+  ge_p3 R;
+
+  expand_seed(az, seed);
+
+  // r = SHA-512(prefix || M) mod L, kept in place of the spent prefix
+  SHA512Init(&ctx);
+  SHA512Update(&ctx, az + 32, 32);
+  SHA512Update(&ctx, message, message_len);
+  SHA512Final(&ctx, h);
+  sc_reduce(h);
+  memcpy(az + 32, h, 32);
+
+  ge_scalarmult_base(&R, az + 32);
+  ge_p3_tobytes(rs, &R);
+
+  // k = SHA-512(R || A || M) mod L, S = r + k a
+  SHA512Init(&ctx);
+  SHA512Update(&ctx, rs, 32);
+  SHA512Update(&ctx, public_key, ED25519_PUBLIC_KEY_SIZE);
+  SHA512Update(&ctx, message, message_len);
+  SHA512Final(&ctx, h);
+  sc_reduce(h);
+  sc_muladd(rs + 32, h, az, az + 32);
+  memcpy(signature, rs, sizeof(rs));
+
+  wipe(az, sizeof(az));
+  wipe(h, sizeof(h));
+  wipe(&R, sizeof(R));
+  wipe(&ctx, sizeof(ctx));
+}
@@ -0,0 +1,37 @@
+#ifndef _ED25519_H_
+#define _ED25519_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ed25519.h
+ * @brief Ed25519 (RFC 8032) key generation and signing.
+ */
+
+#define ED25519_SEED_SIZE 32
+#define ED25519_PUBLIC_KEY_SIZE 32
+#define ED25519_SIGNATURE_SIZE 64
+
+/**
+ * @brief Derives the public key of a 32-byte private key (seed).
+ *
+ * @param public_key Output buffer for the 32-byte encoded point A.
+ * @param seed The 32-byte private key.
+ */
+void ed25519_public_key(uint8_t *public_key, const uint8_t *seed);
+
+/**
+ * @brief Signs a message (PureEdDSA, no prehash).
+ *
+ * @param signature Output buffer for the 64-byte signature R || S.
+ * @param message The message to sign.
+ * @param message_len Length of the message in bytes.
+ * @param seed The 32-byte private key.
+ * @param public_key The public key of the seed, as from ed25519_public_key().
+ */
+void ed25519_sign(uint8_t *signature, const uint8_t *message,
+                  size_t message_len, const uint8_t *seed,
+                  const uint8_t *public_key);
+
+#endif // _ED25519_H_
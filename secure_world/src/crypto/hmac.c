@@ -1,80 +1,226 @@
 #include "hmac.h"
-// #include "pico/sha256_hw.h" // Missing in SDK, stubbing
-#include "libcotp/src/whmac.h"
-#include <stdio.h>
+#include "sha1.h"
+#include "sha256.h"
+#include "sha512.h"
 #include <string.h>
 
-// Dummy context for build
-typedef struct {
-  uint8_t buffer[64];
-} sha256_hw_context_t;
-
-// Dummy functions
-static void sha256_hw_init(sha256_hw_context_t *ctx) {}
-static void sha256_hw_update(sha256_hw_context_t *ctx, const uint8_t *data,
-                             size_t len) {}
-static void sha256_hw_final(sha256_hw_context_t *ctx, uint8_t *output) {
-  // Return dummy hash
-  memset(output, 0xCC, 32);
-}
+/**
+ * @file hmac.c
+ * @brief HMAC-SHA1, HMAC-SHA256 and HMAC-SHA512 (RFC 2104) on top of the
+ * software hash cores.
+ *
+ * Each HMAC is split into a precompute step, which absorbs the padded key
+ * blocks, and a resume step, which hashes the message and the inner digest
+ * starting from those states. The one-shot functions run both.
+ */
+
+void hmac_sha256_precompute(const uint8_t *key, size_t key_len,
+                            hmac_midstate_t *ms) {
+  SHA256_CTX ctx;
+  uint8_t k_pad[SHA256_BLOCK_SIZE];
+
+  memset(ms, 0, sizeof(*ms));
+  memset(k_pad, 0, sizeof(k_pad));
+  if (key_len > SHA256_BLOCK_SIZE) {
+    SHA256Init(&ctx);
+    SHA256Update(&ctx, key, key_len);
+    SHA256Final(&ctx, k_pad);
+  } else {
+    memcpy(k_pad, key, key_len);
+  }
+
+  // Inner state: H((K ^ ipad) ...
+  for (int i = 0; i < SHA256_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36;
+  SHA256Init(&ctx);
+  SHA256Update(&ctx, k_pad, SHA256_BLOCK_SIZE);
+  memcpy(ms->inner, ctx.state, sizeof(ctx.state));
 
-// Global ctx
-static sha256_hw_context_t hw_sha256_ctx;
+  // Outer state: H((K ^ opad) ... 0x36 ^ 0x5C flips ipad into opad.
+  for (int i = 0; i < SHA256_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36 ^ 0x5C;
+  SHA256Init(&ctx);
+  SHA256Update(&ctx, k_pad, SHA256_BLOCK_SIZE);
+  memcpy(ms->outer, ctx.state, sizeof(ctx.state));
 
-static void hardware_sha256(const uint8_t *data, size_t len, uint8_t *output) {
-  printf("CRYPTO: Using DUMMY SHA-256 (Stub).\n");
-  sha256_hw_init(&hw_sha256_ctx);
-  sha256_hw_update(&hw_sha256_ctx, data, len);
-  sha256_hw_final(&hw_sha256_ctx, output);
+  memset(k_pad, 0, sizeof(k_pad));
+  memset(&ctx, 0, sizeof(ctx));
 }
 
-// Inner and outer padded keys
-static uint8_t k_ipad[64];
-static uint8_t k_opad[64];
+// Restores a context that has absorbed exactly one block
+static void sha256_restore(SHA256_CTX *ctx, const uint32_t state[8]) {
+  memcpy(ctx->state, state, sizeof(ctx->state));
+  ctx->datalen = 0;
+  ctx->bitlen = SHA256_BLOCK_SIZE * 8;
+}
+
+void hmac_sha256_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                        size_t data_len, uint8_t *output) {
+  SHA256_CTX ctx;
+  uint8_t inner_hash[SHA256_DIGEST_SIZE];
+
+  sha256_restore(&ctx, ms->inner);
+  SHA256Update(&ctx, data, data_len);
+  SHA256Final(&ctx, inner_hash);
 
-#define SHA256_BLOCK_SIZE 64
-#define SHA256_DIGEST_SIZE 32
+  sha256_restore(&ctx, ms->outer);
+  SHA256Update(&ctx, inner_hash, SHA256_DIGEST_SIZE);
+  SHA256Final(&ctx, output);
 
-int whmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data,
+  memset(inner_hash, 0, sizeof(inner_hash));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+bool hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data,
                  size_t data_len, uint8_t *output) {
-  sha256_hw_context_t ctx;
-  uint8_t temp_hash[SHA256_DIGEST_SIZE];
+  hmac_midstate_t ms;
 
-  if (key_len > SHA256_BLOCK_SIZE) {
-    sha256_hw_init(&ctx);
-    sha256_hw_update(&ctx, key, key_len);
-    sha256_hw_final(&ctx, temp_hash);
-    key = temp_hash;
-    key_len = SHA256_DIGEST_SIZE;
-  }
+  if (!key || !output || (!data && data_len > 0))
+    return false;
+
+  hmac_sha256_precompute(key, key_len, &ms);
+  hmac_sha256_resume(&ms, data, data_len, output);
+  memset(&ms, 0, sizeof(ms));
+  return true;
+}
 
-  memset(k_ipad, 0, SHA256_BLOCK_SIZE);
-  memset(k_opad, 0, SHA256_BLOCK_SIZE);
-  memcpy(k_ipad, key, key_len);
-  memcpy(k_opad, key, key_len);
+void hmac_sha1_precompute(const uint8_t *key, size_t key_len,
+                          hmac_midstate_t *ms) {
+  SHA1_CTX ctx;
+  uint8_t k_pad[SHA1_BLOCK_SIZE];
 
-  for (int i = 0; i < SHA256_BLOCK_SIZE; i++) {
-    k_ipad[i] ^= 0x36;
-    k_opad[i] ^= 0x5C;
+  memset(ms, 0, sizeof(*ms));
+  memset(k_pad, 0, sizeof(k_pad));
+  if (key_len > SHA1_BLOCK_SIZE) {
+    SHA1Init(&ctx);
+    SHA1Update(&ctx, key, (uint32_t)key_len);
+    SHA1Final(k_pad, &ctx);
+  } else {
+    memcpy(k_pad, key, key_len);
   }
 
-  // Inner
-  sha256_hw_init(&ctx);
-  sha256_hw_update(&ctx, k_ipad, SHA256_BLOCK_SIZE);
-  sha256_hw_update(&ctx, data, data_len);
-  sha256_hw_final(&ctx, temp_hash);
+  for (int i = 0; i < SHA1_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36;
+  SHA1Init(&ctx);
+  SHA1Update(&ctx, k_pad, SHA1_BLOCK_SIZE);
+  memcpy(ms->inner, ctx.state, sizeof(ctx.state));
 
-  // Outer
-  sha256_hw_init(&ctx);
-  sha256_hw_update(&ctx, k_opad, SHA256_BLOCK_SIZE);
-  sha256_hw_update(&ctx, temp_hash, SHA256_DIGEST_SIZE);
-  sha256_hw_final(&ctx, output);
+  for (int i = 0; i < SHA1_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36 ^ 0x5C;
+  SHA1Init(&ctx);
+  SHA1Update(&ctx, k_pad, SHA1_BLOCK_SIZE);
+  memcpy(ms->outer, ctx.state, sizeof(ctx.state));
 
-  return 0;
+  memset(k_pad, 0, sizeof(k_pad));
+  memset(&ctx, 0, sizeof(ctx));
 }
 
-int whmac_sha1(const uint8_t *key, size_t key_len, const uint8_t *data,
+static void sha1_restore(SHA1_CTX *ctx, const uint32_t state[5]) {
+  memcpy(ctx->state, state, sizeof(ctx->state));
+  ctx->count[0] = SHA1_BLOCK_SIZE * 8;
+  ctx->count[1] = 0;
+}
+
+void hmac_sha1_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                      size_t data_len, uint8_t *output) {
+  SHA1_CTX ctx;
+  uint8_t inner_hash[SHA1_DIGEST_SIZE];
+
+  sha1_restore(&ctx, ms->inner);
+  SHA1Update(&ctx, data, (uint32_t)data_len);
+  SHA1Final(inner_hash, &ctx);
+
+  sha1_restore(&ctx, ms->outer);
+  SHA1Update(&ctx, inner_hash, SHA1_DIGEST_SIZE);
+  SHA1Final(output, &ctx);
+
+  memset(inner_hash, 0, sizeof(inner_hash));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+bool hmac_sha1(const uint8_t *key, size_t key_len, const uint8_t *data,
                size_t data_len, uint8_t *output) {
-  printf("CRYPTO: Using software HMAC-SHA1 (Stub)...\n");
-  return 0;
+  hmac_midstate_t ms;
+
+  if (!key || !output || (!data && data_len > 0))
+    return false;
+
+  hmac_sha1_precompute(key, key_len, &ms);
+  hmac_sha1_resume(&ms, data, data_len, output);
+  memset(&ms, 0, sizeof(ms));
+  return true;
+}
+
+void hmac_sha512_precompute(const uint8_t *key, size_t key_len,
+                            hmac_midstate_t *ms) {
+  SHA512_CTX ctx;
+  uint8_t k_pad[SHA512_BLOCK_SIZE];
+
+  memset(ms, 0, sizeof(*ms));
+  memset(k_pad, 0, sizeof(k_pad));
+  if (key_len > SHA512_BLOCK_SIZE) {
+    SHA512Init(&ctx);
+    SHA512Update(&ctx, key, key_len);
+    SHA512Final(&ctx, k_pad);
+  } else {
+    memcpy(k_pad, key, key_len);
+  }
+
+  for (int i = 0; i < SHA512_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36;
+  SHA512Init(&ctx);
+  SHA512Transform(ctx.state, k_pad);
+  for (int i = 0; i < 8; i++) {
+    ms->inner[2 * i] = (uint32_t)(ctx.state[i] >> 32);
+    ms->inner[2 * i + 1] = (uint32_t)ctx.state[i];
+  }
+
+  for (int i = 0; i < SHA512_BLOCK_SIZE; i++)
+    k_pad[i] ^= 0x36 ^ 0x5C;
+  SHA512Init(&ctx);
+  SHA512Transform(ctx.state, k_pad);
+  for (int i = 0; i < 8; i++) {
+    ms->outer[2 * i] = (uint32_t)(ctx.state[i] >> 32);
+    ms->outer[2 * i + 1] = (uint32_t)ctx.state[i];
+  }
+
+  memset(k_pad, 0, sizeof(k_pad));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+static void sha512_restore(SHA512_CTX *ctx, const uint32_t state[16]) {
+  for (int i = 0; i < 8; i++)
+    ctx->state[i] = ((uint64_t)state[2 * i] << 32) | state[2 * i + 1];
+  ctx->datalen = 0;
+  ctx->bitlen = SHA512_BLOCK_SIZE * 8;
+}
+
+void hmac_sha512_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                        size_t data_len, uint8_t *output) {
+  SHA512_CTX ctx;
+  uint8_t inner_hash[SHA512_DIGEST_SIZE];
+
+  sha512_restore(&ctx, ms->inner);
+  SHA512Update(&ctx, data, data_len);
+  SHA512Final(&ctx, inner_hash);
+
+  sha512_restore(&ctx, ms->outer);
+  SHA512Update(&ctx, inner_hash, SHA512_DIGEST_SIZE);
+  SHA512Final(&ctx, output);
+
+  memset(inner_hash, 0, sizeof(inner_hash));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+bool hmac_sha512(const uint8_t *key, size_t key_len, const uint8_t *data,
+                 size_t data_len, uint8_t *output) {
+  hmac_midstate_t ms;
+
+  if (!key || !output || (!data && data_len > 0))
+    return false;
+
+  hmac_sha512_precompute(key, key_len, &ms);
+  hmac_sha512_resume(&ms, data, data_len, output);
+  memset(&ms, 0, sizeof(ms));
+  return true;
 }
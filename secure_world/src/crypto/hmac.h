@@ -7,9 +7,22 @@
 
 #define SHA256_BLOCK_SIZE 64
 #define SHA256_DIGEST_SIZE 32
+#define SHA1_BLOCK_SIZE 64
+#define SHA1_DIGEST_SIZE 20
+#define SHA512_BLOCK_SIZE 128
+#define SHA512_DIGEST_SIZE 64
+
+// Hash states after compressing the key-xor-ipad and key-xor-opad blocks.
+// Holding them skips two of the four compressions of a short-message HMAC.
+// SHA-1 uses the first 5 words, SHA-256 8 and SHA-512 16 (each 64-bit state
+// word as its high then low half). Key-equivalent: wipe after use.
+typedef struct {
+  uint32_t inner[16];
+  uint32_t outer[16];
+} hmac_midstate_t;
 
 /**
- * @brief Calculates the HMAC-SHA256 of a message using the RP2350 hardware accelerator.
+ * @brief Calculates the HMAC-SHA256 of a message (software SHA-256 core).
  * 
  * @param key Pointer to the secret key.
  * @param key_len Length of the secret key in bytes.
@@ -20,4 +33,68 @@
  */
 bool hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t *output);
 
+/**
+ * @brief Calculates the HMAC-SHA1 of a message (software SHA-1 core).
+ *
+ * @param key Pointer to the secret key.
+ * @param key_len Length of the secret key in bytes.
+ * @param data Pointer to the message data.
+ * @param data_len Length of the message data in bytes.
+ * @param output Pointer to the buffer to store the 20-byte HMAC result.
+ * @return true on success, false on failure.
+ */
+bool hmac_sha1(const uint8_t *key, size_t key_len, const uint8_t *data,
+               size_t data_len, uint8_t *output);
+
+/**
+ * @brief Precomputes the HMAC-SHA256 pad states for a key.
+ */
+void hmac_sha256_precompute(const uint8_t *key, size_t key_len,
+                            hmac_midstate_t *ms);
+
+/**
+ * @brief Finishes an HMAC-SHA256 from precomputed pad states.
+ *
+ * @param output Receives the 32-byte HMAC.
+ */
+void hmac_sha256_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                        size_t data_len, uint8_t *output);
+
+/**
+ * @brief Precomputes the HMAC-SHA1 pad states for a key.
+ */
+void hmac_sha1_precompute(const uint8_t *key, size_t key_len,
+                          hmac_midstate_t *ms);
+
+/**
+ * @brief Finishes an HMAC-SHA1 from precomputed pad states.
+ *
+ * @param output Receives the 20-byte HMAC.
+ */
+void hmac_sha1_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                      size_t data_len, uint8_t *output);
+
+/**
+ * @brief Calculates the HMAC-SHA512 of a message (software SHA-512 core).
+ *
+ * @param output Pointer to the buffer to store the 64-byte HMAC result.
+ * @return true on success, false on failure.
+ */
+bool hmac_sha512(const uint8_t *key, size_t key_len, const uint8_t *data,
+                 size_t data_len, uint8_t *output);
+
+/**
+ * @brief Precomputes the HMAC-SHA512 pad states for a key.
+ */
+void hmac_sha512_precompute(const uint8_t *key, size_t key_len,
+                            hmac_midstate_t *ms);
+
+/**
+ * @brief Finishes an HMAC-SHA512 from precomputed pad states.
+ *
+ * @param output Receives the 64-byte HMAC.
+ */
+void hmac_sha512_resume(const hmac_midstate_t *ms, const uint8_t *data,
+                        size_t data_len, uint8_t *output);
+
 #endif // _HMAC_H_
@@ -0,0 +1,172 @@
+#include "sha512.h"
+#include <string.h>
+
+/**
+ * @file sha512.c
+ * @brief SHA-512 laid out for a 32-bit core without 64-bit registers.
+ *
+ * On the Cortex-M33 every 64-bit value occupies a register pair, so the
+ * transform avoids the usual eight-way variable shuffle per round: rounds
+ * are unrolled by eight and the working variables rotate by name instead.
+ * The message schedule is a 16-word ring (128 bytes of stack rather than
+ * 640), and big-endian words are loaded as two byte-reversed halves.
+ */
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define EP0(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define EP1(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define SIG0(x) (ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define SIG1(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+static const uint64_t k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+static inline uint32_t load_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+// Schedule word t (t >= 16) computed in place in the 16-word ring
+#define W(t)                                                                   \
+  (w[(t) & 15] += SIG1(w[((t) - 2) & 15]) + w[((t) - 7) & 15] +                \
+                  SIG0(w[((t) - 15) & 15]))
+
+// One round. The caller rotates the roles of a..h instead of moving values.
+#define ROUND(a, b, c, d, e, f, g, h, t, wt)                                   \
+  do {                                                                         \
+    uint64_t t1 = (h) + EP1(e) + CH(e, f, g) + k[t] + (wt);                    \
+    (d) += t1;                                                                 \
+    (h) = t1 + EP0(a) + MAJ(a, b, c);                                          \
+  } while (0)
+
+#define ROUNDS8(i, WORD)                                                       \
+  do {                                                                         \
+    ROUND(a, b, c, d, e, f, g, h, (i) + 0, WORD((i) + 0));                     \
+    ROUND(h, a, b, c, d, e, f, g, (i) + 1, WORD((i) + 1));                     \
+    ROUND(g, h, a, b, c, d, e, f, (i) + 2, WORD((i) + 2));                     \
+    ROUND(f, g, h, a, b, c, d, e, (i) + 3, WORD((i) + 3));                     \
+    ROUND(e, f, g, h, a, b, c, d, (i) + 4, WORD((i) + 4));                     \
+    ROUND(d, e, f, g, h, a, b, c, (i) + 5, WORD((i) + 5));                     \
+    ROUND(c, d, e, f, g, h, a, b, (i) + 6, WORD((i) + 6));                     \
+    ROUND(b, c, d, e, f, g, h, a, (i) + 7, WORD((i) + 7));                     \
+  } while (0)
+
+#define W0(t) (w[t])
+
+void SHA512Transform(uint64_t state[8], const uint8_t data[128]) {
+  uint64_t w[16];
+  uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (int i = 0; i < 16; i++)
+    w[i] = load_be64(data + 8 * i);
+
+  ROUNDS8(0, W0);
+  ROUNDS8(8, W0);
+  for (int i = 16; i < 80; i += 8)
+    ROUNDS8(i, W);
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+  memset(w, 0, sizeof(w));
+}
+
+void SHA512Init(SHA512_CTX *ctx) {
+  ctx->datalen = 0;
+  ctx->bitlen = 0;
+  ctx->state[0] = 0x6a09e667f3bcc908ULL;
+  ctx->state[1] = 0xbb67ae8584caa73bULL;
+  ctx->state[2] = 0x3c6ef372fe94f82bULL;
+  ctx->state[3] = 0xa54ff53a5f1d36f1ULL;
+  ctx->state[4] = 0x510e527fade682d1ULL;
+  ctx->state[5] = 0x9b05688c2b3e6c1fULL;
+  ctx->state[6] = 0x1f83d9abfb41bd6bULL;
+  ctx->state[7] = 0x5be0cd19137e2179ULL;
+}
+
+void SHA512Update(SHA512_CTX *ctx, const uint8_t *data, size_t len) {
+  // Top up a partial block first, then hash whole blocks in place
+  if (ctx->datalen > 0) {
+    size_t n = sizeof(ctx->data) - ctx->datalen;
+    if (n > len)
+      n = len;
+    memcpy(ctx->data + ctx->datalen, data, n);
+    ctx->datalen += (uint32_t)n;
+    data += n;
+    len -= n;
+    if (ctx->datalen < sizeof(ctx->data))
+      return;
+    SHA512Transform(ctx->state, ctx->data);
+    ctx->bitlen += 1024;
+    ctx->datalen = 0;
+  }
+
+  while (len >= sizeof(ctx->data)) {
+    SHA512Transform(ctx->state, data);
+    ctx->bitlen += 1024;
+    data += sizeof(ctx->data);
+    len -= sizeof(ctx->data);
+  }
+
+  memcpy(ctx->data, data, len);
+  ctx->datalen = (uint32_t)len;
+}
+
+void SHA512Final(SHA512_CTX *ctx, uint8_t hash[64]) {
+  uint32_t i = ctx->datalen;
+
+  ctx->bitlen += (uint64_t)ctx->datalen * 8;
+  ctx->data[i++] = 0x80;
+  if (i > 112) {
+    memset(ctx->data + i, 0, 128 - i);
+    SHA512Transform(ctx->state, ctx->data);
+    i = 0;
+  }
+  // 128-bit length field; the upper half is always zero here
+  memset(ctx->data + i, 0, 120 - i);
+  for (i = 0; i < 8; i++)
+    ctx->data[127 - i] = (uint8_t)(ctx->bitlen >> (8 * i));
+  SHA512Transform(ctx->state, ctx->data);
+
+  for (i = 0; i < 64; i++)
+    hash[i] = (uint8_t)(ctx->state[i / 8] >> (56 - 8 * (i % 8)));
+}
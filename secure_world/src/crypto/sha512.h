@@ -0,0 +1,24 @@
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file sha512.h
+ * @brief SHA-512 (FIPS 180-4) software core.
+ */
+
+typedef struct {
+  uint64_t state[8];
+  uint64_t bitlen; // Message length so far (messages stay below 2^64 bits)
+  uint8_t data[128];
+  uint32_t datalen;
+} SHA512_CTX;
+
+void SHA512Transform(uint64_t state[8], const uint8_t data[128]);
+void SHA512Init(SHA512_CTX *ctx);
+void SHA512Update(SHA512_CTX *ctx, const uint8_t *data, size_t len);
+void SHA512Final(SHA512_CTX *ctx, uint8_t hash[64]);
+
+#endif // SHA512_H
@@ -31,13 +31,18 @@
 #if (uECC_PLATFORM == uECC_arm) && (__ARM_ARCH >= 6)
 #define uECC_ARM_USE_UMAAL 1
 #elif (uECC_PLATFORM == uECC_arm_thumb2) && (__ARM_ARCH >= 6) &&               \
-    !__ARM_ARCH_7M__
+    !__ARM_ARCH_7M__ && (__ARM_ARCH_PROFILE != 'M' || __ARM_FEATURE_DSP)
 #define uECC_ARM_USE_UMAAL 1
 #else
 #define uECC_ARM_USE_UMAAL 0
 #endif
 #endif
 
+/* On M-profile cores (e.g. Cortex-M33) UMAAL is part of the DSP extension */
+#if uECC_ARM_USE_UMAAL && (__ARM_ARCH_PROFILE == 'M') && !__ARM_FEATURE_DSP
+#error "uECC_ARM_USE_UMAAL requires the DSP extension on this core"
+#endif
+
 #ifndef uECC_WORD_SIZE
 #if uECC_PLATFORM == uECC_avr
 #define uECC_WORD_SIZE 1
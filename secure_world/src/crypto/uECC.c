@@ -742,6 +742,21 @@ uECC_VLI_API void uECC_vli_modInv(uECC_word_t *result,
 
 #include "curve-specific.inc"
 
+/* Computes result = (1 / input) % curve->p for secret inputs such as the final
+   Z of a scalar multiplication. secp256r1 uses a fixed addition chain; other
+   curves fall back to uECC_vli_modInv(). */
+static void vli_modInv_secret_p(uECC_word_t *result,
+                                const uECC_word_t *input,
+                                uECC_Curve curve) {
+#if uECC_SUPPORTS_secp256r1
+    if (curve == &curve_secp256r1) {
+        vli_modInv_secp256r1(result, input);
+        return;
+    }
+#endif
+    uECC_vli_modInv(result, input, curve->p, curve->num_words);
+}
+
 /* Returns 1 if 'point' is the point at infinity, 0 otherwise. */
 #define EccPoint_isZero(point, curve) uECC_vli_isZero((point), (curve)->num_words * 2)
 
@@ -895,7 +910,7 @@ static void EccPoint_mult(uECC_word_t * result,
     uECC_vli_modSub(z, Rx[1], Rx[0], curve->p, num_words); /* X1 - X0 */
     uECC_vli_modMult_fast(z, z, Ry[1 - nb], curve);        /* Yb * (X1 - X0) */
     uECC_vli_modMult_fast(z, z, point, curve);             /* xP * Yb * (X1 - X0) */
-    uECC_vli_modInv(z, z, curve->p, num_words);            /* 1 / (xP * Yb * (X1 - X0)) */
+    vli_modInv_secret_p(z, z, curve);                      /* 1 / (xP * Yb * (X1 - X0)) */
     uECC_vli_modMult_fast(z, z, point + num_words, curve); /* yP / (xP * Yb * (X1 - X0)) */
     uECC_vli_modMult_fast(z, z, Rx[1 - nb], curve);        /* Xb * yP / (xP * Yb * (X1 - X0)) */
     /* End 1/Z calculation */
@@ -946,6 +961,10 @@ uECC_VLI_API int uECC_generate_random_int(uECC_word_t *random,
     return 0;
 }
 
+#if uECC_SUPPORTS_secp256r1 && uECC_P256_COMB
+#include "p256_comb.inc"
+#endif
+
 static uECC_word_t EccPoint_compute_public_key(uECC_word_t *result,
                                                uECC_word_t *private_key,
                                                uECC_Curve curve) {
@@ -955,6 +974,16 @@ static uECC_word_t EccPoint_compute_public_key(uECC_word_t *result,
     uECC_word_t *initial_Z = 0;
     uECC_word_t carry;
 
+#if uECC_SUPPORTS_secp256r1 && uECC_P256_COMB
+    if (curve == uECC_secp256r1()) {
+        /* The comb runs a fixed number of columns whatever the leading zeros */
+        if (!p256_comb_mult(result, private_key, curve)) {
+            return 0;
+        }
+        return !EccPoint_isZero(result, curve);
+    }
+#endif
+
     /* Regularize the bitcount for the private key so that attackers cannot use a side channel
        attack to learn the number of leading zeros. */
     carry = regularize_k(private_key, tmp1, tmp2, curve);
@@ -1246,22 +1275,13 @@ static void bits2int(uECC_word_t *native,
     }
 }
 
-static int uECC_sign_with_k_internal(const uint8_t *private_key,
-                            const uint8_t *message_hash,
-                            unsigned hash_size,
-                            uECC_word_t *k,
-                            uint8_t *signature,
-                            uECC_Curve curve) {
-
+/* Computes r = x(k * G) and replaces k with 1 / k mod n. */
+static int sign_nonce(uECC_word_t *k, uECC_word_t *r, uECC_Curve curve) {
     uECC_word_t tmp[uECC_MAX_WORDS];
     uECC_word_t s[uECC_MAX_WORDS];
     uECC_word_t *k2[2] = {tmp, s};
     uECC_word_t *initial_Z = 0;
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    uECC_word_t *p = (uECC_word_t *)signature;
-#else
     uECC_word_t p[uECC_MAX_WORDS * 2];
-#endif
     uECC_word_t carry;
     wordcount_t num_words = curve->num_words;
     wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
@@ -1272,19 +1292,29 @@ static int uECC_sign_with_k_internal(const uint8_t *private_key,
         return 0;
     }
 
-    carry = regularize_k(k, tmp, s, curve);
-    /* If an RNG function was specified, try to get a random initial Z value to improve
-       protection against side-channel attacks. */
-    if (g_rng_function) {
-        if (!uECC_generate_random_int(k2[carry], curve->p, num_words)) {
+#if uECC_SUPPORTS_secp256r1 && uECC_P256_COMB
+    if (curve == uECC_secp256r1()) {
+        if (!p256_comb_mult(p, k, curve)) {
             return 0;
         }
-        initial_Z = k2[carry];
+    } else
+#endif
+    {
+        carry = regularize_k(k, tmp, s, curve);
+        /* If an RNG function was specified, try to get a random initial Z value to improve
+           protection against side-channel attacks. */
+        if (g_rng_function) {
+            if (!uECC_generate_random_int(k2[carry], curve->p, num_words)) {
+                return 0;
+            }
+            initial_Z = k2[carry];
+        }
+        EccPoint_mult(p, curve->G, k2[!carry], initial_Z, num_n_bits + 1, curve);
     }
-    EccPoint_mult(p, curve->G, k2[!carry], initial_Z, num_n_bits + 1, curve);
     if (uECC_vli_isZero(p, num_words)) {
         return 0;
     }
+    uECC_vli_set(r, p, num_words);
 
     /* If an RNG function was specified, get a random number
        to prevent side channel analysis of k. */
@@ -1300,10 +1330,21 @@ static int uECC_sign_with_k_internal(const uint8_t *private_key,
     uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k' = rand * k */
     uECC_vli_modInv(k, k, curve->n, num_n_words);       /* k = 1 / k' */
     uECC_vli_modMult(k, k, tmp, curve->n, num_n_words); /* k = 1 / k */
+    return 1;
+}
 
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN == 0
-    uECC_vli_nativeToBytes(signature, curve->num_bytes, p); /* store r */
-#endif
+/* Computes s = (e + r * d) / k from k_inv = 1 / k and stores (r, s). */
+static int sign_finish(const uint8_t *private_key,
+                       const uint8_t *message_hash,
+                       unsigned hash_size,
+                       const uECC_word_t *k_inv,
+                       const uECC_word_t *r,
+                       uint8_t *signature,
+                       uECC_Curve curve) {
+    uECC_word_t tmp[uECC_MAX_WORDS];
+    uECC_word_t s[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+    wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
 
 #if uECC_VLI_NATIVE_LITTLE_ENDIAN
     bcopy((uint8_t *) tmp, private_key, BITS_TO_BYTES(curve->num_n_bits));
@@ -1312,23 +1353,34 @@ static int uECC_sign_with_k_internal(const uint8_t *private_key,
 #endif
 
     s[num_n_words - 1] = 0;
-    uECC_vli_set(s, p, num_words);
+    uECC_vli_set(s, r, num_words);
     uECC_vli_modMult(s, tmp, s, curve->n, num_n_words); /* s = r*d */
 
     bits2int(tmp, message_hash, hash_size, curve);
     uECC_vli_modAdd(s, tmp, s, curve->n, num_n_words); /* s = e + r*d */
-    uECC_vli_modMult(s, s, k, curve->n, num_n_words);  /* s = (e + r*d) / k */
+    uECC_vli_modMult(s, s, k_inv, curve->n, num_n_words); /* s = (e + r*d) / k */
     if (uECC_vli_numBits(s, num_n_words) > (bitcount_t)curve->num_bytes * 8) {
         return 0;
     }
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    bcopy((uint8_t *) signature + curve->num_bytes, (uint8_t *) s, curve->num_bytes);
-#else
+    uECC_vli_nativeToBytes(signature, curve->num_bytes, r); /* store r */
     uECC_vli_nativeToBytes(signature + curve->num_bytes, curve->num_bytes, s);
-#endif
     return 1;
 }
 
+static int uECC_sign_with_k_internal(const uint8_t *private_key,
+                            const uint8_t *message_hash,
+                            unsigned hash_size,
+                            uECC_word_t *k,
+                            uint8_t *signature,
+                            uECC_Curve curve) {
+    uECC_word_t r[uECC_MAX_WORDS];
+
+    if (!sign_nonce(k, r, curve)) {
+        return 0;
+    }
+    return sign_finish(private_key, message_hash, hash_size, k, r, signature, curve);
+}
+
 /* For testing - sign with an explicitly specified k value */
 int uECC_sign_with_k(const uint8_t *private_key,
                             const uint8_t *message_hash,
@@ -1361,6 +1413,48 @@ int uECC_sign(const uint8_t *private_key,
     return 0;
 }
 
+int uECC_sign_precompute(uint8_t *k_inverse, uint8_t *r, uECC_Curve curve) {
+    uECC_word_t k[uECC_MAX_WORDS];
+    uECC_word_t _r[uECC_MAX_WORDS];
+    uECC_word_t tries;
+
+    for (tries = 0; tries < uECC_RNG_MAX_TRIES; ++tries) {
+        if (!uECC_generate_random_int(k, curve->n, BITS_TO_WORDS(curve->num_n_bits))) {
+            return 0;
+        }
+
+        if (sign_nonce(k, _r, curve)) {
+            uECC_vli_nativeToBytes(k_inverse, BITS_TO_BYTES(curve->num_n_bits), k);
+            uECC_vli_nativeToBytes(r, curve->num_bytes, _r);
+            uECC_vli_clear(k, BITS_TO_WORDS(curve->num_n_bits));
+            uECC_vli_clear(_r, curve->num_words);
+            return 1;
+        }
+    }
+    uECC_vli_clear(k, BITS_TO_WORDS(curve->num_n_bits));
+    uECC_vli_clear(_r, curve->num_words);
+    return 0;
+}
+
+int uECC_sign_with_precomputed(const uint8_t *private_key,
+                               const uint8_t *message_hash,
+                               unsigned hash_size,
+                               const uint8_t *k_inverse,
+                               const uint8_t *r,
+                               uint8_t *signature,
+                               uECC_Curve curve) {
+    uECC_word_t k[uECC_MAX_WORDS];
+    uECC_word_t _r[uECC_MAX_WORDS];
+    int ok;
+
+    uECC_vli_bytesToNative(k, k_inverse, BITS_TO_BYTES(curve->num_n_bits));
+    uECC_vli_bytesToNative(_r, r, curve->num_bytes);
+    ok = sign_finish(private_key, message_hash, hash_size, k, _r, signature, curve);
+    uECC_vli_clear(k, BITS_TO_WORDS(curve->num_n_bits));
+    uECC_vli_clear(_r, curve->num_words);
+    return ok;
+}
+
 /* Compute an HMAC using K as a key (as in RFC 6979). Note that K is always
    the same size as the hash result size. */
 static void HMAC_init(const uECC_HashContext *hash_context, const uint8_t *K) {
@@ -1489,14 +1583,34 @@ static bitcount_t smax(bitcount_t a, bitcount_t b) {
     return (a > b ? a : b);
 }
 
-int uECC_verify(const uint8_t *public_key,
-                const uint8_t *message_hash,
-                unsigned hash_size,
-                const uint8_t *signature,
-                uECC_Curve curve) {
+/* Computes sum = G + Q in affine coordinates, the extra point used by
+   Shamir's trick. */
+static void verify_sum(uECC_word_t *sum, const uECC_word_t *_public, uECC_Curve curve) {
+    uECC_word_t tx[uECC_MAX_WORDS];
+    uECC_word_t ty[uECC_MAX_WORDS];
+    uECC_word_t z[uECC_MAX_WORDS];
+    wordcount_t num_words = curve->num_words;
+
+    uECC_vli_set(sum, _public, num_words);
+    uECC_vli_set(sum + num_words, _public + num_words, num_words);
+    uECC_vli_set(tx, curve->G, num_words);
+    uECC_vli_set(ty, curve->G + num_words, num_words);
+    uECC_vli_modSub(z, sum, tx, curve->p, num_words); /* z = x2 - x1 */
+    /* Note: safe to use tx for 'sub' param, since tx is not used after XYcZ_add. */
+    XYcZ_add(tx, ty, sum, sum + num_words, tx, curve);
+    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
+    apply_z(sum, sum + num_words, z, curve);
+}
+
+/* Verifies one signature given the native public key and sum = G + Q. */
+static int verify_with_sum(const uECC_word_t *_public,
+                           const uECC_word_t *sum,
+                           const uint8_t *message_hash,
+                           unsigned hash_size,
+                           const uint8_t *signature,
+                           uECC_Curve curve) {
     uECC_word_t u1[uECC_MAX_WORDS], u2[uECC_MAX_WORDS];
     uECC_word_t z[uECC_MAX_WORDS];
-    uECC_word_t sum[uECC_MAX_WORDS * 2];
     uECC_word_t rx[uECC_MAX_WORDS];
     uECC_word_t ry[uECC_MAX_WORDS];
     uECC_word_t tx[uECC_MAX_WORDS];
@@ -1506,11 +1620,6 @@ int uECC_verify(const uint8_t *public_key,
     const uECC_word_t *point;
     bitcount_t num_bits;
     bitcount_t i;
-#if uECC_VLI_NATIVE_LITTLE_ENDIAN
-    uECC_word_t *_public = (uECC_word_t *)public_key;
-#else
-    uECC_word_t _public[uECC_MAX_WORDS * 2];
-#endif
     uECC_word_t r[uECC_MAX_WORDS], s[uECC_MAX_WORDS];
     wordcount_t num_words = curve->num_words;
     wordcount_t num_n_words = BITS_TO_WORDS(curve->num_n_bits);
@@ -1523,9 +1632,6 @@ int uECC_verify(const uint8_t *public_key,
     bcopy((uint8_t *) r, signature, curve->num_bytes);
     bcopy((uint8_t *) s, signature + curve->num_bytes, curve->num_bytes);
 #else
-    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
-    uECC_vli_bytesToNative(
-        _public + num_words, public_key + curve->num_bytes, curve->num_bytes);
     uECC_vli_bytesToNative(r, signature, curve->num_bytes);
     uECC_vli_bytesToNative(s, signature + curve->num_bytes, curve->num_bytes);
 #endif
@@ -1548,17 +1654,6 @@ int uECC_verify(const uint8_t *public_key,
     uECC_vli_modMult(u1, u1, z, curve->n, num_n_words); /* u1 = e/s */
     uECC_vli_modMult(u2, r, z, curve->n, num_n_words); /* u2 = r/s */
 
-    /* Calculate sum = G + Q. */
-    uECC_vli_set(sum, _public, num_words);
-    uECC_vli_set(sum + num_words, _public + num_words, num_words);
-    uECC_vli_set(tx, curve->G, num_words);
-    uECC_vli_set(ty, curve->G + num_words, num_words);
-    uECC_vli_modSub(z, sum, tx, curve->p, num_words); /* z = x2 - x1 */
-    /* Note: safe to use tx for 'sub' param, since tx is not used after XYcZ_add. */
-    XYcZ_add(tx, ty, sum, sum + num_words, tx, curve);
-    uECC_vli_modInv(z, z, curve->p, num_words); /* z = 1/z */
-    apply_z(sum, sum + num_words, z, curve);
-
     /* Use Shamir's trick to calculate u1*G + u2*Q */
     points[0] = 0;
     points[1] = curve->G;
@@ -1590,6 +1685,25 @@ int uECC_verify(const uint8_t *public_key,
         }
     }
 
+    if (num_n_words == num_words) {
+        /* Compare in Jacobian coordinates instead of inverting Z: accept if
+           X = r * Z^2, or (r + n) * Z^2 when r + n < p. */
+        if (uECC_vli_isZero(z, num_words)) {
+            return 0;
+        }
+        uECC_vli_modSquare_fast(z, z, curve);
+        uECC_vli_modMult_fast(tx, r, z, curve);
+        if (uECC_vli_equal(tx, rx, num_words)) {
+            return 1;
+        }
+        if (uECC_vli_add(tz, r, curve->n, num_words) ||
+                uECC_vli_cmp_unsafe(curve->p, tz, num_words) != 1) {
+            return 0;
+        }
+        uECC_vli_modMult_fast(tx, tz, z, curve);
+        return (int)(uECC_vli_equal(tx, rx, num_words));
+    }
+
     uECC_vli_modInv(z, z, curve->p, num_words); /* Z = 1/Z */
     apply_z(rx, ry, z, curve);
 
@@ -1602,6 +1716,56 @@ int uECC_verify(const uint8_t *public_key,
     return (int)(uECC_vli_equal(rx, r, num_words));
 }
 
+int uECC_verify(const uint8_t *public_key,
+                const uint8_t *message_hash,
+                unsigned hash_size,
+                const uint8_t *signature,
+                uECC_Curve curve) {
+    uECC_word_t sum[uECC_MAX_WORDS * 2];
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    uECC_word_t *_public = (uECC_word_t *)public_key;
+#else
+    uECC_word_t _public[uECC_MAX_WORDS * 2];
+
+    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
+    uECC_vli_bytesToNative(
+        _public + curve->num_words, public_key + curve->num_bytes, curve->num_bytes);
+#endif
+
+    verify_sum(sum, _public, curve);
+    return verify_with_sum(_public, sum, message_hash, hash_size, signature, curve);
+}
+
+int uECC_verify_multi(const uint8_t *public_key,
+                      const uint8_t *items,
+                      unsigned count,
+                      unsigned hash_size,
+                      uint8_t *results,
+                      uECC_Curve curve) {
+    uECC_word_t sum[uECC_MAX_WORDS * 2];
+    unsigned item_size = hash_size + 2 * curve->num_bytes;
+    unsigned i;
+    int valid = 0;
+#if uECC_VLI_NATIVE_LITTLE_ENDIAN
+    uECC_word_t *_public = (uECC_word_t *)public_key;
+#else
+    uECC_word_t _public[uECC_MAX_WORDS * 2];
+
+    uECC_vli_bytesToNative(_public, public_key, curve->num_bytes);
+    uECC_vli_bytesToNative(
+        _public + curve->num_words, public_key + curve->num_bytes, curve->num_bytes);
+#endif
+
+    verify_sum(sum, _public, curve);
+    for (i = 0; i < count; ++i) {
+        const uint8_t *item = items + i * item_size;
+        results[i] = (uint8_t)verify_with_sum(_public, sum, item, hash_size,
+                                              item + hash_size, curve);
+        valid += results[i];
+    }
+    return valid;
+}
+
 #if uECC_ENABLE_VLI_API
 
 unsigned uECC_curve_num_words(uECC_Curve curve) {
@@ -75,6 +75,13 @@ the same endianness. */
     #define uECC_SUPPORT_COMPRESSED_POINT 1
 #endif
 
+/* Specifies whether secp256r1 multiplications by the generator (key
+   generation and signing) use the fixed-base comb in p256_comb.inc, at the
+   cost of a 2KB table in flash. Set to 0 to use the generic ladder. */
+#ifndef uECC_P256_COMB
+    #define uECC_P256_COMB 1
+#endif
+
 struct uECC_Curve_t;
 typedef const struct uECC_Curve_t * uECC_Curve;
 
@@ -263,6 +270,44 @@ int uECC_sign(const uint8_t *private_key,
               uint8_t *signature,
               uECC_Curve curve);
 
+/* uECC_sign_precompute() function.
+Compute the message-independent part of an ECDSA signature ahead of time: a random
+nonce k and r = x(k * G). The outputs must be kept secret and passed to
+uECC_sign_with_precomputed() exactly once; signing two messages with the same values
+reveals the private key. An RNG function must be set (see uECC_set_rng()).
+
+Outputs:
+    k_inverse - Will be filled in with 1/k mod n. Must be curve size long.
+    r         - Will be filled in with the r value of the signature. Must be curve size long.
+
+Returns 1 if the values were generated successfully, 0 if an error occurred.
+*/
+int uECC_sign_precompute(uint8_t *k_inverse, uint8_t *r, uECC_Curve curve);
+
+/* uECC_sign_with_precomputed() function.
+Generate an ECDSA signature for a given hash value using values from
+uECC_sign_precompute(). This only costs a few modular multiplications.
+
+Inputs:
+    private_key  - Your private key.
+    message_hash - The hash of the message to sign.
+    hash_size    - The size of message_hash in bytes.
+    k_inverse    - The k_inverse value from uECC_sign_precompute().
+    r            - The r value from uECC_sign_precompute().
+
+Outputs:
+    signature - Will be filled in with the signature value. Must be at least 2 * curve size long.
+
+Returns 1 if the signature generated successfully, 0 if an error occurred.
+*/
+int uECC_sign_with_precomputed(const uint8_t *private_key,
+                               const uint8_t *message_hash,
+                               unsigned hash_size,
+                               const uint8_t *k_inverse,
+                               const uint8_t *r,
+                               uint8_t *signature,
+                               uECC_Curve curve);
+
 /* uECC_HashContext structure.
 This is used to pass in an arbitrary hash function to uECC_sign_deterministic().
 The structure will be used for multiple hash computations; each time a new hash
@@ -360,6 +405,33 @@ int uECC_verify(const uint8_t *public_key,
                 const uint8_t *signature,
                 uECC_Curve curve);
 
+/* uECC_verify_multi() function.
+Verify several ECDSA signatures made with the same public key, one after the other.
+Only the point G + Q used by Shamir's trick is shared; each signature otherwise costs
+as much as uECC_verify(). This is not batch verification: (r, s) does not say which
+of the two points with x = r was R, so a random linear combination of the
+signatures cannot be checked in one multi-scalar multiplication.
+
+Inputs:
+    public_key - The signer's public key.
+    items      - count records of (message_hash, signature) laid out back to back;
+                 each record is hash_size + 2 * curve size bytes long.
+    count      - The number of records.
+    hash_size  - The size of each message_hash in bytes.
+
+Outputs:
+    results - Will be filled in with 1 for each valid signature and 0 otherwise.
+              Must be count bytes long.
+
+Returns the number of valid signatures.
+*/
+int uECC_verify_multi(const uint8_t *public_key,
+                      const uint8_t *items,
+                      unsigned count,
+                      unsigned hash_size,
+                      uint8_t *results,
+                      uECC_Curve curve);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
@@ -1,4 +1,6 @@
 #include "hid_keyboard.h"
+#include "oath_compute.h"
+#include "oath_protocol.h"
 #include "oath_storage.h"
 #include "time_sync.h"
 #include "led_driver.h"
@@ -84,6 +86,16 @@ bool hid_keyboard_generate_code(void) {
     if (!hid_mode_enabled) {
         return false;
     }
+
+    // Same gate as CALCULATE: no code, and no HOTP step, from an engine
+    // that failed its self-test
+    if (!oath_codes_enabled()) {
+        printf("HID Keyboard: Code engine self-test failed, no code\n");
+        led_set_color(255, 0, 0); // Red
+        sleep_ms(200);
+        led_set_color(0, 255, 0); // Green
+        return false;
+    }
     
     // Get current credential name
     const char* name = oath_storage_list(current_credential_index);
@@ -102,7 +114,7 @@ bool hid_keyboard_generate_code(void) {
     }
     
     // Check if time is synced (required for TOTP)
-    if (!time_sync_is_synced()) {
+    if (cred.type == OATH_TYPE_TOTP && !time_sync_is_synced()) {
         printf("HID Keyboard: Time not synced, cannot generate TOTP\n");
         led_set_color(255, 0, 0); // Red
         sleep_ms(200);
@@ -113,25 +125,33 @@ bool hid_keyboard_generate_code(void) {
     // Get current timestamp
     uint64_t timestamp = time_sync_get_timestamp();
     
-    // Generate TOTP code using libcotp
-    // Note: This is a simplified version. In production, use the oath_protocol functions
-    // For now, we'll use a placeholder
-    
-    // Simulate TOTP generation (replace with actual libcotp call)
-    uint32_t code = (uint32_t)(timestamp / 30) % 1000000; // 6 digits
+    uint32_t code;
+    bool ok = oath_compute(&cred, oath_moving_factor(&cred, timestamp), &code);
+    // HOTP: the counter step is durable before the code is typed
+    if (ok && cred.type == OATH_TYPE_HOTP)
+        ok = oath_storage_update_counter(cred.name, cred.counter + 1) &&
+             oath_storage_commit();
+    uint8_t digits = cred.digits;
+    memset(&cred, 0, sizeof(cred));
+    if (!ok) {
+        led_set_color(255, 0, 0); // Red
+        sleep_ms(200);
+        led_set_color(0, 255, 0); // Green
+        return false;
+    }
     
-    printf("HID Keyboard: Generating code for '%s': %06d\n", name, code);
+    char code_str[OATH_MAX_DIGITS + 1];
+    oath_format_code(code, digits, code_str);
+    // Never log the code itself: the console is not a secure channel
+    printf("HID Keyboard: Generating code for '%s'\n", name);
     
     // Type the code via HID
     // In a real implementation, this would send HID reports via TinyUSB
     // For now, we'll simulate by printing and blinking
     
     // Convert code to digits and "type" them
-    char code_str[7];
-    snprintf(code_str, sizeof(code_str), "%06d", code);
-    
     // Blink LED for each digit
-    for (int i = 0; i < 6; i++) {
+    for (int i = 0; i < digits; i++) {
         led_set_color(0, 255, 0); // Green
         sleep_ms(50);
         led_set_color(0, 0, 0); // Off
@@ -142,7 +162,8 @@ bool hid_keyboard_generate_code(void) {
     sleep_ms(100);
     led_set_color(0, 255, 0); // Green
     
-    printf("HID Keyboard: Code typed: %s\n", code_str);
+    printf("HID Keyboard: Code typed (%u digits)\n", digits);
+    memset(code_str, 0, sizeof(code_str));
     
     return true;
 }
@@ -27,6 +27,8 @@
 #define SW_CLA_NOT_SUPPORTED 0x6E00
 #define SW_MEMORY_FAILURE 0x6581 // Added for memory write failure
 #define SW_UNKNOWN 0x6F00        // General error
+#define SW_BYTES_REMAINING 0x6100 // More data, fetch with SEND REMAINING
+#define SW_WRONG_LE 0x6C00        // Wrong Le, low byte is the exact length
 
 // APDU Instructions
 #define INS_SELECT 0xA4
@@ -34,6 +36,7 @@
 #define INS_CALCULATE 0xA2
 #define INS_VALIDATE 0xA3 // Validate PIN (YKOATH standard)
 #define INS_CALCULATE_ALL 0xA4
+#define INS_SEND_REMAINING 0xA5 // Fetch the next chunk after SW 61xx
 #define INS_VERSION 0x06 // Get Version
 
 //--------------------------------------------------------------------+
@@ -72,6 +75,9 @@ static const uint8_t FIDO2_AID[FIDO2_AID_LEN] = {0xA0, 0x00, 0x00, 0x06,
 #define OATH_TAG_PERIOD 0x76
 #define OATH_TAG_ALGORITHM 0x77
 #define OATH_TAG_CREDENTIAL_LIST 0x79
+#define OATH_TAG_TRUNCATED 0x76 // CALCULATE (ALL): truncated code
+#define OATH_TAG_HOTP 0x77      // CALCULATE ALL: HOTP, use CALCULATE
+#define OATH_TAG_TOUCH 0x7C     // CALCULATE ALL: touch, use CALCULATE
 
 //--------------------------------------------------------------------+
 // APDU Structure
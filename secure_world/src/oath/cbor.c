@@ -116,6 +116,23 @@ bool cbor_parse_uint(cbor_parser_t *parser, uint64_t *value) {
   return parse_header(parser, CBOR_TYPE_UINT, value);
 }
 
+bool cbor_parse_int(cbor_parser_t *parser, int64_t *value) {
+  uint64_t val;
+  if (parse_header(parser, CBOR_TYPE_UINT, &val)) {
+    if (val > INT64_MAX)
+      return false;
+    *value = (int64_t)val;
+    return true;
+  }
+  if (parse_header(parser, CBOR_TYPE_NINT, &val)) {
+    if (val > INT64_MAX)
+      return false;
+    *value = -1 - (int64_t)val;
+    return true;
+  }
+  return false;
+}
+
 bool cbor_parse_map(cbor_parser_t *parser, size_t *size) {
   uint64_t val;
   if (parse_header(parser, CBOR_TYPE_MAP, &val)) {
@@ -160,3 +177,54 @@ bool cbor_parse_text(cbor_parser_t *parser, const char **text, size_t *len) {
   }
   return false;
 }
+
+bool cbor_parse_bool(cbor_parser_t *parser, bool *value) {
+  if (parser->offset >= parser->size)
+    return false;
+  uint8_t header = parser->buffer[parser->offset];
+  if (header != (CBOR_TYPE_FLOAT_SIMPLE | 20) &&
+      header != (CBOR_TYPE_FLOAT_SIMPLE | 21))
+    return false;
+  *value = header == (CBOR_TYPE_FLOAT_SIMPLE | 21);
+  parser->offset++;
+  return true;
+}
+
+static bool skip_item(cbor_parser_t *parser, int depth) {
+  if (depth > CBOR_MAX_DEPTH || parser->offset >= parser->size)
+    return false;
+
+  uint8_t type = parser->buffer[parser->offset] & 0xE0;
+  uint64_t value;
+  if (!parse_header(parser, type, &value))
+    return false;
+
+  switch (type) {
+  case CBOR_TYPE_BYTES:
+  case CBOR_TYPE_TEXT:
+    if (value > parser->size - parser->offset)
+      return false;
+    parser->offset += (size_t)value;
+    return true;
+  case CBOR_TYPE_MAP:
+    if (value > parser->size)
+      return false;
+    value *= 2;
+    // fall through
+  case CBOR_TYPE_ARRAY:
+    // Every item takes at least one byte, which bounds the loop
+    if (value > parser->size - parser->offset)
+      return false;
+    for (uint64_t i = 0; i < value; i++) {
+      if (!skip_item(parser, depth + 1))
+        return false;
+    }
+    return true;
+  case CBOR_TYPE_TAG:
+    return skip_item(parser, depth + 1);
+  default:
+    return true; // Integers and simple values are header only
+  }
+}
+
+bool cbor_skip(cbor_parser_t *parser) { return skip_item(parser, 0); }
@@ -17,6 +17,9 @@ typedef enum {
   CBOR_TYPE_FLOAT_SIMPLE = 0xE0
 } cbor_type_t;
 
+// Nesting accepted by cbor_skip()
+#define CBOR_MAX_DEPTH 8
+
 uint8_t *cbor_encode_uint(uint8_t *buffer, uint64_t value);
 uint8_t *cbor_encode_nint(uint8_t *buffer, uint64_t value);
 uint8_t *cbor_encode_bytes(uint8_t *buffer, const uint8_t *data, size_t len);
@@ -33,9 +36,14 @@ typedef struct {
 } cbor_parser_t;
 
 bool cbor_parse_uint(cbor_parser_t *parser, uint64_t *value);
+// Unsigned or negative integer that fits in an int64_t
+bool cbor_parse_int(cbor_parser_t *parser, int64_t *value);
 bool cbor_parse_map(cbor_parser_t *parser, size_t *size);
 bool cbor_parse_array(cbor_parser_t *parser, size_t *size);
 bool cbor_parse_bytes(cbor_parser_t *parser, const uint8_t **data, size_t *len);
 bool cbor_parse_text(cbor_parser_t *parser, const char **text, size_t *len);
+bool cbor_parse_bool(cbor_parser_t *parser, bool *value);
+// Steps over one complete item (nested arrays and maps included)
+bool cbor_skip(cbor_parser_t *parser);
 
 #endif // CBOR_H
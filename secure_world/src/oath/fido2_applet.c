@@ -2,12 +2,17 @@
 #include "apdu_protocol.h"
 #include "fido2_storage.h"
 #include "iso7816_4.h"
+#include <hardware/gpio.h>
 #include <pico/rand.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "../../include/secure_functions.h"
+#include "../crypto/aes_gcm.h"
+#include "../crypto/hmac.h"
+#include "../crypto/sha256.h"
 #include "../security/hsm.h"
+#include "../security/security.h"
 #include "cbor.h"
 
 // FIDO2 specific instructions
@@ -20,11 +25,47 @@
 #define CTAP2_CLIENT_PIN 0x06
 #define CTAP2_RESET 0x07
 
+// CTAP2 Status Codes
+#define CTAP2_OK 0x00
+#define CTAP2_ERR_INVALID_CBOR 0x12
+#define CTAP2_ERR_MISSING_PARAMETER 0x14
+#define CTAP2_ERR_UNSUPPORTED_ALGORITHM 0x26
+#define CTAP2_ERR_KEY_STORE_FULL 0x28
+#define CTAP2_ERR_NO_CREDENTIALS 0x2E
+#define CTAP1_ERR_OTHER 0x7F
+
+// COSE algorithm identifiers
+#define COSE_ALG_ES256 (-7)
+#define COSE_ALG_EDDSA (-8)
+
+// DER-encoded ES256 signature: SEQUENCE of two INTEGERs of up to 33 bytes.
+// Also holds a raw 64-byte EdDSA signature.
+#define FIDO2_DER_SIG_MAX (2 + 2 * (2 + 33))
+
+// Derivation label of the credential wrapping key
+#define CRED_WRAP_LABEL "FIDO2 credential wrap"
+
+// Response and attested authData staging for MakeCredential and
+// GetAssertion. Static to keep both handlers within the Secure World stack
+// budget; neither handler runs while the other is active and they hold no
+// key material.
+static uint8_t ctap_response[512];
+static uint8_t attested_auth_data[256];
+
+static const uint8_t fido2_aaguid[16] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC,
+                                         0xDE, 0xF0, 0x11, 0x22, 0x33, 0x44,
+                                         0x55, 0x66, 0x77, 0x88};
+
 void fido2_applet_init(void) {
   printf("FIDO2: Initializing applet...\n");
   fido2_storage_init();
+  gpio_init(FIDO2_TOUCH_PIN);
+  gpio_set_dir(FIDO2_TOUCH_PIN, GPIO_IN);
+  gpio_pull_up(FIDO2_TOUCH_PIN);
 }
 
+static bool user_present(void) { return !gpio_get(FIDO2_TOUCH_PIN); }
+
 static void handle_select(uint8_t *apdu_out, uint16_t *len_out) {
   // FIDO2 SELECT response returns fixed string "U2F_V2"
   const uint8_t response[] = "U2F_V2";
@@ -39,8 +80,9 @@ static void handle_get_info(uint8_t *apdu_out, uint16_t *len_out) {
   // Status byte: 0x00 (Success)
   *ptr++ = 0x00;
 
-  // CBOR map with 4 items: versions, extensions, aaguid, options
-  ptr = cbor_encode_map(ptr, 4);
+  // CBOR map with 5 items: versions, extensions, aaguid, options,
+  // algorithms
+  ptr = cbor_encode_map(ptr, 5);
 
   // 0x01: versions -> ["FIDO_2_0", "U2F_V2"]
   ptr = cbor_encode_uint(ptr, 0x01);
@@ -52,12 +94,9 @@ static void handle_get_info(uint8_t *apdu_out, uint16_t *len_out) {
   ptr = cbor_encode_uint(ptr, 0x02);
   ptr = cbor_encode_array(ptr, 0);
 
-  // 0x03: aaguid -> 16 bytes (zeroed for now or fixed)
-  static const uint8_t aaguid[16] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC,
-                                     0xDE, 0xF0, 0x11, 0x22, 0x33, 0x44,
-                                     0x55, 0x66, 0x77, 0x88};
+  // 0x03: aaguid -> 16 bytes
   ptr = cbor_encode_uint(ptr, 0x03);
-  ptr = cbor_encode_bytes(ptr, aaguid, 16);
+  ptr = cbor_encode_bytes(ptr, fido2_aaguid, 16);
 
   // 0x04: options -> {rk: true, up: true, uv: false}
   ptr = cbor_encode_uint(ptr, 0x04);
@@ -69,12 +108,48 @@ static void handle_get_info(uint8_t *apdu_out, uint16_t *len_out) {
   ptr = cbor_encode_text(ptr, "uv");
   ptr = cbor_encode_bool(ptr, false);
 
+  // 0x0A: algorithms -> [{alg: -7, type}, {alg: -8, type}]
+  ptr = cbor_encode_uint(ptr, 0x0A);
+  ptr = cbor_encode_array(ptr, 2);
+  ptr = cbor_encode_map(ptr, 2);
+  ptr = cbor_encode_text(ptr, "alg");
+  ptr = cbor_encode_nint(ptr, 6); // -7
+  ptr = cbor_encode_text(ptr, "type");
+  ptr = cbor_encode_text(ptr, "public-key");
+  ptr = cbor_encode_map(ptr, 2);
+  ptr = cbor_encode_text(ptr, "alg");
+  ptr = cbor_encode_nint(ptr, 7); // -8
+  ptr = cbor_encode_text(ptr, "type");
+  ptr = cbor_encode_text(ptr, "public-key");
+
   uint16_t resp_len = ptr - buffer;
   memcpy(apdu_out, buffer, resp_len);
   iso7816_finalize_response(apdu_out, resp_len, len_out, SW_OK);
 }
 
-static uint8_t *encode_cose_key(uint8_t *ptr, const uint8_t *pubkey) {
+static uint8_t *encode_cose_key(uint8_t *ptr, uint8_t algorithm,
+                                const uint8_t *pubkey) {
+  if (algorithm == HSM_ALG_ED25519) {
+    // COSE Map (4 items)
+    ptr = cbor_encode_map(ptr, 4);
+
+    // 1: kty -> 1 (OKP)
+    ptr = cbor_encode_uint(ptr, 1);
+    ptr = cbor_encode_uint(ptr, 1);
+
+    // 3: alg -> -8 (EdDSA)
+    ptr = cbor_encode_uint(ptr, 3);
+    ptr = cbor_encode_nint(ptr, 7); // -1 - 7 = -8
+
+    // -1: crv -> 6 (Ed25519)
+    ptr = cbor_encode_nint(ptr, 0);
+    ptr = cbor_encode_uint(ptr, 6);
+
+    // -2: x -> the 32-byte encoded point
+    ptr = cbor_encode_nint(ptr, 1);
+    return cbor_encode_bytes(ptr, pubkey, 32);
+  }
+
   // COSE Map (5 items)
   ptr = cbor_encode_map(ptr, 5);
 
@@ -101,29 +176,399 @@ static uint8_t *encode_cose_key(uint8_t *ptr, const uint8_t *pubkey) {
   return ptr;
 }
 
-static void handle_make_credential(uint8_t *apdu_out, uint16_t *len_out) {
-  printf("FIDO2: Real MakeCredential implementation\n");
+static void ctap_status(uint8_t status, uint8_t *apdu_out, uint16_t *len_out) {
+  apdu_out[0] = status;
+  iso7816_finalize_response(apdu_out, 1, len_out, SW_OK);
+}
+
+static bool text_is(const char *text, size_t len, const char *literal) {
+  return len == strlen(literal) && memcmp(text, literal, len) == 0;
+}
+
+static void sha256(const uint8_t *data, size_t len, uint8_t *out) {
+  SHA256_CTX ctx;
+  SHA256Init(&ctx);
+  SHA256Update(&ctx, data, len);
+  SHA256Final(&ctx, out);
+}
+
+//--------------------------------------------------------------------+
+// Credential Wrapping
+//--------------------------------------------------------------------+
+
+// Keyed on first use with HMAC(master_key, CRED_WRAP_LABEL), so credential
+// IDs stay valid as long as the master key does
+static aes_gcm_ctx_t wrap_ctx;
+
+static const aes_gcm_ctx_t *get_wrap_ctx(void) {
+  if (wrap_ctx.ready)
+    return &wrap_ctx;
+
+  uint8_t master_key[32];
+  uint8_t wrap_key[SHA256_DIGEST_SIZE];
+  if (!security_get_master_key(master_key))
+    return NULL;
+  hmac_sha256(master_key, sizeof(master_key), (const uint8_t *)CRED_WRAP_LABEL,
+              sizeof(CRED_WRAP_LABEL) - 1, wrap_key);
+  aes_gcm_ctx_init(&wrap_ctx, wrap_key);
+
+  memset(master_key, 0, sizeof(master_key));
+  memset(wrap_key, 0, sizeof(wrap_key));
+  return &wrap_ctx;
+}
+
+void fido2_applet_wipe_keys(void) { aes_gcm_ctx_wipe(&wrap_ctx); }
+
+// AAD = version | rpIdHash: an ID only opens for the RP it was made for, and
+// the key type in the version byte cannot be swapped
+static void wrap_aad(uint8_t version, const uint8_t *rp_id_hash,
+                     uint8_t *aad) {
+  aad[0] = version;
+  memcpy(aad + 1, rp_id_hash, FIDO2_RP_ID_HASH_LEN);
+}
+
+static bool wrap_credential(const uint8_t *rp_id_hash, uint8_t algorithm,
+                            const uint8_t *private_key, uint8_t *cred_id) {
+  const aes_gcm_ctx_t *gcm = get_wrap_ctx();
+  if (!gcm)
+    return false;
+
+  uint8_t version = (algorithm == HSM_ALG_ED25519)
+                        ? FIDO2_CRED_ID_VERSION_EDDSA
+                        : FIDO2_CRED_ID_VERSION;
+  uint8_t aad[1 + FIDO2_RP_ID_HASH_LEN];
+  wrap_aad(version, rp_id_hash, aad);
+
+  uint8_t *iv = cred_id + 1;
+  uint8_t *sealed = iv + FIDO2_CRED_IV_LEN;
+  cred_id[0] = version;
+  for (int i = 0; i < FIDO2_CRED_IV_LEN; i += 4) {
+    uint32_t r = get_rand_32();
+    memcpy(iv + i, &r, 4);
+  }
+  return aes_gcm_ctx_encrypt(gcm, iv, aad, sizeof(aad), private_key,
+                             FIDO2_KEY_LEN, sealed, sealed + FIDO2_KEY_LEN);
+}
+
+// Fails for IDs made by another authenticator or for another RP. Sets the
+// key's HSM algorithm.
+static bool unwrap_credential(const uint8_t *rp_id_hash, const uint8_t *cred_id,
+                              size_t cred_id_len, uint8_t *private_key,
+                              uint8_t *algorithm) {
+  if (cred_id_len != FIDO2_ID_LEN)
+    return false;
+  if (cred_id[0] == FIDO2_CRED_ID_VERSION)
+    *algorithm = HSM_ALG_P256;
+  else if (cred_id[0] == FIDO2_CRED_ID_VERSION_EDDSA)
+    *algorithm = HSM_ALG_ED25519;
+  else
+    return false;
+
+  const aes_gcm_ctx_t *gcm = get_wrap_ctx();
+  if (!gcm)
+    return false;
+
+  uint8_t aad[1 + FIDO2_RP_ID_HASH_LEN];
+  wrap_aad(cred_id[0], rp_id_hash, aad);
+
+  const uint8_t *iv = cred_id + 1;
+  const uint8_t *sealed = iv + FIDO2_CRED_IV_LEN;
+  if (!aes_gcm_ctx_decrypt(gcm, iv, aad, sizeof(aad), sealed, FIDO2_KEY_LEN,
+                           sealed + FIDO2_KEY_LEN, private_key)) {
+    memset(private_key, 0, FIDO2_KEY_LEN);
+    return false;
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Request Parsing
+//--------------------------------------------------------------------+
+
+// PublicKeyCredentialRpEntity {id, name}: hashes the id
+static bool parse_rp_entity(cbor_parser_t *parser, uint8_t *rp_id_hash) {
+  size_t entries;
+  bool found = false;
+  if (!cbor_parse_map(parser, &entries))
+    return false;
+  for (size_t i = 0; i < entries; i++) {
+    const char *key;
+    size_t key_len;
+    if (!cbor_parse_text(parser, &key, &key_len))
+      return false;
+    if (text_is(key, key_len, "id")) {
+      const char *id;
+      size_t id_len;
+      if (!cbor_parse_text(parser, &id, &id_len))
+        return false;
+      sha256((const uint8_t *)id, id_len, rp_id_hash);
+      found = true;
+    } else if (!cbor_skip(parser)) {
+      return false;
+    }
+  }
+  return found;
+}
+
+// PublicKeyCredentialUserEntity {id, name, displayName}
+static bool parse_user_entity(cbor_parser_t *parser, const uint8_t **user_id,
+                              size_t *user_id_len) {
+  size_t entries;
+  if (!cbor_parse_map(parser, &entries))
+    return false;
+  for (size_t i = 0; i < entries; i++) {
+    const char *key;
+    size_t key_len;
+    if (!cbor_parse_text(parser, &key, &key_len))
+      return false;
+    if (text_is(key, key_len, "id")) {
+      if (!cbor_parse_bytes(parser, user_id, user_id_len))
+        return false;
+    } else if (!cbor_skip(parser)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Options map {rk, up, uv}: only rk changes what is done here
+static bool parse_options(cbor_parser_t *parser, bool *rk) {
+  size_t entries;
+  if (!cbor_parse_map(parser, &entries))
+    return false;
+  for (size_t i = 0; i < entries; i++) {
+    const char *key;
+    size_t key_len;
+    bool value;
+    if (!cbor_parse_text(parser, &key, &key_len) ||
+        !cbor_parse_bool(parser, &value))
+      return false;
+    if (text_is(key, key_len, "rk"))
+      *rk = value;
+  }
+  return true;
+}
+
+// pubKeyCredParams [{alg, type}, ...] in the RP's order of preference:
+// picks the first ES256 or EdDSA entry, HSM_ALG_NONE when there is none
+static bool parse_cred_params(cbor_parser_t *parser, uint8_t *algorithm) {
+  size_t count;
+  *algorithm = HSM_ALG_NONE;
+  if (!cbor_parse_array(parser, &count))
+    return false;
+  for (size_t i = 0; i < count; i++) {
+    size_t entries;
+    int64_t alg = 0;
+    bool public_key = false;
+    if (!cbor_parse_map(parser, &entries))
+      return false;
+    for (size_t j = 0; j < entries; j++) {
+      const char *key;
+      size_t key_len;
+      if (!cbor_parse_text(parser, &key, &key_len))
+        return false;
+      if (text_is(key, key_len, "alg")) {
+        if (!cbor_parse_int(parser, &alg))
+          return false;
+      } else if (text_is(key, key_len, "type")) {
+        const char *type;
+        size_t type_len;
+        if (!cbor_parse_text(parser, &type, &type_len))
+          return false;
+        public_key = text_is(type, type_len, "public-key");
+      } else if (!cbor_skip(parser)) {
+        return false;
+      }
+    }
+    if (*algorithm != HSM_ALG_NONE || !public_key)
+      continue;
+    if (alg == COSE_ALG_ES256)
+      *algorithm = HSM_ALG_P256;
+    else if (alg == COSE_ALG_EDDSA)
+      *algorithm = HSM_ALG_ED25519;
+  }
+  return true;
+}
+
+// PublicKeyCredentialDescriptor {id, type}
+static bool parse_descriptor(cbor_parser_t *parser, const uint8_t **id,
+                             size_t *id_len) {
+  size_t entries;
+  *id = NULL;
+  if (!cbor_parse_map(parser, &entries))
+    return false;
+  for (size_t i = 0; i < entries; i++) {
+    const char *key;
+    size_t key_len;
+    if (!cbor_parse_text(parser, &key, &key_len))
+      return false;
+    if (text_is(key, key_len, "id")) {
+      if (!cbor_parse_bytes(parser, id, id_len))
+        return false;
+    } else if (!cbor_skip(parser)) {
+      return false;
+    }
+  }
+  return *id != NULL;
+}
+
+//--------------------------------------------------------------------+
+// Signing
+//--------------------------------------------------------------------+
+
+static uint8_t *encode_der_integer(uint8_t *ptr, const uint8_t *value) {
+  int skip = 0;
+  while (skip < 31 && value[skip] == 0)
+    skip++;
+  int len = 32 - skip;
+  bool pad = (value[skip] & 0x80) != 0; // Keep the INTEGER positive
+
+  *ptr++ = 0x02;
+  *ptr++ = (uint8_t)(len + pad);
+  if (pad)
+    *ptr++ = 0x00;
+  memcpy(ptr, value + skip, len);
+  return ptr + len;
+}
+
+// ES256 signatures go on the wire as DER SEQUENCE { INTEGER r, INTEGER s }
+static uint16_t encode_der_signature(const uint8_t *raw, uint8_t *der) {
+  uint8_t *ptr = der + 2;
+  ptr = encode_der_integer(ptr, raw);
+  ptr = encode_der_integer(ptr, raw + 32);
+  der[0] = 0x30;
+  der[1] = (uint8_t)(ptr - der - 2);
+  return (uint16_t)(ptr - der);
+}
+
+// Signs authData | clientDataHash; sig_out takes FIDO2_DER_SIG_MAX bytes.
+// ES256 signs the SHA-256 of the pair and returns DER; EdDSA signs the pair
+// itself and returns the raw 64-byte signature.
+static bool sign_assertion(uint8_t algorithm, const uint8_t *private_key,
+                           const uint8_t *auth_data, uint16_t ad_len,
+                           const uint8_t *client_data_hash, uint8_t *sig_out,
+                           uint16_t *sig_len) {
+  uint8_t signature[64];
+  uint16_t raw_len;
+
+  if (algorithm == HSM_ALG_ED25519) {
+    uint8_t message[64 + 32];
+    if (ad_len > sizeof(message) - 32)
+      return false;
+    memcpy(message, auth_data, ad_len);
+    memcpy(message + ad_len, client_data_hash, 32);
+    return hsm_sign_with_key(algorithm, private_key, NULL, message,
+                             ad_len + 32, sig_out, sig_len) == HSM_STATUS_OK;
+  }
 
-  // For now, we use a fixed slot or dynamic slot from HSM
-  uint8_t slot = 0; // Simplified for now
-  if (hsm_generate_key(slot) != HSM_STATUS_OK) {
-    uint8_t response[] = {0x21}; // CTAP2_ERR_NOT_ALLOWED
-    memcpy(apdu_out, response, sizeof(response));
-    iso7816_finalize_response(apdu_out, sizeof(response), len_out, SW_OK);
+  uint8_t hash[32];
+  SHA256_CTX ctx;
+  SHA256Init(&ctx);
+  SHA256Update(&ctx, auth_data, ad_len);
+  SHA256Update(&ctx, client_data_hash, 32);
+  SHA256Final(&ctx, hash);
+
+  if (hsm_sign_with_key(algorithm, private_key, NULL, hash, sizeof(hash),
+                        signature, &raw_len) != HSM_STATUS_OK)
+    return false;
+  *sig_len = encode_der_signature(signature, sig_out);
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// CTAP2 Commands
+//--------------------------------------------------------------------+
+
+// Every credential gets a fresh key pair whose private key is wrapped into
+// the credential ID. Non-resident credentials therefore cost no flash write
+// and there is no limit on how many can be registered; resident ones
+// (rk = true) additionally go into the discoverable credential store.
+static void handle_make_credential(uint8_t *data, uint16_t len,
+                                   uint8_t *apdu_out, uint16_t *len_out) {
+  printf("FIDO2: MakeCredential\n");
+
+  cbor_parser_t parser = {.buffer = data + 1, .size = len - 1, .offset = 0};
+  size_t map_size;
+  if (!cbor_parse_map(&parser, &map_size)) {
+    ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
+    return;
+  }
+
+  const uint8_t *client_data_hash = NULL;
+  size_t client_data_hash_len = 0;
+  uint8_t rp_id_hash[FIDO2_RP_ID_HASH_LEN];
+  bool have_rp = false;
+  const uint8_t *user_id = NULL;
+  size_t user_id_len = 0;
+  bool rk = false;
+  uint8_t algorithm = HSM_ALG_P256; // ES256 when pubKeyCredParams is absent
+
+  for (size_t i = 0; i < map_size; i++) {
+    uint64_t key;
+    bool ok;
+    if (!cbor_parse_uint(&parser, &key)) {
+      ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
+      return;
+    }
+
+    if (key == 0x01) { // clientDataHash
+      ok = cbor_parse_bytes(&parser, &client_data_hash, &client_data_hash_len);
+    } else if (key == 0x02) { // rp
+      ok = have_rp = parse_rp_entity(&parser, rp_id_hash);
+    } else if (key == 0x03) { // user
+      ok = parse_user_entity(&parser, &user_id, &user_id_len);
+    } else if (key == 0x04) { // pubKeyCredParams
+      ok = parse_cred_params(&parser, &algorithm);
+    } else if (key == 0x07) { // options
+      ok = parse_options(&parser, &rk);
+    } else {
+      ok = cbor_skip(&parser);
+    }
+    if (!ok) {
+      ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
+      return;
+    }
+  }
+
+  if (client_data_hash_len != 32 || !have_rp ||
+      (rk && (user_id == NULL || user_id_len > FIDO2_USER_ID_MAX))) {
+    ctap_status(CTAP2_ERR_MISSING_PARAMETER, apdu_out, len_out);
+    return;
+  }
+  if (algorithm == HSM_ALG_NONE) {
+    ctap_status(CTAP2_ERR_UNSUPPORTED_ALGORITHM, apdu_out, len_out);
     return;
   }
 
+  uint8_t private_key[FIDO2_KEY_LEN];
   uint8_t pubkey[64];
-  uint16_t pub_len;
-  hsm_get_pubkey(slot, pubkey, &pub_len);
+  uint8_t cred_id[FIDO2_ID_LEN];
+  bool ok =
+      hsm_generate_keypair(algorithm, private_key, pubkey) == HSM_STATUS_OK &&
+      wrap_credential(rp_id_hash, algorithm, private_key, cred_id);
+  memset(private_key, 0, sizeof(private_key));
+  if (!ok) {
+    ctap_status(CTAP1_ERR_OTHER, apdu_out, len_out);
+    return;
+  }
+
+  if (rk) {
+    fido2_credential_t cred;
+    memcpy(cred.credential_id, cred_id, FIDO2_ID_LEN);
+    cred.user_id_len = (uint8_t)user_id_len;
+    memcpy(cred.user_id, user_id, user_id_len);
+    if (!fido2_storage_put(rp_id_hash, &cred)) {
+      ctap_status(CTAP2_ERR_KEY_STORE_FULL, apdu_out, len_out);
+      return;
+    }
+  }
 
   // AuthData
-  uint8_t auth_data[256];
+  uint8_t *auth_data = attested_auth_data;
   uint8_t *ad_ptr = auth_data;
 
-  // RP ID Hash (32 bytes) - Stubbed for now
-  memset(ad_ptr, 0, 32);
-  ad_ptr += 32;
+  memcpy(ad_ptr, rp_id_hash, FIDO2_RP_ID_HASH_LEN);
+  ad_ptr += FIDO2_RP_ID_HASH_LEN;
 
   // Flags: UP (1), AT (1) -> 0x41
   *ad_ptr++ = 0x41;
@@ -132,57 +577,37 @@ static void handle_make_credential(uint8_t *apdu_out, uint16_t *len_out) {
   memset(ad_ptr, 0, 4);
   ad_ptr += 4;
 
-  // AAGUID (16 bytes)
-  static const uint8_t aaguid[16] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC,
-                                     0xDE, 0xF0, 0x11, 0x22, 0x33, 0x44,
-                                     0x55, 0x66, 0x77, 0x88};
-  memcpy(ad_ptr, aaguid, 16);
+  memcpy(ad_ptr, fido2_aaguid, 16);
   ad_ptr += 16;
 
-  // Credential ID (16 bytes)
-  uint8_t cred_id[16];
-  for (int i = 0; i < 16; i++)
-    cred_id[i] = (uint8_t)get_rand_32();
-  *ad_ptr++ = 0x00; // Credential ID Length (16 bit)
-  *ad_ptr++ = 16;
-  memcpy(ad_ptr, cred_id, 16);
-  ad_ptr += 16;
-
-  // Save to storage
-  fido2_storage_t *storage = fido2_storage_get_data();
-  if (storage->count < FIDO2_MAX_CREDENTIALS) {
-    fido2_credential_t *new_cred = &storage->credentials[storage->count];
-    memcpy(new_cred->credential_id, cred_id, 16);
-    new_cred->sign_count = 0;
-    // Slot information is implicit or we can store it in a private_key field
-    // (abuse) For now, let's just assume slot = index
-    storage->count++;
-    fido2_storage_save();
-  }
+  // Credential ID Length (16 bit) and Credential ID
+  *ad_ptr++ = 0x00;
+  *ad_ptr++ = FIDO2_ID_LEN;
+  memcpy(ad_ptr, cred_id, FIDO2_ID_LEN);
+  ad_ptr += FIDO2_ID_LEN;
 
   // Public Key (COSE)
-  ad_ptr = encode_cose_key(ad_ptr, pubkey);
+  ad_ptr = encode_cose_key(ad_ptr, algorithm, pubkey);
 
   uint16_t ad_len = ad_ptr - auth_data;
 
   // Final Response (CBOR)
-  uint8_t response[512];
+  uint8_t *response = ctap_response;
   uint8_t *resp_ptr = response;
-  uint8_t *tmp_ptr;
-  *resp_ptr++ = 0x00; // Success
+  *resp_ptr++ = CTAP2_OK;
 
   resp_ptr = cbor_encode_map(resp_ptr, 3);
 
-  // fmt: "none"
-  resp_ptr = cbor_encode_text(resp_ptr, "fmt");
+  // 1: fmt -> "none"
+  resp_ptr = cbor_encode_uint(resp_ptr, 0x01);
   resp_ptr = cbor_encode_text(resp_ptr, "none");
 
-  // authData
-  resp_ptr = cbor_encode_text(resp_ptr, "authData");
+  // 2: authData
+  resp_ptr = cbor_encode_uint(resp_ptr, 0x02);
   resp_ptr = cbor_encode_bytes(resp_ptr, auth_data, ad_len);
 
-  // attStmt: {}
-  resp_ptr = cbor_encode_text(resp_ptr, "attStmt");
+  // 3: attStmt -> {}
+  resp_ptr = cbor_encode_uint(resp_ptr, 0x03);
   resp_ptr = cbor_encode_map(resp_ptr, 0);
 
   uint16_t final_len = resp_ptr - response;
@@ -190,102 +615,168 @@ static void handle_make_credential(uint8_t *apdu_out, uint16_t *len_out) {
   iso7816_finalize_response(apdu_out, final_len, len_out, SW_OK);
 }
 
+// The key comes from the first allowList entry that unwraps for this RP,
+// or from the discoverable credential store when no allowList is given. No
+// storage is scanned for non-resident credentials.
 static void handle_get_assertion(uint8_t *data, uint16_t len, uint8_t *apdu_out,
                                  uint16_t *len_out) {
-  printf("FIDO2: Real GetAssertion implementation\n");
+  printf("FIDO2: GetAssertion\n");
 
   cbor_parser_t parser = {.buffer = data + 1, .size = len - 1, .offset = 0};
   size_t map_size;
   if (!cbor_parse_map(&parser, &map_size)) {
-    uint8_t response[] = {0x01}; // CTAP2_ERR_INVALID_COMMAND
-    memcpy(apdu_out, response, sizeof(response));
-    iso7816_finalize_response(apdu_out, sizeof(response), len_out, SW_OK);
+    ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
     return;
   }
 
-  const uint8_t *rp_id_hash = NULL;
-  size_t rp_id_hash_len = 0;
+  uint8_t rp_id_hash[FIDO2_RP_ID_HASH_LEN];
+  bool have_rp = false;
   const uint8_t *client_data_hash = NULL;
   size_t client_data_hash_len = 0;
+  uint8_t private_key[FIDO2_KEY_LEN];
+  uint8_t algorithm = HSM_ALG_NONE;
+  const uint8_t *cred_id = NULL;
+  bool have_allow_list = false;
 
-  // Simple key/value parsing in map
   for (size_t i = 0; i < map_size; i++) {
     uint64_t key;
-    if (!cbor_parse_uint(&parser, &key))
-      break;
+    bool ok = true;
+    if (!cbor_parse_uint(&parser, &key)) {
+      ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
+      return;
+    }
 
     if (key == 0x01) { // rpId
-      cbor_parse_bytes(&parser, &rp_id_hash, &rp_id_hash_len);
+      const char *rp_id;
+      size_t rp_id_len;
+      ok = have_rp = cbor_parse_text(&parser, &rp_id, &rp_id_len);
+      if (ok)
+        sha256((const uint8_t *)rp_id, rp_id_len, rp_id_hash);
     } else if (key == 0x02) { // clientDataHash
-      cbor_parse_bytes(&parser, &client_data_hash, &client_data_hash_len);
+      ok = cbor_parse_bytes(&parser, &client_data_hash, &client_data_hash_len);
+    } else if (key == 0x03 && have_rp) { // allowList
+      size_t count;
+      ok = cbor_parse_array(&parser, &count);
+      have_allow_list = ok && count > 0;
+      for (size_t j = 0; ok && j < count; j++) {
+        const uint8_t *id;
+        size_t id_len;
+        ok = parse_descriptor(&parser, &id, &id_len);
+        if (ok && cred_id == NULL &&
+            unwrap_credential(rp_id_hash, id, id_len, private_key,
+                              &algorithm))
+          cred_id = id;
+      }
     } else {
-      // Skip unknown keys or handled elsewhere
+      // rpId comes first in canonical CBOR, so an allowList without it is
+      // malformed and simply skipped here
+      ok = cbor_skip(&parser);
+    }
+    if (!ok) {
+      if (cred_id)
+        memset(private_key, 0, sizeof(private_key));
+      ctap_status(CTAP2_ERR_INVALID_CBOR, apdu_out, len_out);
+      return;
     }
   }
 
-  // Find a credential (simplified: just take the first one for now)
-  fido2_storage_t *storage = fido2_storage_get_data();
-  if (storage->count == 0) {
-    uint8_t response[] = {0x2E}; // CTAP2_ERR_NO_CREDENTIALS
-    memcpy(apdu_out, response, sizeof(response));
-    iso7816_finalize_response(apdu_out, sizeof(response), len_out, SW_OK);
+  if (!have_rp || client_data_hash_len != 32) {
+    if (cred_id)
+      memset(private_key, 0, sizeof(private_key));
+    ctap_status(CTAP2_ERR_MISSING_PARAMETER, apdu_out, len_out);
     return;
   }
 
-  // HSM Slot 0 assumed for now
-  uint16_t sig_len = 0;
-  uint8_t signature[64];
+  // Discoverable credentials: the first store candidate that unwraps
+  fido2_credential_t resident;
+  bool is_resident = false;
+  if (!have_allow_list) {
+    uint32_t cursor = 0;
+    while (!is_resident &&
+           fido2_storage_find(rp_id_hash, &cursor, &resident)) {
+      is_resident = unwrap_credential(rp_id_hash, resident.credential_id,
+                                      FIDO2_ID_LEN, private_key, &algorithm);
+    }
+    if (is_resident)
+      cred_id = resident.credential_id;
+  }
+  if (cred_id == NULL) {
+    ctap_status(CTAP2_ERR_NO_CREDENTIALS, apdu_out, len_out);
+    return;
+  }
 
-  // Real FIDO2 signs [AuthData || ClientDataHash]
-  // For now, let's just sign the clientDataHash to show the mechanism is
-  // working
-  if (hsm_sign(0, client_data_hash, signature, &sig_len) != HSM_STATUS_OK) {
-    uint8_t response[] = {0x01}; // Error
-    memcpy(apdu_out, response, sizeof(response));
-    iso7816_finalize_response(apdu_out, sizeof(response), len_out, SW_OK);
+  uint32_t counter;
+  if (!fido2_storage_next_counter(&counter)) {
+    memset(private_key, 0, sizeof(private_key));
+    ctap_status(CTAP1_ERR_OTHER, apdu_out, len_out);
     return;
   }
 
   // AuthData for GetAssertion
   uint8_t auth_data[37];
-  memcpy(auth_data, rp_id_hash, 32);
-  auth_data[32] = 0x01;         // UP flag only
-  memset(auth_data + 33, 0, 4); // signCount
+  memcpy(auth_data, rp_id_hash, FIDO2_RP_ID_HASH_LEN);
+  auth_data[32] = 0x01; // UP flag only
+  auth_data[33] = (uint8_t)(counter >> 24);
+  auth_data[34] = (uint8_t)(counter >> 16);
+  auth_data[35] = (uint8_t)(counter >> 8);
+  auth_data[36] = (uint8_t)counter;
+
+  uint8_t signature[FIDO2_DER_SIG_MAX];
+  uint16_t sig_len;
+  bool ok = sign_assertion(algorithm, private_key, auth_data,
+                           sizeof(auth_data), client_data_hash, signature,
+                           &sig_len);
+  memset(private_key, 0, sizeof(private_key));
+  if (!ok) {
+    ctap_status(CTAP1_ERR_OTHER, apdu_out, len_out);
+    return;
+  }
 
   // Response (CBOR)
-  uint8_t response[256];
+  uint8_t *response = ctap_response;
   uint8_t *resp_ptr = response;
-  *resp_ptr++ = 0x00; // Success
+  *resp_ptr++ = CTAP2_OK;
 
-  resp_ptr = cbor_encode_map(resp_ptr, 3);
+  resp_ptr = cbor_encode_map(resp_ptr, is_resident ? 4 : 3);
 
   // 1: credential
   resp_ptr = cbor_encode_uint(resp_ptr, 0x01);
   resp_ptr = cbor_encode_map(resp_ptr, 2);
   resp_ptr = cbor_encode_text(resp_ptr, "id");
-  resp_ptr =
-      cbor_encode_bytes(resp_ptr, storage->credentials[0].credential_id, 16);
+  resp_ptr = cbor_encode_bytes(resp_ptr, cred_id, FIDO2_ID_LEN);
   resp_ptr = cbor_encode_text(resp_ptr, "type");
   resp_ptr = cbor_encode_text(resp_ptr, "public-key");
 
   // 2: authData
   resp_ptr = cbor_encode_uint(resp_ptr, 0x02);
-  resp_ptr = cbor_encode_bytes(resp_ptr, auth_data, 37);
+  resp_ptr = cbor_encode_bytes(resp_ptr, auth_data, sizeof(auth_data));
 
   // 3: signature
   resp_ptr = cbor_encode_uint(resp_ptr, 0x03);
-  resp_ptr = cbor_encode_bytes(resp_ptr, signature, 64);
+  resp_ptr = cbor_encode_bytes(resp_ptr, signature, sig_len);
+
+  // 4: user (discoverable credentials only)
+  if (is_resident) {
+    resp_ptr = cbor_encode_uint(resp_ptr, 0x04);
+    resp_ptr = cbor_encode_map(resp_ptr, 1);
+    resp_ptr = cbor_encode_text(resp_ptr, "id");
+    resp_ptr =
+        cbor_encode_bytes(resp_ptr, resident.user_id, resident.user_id_len);
+  }
 
   uint16_t final_len = resp_ptr - response;
   memcpy(apdu_out, response, final_len);
   iso7816_finalize_response(apdu_out, final_len, len_out, SW_OK);
 }
 
-static void handle_fido_msg(uint8_t *data, uint16_t lc, uint8_t *apdu_out,
+// Returns false without answering while a request that needs user presence
+// waits for the button. The check is made once per submission and never
+// blocks: the Non-Secure side keeps the host informed and resubmits.
+static bool handle_fido_msg(uint8_t *data, uint16_t lc, uint8_t *apdu_out,
                             uint16_t *len_out) {
   if (lc == 0) {
     iso7816_set_sw(apdu_out, len_out, SW_WRONG_LENGTH);
-    return;
+    return true;
   }
 
   uint8_t cmd = data[0];
@@ -293,10 +784,14 @@ static void handle_fido_msg(uint8_t *data, uint16_t lc, uint8_t *apdu_out,
 
   switch (cmd) {
   case CTAP2_MAKE_CREDENTIAL: {
-    handle_make_credential(apdu_out, len_out);
+    if (!user_present())
+      return false;
+    handle_make_credential(data, lc, apdu_out, len_out);
     break;
   }
   case CTAP2_GET_ASSERTION: {
+    if (!user_present())
+      return false;
     handle_get_assertion(data, lc, apdu_out, len_out);
     break;
   }
@@ -308,11 +803,12 @@ static void handle_fido_msg(uint8_t *data, uint16_t lc, uint8_t *apdu_out,
     iso7816_set_sw(apdu_out, len_out, SW_FUNC_NOT_SUPPORTED);
     break;
   }
+  return true;
 }
 
-void fido2_applet_handle_msg(uint8_t *data_in, uint16_t len_in,
+bool fido2_applet_handle_msg(uint8_t *data_in, uint16_t len_in,
                              uint8_t *data_out, uint16_t *len_out) {
-  handle_fido_msg(data_in, len_in, data_out, len_out);
+  return handle_fido_msg(data_in, len_in, data_out, len_out);
 }
 
 void fido2_applet_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
@@ -329,8 +825,15 @@ void fido2_applet_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
     break;
 
   case INS_FIDO_MSG: {
-    uint16_t lc = (len_in > 4) ? apdu_in[APDU_LC_POS] : 0;
-    handle_fido_msg(&apdu_in[APDU_DATA_POS], lc, apdu_out, len_out);
+    // CTAP requests routinely exceed 255 bytes and arrive as extended APDUs
+    iso7816_apdu_t apdu;
+    if (!iso7816_parse_apdu(apdu_in, len_in, &apdu)) {
+      iso7816_set_sw(apdu_out, len_out, SW_WRONG_LENGTH);
+      break;
+    }
+    // U2F convention for a missing test of user presence
+    if (!handle_fido_msg((uint8_t *)apdu.data, apdu.lc, apdu_out, len_out))
+      iso7816_set_sw(apdu_out, len_out, SW_CONDITIONS_NOT_SATISFIED);
     break;
   }
 
@@ -3,12 +3,20 @@
 
 #include "../applet_manager.h"
 #include "apdu_protocol.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+// User presence button, active low; the OATH touch button
+#define FIDO2_TOUCH_PIN 21
+
 void fido2_applet_init(void);
 void fido2_applet_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
                               uint8_t *apdu_out, uint16_t *len_out);
-void fido2_applet_handle_msg(uint8_t *data_in, uint16_t len_in,
+// Returns false, writing nothing, when the request needs user presence and
+// the button is not pressed; the client submits it again later
+bool fido2_applet_handle_msg(uint8_t *data_in, uint16_t len_in,
                              uint8_t *data_out, uint16_t *len_out);
+// Forget the credential wrapping key derived from the master key
+void fido2_applet_wipe_keys(void);
 
 #endif // FIDO2_APPLET_H
@@ -1,81 +1,340 @@
 #include "fido2_storage.h"
 #include "../crypto/aes_gcm.h"
+#include "../crypto/hmac.h"
 #include "../security/security.h"
-#include <hardware/address_mapped.h>
-#include <hardware/flash.h>
-#include <hardware/sync.h>
-#include <pico/stdlib.h>
+#include "../security/security_manager.h"
+#include "flash_journal.h"
+#include <pico/rand.h>
 #include <stdio.h>
 #include <string.h>
 
+#define FIDO2_JOURNAL_MAGIC 0x4A4F4446 // "FDOJ"
 
-#define FIDO2_MAGIC 0x46444F32 // "FDO2"
+// Journal record types (see flash_journal.h)
+#define FIDO2_REC_CREDENTIAL 0x01 // key = slot, payload = fido2_record_t
+#define FIDO2_REC_COUNTER 0x02    // payload = reserved counter limit (LE32)
 
+// Counter values reserved by each counter record
+#define FIDO2_COUNTER_LEASE 32
+
+#define FIDO2_RP_TAG_LEN 8
+
+// Domain separation label for the RP index key
+static const char RP_INDEX_LABEL[] = "RP2350-FIDO2 rp index v1";
+
+// Credential record. The RP tag is stored in clear for the index and is the
+// AAD of the encrypted credential, so a record cannot be moved to another RP.
 typedef struct {
-  uint32_t magic;
-  fido2_storage_t storage;
+  uint8_t rp_tag[FIDO2_RP_TAG_LEN];
   uint8_t iv[12];
   uint8_t tag[16];
-  uint8_t encrypted_data[sizeof(fido2_storage_t)];
-} fido2_persist_t;
+  uint8_t ciphertext[sizeof(fido2_credential_t)];
+} fido2_record_t;
+
+typedef struct {
+  uint8_t rp_tag[FIDO2_RP_TAG_LEN];
+  uint32_t addr; // Journal record backing the slot, 0 if free
+} slot_entry_t;
 
-static fido2_storage_t current_fido_storage;
+static slot_entry_t slots[FIDO2_MAX_RESIDENT];
+// Used slots sorted by RP tag
+static uint8_t order[FIDO2_MAX_RESIDENT];
+static uint32_t order_len;
 
-static void fido2_save_to_flash(void) {
-  uint8_t master_key[32];
-  security_get_master_key(master_key);
+static hmac_midstate_t rp_index_key;
+static bool rp_index_ready;
 
-  fido2_persist_t persist;
-  persist.magic = FIDO2_MAGIC;
-  persist.storage = current_fido_storage;
+static uint32_t counter_value; // Last value handed out
+static uint32_t counter_limit; // Highest value reserved on flash
+static uint32_t counter_addr;  // Record holding counter_limit, 0 if none
 
-  for (int i = 0; i < 12; i++)
-    persist.iv[i] = (uint8_t)i;
+static bool mounted;
 
-  if (!aes_gcm_encrypt(master_key, persist.iv, (uint8_t *)&persist.storage,
-                       sizeof(fido2_storage_t), persist.tag,
-                       persist.encrypted_data)) {
-    printf("FIDO2 Storage: Encryption failed!\n");
-    return;
+static bool record_is_live(void *ctx, const flash_journal_record_t *rec,
+                           uint32_t addr);
+static void record_relocated(void *ctx, const flash_journal_record_t *rec,
+                             uint32_t old_addr, uint32_t new_addr);
+
+static flash_journal_t journal = {
+    .base = FIDO2_JOURNAL_OFFSET,
+    .sector_count = FIDO2_JOURNAL_SECTORS,
+    .magic = FIDO2_JOURNAL_MAGIC,
+    .owner = {.is_live = record_is_live, .relocated = record_relocated},
+};
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+//--------------------------------------------------------------------+
+// RP Index
+//--------------------------------------------------------------------+
+
+// tag = HMAC(HMAC(master_key, label), rpIdHash)[0..FIDO2_RP_TAG_LEN). Keeps
+// the list of registered RPs out of a flash dump.
+static bool compute_rp_tag(const uint8_t *rp_id_hash, uint8_t *tag_out) {
+  if (!rp_index_ready) {
+    uint8_t master_key[32];
+    uint8_t index_key[SHA256_DIGEST_SIZE];
+    if (!security_get_master_key(master_key))
+      return false;
+    hmac_sha256(master_key, sizeof(master_key),
+                (const uint8_t *)RP_INDEX_LABEL, sizeof(RP_INDEX_LABEL) - 1,
+                index_key);
+    hmac_sha256_precompute(index_key, sizeof(index_key), &rp_index_key);
+    rp_index_ready = true;
+    memset(master_key, 0, sizeof(master_key));
+    memset(index_key, 0, sizeof(index_key));
+  }
+
+  uint8_t mac[SHA256_DIGEST_SIZE];
+  hmac_sha256_resume(&rp_index_key, rp_id_hash, FIDO2_RP_ID_HASH_LEN, mac);
+  memcpy(tag_out, mac, FIDO2_RP_TAG_LEN);
+  memset(mac, 0, sizeof(mac));
+  return true;
+}
+
+void fido2_storage_wipe_keys(void) {
+  volatile uint8_t *p = (volatile uint8_t *)&rp_index_key;
+  for (size_t i = 0; i < sizeof(rp_index_key); i++)
+    p[i] = 0;
+  rp_index_ready = false;
+}
+
+// First position in `order` whose tag is not below `tag`
+static uint32_t lower_bound(const uint8_t *tag) {
+  uint32_t lo = 0, hi = order_len;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (memcmp(slots[order[mid]].rp_tag, tag, FIDO2_RP_TAG_LEN) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return lo;
+}
 
-  uint32_t ints = save_and_disable_interrupts();
-  flash_range_erase(FIDO2_FLASH_OFFSET, FLASH_SECTOR_SIZE);
-  flash_range_program(FIDO2_FLASH_OFFSET, (uint8_t *)&persist, sizeof(persist));
-  restore_interrupts(ints);
+static void index_insert(uint8_t slot) {
+  uint32_t pos = lower_bound(slots[slot].rp_tag);
+  memmove(&order[pos + 1], &order[pos], order_len - pos);
+  order[pos] = slot;
+  order_len++;
+}
 
-  printf("FIDO2 Storage: Saved and encrypted to flash.\n");
+static void rebuild_index(void) {
+  order_len = 0;
+  for (int i = 0; i < FIDO2_MAX_RESIDENT; i++) {
+    if (slots[i].addr != 0)
+      index_insert((uint8_t)i);
+  }
 }
 
-static void fido2_load_from_flash(void) {
-  const fido2_persist_t *stored_data =
-      (const fido2_persist_t *)(XIP_BASE + FIDO2_FLASH_OFFSET);
+static bool read_slot(const aes_gcm_ctx_t *gcm, uint8_t slot,
+                      fido2_credential_t *cred) {
+  uint16_t len;
+  const fido2_record_t *rec =
+      (const fido2_record_t *)flash_journal_payload(slots[slot].addr, &len);
+  if (len != sizeof(fido2_record_t))
+    return false;
+  return aes_gcm_ctx_decrypt(gcm, rec->iv, rec->rp_tag, FIDO2_RP_TAG_LEN,
+                             rec->ciphertext, sizeof(rec->ciphertext),
+                             rec->tag, (uint8_t *)cred);
+}
 
-  if (stored_data->magic != FIDO2_MAGIC) {
-    printf("FIDO2 Storage: No valid data in flash. Initializing empty.\n");
-    memset(&current_fido_storage, 0, sizeof(fido2_storage_t));
-    fido2_save_to_flash();
-    return;
+//--------------------------------------------------------------------+
+// Journal Callbacks
+//--------------------------------------------------------------------+
+
+static bool record_is_live(void *ctx, const flash_journal_record_t *rec,
+                           uint32_t addr) {
+  (void)ctx;
+  switch (rec->type) {
+  case FIDO2_REC_CREDENTIAL:
+    return rec->key < FIDO2_MAX_RESIDENT && slots[rec->key].addr == addr;
+  case FIDO2_REC_COUNTER:
+    return counter_addr == addr;
+  default:
+    return false;
   }
+}
 
-  uint8_t master_key[32];
-  security_get_master_key(master_key);
+static void record_relocated(void *ctx, const flash_journal_record_t *rec,
+                             uint32_t old_addr, uint32_t new_addr) {
+  (void)ctx;
+  (void)old_addr;
+  if (rec->type == FIDO2_REC_CREDENTIAL)
+    slots[rec->key].addr = new_addr;
+  else if (rec->type == FIDO2_REC_COUNTER)
+    counter_addr = new_addr;
+}
 
-  if (aes_gcm_decrypt(master_key, stored_data->iv, stored_data->encrypted_data,
-                      sizeof(fido2_storage_t), stored_data->tag,
-                      (uint8_t *)&current_fido_storage)) {
-    printf("FIDO2 Storage: Loaded and decrypted from flash.\n");
-  } else {
-    printf("FIDO2 Storage: Decryption failed! Re-initializing.\n");
-    memset(&current_fido_storage, 0, sizeof(fido2_storage_t));
+static void replay_record(void *ctx, const flash_journal_record_t *rec,
+                          const uint8_t *payload, uint32_t addr) {
+  (void)ctx;
+  switch (rec->type) {
+  case FIDO2_REC_CREDENTIAL:
+    if (rec->key >= FIDO2_MAX_RESIDENT || rec->len != sizeof(fido2_record_t))
+      return;
+    memcpy(slots[rec->key].rp_tag, payload, FIDO2_RP_TAG_LEN);
+    slots[rec->key].addr = addr;
+    break;
+
+  case FIDO2_REC_COUNTER:
+    if (rec->len != 4)
+      return;
+    counter_limit = get_le32(payload);
+    counter_addr = addr;
+    break;
+
+  default:
+    break;
   }
 }
 
+//--------------------------------------------------------------------+
+// Public API
+//--------------------------------------------------------------------+
+
 void fido2_storage_init(void) {
   printf("FIDO2 Storage: Initializing...\n");
-  fido2_load_from_flash();
+
+  memset(slots, 0, sizeof(slots));
+  order_len = 0;
+  counter_limit = 0;
+  counter_addr = 0;
+  mounted = false;
+
+  if (!security_get_storage_ctx())
+    return;
+
+  if (!flash_journal_mount(&journal, replay_record, NULL)) {
+    printf("FIDO2 Storage: Journal unusable. Initializing empty.\n");
+    memset(slots, 0, sizeof(slots));
+    counter_limit = 0;
+    counter_addr = 0;
+    if (!flash_journal_format(&journal))
+      return;
+  }
+
+  // Values between the last one used and the limit are given up
+  counter_value = counter_limit;
+  rebuild_index();
+  mounted = true;
+
+  // A full store plus the counter record must leave compaction room
+  uint32_t needed =
+      FIDO2_MAX_RESIDENT * flash_journal_record_size(sizeof(fido2_record_t)) +
+      flash_journal_record_size(4);
+  if (needed > flash_journal_capacity(&journal, sizeof(fido2_record_t)))
+    printf("FIDO2 Storage: WARNING - journal too small for %d credentials\n",
+           FIDO2_MAX_RESIDENT);
+
+  printf("FIDO2 Storage: %lu discoverable credentials, counter %lu\n",
+         (unsigned long)order_len, (unsigned long)counter_value);
 }
 
-void fido2_storage_save(void) { fido2_save_to_flash(); }
+bool fido2_storage_put(const uint8_t *rp_id_hash,
+                       const fido2_credential_t *cred) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!mounted || !gcm)
+    return false;
+
+  fido2_record_t rec;
+  if (!compute_rp_tag(rp_id_hash, rec.rp_tag))
+    return false;
+
+  // Same RP and user: replace. Otherwise take a free slot.
+  int slot = -1;
+  fido2_credential_t old;
+  for (uint32_t pos = lower_bound(rec.rp_tag);
+       pos < order_len && slot < 0 &&
+       memcmp(slots[order[pos]].rp_tag, rec.rp_tag, FIDO2_RP_TAG_LEN) == 0;
+       pos++) {
+    if (read_slot(gcm, order[pos], &old) &&
+        old.user_id_len == cred->user_id_len &&
+        memcmp(old.user_id, cred->user_id, cred->user_id_len) == 0)
+      slot = order[pos];
+  }
+  memset(&old, 0, sizeof(old));
+
+  bool is_new = slot < 0;
+  for (int i = 0; is_new && slot < 0 && i < FIDO2_MAX_RESIDENT; i++) {
+    if (slots[i].addr == 0)
+      slot = i;
+  }
+  if (slot < 0) {
+    printf("FIDO2 Storage: Credential store full.\n");
+    return false;
+  }
+
+  for (int i = 0; i < 12; i += 4) {
+    uint32_t r = get_rand_32();
+    memcpy(rec.iv + i, &r, 4);
+  }
+  if (!aes_gcm_ctx_encrypt(gcm, rec.iv, rec.rp_tag, FIDO2_RP_TAG_LEN,
+                           (const uint8_t *)cred, sizeof(*cred),
+                           rec.ciphertext, rec.tag))
+    return false;
+
+  uint32_t addr;
+  if (!flash_journal_append(&journal, FIDO2_REC_CREDENTIAL, (uint8_t)slot,
+                            (const uint8_t *)&rec, sizeof(rec), &addr))
+    return false;
+
+  slots[slot].addr = addr;
+  if (is_new) {
+    memcpy(slots[slot].rp_tag, rec.rp_tag, FIDO2_RP_TAG_LEN);
+    index_insert((uint8_t)slot);
+  }
+  return true;
+}
+
+bool fido2_storage_find(const uint8_t *rp_id_hash, uint32_t *cursor,
+                        fido2_credential_t *cred_out) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  uint8_t tag[FIDO2_RP_TAG_LEN];
+  if (!mounted || !gcm || !compute_rp_tag(rp_id_hash, tag))
+    return false;
+
+  // The cursor holds the next position plus one; 0 starts a new search
+  uint32_t pos = *cursor ? *cursor - 1 : lower_bound(tag);
+  for (; pos < order_len &&
+         memcmp(slots[order[pos]].rp_tag, tag, FIDO2_RP_TAG_LEN) == 0;
+       pos++) {
+    if (read_slot(gcm, order[pos], cred_out)) {
+      *cursor = pos + 2;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool fido2_storage_next_counter(uint32_t *value_out) {
+  if (!mounted)
+    return false;
+
+  if (counter_value == counter_limit) {
+    uint8_t payload[4];
+    uint32_t limit = counter_limit + FIDO2_COUNTER_LEASE;
+    uint32_t addr;
+    put_le32(payload, limit);
+    if (!flash_journal_append(&journal, FIDO2_REC_COUNTER, 0, payload,
+                              sizeof(payload), &addr))
+      return false;
+    counter_limit = limit;
+    counter_addr = addr;
+  }
+
+  *value_out = ++counter_value;
+  return true;
+}
 
-fido2_storage_t *fido2_storage_get_data(void) { return &current_fido_storage; }
+uint32_t fido2_storage_count(void) { return order_len; }
@@ -4,41 +4,86 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * @file fido2_storage.h
+ * @brief Discoverable (resident) FIDO2 credentials and the signature counter.
+ *
+ * Credentials are encrypted records in a flash journal (see
+ * flash_journal.h), found through a RAM index sorted by a keyed tag of the
+ * rpIdHash. The signature counter is reserved in blocks whose upper bounds
+ * are appended to the same journal, so an assertion never erases a sector.
+ */
 
-// FIDO2 Storage Configuration
-// Using the 4th to last 4KB sector of Flash
-#define FIDO2_FLASH_OFFSET (2 * 1024 * 1024 - 16384)
-
-#define FIDO2_MAX_CREDENTIALS 10
-#define FIDO2_ID_LEN 16
+#define FIDO2_MAX_RESIDENT 128
 #define FIDO2_KEY_LEN 32
+#define FIDO2_RP_ID_HASH_LEN 32
+#define FIDO2_USER_ID_MAX 64
+
+// Credential ID: version | IV | private key | tag, the key sealed with
+// AES-GCM under the credential wrapping key and bound to the RP ID hash. The
+// version byte also names the key type: a P-256 scalar (ES256) or an
+// Ed25519 seed (EdDSA).
+#define FIDO2_CRED_ID_VERSION 0x01
+#define FIDO2_CRED_ID_VERSION_EDDSA 0x02
+#define FIDO2_CRED_IV_LEN 12
+#define FIDO2_CRED_TAG_LEN 16
+#define FIDO2_ID_LEN                                                           \
+  (1 + FIDO2_CRED_IV_LEN + FIDO2_KEY_LEN + FIDO2_CRED_TAG_LEN)
 
+// Discoverable credential. The private key travels inside the credential ID,
+// which only unwraps for its own RP, so the entry needs no copy of the
+// rpIdHash.
 typedef struct {
   uint8_t credential_id[FIDO2_ID_LEN];
-  uint8_t private_key[FIDO2_KEY_LEN];
-  char user_id[32];
-  char rp_id[64];
-  uint32_t sign_count;
+  uint8_t user_id_len;
+  uint8_t user_id[FIDO2_USER_ID_MAX];
 } fido2_credential_t;
 
-typedef struct {
-  uint32_t count;
-  fido2_credential_t credentials[FIDO2_MAX_CREDENTIALS];
-} fido2_storage_t;
-
 /**
- * @brief Initializes FIDO2 storage.
+ * @brief Mounts the credential journal and rebuilds the index.
  */
 void fido2_storage_init(void);
 
 /**
- * @brief Saves the current FIDO2 credentials to flash.
+ * @brief Stores a discoverable credential, replacing the one the same user
+ * already has with this RP.
+ *
+ * @return false if the store is full or the write failed.
+ */
+bool fido2_storage_put(const uint8_t *rp_id_hash,
+                       const fido2_credential_t *cred);
+
+/**
+ * @brief Walks the discoverable credentials of an RP.
+ *
+ * Set *cursor to 0 before the first call; each call fills cred_out with the
+ * next candidate. Candidates match on a 64-bit tag, so callers confirm them
+ * by unwrapping the credential ID.
+ *
+ * @return true while a candidate was returned.
+ */
+bool fido2_storage_find(const uint8_t *rp_id_hash, uint32_t *cursor,
+                        fido2_credential_t *cred_out);
+
+/**
+ * @brief Returns the next value of the authenticator-wide signature counter.
+ *
+ * Values increase strictly, also across resets; values reserved but unused
+ * before a reset are skipped.
+ *
+ * @return false if the counter could not be persisted.
+ */
+bool fido2_storage_next_counter(uint32_t *value_out);
+
+/**
+ * @brief Number of discoverable credentials stored.
  */
-void fido2_storage_save(void);
+uint32_t fido2_storage_count(void);
 
 /**
- * @brief Returns a pointer to the FIDO2 storage.
+ * @brief Forgets the cached RP index key. Called by
+ * security_wipe_storage_keys(); the next lookup derives it again.
  */
-fido2_storage_t *fido2_storage_get_data(void);
+void fido2_storage_wipe_keys(void);
 
 #endif // FIDO2_STORAGE_H
@@ -0,0 +1,169 @@
+#include "flash_counter.h"
+#include <hardware/address_mapped.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @file flash_counter.c
+ * @brief Bit-clearing counter cells with a two-bank fold on wrap.
+ */
+
+#ifndef FLASH_SECTOR_SIZE
+#define FLASH_SECTOR_SIZE 4096
+#endif
+
+#ifndef FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE 256
+#endif
+
+// Bank header, programmed as one page right after the bank is erased
+typedef struct {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t bases[FLASH_COUNTER_CELLS];
+  uint32_t checksum;
+} bank_header_t;
+
+_Static_assert(sizeof(bank_header_t) <= FLASH_PAGE_SIZE,
+               "bank header must fit in one page");
+_Static_assert(FLASH_PAGE_SIZE +
+                       FLASH_COUNTER_CELLS * FLASH_COUNTER_CELL_BYTES <=
+                   FLASH_SECTOR_SIZE,
+               "counter cells must fit in one sector");
+
+static uint8_t page_buf[FLASH_PAGE_SIZE];
+
+static inline uint32_t bank_addr(const flash_counter_t *fc, uint8_t bank) {
+  return fc->base + (uint32_t)bank * FLASH_SECTOR_SIZE;
+}
+
+static inline uint32_t cell_addr(const flash_counter_t *fc, uint8_t bank,
+                                 uint8_t cell) {
+  return bank_addr(fc, bank) + FLASH_PAGE_SIZE +
+         (uint32_t)cell * FLASH_COUNTER_CELL_BYTES;
+}
+
+static inline const bank_header_t *bank_header(const flash_counter_t *fc,
+                                               uint8_t bank) {
+  return (const bank_header_t *)(XIP_BASE + bank_addr(fc, bank));
+}
+
+static uint32_t header_checksum(const bank_header_t *hdr) {
+  // FNV-1a over everything but the checksum itself
+  const uint8_t *p = (const uint8_t *)hdr;
+  uint32_t h = 0x811C9DC5u;
+  for (size_t i = 0; i < offsetof(bank_header_t, checksum); i++) {
+    h ^= p[i];
+    h *= 0x01000193u;
+  }
+  return h;
+}
+
+static bool bank_valid(const flash_counter_t *fc, uint8_t bank) {
+  const bank_header_t *hdr = bank_header(fc, bank);
+  return hdr->magic == fc->magic && hdr->checksum == header_checksum(hdr);
+}
+
+static uint32_t cleared_bits(const flash_counter_t *fc, uint8_t bank,
+                             uint8_t cell) {
+  const uint8_t *p = (const uint8_t *)(XIP_BASE + cell_addr(fc, bank, cell));
+  uint32_t n = 0;
+  for (int i = 0; i < FLASH_COUNTER_CELL_BYTES; i++)
+    n += 8u - (uint32_t)__builtin_popcount(p[i]);
+  return n;
+}
+
+static void program_page(uint32_t page_addr) {
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(page_addr, page_buf, FLASH_PAGE_SIZE);
+  restore_interrupts(ints);
+}
+
+// Erases `bank` and writes a header carrying `bases`. The bank only becomes
+// valid once the header page is programmed, so an interrupted switch leaves
+// the previous bank in charge.
+static void write_bank(flash_counter_t *fc, uint8_t bank, uint32_t generation,
+                       const uint32_t *bases) {
+  bank_header_t hdr;
+  hdr.magic = fc->magic;
+  hdr.generation = generation;
+  memcpy(hdr.bases, bases, sizeof(hdr.bases));
+  hdr.checksum = header_checksum(&hdr);
+
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_erase(bank_addr(fc, bank), FLASH_SECTOR_SIZE);
+  restore_interrupts(ints);
+
+  memset(page_buf, 0xFF, sizeof(page_buf));
+  memcpy(page_buf, &hdr, sizeof(hdr));
+  program_page(bank_addr(fc, bank));
+
+  fc->active = bank;
+  fc->generation = generation;
+}
+
+static void fold(flash_counter_t *fc) {
+  uint32_t bases[FLASH_COUNTER_CELLS];
+  for (uint8_t c = 0; c < FLASH_COUNTER_CELLS; c++)
+    bases[c] = flash_counter_read(fc, c);
+
+  write_bank(fc, (uint8_t)(fc->active ^ 1), fc->generation + 1, bases);
+  fc->folds++;
+}
+
+bool flash_counter_mount(flash_counter_t *fc) {
+  bool valid0 = bank_valid(fc, 0);
+  bool valid1 = bank_valid(fc, 1);
+
+  if (!valid0 && !valid1) {
+    uint32_t zero[FLASH_COUNTER_CELLS] = {0};
+    printf("[COUNTER] Formatting counter region at 0x%08lx\n",
+           (unsigned long)fc->base);
+    write_bank(fc, 0, 1, zero);
+    return true;
+  }
+
+  if (valid0 && valid1) {
+    // Signed difference tolerates generation wrap-around
+    int32_t d = (int32_t)(bank_header(fc, 1)->generation -
+                          bank_header(fc, 0)->generation);
+    fc->active = d > 0 ? 1 : 0;
+  } else {
+    fc->active = valid0 ? 0 : 1;
+  }
+  fc->generation = bank_header(fc, fc->active)->generation;
+  return true;
+}
+
+uint32_t flash_counter_read(const flash_counter_t *fc, uint8_t cell) {
+  if (cell >= FLASH_COUNTER_CELLS)
+    return 0;
+  return bank_header(fc, fc->active)->bases[cell] +
+         cleared_bits(fc, fc->active, cell);
+}
+
+bool flash_counter_increment(flash_counter_t *fc, uint8_t cell) {
+  if (cell >= FLASH_COUNTER_CELLS)
+    return false;
+
+  if (cleared_bits(fc, fc->active, cell) >= FLASH_COUNTER_CELL_STEPS)
+    fold(fc);
+
+  uint32_t addr = cell_addr(fc, fc->active, cell);
+  const uint8_t *p = (const uint8_t *)(XIP_BASE + addr);
+  int i = 0;
+  while (i < FLASH_COUNTER_CELL_BYTES && p[i] == 0x00)
+    i++;
+  if (i == FLASH_COUNTER_CELL_BYTES)
+    return false;
+
+  // Clear the lowest set bit of the first byte that still has one
+  uint32_t page = addr & ~(uint32_t)(FLASH_PAGE_SIZE - 1);
+  memset(page_buf, 0xFF, sizeof(page_buf));
+  page_buf[addr - page + (uint32_t)i] = (uint8_t)(p[i] & (p[i] - 1));
+  program_page(page);
+  return true;
+}
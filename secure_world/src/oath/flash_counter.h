@@ -0,0 +1,49 @@
+#ifndef FLASH_COUNTER_H
+#define FLASH_COUNTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file flash_counter.h
+ * @brief Monotonic counters that increment by clearing bits in erased flash.
+ *
+ * Two sectors form two banks. The active bank holds a header page with a
+ * base value per cell, followed by 64-byte cells. A cell's value is its base
+ * plus the number of cleared bits, so an increment is a single page program
+ * with no erase. When a cell runs out of bits, every current value is folded
+ * into the bases of the other bank, which is then erased and activated.
+ */
+
+#define FLASH_COUNTER_CELLS 60
+#define FLASH_COUNTER_CELL_BYTES 64
+#define FLASH_COUNTER_CELL_STEPS (FLASH_COUNTER_CELL_BYTES * 8)
+
+typedef struct {
+  // Configuration (set before flash_counter_mount)
+  uint32_t base;  // Flash offset of two consecutive sectors
+  uint32_t magic; // Identifies this region's bank headers
+
+  // Runtime state
+  uint8_t active;      // Bank currently in use (0 or 1)
+  uint32_t generation; // Generation of the active bank
+  uint32_t folds;      // Bank switches since mount
+} flash_counter_t;
+
+/**
+ * @brief Selects the newest valid bank, formatting the region if none is.
+ */
+bool flash_counter_mount(flash_counter_t *fc);
+
+/**
+ * @brief Returns the current value of a cell.
+ */
+uint32_t flash_counter_read(const flash_counter_t *fc, uint8_t cell);
+
+/**
+ * @brief Adds one to a cell. Costs one page program, or a bank fold when the
+ * cell is exhausted.
+ */
+bool flash_counter_increment(flash_counter_t *fc, uint8_t cell);
+
+#endif // FLASH_COUNTER_H
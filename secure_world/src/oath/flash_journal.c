@@ -0,0 +1,378 @@
+#include "flash_journal.h"
+#include <hardware/address_mapped.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @file flash_journal.c
+ * @brief Log-structured record storage on NOR flash.
+ *
+ * Appends never rewrite existing bytes: a page is programmed from a buffer
+ * that holds 0xFF everywhere except the new bytes, and programming 0xFF
+ * leaves NOR cells untouched. Sector headers of compacted sectors are
+ * cleared to zero rather than erased; the erase is deferred until the sector
+ * is reused as head.
+ */
+
+#ifndef FLASH_SECTOR_SIZE
+#define FLASH_SECTOR_SIZE 4096
+#endif
+
+#ifndef FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE 256
+#endif
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;
+} sector_header_t;
+
+#define RECORD_ALIGN(len) (((len) + 3u) & ~3u)
+#define RECORD_SIZE(len) (sizeof(flash_journal_record_t) + RECORD_ALIGN(len))
+#define SECTOR_DATA_START (sizeof(sector_header_t))
+
+static uint8_t page_buf[FLASH_PAGE_SIZE];
+
+//--------------------------------------------------------------------+
+// Flash Helpers
+//--------------------------------------------------------------------+
+
+static inline uint32_t sector_addr(const flash_journal_t *j, uint8_t sector) {
+  return j->base + (uint32_t)sector * FLASH_SECTOR_SIZE;
+}
+
+static inline const void *xip_ptr(uint32_t addr) {
+  return (const void *)(XIP_BASE + addr);
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++)
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+  }
+  return ~crc;
+}
+
+static uint32_t record_crc(const flash_journal_record_t *rec,
+                           const uint8_t *payload) {
+  uint32_t crc = crc32_update(0, (const uint8_t *)rec,
+                              offsetof(flash_journal_record_t, crc));
+  return crc32_update(crc, payload, rec->len);
+}
+
+static void program_page(flash_journal_t *j, uint32_t page_addr) {
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_program(page_addr, page_buf, FLASH_PAGE_SIZE);
+  restore_interrupts(ints);
+  j->stats.pages_programmed++;
+}
+
+static void erase_sector(flash_journal_t *j, uint8_t sector) {
+  uint32_t ints = save_and_disable_interrupts();
+  flash_range_erase(sector_addr(j, sector), FLASH_SECTOR_SIZE);
+  restore_interrupts(ints);
+  j->stats.erases++;
+}
+
+// Programs `head` followed by `body` at `addr`, one page program per page
+// touched. Bytes outside the range are left at 0xFF in the page buffer.
+static void program_bytes(flash_journal_t *j, uint32_t addr,
+                          const uint8_t *head, uint32_t head_len,
+                          const uint8_t *body, uint32_t body_len) {
+  uint32_t total = head_len + body_len;
+  uint32_t pos = 0;
+
+  while (pos < total) {
+    uint32_t page = (addr + pos) & ~(uint32_t)(FLASH_PAGE_SIZE - 1);
+    uint32_t off = (addr + pos) - page;
+    uint32_t n = FLASH_PAGE_SIZE - off;
+    if (n > total - pos)
+      n = total - pos;
+
+    memset(page_buf, 0xFF, sizeof(page_buf));
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t p = pos + i;
+      page_buf[off + i] = (p < head_len) ? head[p] : body[p - head_len];
+    }
+    program_page(j, page);
+    pos += n;
+  }
+}
+
+static void write_record(flash_journal_t *j, uint32_t addr,
+                         const flash_journal_record_t *rec,
+                         const uint8_t *payload) {
+  program_bytes(j, addr, (const uint8_t *)rec, sizeof(*rec), payload,
+                rec->len);
+  j->stats.bytes_appended += RECORD_SIZE(rec->len);
+}
+
+static const sector_header_t *sector_header(const flash_journal_t *j,
+                                            uint8_t sector) {
+  return (const sector_header_t *)xip_ptr(sector_addr(j, sector));
+}
+
+static bool sector_valid(const flash_journal_t *j, uint8_t sector) {
+  const sector_header_t *hdr = sector_header(j, sector);
+  return hdr->magic == j->magic && hdr->seq != 0xFFFFFFFFu;
+}
+
+// Makes `sector` the new head: erase, then write its header.
+static void take_sector(flash_journal_t *j, uint8_t sector, uint32_t seq) {
+  sector_header_t hdr = {.magic = j->magic, .seq = seq};
+
+  erase_sector(j, sector);
+  program_bytes(j, sector_addr(j, sector), (const uint8_t *)&hdr,
+                sizeof(hdr), NULL, 0);
+  j->head = sector;
+  j->head_seq = seq;
+  j->write_off = SECTOR_DATA_START;
+}
+
+// Clears the header of a compacted sector so mount no longer treats it as
+// part of the ring. No erase needed: clearing bits is a plain program.
+static void retire_sector(flash_journal_t *j, uint8_t sector) {
+  const sector_header_t dead = {0, 0};
+  program_bytes(j, sector_addr(j, sector), (const uint8_t *)&dead,
+                sizeof(dead), NULL, 0);
+}
+
+//--------------------------------------------------------------------+
+// Record Walking
+//--------------------------------------------------------------------+
+
+typedef bool (*record_visit_fn)(flash_journal_t *j,
+                                const flash_journal_record_t *rec,
+                                uint32_t addr, void *arg);
+
+static bool header_erased(const flash_journal_record_t *rec) {
+  const uint8_t *p = (const uint8_t *)rec;
+  for (size_t i = 0; i < sizeof(*rec); i++) {
+    if (p[i] != 0xFF)
+      return false;
+  }
+  return true;
+}
+
+// Visits every valid record of `sector` in order. Returns the offset of the
+// first free byte, or FLASH_SECTOR_SIZE if the sector ends in a torn record
+// (nothing may be appended after it).
+static uint32_t walk_sector(flash_journal_t *j, uint8_t sector,
+                            record_visit_fn visit, void *arg) {
+  uint32_t base = sector_addr(j, sector);
+  uint32_t off = SECTOR_DATA_START;
+
+  while (off + sizeof(flash_journal_record_t) <= FLASH_SECTOR_SIZE) {
+    const flash_journal_record_t *rec = xip_ptr(base + off);
+    if (rec->type == FLASH_JOURNAL_TYPE_ERASED)
+      return header_erased(rec) ? off : FLASH_SECTOR_SIZE;
+
+    if (off + RECORD_SIZE(rec->len) > FLASH_SECTOR_SIZE ||
+        record_crc(rec, (const uint8_t *)(rec + 1)) != rec->crc) {
+      printf("[JOURNAL] Torn record at 0x%08lx, sealing sector.\n",
+             (unsigned long)(base + off));
+      return FLASH_SECTOR_SIZE;
+    }
+
+    if (!visit(j, rec, base + off, arg))
+      return FLASH_SECTOR_SIZE;
+    off += RECORD_SIZE(rec->len);
+  }
+  return off;
+}
+
+typedef struct {
+  flash_journal_replay_cb cb;
+  void *ctx;
+} replay_arg_t;
+
+static bool replay_visit(flash_journal_t *j, const flash_journal_record_t *rec,
+                         uint32_t addr, void *arg) {
+  (void)j;
+  replay_arg_t *r = (replay_arg_t *)arg;
+  if (r->cb)
+    r->cb(r->ctx, rec, (const uint8_t *)(rec + 1), addr);
+  return true;
+}
+
+static bool compact_visit(flash_journal_t *j, const flash_journal_record_t *rec,
+                          uint32_t addr, void *arg) {
+  bool *ok = (bool *)arg;
+  const flash_journal_owner_t *owner = &j->owner;
+
+  if (!owner->is_live || !owner->is_live(owner->ctx, rec, addr))
+    return true;
+
+  uint32_t size = RECORD_SIZE(rec->len);
+  if (j->write_off + size > FLASH_SECTOR_SIZE) {
+    *ok = false;
+    return false;
+  }
+
+  // Copy the header out of XIP first: it is reused for the new record.
+  flash_journal_record_t copy = *rec;
+  uint32_t new_addr = sector_addr(j, j->head) + j->write_off;
+  write_record(j, new_addr, &copy, (const uint8_t *)(rec + 1));
+  j->write_off += size;
+  j->stats.records_relocated++;
+
+  if (owner->relocated)
+    owner->relocated(owner->ctx, &copy, addr, new_addr);
+  return true;
+}
+
+// Copies the live records of the tail sector into the head and retires it.
+static bool compact_tail(flash_journal_t *j) {
+  bool ok = true;
+
+  walk_sector(j, j->tail, compact_visit, &ok);
+  if (!ok) {
+    printf("[JOURNAL] Compaction ran out of space.\n");
+    return false;
+  }
+
+  retire_sector(j, j->tail);
+  j->tail = (uint8_t)((j->tail + 1) % j->sector_count);
+  j->used--;
+  j->stats.gc_runs++;
+  return true;
+}
+
+// Moves the head to the next sector until `need` bytes fit. One sector is
+// always kept free so the next compaction has somewhere to copy to.
+static bool advance_head(flash_journal_t *j, uint32_t need) {
+  for (int attempt = 0; attempt < j->sector_count; attempt++) {
+    if (j->used >= j->sector_count)
+      return false;
+
+    take_sector(j, (uint8_t)((j->head + 1) % j->sector_count),
+                j->head_seq + 1);
+    j->used++;
+
+    if (j->used == j->sector_count && !compact_tail(j))
+      return false;
+
+    if (j->write_off + need <= FLASH_SECTOR_SIZE)
+      return true;
+  }
+  return false;
+}
+
+//--------------------------------------------------------------------+
+// Public API
+//--------------------------------------------------------------------+
+
+bool flash_journal_format(flash_journal_t *j) {
+  printf("[JOURNAL] Formatting %u sectors at 0x%08lx\n", j->sector_count,
+         (unsigned long)j->base);
+
+  for (uint8_t s = 0; s < j->sector_count; s++)
+    erase_sector(j, s);
+
+  take_sector(j, 0, 1);
+  j->tail = 0;
+  j->used = 1;
+  return true;
+}
+
+bool flash_journal_mount(flash_journal_t *j, flash_journal_replay_cb cb,
+                         void *ctx) {
+  if (j->sector_count < 3 || j->sector_count > FLASH_JOURNAL_MAX_SECTORS)
+    return false;
+
+  // The head is the valid sector with the highest sequence number
+  int head = -1;
+  uint32_t head_seq = 0;
+  for (uint8_t s = 0; s < j->sector_count; s++) {
+    if (!sector_valid(j, s))
+      continue;
+    uint32_t seq = sector_header(j, s)->seq;
+    if (head < 0 || seq > head_seq) {
+      head = s;
+      head_seq = seq;
+    }
+  }
+
+  if (head < 0)
+    return flash_journal_format(j);
+
+  // Walk backwards while sequence numbers stay consecutive
+  j->head = (uint8_t)head;
+  j->head_seq = head_seq;
+  j->tail = j->head;
+  j->used = 1;
+  while (j->used < j->sector_count) {
+    uint8_t prev = (uint8_t)((j->tail + j->sector_count - 1) % j->sector_count);
+    if (!sector_valid(j, prev) ||
+        sector_header(j, prev)->seq != sector_header(j, j->tail)->seq - 1)
+      break;
+    j->tail = prev;
+    j->used++;
+  }
+
+  replay_arg_t arg = {.cb = cb, .ctx = ctx};
+  for (uint8_t i = 0; i < j->used; i++) {
+    uint8_t s = (uint8_t)((j->tail + i) % j->sector_count);
+    uint32_t end = walk_sector(j, s, replay_visit, &arg);
+    if (s == j->head)
+      j->write_off = end;
+  }
+
+  printf("[JOURNAL] Mounted: %u/%u sectors in use, head seq %lu\n", j->used,
+         j->sector_count, (unsigned long)j->head_seq);
+
+  // Power was lost between taking the last free sector and retiring the tail
+  if (j->used == j->sector_count)
+    return compact_tail(j);
+  return true;
+}
+
+bool flash_journal_append(flash_journal_t *j, uint8_t type, uint8_t key,
+                          const uint8_t *payload, uint16_t len,
+                          uint32_t *addr_out) {
+  if (type == FLASH_JOURNAL_TYPE_ERASED || len > flash_journal_max_payload())
+    return false;
+
+  uint32_t size = RECORD_SIZE(len);
+  if (j->write_off + size > FLASH_SECTOR_SIZE && !advance_head(j, size))
+    return false;
+
+  flash_journal_record_t rec = {.type = type, .key = key, .len = len};
+  rec.crc = record_crc(&rec, payload);
+
+  uint32_t addr = sector_addr(j, j->head) + j->write_off;
+  write_record(j, addr, &rec, payload);
+  j->write_off += size;
+  j->stats.records_appended++;
+
+  if (addr_out)
+    *addr_out = addr;
+  return true;
+}
+
+const uint8_t *flash_journal_payload(uint32_t addr, uint16_t *len_out) {
+  const flash_journal_record_t *rec = xip_ptr(addr);
+  if (len_out)
+    *len_out = rec->len;
+  return (const uint8_t *)(rec + 1);
+}
+
+uint16_t flash_journal_max_payload(void) {
+  return (uint16_t)(FLASH_SECTOR_SIZE - SECTOR_DATA_START -
+                    sizeof(flash_journal_record_t));
+}
+
+uint32_t flash_journal_record_size(uint16_t len) { return RECORD_SIZE(len); }
+
+uint32_t flash_journal_capacity(const flash_journal_t *j, uint16_t max_len) {
+  // One sector is kept free for compaction and one more absorbs the head
+  // being partly used. Each sector may waste up to one record at its end.
+  uint32_t per_sector =
+      FLASH_SECTOR_SIZE - SECTOR_DATA_START - RECORD_SIZE(max_len);
+  return (uint32_t)(j->sector_count - 2) * per_sector;
+}
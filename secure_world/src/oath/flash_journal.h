@@ -0,0 +1,131 @@
+#ifndef FLASH_JOURNAL_H
+#define FLASH_JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file flash_journal.h
+ * @brief Append-only record log spread over a ring of flash sectors.
+ *
+ * Each sector starts with a small header (magic + sequence number) and is
+ * filled with records in write order. A mutation costs one record append,
+ * which only programs the flash pages it touches; sectors are erased only
+ * when the ring wraps and the oldest sector has been compacted.
+ *
+ * The journal does not interpret payloads. Its owner keeps a RAM index of
+ * which records are current, answers liveness queries during compaction and
+ * is told where relocated records end up.
+ */
+
+#define FLASH_JOURNAL_MAX_SECTORS 32
+#define FLASH_JOURNAL_TYPE_ERASED 0xFF // Unwritten header (end of sector)
+
+// On-flash record header. The payload follows, padded to a 4-byte boundary.
+typedef struct {
+  uint8_t type;    // Owner defined, never FLASH_JOURNAL_TYPE_ERASED
+  uint8_t key;     // Owner defined (e.g. slot number)
+  uint16_t len;    // Payload length in bytes
+  uint32_t crc;    // CRC-32 over type, key, len and payload
+} flash_journal_record_t;
+
+typedef struct {
+  uint32_t erases;            // Sector erases
+  uint32_t pages_programmed;  // 256-byte page programs
+  uint32_t bytes_appended;    // Record bytes written (headers included)
+  uint32_t records_appended;  // Records written by the owner
+  uint32_t gc_runs;           // Sectors compacted
+  uint32_t records_relocated; // Live records copied forward by compaction
+} flash_journal_stats_t;
+
+typedef struct {
+  // Return true if the record at `addr` is still referenced by the owner.
+  // Records reported dead are dropped when their sector is compacted.
+  bool (*is_live)(void *ctx, const flash_journal_record_t *rec, uint32_t addr);
+  // A live record was copied from `old_addr` to `new_addr`.
+  void (*relocated)(void *ctx, const flash_journal_record_t *rec,
+                    uint32_t old_addr, uint32_t new_addr);
+  void *ctx;
+} flash_journal_owner_t;
+
+typedef struct {
+  // Configuration (set before flash_journal_mount)
+  uint32_t base;         // Flash offset of the first sector (sector aligned)
+  uint8_t sector_count;  // Sectors in the ring, at least 3
+  uint32_t magic;        // Identifies this journal's sector headers
+  flash_journal_owner_t owner;
+
+  // Runtime state
+  uint8_t head;       // Sector currently being appended to
+  uint8_t tail;       // Oldest sector holding records
+  uint8_t used;       // Sectors from tail to head inclusive
+  uint32_t head_seq;  // Sequence number of the head sector
+  uint32_t write_off; // Next free byte in the head sector
+  flash_journal_stats_t stats;
+} flash_journal_t;
+
+/**
+ * @brief Called for each valid record during replay, oldest first.
+ *
+ * @param addr Flash offset of the record header. The payload can be read
+ *             later through flash_journal_payload().
+ */
+typedef void (*flash_journal_replay_cb)(void *ctx,
+                                        const flash_journal_record_t *rec,
+                                        const uint8_t *payload, uint32_t addr);
+
+/**
+ * @brief Scans the sector ring and replays every record in write order.
+ *
+ * Sectors without a valid header are treated as free. If no sector is valid
+ * the journal is formatted. A torn record at the end of the head sector stops
+ * replay of that sector and the next append starts a fresh sector.
+ *
+ * @return true if the journal is ready for appends.
+ */
+bool flash_journal_mount(flash_journal_t *j, flash_journal_replay_cb cb,
+                         void *ctx);
+
+/**
+ * @brief Appends one record.
+ *
+ * Moves to the next sector when the head is full, compacting the oldest
+ * sector first if no free sector would be left for the next compaction.
+ *
+ * @param addr_out Optional, receives the flash offset of the new record.
+ * @return false if the record cannot fit even after compaction.
+ */
+bool flash_journal_append(flash_journal_t *j, uint8_t type, uint8_t key,
+                          const uint8_t *payload, uint16_t len,
+                          uint32_t *addr_out);
+
+/**
+ * @brief Erases every sector of the ring and writes a fresh head.
+ */
+bool flash_journal_format(flash_journal_t *j);
+
+/**
+ * @brief Returns a read pointer (XIP) to the payload of the record at `addr`.
+ *
+ * @param len_out Optional, receives the payload length.
+ */
+const uint8_t *flash_journal_payload(uint32_t addr, uint16_t *len_out);
+
+/**
+ * @brief Largest payload a single record can carry.
+ */
+uint16_t flash_journal_max_payload(void);
+
+/**
+ * @brief Flash bytes taken by a record with a `len`-byte payload.
+ */
+uint32_t flash_journal_record_size(uint16_t len);
+
+/**
+ * @brief Total record size (see flash_journal_record_size) that may be live
+ * at once while compaction is still guaranteed to make progress, when no
+ * record payload exceeds `max_len`.
+ */
+uint32_t flash_journal_capacity(const flash_journal_t *j, uint16_t max_len);
+
+#endif // FLASH_JOURNAL_H
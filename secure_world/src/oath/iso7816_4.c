@@ -15,3 +15,68 @@ void iso7816_finalize_response(uint8_t *buffer, uint16_t data_len,
   buffer[data_len + 1] = (uint8_t)(sw & 0xFF);
   *total_len = data_len + 2;
 }
+
+bool iso7816_parse_apdu(const uint8_t *buf, uint16_t len,
+                        iso7816_apdu_t *out) {
+  memset(out, 0, sizeof(*out));
+  if (len < 4)
+    return false;
+  out->cla = buf[APDU_CLA_POS];
+  out->ins = buf[APDU_INS_POS];
+  out->p1 = buf[APDU_P1_POS];
+  out->p2 = buf[APDU_P2_POS];
+
+  // Case 1: header only
+  if (len == 4)
+    return true;
+
+  const uint8_t *body = buf + 4;
+  uint16_t body_len = len - 4;
+
+  // Short APDUs: a non-zero first byte, or a lone Le byte
+  if (body[0] != 0x00 || body_len == 1) {
+    if (body_len == 1) { // Case 2S
+      out->le = body[0] ? body[0] : 256;
+      return true;
+    }
+    out->lc = body[0];
+    out->data = body + 1;
+    if (body_len == 1 + out->lc) // Case 3S
+      return true;
+    if (body_len == 2 + out->lc) { // Case 4S
+      out->le = body[body_len - 1] ? body[body_len - 1] : 256;
+      return true;
+    }
+    return false;
+  }
+
+  // Extended APDUs start with a zero byte followed by two length bytes
+  out->extended = true;
+  if (body_len < 3)
+    return false;
+  uint16_t n = (uint16_t)((body[1] << 8) | body[2]);
+  if (body_len == 3) { // Case 2E
+    out->le = n ? n : 65536;
+    return true;
+  }
+  if (n == 0)
+    return false;
+  out->lc = n;
+  out->data = body + 3;
+  if (body_len == 3 + (uint32_t)n) // Case 3E
+    return true;
+  if (body_len == 5 + (uint32_t)n) { // Case 4E
+    uint16_t le = (uint16_t)((body[body_len - 2] << 8) | body[body_len - 1]);
+    out->le = le ? le : 65536;
+    return true;
+  }
+  return false;
+}
+
+uint16_t iso7816_response_limit(const iso7816_apdu_t *apdu) {
+  uint32_t le = apdu->le;
+  if (le == 0)
+    le = apdu->extended ? ISO7816_MAX_RESPONSE_DATA : 256;
+  return le > ISO7816_MAX_RESPONSE_DATA ? ISO7816_MAX_RESPONSE_DATA
+                                        : (uint16_t)le;
+}
@@ -1,11 +1,16 @@
 #ifndef ISO7816_4_H
 #define ISO7816_4_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "secure_gateway.h"
+
 // ISO 7816-4 Status Words (SW)
 #define SW_OK 0x9000
 #define SW_WRONG_LENGTH 0x6700
+#define SW_VERIFY_FAILED 0x63C0 // Low nibble: tries left
+#define SW_AUTH_METHOD_BLOCKED 0x6983
 #define SW_CONDITIONS_NOT_SATISFIED 0x6985
 #define SW_WRONG_DATA 0x6A80
 #define SW_FUNC_NOT_SUPPORTED 0x6A81
@@ -23,6 +28,38 @@
 #define APDU_LC_POS 4
 #define APDU_DATA_POS 5
 
+// Largest response data field that fits the gateway buffer with its SW
+#define ISO7816_MAX_RESPONSE_DATA (SG_APDU_MAX_LEN - 2)
+
+// A command APDU split into its fields (ISO 7816-4 section 5.1)
+typedef struct {
+  uint8_t cla;
+  uint8_t ins;
+  uint8_t p1;
+  uint8_t p2;
+  const uint8_t *data; // Command data (Lc bytes), NULL if absent
+  uint16_t lc;
+  uint32_t le;   // Expected response length, 0 if absent (up to 65536)
+  bool extended; // Lc/Le were coded on two bytes
+} iso7816_apdu_t;
+
+/**
+ * @brief Parses a short or extended command APDU (cases 1 to 4).
+ *
+ * An Le of zero means the maximum: 256 for short and 65536 for extended
+ * APDUs.
+ *
+ * @return false if the length fields do not match the buffer length.
+ */
+bool iso7816_parse_apdu(const uint8_t *buf, uint16_t len, iso7816_apdu_t *out);
+
+/**
+ * @brief Response data budget for a command: its Le, capped at
+ * ISO7816_MAX_RESPONSE_DATA. Without Le, short commands get 256 bytes and
+ * extended ones the full budget.
+ */
+uint16_t iso7816_response_limit(const iso7816_apdu_t *apdu);
+
 /**
  * @brief Sets a Status Word in the response buffer.
  *
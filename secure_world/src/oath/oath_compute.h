@@ -0,0 +1,76 @@
+#ifndef OATH_COMPUTE_H
+#define OATH_COMPUTE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "oath_storage.h"
+
+/**
+ * @file oath_compute.h
+ * @brief HOTP (RFC 4226) and TOTP (RFC 6238) code generation.
+ *
+ * Works on the binary secret held in the credential: the HMAC runs
+ * directly over it and the dynamic truncation reads the MAC in place.
+ */
+
+#define OATH_MIN_DIGITS 6
+#define OATH_MAX_DIGITS 8
+#define OATH_DEFAULT_PERIOD 30 // TOTP step when a credential stores 0
+
+/**
+ * @brief Computes the truncated OTP value for a credential.
+ *
+ * @param cred Credential (secret, algorithm and digits are used).
+ * @param moving_factor HOTP counter, or TOTP time step.
+ * @param code_out Receives the code, already reduced to cred->digits.
+ * @return false if the algorithm or digit count is not supported.
+ */
+bool oath_compute(const oath_credential_t *cred, uint64_t moving_factor,
+                  uint32_t *code_out);
+
+/**
+ * @brief Computes the HMAC pad states of a credential for its algorithm.
+ *
+ * Does nothing if cred->pads_algorithm already matches cred->algorithm.
+ * oath_compute() uses valid pads and skips hashing the padded key.
+ *
+ * @return false if the algorithm is not supported (pads are cleared).
+ */
+bool oath_compute_prepare(oath_credential_t *cred);
+
+/**
+ * @brief Number of 32-bit words in each pad state for an algorithm, 0 if
+ * the algorithm is not supported.
+ */
+uint8_t oath_pad_state_words(uint8_t algorithm);
+
+/**
+ * @brief TOTP period of a credential in seconds (OATH_DEFAULT_PERIOD if
+ * unset).
+ */
+uint32_t oath_period(const oath_credential_t *cred);
+
+/**
+ * @brief Moving factor for a credential at Unix time `ts`: the time step
+ * for TOTP, the stored counter for HOTP.
+ */
+uint64_t oath_moving_factor(const oath_credential_t *cred, uint64_t ts);
+
+/**
+ * @brief Checks the engine against the RFC 6238 test vectors (SHA-1,
+ * SHA-256 and SHA-512), with and without precomputed pads.
+ *
+ * @return false if any vector fails (each failure is logged).
+ */
+bool oath_compute_self_test(void);
+
+/**
+ * @brief Formats a code as zero-padded decimal digits.
+ *
+ * @param out Receives `digits` characters and a terminating NUL.
+ * @return Number of digits written.
+ */
+uint8_t oath_format_code(uint32_t code, uint8_t digits, char *out);
+
+#endif // OATH_COMPUTE_H
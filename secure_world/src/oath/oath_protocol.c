@@ -7,26 +7,197 @@
 #include <pico/stdlib.h>
 #include <pico/time.h>
 
-#include "../../../lib/libcotp/src/cotp.h"
 #include "../drivers/led_driver.h"
 #include "../time_sync.h"
 #include "apdu_protocol.h"
+#include "iso7816_4.h"
+#include "oath_compute.h"
 #include "oath_protocol.h"
 #include "oath_storage.h"
 
 #define OATH_TOUCH_PIN 21
 
+// Name TLV plus a code TLV
+#define OATH_MAX_ENTRY_LEN (2 + OATH_MAX_NAME_LEN + 2 + OATH_MAX_DIGITS)
+
 /**
  * @file oath_protocol.c
  * @brief Implementation of Yubico-compatible OATH protocol over CCID.
  */
 
+// Listing left unfinished by the previous response (see send_listing)
+static struct {
+  bool active;
+  uint8_t ins;        // INS_LIST or INS_CALCULATE_ALL
+  uint16_t cursor;    // Iterator position of the first unsent entry
+  uint64_t timestamp; // Keeps every chunk on the same TOTP time step
+} pending;
+
+// Set by oath_init once the code engine passes its self-test; no code is
+// served before that or after a failure
+static bool codes_enabled;
+
 static bool check_touch(void) {
   // Active low button on GPIO 21
   return !gpio_get(OATH_TOUCH_PIN);
 }
 
+static uint16_t put_sw(uint8_t *out, uint16_t offset, uint16_t sw) {
+  out[offset++] = (uint8_t)(sw >> 8);
+  out[offset++] = (uint8_t)(sw & 0xFF);
+  return offset;
+}
+
+// TOTP time steps of one listing, one per distinct period. Credentials
+// sharing a period form a group whose step is derived once, not per entry.
+#define OATH_PERIOD_GROUPS 4
+
+typedef struct {
+  uint64_t ts;
+  uint8_t count;
+  uint32_t period[OATH_PERIOD_GROUPS];
+  uint64_t step[OATH_PERIOD_GROUPS];
+} period_groups_t;
+
+static uint64_t group_step(period_groups_t *groups, uint32_t period) {
+  for (uint8_t i = 0; i < groups->count; i++) {
+    if (groups->period[i] == period)
+      return groups->step[i];
+  }
+  uint64_t step = groups->ts / period;
+  if (groups->count < OATH_PERIOD_GROUPS) {
+    groups->period[groups->count] = period;
+    groups->step[groups->count++] = step;
+  }
+  return step;
+}
+
+// Computes the current code of a credential into `otp` (OATH_MAX_DIGITS + 1
+// bytes). HOTP uses the stored counter; TOTP the step of the credential's
+// period at `groups->ts`.
+static bool compute_code(const oath_credential_t *cred,
+                         period_groups_t *groups, char *otp) {
+  uint64_t moving_factor = cred->type == OATH_TYPE_TOTP
+                               ? group_step(groups, oath_period(cred))
+                               : (uint64_t)cred->counter;
+  uint32_t code;
+  if (!oath_compute(cred, moving_factor, &code))
+    return false;
+  oath_format_code(code, cred->digits, otp);
+  return true;
+}
+
+// Finds the value of a top-level TLV with a one-byte length in `data`
+static const uint8_t *find_tlv(const uint8_t *data, uint16_t len, uint8_t tag,
+                               uint8_t *value_len) {
+  uint16_t off = 0;
+  while (off + 2 <= len) {
+    uint8_t t = data[off];
+    uint8_t l = data[off + 1];
+    if (off + 2 + l > len)
+      return NULL;
+    if (t == tag) {
+      *value_len = l;
+      return data + off + 2;
+    }
+    off += 2 + l;
+  }
+  return NULL;
+}
+
+// Formats one LIST / CALCULATE ALL entry: name TLV, plus the response TLV
+// for CALCULATE ALL. HOTP and touch credentials get an empty HOTP / touch
+// tag instead of a code: a HOTP code is only issued by CALCULATE, which
+// steps the counter first, and a touch code only once the button is pressed.
+// Returns the entry length.
+static uint16_t format_entry(uint8_t ins, const oath_credential_t *cred,
+                             period_groups_t *groups, uint8_t *out) {
+  uint16_t offset = 0;
+  size_t n_len = strnlen(cred->name, OATH_MAX_NAME_LEN);
+  out[offset++] = OATH_TAG_NAME;
+  out[offset++] = (uint8_t)n_len;
+  memcpy(out + offset, cred->name, n_len);
+  offset += (uint16_t)n_len;
+  if (ins != INS_CALCULATE_ALL)
+    return offset;
+
+  if (cred->type == OATH_TYPE_HOTP) {
+    out[offset++] = OATH_TAG_HOTP;
+    out[offset++] = 0;
+    return offset;
+  }
+  if (cred->touch_required) {
+    out[offset++] = OATH_TAG_TOUCH;
+    out[offset++] = 0;
+    return offset;
+  }
+
+  char otp[OATH_MAX_DIGITS + 1];
+  if (compute_code(cred, groups, otp)) {
+    size_t o_len = strlen(otp);
+    out[offset++] = OATH_TAG_TRUNCATED;
+    out[offset++] = (uint8_t)o_len;
+    memcpy(out + offset, otp, o_len);
+    offset += (uint16_t)o_len;
+  }
+  return offset;
+}
+
+// Walks the credential store once from `cursor`, filling at most `limit`
+// bytes (the command's Le, so an extended APDU can take the whole listing at
+// once). If entries remain, the position is kept and SW 61xx tells the host
+// to fetch the rest with SEND REMAINING.
+static void send_listing(uint8_t ins, uint16_t cursor, uint64_t ts,
+                         uint16_t limit, uint8_t *apdu_out,
+                         uint16_t *len_out) {
+  oath_storage_iter_t it;
+  if (!oath_storage_iter_begin(&it, cursor)) {
+    pending.active = false;
+    *len_out = put_sw(apdu_out, 0, SW_UNKNOWN);
+    return;
+  }
+
+  uint16_t offset = 0;
+  oath_credential_t cred;
+  uint8_t entry[OATH_MAX_ENTRY_LEN];
+  period_groups_t groups = {.ts = ts};
+  for (;;) {
+    uint16_t entry_cursor = it.cursor;
+    if (!oath_storage_iter_next(&it, &cred))
+      break;
+
+    uint16_t entry_len = format_entry(ins, &cred, &groups, entry);
+    if (offset + entry_len > limit) {
+      // Resend this entry at the start of the next chunk. If it does not
+      // fit even alone, SW 6Cxx asks for the same command again with Le set
+      // to its length; entries are never split.
+      oath_storage_iter_end(&it);
+      pending.active = true;
+      pending.ins = ins;
+      pending.cursor = entry_cursor;
+      pending.timestamp = ts;
+      memset(&cred, 0, sizeof(cred));
+      memset(entry, 0, sizeof(entry));
+      if (offset == 0)
+        *len_out = put_sw(apdu_out, 0, SW_WRONG_LE | entry_len);
+      else
+        *len_out = put_sw(apdu_out, offset, SW_BYTES_REMAINING);
+      return;
+    }
+    memcpy(apdu_out + offset, entry, entry_len);
+    offset += entry_len;
+  }
+
+  memset(&cred, 0, sizeof(cred));
+  memset(entry, 0, sizeof(entry));
+  pending.active = false;
+  *len_out = put_sw(apdu_out, offset, SW_OK);
+}
+
 void oath_init(void) {
+  codes_enabled = oath_compute_self_test();
+  if (!codes_enabled)
+    printf("[OATH] Code generation self-test failed, codes disabled\n");
   oath_storage_init();
   gpio_init(OATH_TOUCH_PIN);
   gpio_set_dir(OATH_TOUCH_PIN, GPIO_IN);
@@ -34,6 +205,8 @@ void oath_init(void) {
   printf("[OATH] OATH Applet Initialized (Touch Pin: %d)\n", OATH_TOUCH_PIN);
 }
 
+bool oath_codes_enabled(void) { return codes_enabled; }
+
 void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out,
                       uint16_t *len_out) {
   if (len_in < 4) {
@@ -41,8 +214,26 @@ void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out,
     return;
   }
 
-  uint8_t ins = apdu_in[APDU_INS_POS];
-  uint8_t p1 = apdu_in[APDU_P1_POS];
+  iso7816_apdu_t apdu;
+  if (!iso7816_parse_apdu(apdu_in, len_in, &apdu)) {
+    *len_out = put_sw(apdu_out, 0, SW_WRONG_LENGTH);
+    return;
+  }
+  uint8_t ins = apdu.ins;
+  uint8_t p1 = apdu.p1;
+  uint16_t limit = iso7816_response_limit(&apdu);
+
+  // Any other command abandons a partially sent listing
+  if (ins != INS_SEND_REMAINING)
+    pending.active = false;
+
+  // A code from an engine that failed its self-test would be wrong, and a
+  // wrong code is worse than none
+  if (!codes_enabled &&
+      (ins == INS_CALCULATE || (ins == INS_CALCULATE_ALL && p1 == 0x00))) {
+    *len_out = put_sw(apdu_out, 0, SW_UNKNOWN);
+    return;
+  }
 
   // ISO SELECT (0xA4 with P1=04)
   if (ins == INS_SELECT && p1 == 0x04) {
@@ -61,7 +252,18 @@ void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out,
   // OATH CALCULATE (0xA2)
   if (ins == INS_CALCULATE) {
     oath_credential_t cred;
-    char name[64] = "RP2350-OATH:test@example.com"; // Placeholder lookup logic
+    char name[OATH_MAX_NAME_LEN];
+    uint8_t name_len = 0;
+    const uint8_t *name_tlv =
+        find_tlv(apdu.data, apdu.lc, OATH_TAG_NAME, &name_len);
+    if (!name_tlv || name_len == 0 || name_len >= OATH_MAX_NAME_LEN) {
+      apdu_out[0] = (uint8_t)(SW_WRONG_DATA >> 8);
+      apdu_out[1] = (uint8_t)(SW_WRONG_DATA & 0xFF);
+      *len_out = 2;
+      return;
+    }
+    memcpy(name, name_tlv, name_len);
+    name[name_len] = '\0';
 
     if (!oath_storage_get(name, &cred)) {
       apdu_out[0] = (uint8_t)(SW_FILE_NOT_FOUND >> 8);
@@ -77,27 +279,14 @@ void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out,
       return;
     }
 
-    cotp_error_t err;
-    char b32_secret[128];
-    if (!base32_encode_buf(cred.secret, cred.secret_len, b32_secret,
-                           sizeof(b32_secret), &err)) {
-      apdu_out[0] = (uint8_t)(SW_UNKNOWN >> 8);
-      apdu_out[1] = (uint8_t)(SW_UNKNOWN & 0xFF);
-      *len_out = 2;
-      return;
-    }
-
-    char otp[16];
-    bool success = false;
-    if (cred.type == OATH_TYPE_TOTP) {
-      uint64_t ts = time_sync_get_timestamp();
-      success = get_totp_at_buf(b32_secret, (long)ts, cred.digits, 30, SHA1,
-                                otp, sizeof(otp), &err);
-    } else {
-      success = get_hotp_buf(b32_secret, cred.counter, cred.digits, SHA1, otp,
-                             sizeof(otp), &err);
-      if (success)
-        oath_storage_update_counter(name, cred.counter + 1);
+    char otp[OATH_MAX_DIGITS + 1];
+    period_groups_t groups = {.ts = time_sync_get_timestamp()};
+    bool success = compute_code(&cred, &groups, otp);
+    if (success && cred.type == OATH_TYPE_HOTP) {
+      // A HOTP code must never be issued twice: the counter step and any
+      // buffered storage changes are flushed before the code is released.
+      success = oath_storage_update_counter(name, cred.counter + 1) &&
+                oath_storage_commit();
     }
 
     if (success) {
@@ -119,67 +308,26 @@ void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out,
 
   // OATH LIST (0xA1)
   if (ins == INS_LIST) {
-    uint16_t offset = 0;
-    for (uint32_t i = 0; i < MAX_CREDENTIALS; i++) {
-      const char *name = oath_storage_list(i);
-      if (name) {
-        size_t n_len = strlen(name);
-        apdu_out[offset++] = 0x71; // Name Tag
-        apdu_out[offset++] = (uint8_t)n_len;
-        memcpy(apdu_out + offset, name, n_len);
-        offset += n_len;
-      }
-    }
-    apdu_out[offset++] = (uint8_t)(SW_OK >> 8);
-    apdu_out[offset++] = (uint8_t)(SW_OK & 0xFF);
-    *len_out = offset;
+    send_listing(INS_LIST, 0, time_sync_get_timestamp(), limit, apdu_out,
+                 len_out);
     return;
   }
 
   // OATH CALCULATE ALL (0xA4 with P1=0x00)
   if (ins == INS_CALCULATE_ALL && p1 == 0x00) {
-    uint16_t offset = 0;
-    cotp_error_t err;
-    char otp[16];
-    uint64_t ts = time_sync_get_timestamp();
-
-    for (uint32_t i = 0; i < MAX_CREDENTIALS; i++) {
-      const char *name = oath_storage_list(i);
-      if (name) {
-        oath_credential_t cred;
-        if (oath_storage_get(name, &cred)) {
-          size_t n_len = strlen(name);
-          apdu_out[offset++] = 0x71; // Name Tag
-          apdu_out[offset++] = (uint8_t)n_len;
-          memcpy(apdu_out + offset, name, n_len);
-          offset += n_len;
-
-          char b32_secret[128];
-          if (base32_encode_buf(cred.secret, cred.secret_len, b32_secret,
-                                sizeof(b32_secret), &err)) {
-            bool success = false;
-            if (cred.type == OATH_TYPE_TOTP) {
-              success = get_totp_at_buf(b32_secret, (long)ts, cred.digits, 30,
-                                        SHA1, otp, sizeof(otp), &err);
-            } else {
-              success = get_hotp_buf(b32_secret, cred.counter, cred.digits,
-                                     SHA1, otp, sizeof(otp), &err);
-            }
-
-            if (success) {
-              size_t o_len = strlen(otp);
-              apdu_out[offset++] = 0x76; // Truncated Response Tag
-              apdu_out[offset++] = (uint8_t)o_len;
-              memcpy(apdu_out + offset, otp, o_len);
-              offset += o_len;
-            }
-          }
-        }
-      }
+    send_listing(INS_CALCULATE_ALL, 0, time_sync_get_timestamp(), limit,
+                 apdu_out, len_out);
+    return;
+  }
+
+  // SEND REMAINING (0xA5) continues a listing that ended with SW 61xx
+  if (ins == INS_SEND_REMAINING) {
+    if (!pending.active) {
+      *len_out = put_sw(apdu_out, 0, SW_CONDITIONS_NOT_SATISFIED);
+      return;
     }
-    apdu_out[offset++] = (uint8_t)(SW_OK >> 8);
-    apdu_out[offset++] = (uint8_t)(SW_OK & 0xFF);
-    *len_out = offset;
+    send_listing(pending.ins, pending.cursor, pending.timestamp, limit,
+                 apdu_out, len_out);
     return;
   }
 
@@ -4,9 +4,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// Initialize the OATH protocol handler and storage
+// Initialize the OATH protocol handler and storage. Runs the code engine
+// self-test; if it fails, CALCULATE and CALCULATE ALL answer 6F00.
 void oath_init(void);
 
+// Whether the code engine passed its self-test in oath_init. Every path
+// that produces a code (APDUs, HID keyboard) checks this first.
+bool oath_codes_enabled(void);
+
 // Handle APDU commands directed to the OATH application
 void oath_handle_apdu(uint8_t *apdu_in, uint16_t len_in, uint8_t *apdu_out, uint16_t *len_out);
 
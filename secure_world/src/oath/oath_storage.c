@@ -1,9 +1,13 @@
 #include "oath_storage.h"
 #include "../crypto/aes.h"
 #include "../crypto/aes_gcm.h"
+#include "../crypto/hmac.h"
 #include "../crypto/sha256.h"
 #include "../security/security.h"
 #include "../security/security_manager.h"
+#include "flash_counter.h"
+#include "flash_journal.h"
+#include "oath_compute.h"
 #include "security/security_manager.h" // Try both for safety in different include setups
 #include <hardware/address_mapped.h>
 #include <hardware/flash.h>
@@ -21,137 +25,631 @@
 #endif
 
 #define STORAGE_MAGIC 0x534F4154 // "SOAT" (Secure OATH)
-#define STORAGE_VERSION 0x02
+#define STORAGE_VERSION 0x06     // v6: record header authenticated as AAD
 
-// Calculate padded size for encryption (must be multiple of AES_BLOCK_SIZE)
-#define PADDED_PERSIST_SIZE                                                    \
-  ((sizeof(oath_persist_t) + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE) *           \
-      AES_BLOCK_SIZE
+// Domain separation label for the name index key
+static const char NAME_INDEX_LABEL[] = "RP2350-OATH name index v1";
+
+// Journal record types (see flash_journal.h)
+#define OATH_REC_CREDENTIAL 0x01 // key = slot, payload = credential record
+#define OATH_REC_DELETE 0x02     // key = slot, no payload
+#define OATH_REC_ACCESS 0x03     // payload = access_record_t
+
+#define OATH_JOURNAL_MAGIC 0x4A54414F // "OATJ"
+#define OATH_COUNTER_MAGIC 0x4354414F // "OATC"
+
+// Write-back window: buffered mutations are flushed once no further mutation
+// has arrived for OATH_WRITEBACK_IDLE_US, and never later than
+// OATH_WRITEBACK_MAX_US after the first buffered mutation.
+#define OATH_WRITEBACK_IDLE_US (200 * 1000)
+#define OATH_WRITEBACK_MAX_US (2 * 1000 * 1000)
+
+// Records written since the last flush wait here until they reach the
+// journal. When all buffers are taken the next mutation forces a flush.
+#define OATH_STAGE_SLOTS 16
+#define OATH_STAGE_NONE 0xFF
+
+// Access code state as stored in the journal. Encrypted so the PIN hash is
+// not exposed to offline guessing from a flash dump.
+typedef struct {
+  uint8_t hash[32];
+  uint8_t set;
+} access_plain_t;
 
 typedef struct {
-  uint8_t iv[AES_IV_SIZE_BYTES];
+  uint8_t iv[12];
   uint8_t tag[16];
-  uint8_t encrypted_data[PADDED_PERSIST_SIZE];
-} oath_flash_package_t;
+  uint8_t ciphertext[sizeof(access_plain_t)];
+} access_record_t;
+
+// RAM index entry. Record bodies are not cached: they are read from flash
+// through XIP, or from the staging area while a write is buffered.
+typedef struct {
+  uint8_t name_tag[OATH_NAME_TAG_LEN];
+  uint32_t addr;        // Journal record backing the slot, 0 if none
+  uint8_t counter_cell; // Mirrors the record header
+  uint8_t stage;        // Staging buffer holding a newer record, or NONE
+  bool used;
+  bool dirty; // RAM state differs from the journal
+} index_entry_t;
 
-static oath_persist_t ram_cache;
-static oath_flash_package_t flash_buffer;
+typedef struct {
+  uint16_t len;
+  uint8_t data[OATH_RECORD_MAX_LEN];
+} staged_record_t;
+
+static index_entry_t index_table[MAX_CREDENTIALS];
+static staged_record_t staged[OATH_STAGE_SLOTS];
+static bool stage_busy[OATH_STAGE_SLOTS];
+
+static access_plain_t access_state;
+static uint32_t access_addr; // Zero: nothing on flash
+
+// Write-back state
+static bool access_dirty;
+static bool dirty;
+static uint64_t dirty_since_us;
+static uint64_t flush_deadline_us;
+
+// Pad states of the name index key (see compute_name_tag)
+static hmac_midstate_t name_index_key;
+static bool name_index_ready;
+
+static bool record_is_live(void *ctx, const flash_journal_record_t *rec,
+                           uint32_t addr);
+static void record_relocated(void *ctx, const flash_journal_record_t *rec,
+                             uint32_t old_addr, uint32_t new_addr);
+
+static flash_journal_t journal = {
+    .base = OATH_JOURNAL_OFFSET,
+    .sector_count = OATH_JOURNAL_SECTORS,
+    .magic = OATH_JOURNAL_MAGIC,
+    .owner = {.is_live = record_is_live, .relocated = record_relocated},
+};
+
+static flash_counter_t counters = {
+    .base = OATH_COUNTER_OFFSET,
+    .magic = OATH_COUNTER_MAGIC,
+};
 
 // Forward declarations
-static bool save_to_flash(void);
-static bool load_from_flash(void);
-static bool derive_and_validate_key(uint8_t *key_out);
+static void compute_name_tag(const char *name, uint8_t *tag_out);
+static int find_credential(const aes_gcm_ctx_t *gcm, const char *name,
+                           const uint8_t *tag, oath_credential_t *out_cred);
 
 //--------------------------------------------------------------------+
 // Encryption Helpers
 //--------------------------------------------------------------------+
 
-static bool derive_and_validate_key(uint8_t *key_out) {
-  if (!otp_read_master_key(key_out)) {
-    printf("[STORAGE] Master key missing. Attempting to provision...\n");
-    if (!otp_write_new_master_key(key_out)) {
-      printf("[STORAGE] CRITICAL: Hard failure provisioning master key.\n");
-      return false;
+// tag = HMAC(HMAC(master_key, label), name)[0..OATH_NAME_TAG_LEN). The index
+// key's pad states are derived once and kept until the storage keys are
+// wiped, so a lookup costs a single HMAC over the name.
+static void compute_name_tag(const char *name, uint8_t *tag_out) {
+  if (!name_index_ready) {
+    uint8_t master_key[32];
+    uint8_t index_key[SHA256_DIGEST_SIZE];
+    if (!security_get_master_key(master_key)) {
+      memset(tag_out, 0, OATH_NAME_TAG_LEN);
+      return;
     }
+    hmac_sha256(master_key, sizeof(master_key),
+                (const uint8_t *)NAME_INDEX_LABEL, sizeof(NAME_INDEX_LABEL) - 1,
+                index_key);
+    hmac_sha256_precompute(index_key, sizeof(index_key), &name_index_key);
+    name_index_ready = true;
+    memset(master_key, 0, sizeof(master_key));
+    memset(index_key, 0, sizeof(index_key));
+  }
+
+  uint8_t mac[SHA256_DIGEST_SIZE];
+  hmac_sha256_resume(&name_index_key, (const uint8_t *)name,
+                     strnlen(name, OATH_MAX_NAME_LEN - 1), mac);
+  memcpy(tag_out, mac, OATH_NAME_TAG_LEN);
+  memset(mac, 0, sizeof(mac));
+}
+
+void oath_storage_wipe_keys(void) {
+  volatile uint8_t *p = (volatile uint8_t *)&name_index_key;
+  for (size_t i = 0; i < sizeof(name_index_key); i++)
+    p[i] = 0;
+  name_index_ready = false;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+// Bytes the pad states add to a packed credential (0 if they are not kept)
+static uint16_t packed_pads_len(const oath_credential_t *cred) {
+#if OATH_STORE_HMAC_PADS
+  if (cred->pads_algorithm == cred->algorithm)
+    return (uint16_t)(1 + 8 * oath_pad_state_words(cred->pads_algorithm));
+#else
+  (void)cred;
+#endif
+  return 0;
+}
+
+// Builds the pad states stored with a credential that is about to be
+// written. A no-op when they are current or not kept at all.
+static void refresh_pads(oath_credential_t *cred) {
+#if OATH_STORE_HMAC_PADS
+  oath_compute_prepare(cred);
+#else
+  (void)cred;
+#endif
+}
+
+// Record length encrypt_credential() will produce for a credential
+static uint16_t credential_record_len(const oath_credential_t *cred) {
+  return (uint16_t)(sizeof(oath_record_header_t) + OATH_PACKED_FIXED_LEN +
+                    strnlen(cred->name, OATH_MAX_NAME_LEN - 1) +
+                    cred->secret_len + packed_pads_len(cred));
+}
+
+// Packs a credential into the compact plaintext layout. Returns its length.
+static uint16_t pack_credential(const oath_credential_t *cred, uint8_t *out) {
+  uint8_t name_len = (uint8_t)strnlen(cred->name, OATH_MAX_NAME_LEN - 1);
+  uint8_t secret_len = cred->secret_len;
+  uint16_t n = 0;
+
+  out[n++] = name_len;
+  memcpy(out + n, cred->name, name_len);
+  n += name_len;
+  out[n++] = secret_len;
+  memcpy(out + n, cred->secret, secret_len);
+  n += secret_len;
+  out[n++] = (uint8_t)cred->type;
+  out[n++] = (uint8_t)cred->algorithm;
+  out[n++] = cred->digits;
+  out[n++] = cred->touch_required;
+  put_le32(out + n, cred->counter);
+  n += 4;
+  put_le32(out + n, cred->period);
+  n += 4;
+
+  if (packed_pads_len(cred) > 0) {
+    uint8_t words = oath_pad_state_words(cred->pads_algorithm);
+    out[n++] = cred->pads_algorithm;
+    for (uint8_t i = 0; i < words; i++, n += 4)
+      put_le32(out + n, cred->pads.inner[i]);
+    for (uint8_t i = 0; i < words; i++, n += 4)
+      put_le32(out + n, cred->pads.outer[i]);
+  }
+  return n;
+}
+
+static bool unpack_credential(const uint8_t *in, uint16_t len,
+                              oath_credential_t *cred) {
+  uint16_t n = 0;
+  memset(cred, 0, sizeof(*cred));
+
+  if (len < OATH_PACKED_FIXED_LEN)
+    return false;
+  uint8_t name_len = in[n++];
+  if (name_len >= OATH_MAX_NAME_LEN || n + name_len >= len)
+    return false;
+  memcpy(cred->name, in + n, name_len);
+  n += name_len;
+  uint8_t secret_len = in[n++];
+  if (secret_len > OATH_MAX_SECRET_LEN ||
+      (uint16_t)(n + secret_len + 12) > len)
+    return false;
+  memcpy(cred->secret, in + n, secret_len);
+  n += secret_len;
+  cred->secret_len = secret_len;
+  cred->type = (oath_type_t)in[n++];
+  cred->algorithm = (oath_algo_t)in[n++];
+  cred->digits = in[n++];
+  cred->touch_required = in[n++];
+  cred->counter = get_le32(in + n);
+  cred->period = get_le32(in + n + 4);
+  n += 8;
+  if (n == len)
+    return true; // Written without pad states
+
+  uint8_t words = oath_pad_state_words(in[n]);
+  if (words == 0 || len - n != 1 + 8 * words)
+    return false;
+  // Pads for another algorithm are stale: leave them invalid
+  if (in[n] == (uint8_t)cred->algorithm) {
+    cred->pads_algorithm = in[n];
+    for (uint8_t i = 0; i < words; i++)
+      cred->pads.inner[i] = get_le32(in + n + 1 + 4 * i);
+    for (uint8_t i = 0; i < words; i++)
+      cred->pads.outer[i] = get_le32(in + n + 1 + 4 * (words + i));
   }
   return true;
 }
 
-bool encrypt_credential(const uint8_t *key, const oath_credential_t *cred,
-                        encrypted_credential_t *encrypted) {
+bool encrypt_credential(const aes_gcm_ctx_t *gcm,
+                        const oath_credential_t *cred, uint8_t *record,
+                        uint16_t *record_len) {
+  oath_record_header_t *hdr = (oath_record_header_t *)record;
+  uint8_t packed[OATH_PACKED_MAX_LEN];
+  uint16_t packed_len = pack_credential(cred, packed);
+
   // 1. Generate unique IV per credential
   for (int i = 0; i < 12; i++) {
-    encrypted->iv[i] = (uint8_t)(get_rand_32() & 0xFF);
+    hdr->iv[i] = (uint8_t)(get_rand_32() & 0xFF);
   }
 
-  // 2. AES-GCM Authenticated Encryption
-  return aes_gcm_encrypt(key, encrypted->iv, (const uint8_t *)cred,
-                         sizeof(oath_credential_t), encrypted->ciphertext,
-                         encrypted->tag);
+  // 2. AES-GCM Authenticated Encryption, binding the plaintext header
+  bool ok = aes_gcm_ctx_encrypt(gcm, hdr->iv, record, OATH_RECORD_AAD_LEN,
+                                packed, packed_len,
+                                record + sizeof(oath_record_header_t),
+                                hdr->tag);
+  memset(packed, 0, sizeof(packed));
+  *record_len = (uint16_t)(sizeof(oath_record_header_t) + packed_len);
+  return ok;
 }
 
-bool decrypt_credential(const uint8_t *key,
-                        const encrypted_credential_t *encrypted,
-                        oath_credential_t *cred) {
-  return aes_gcm_decrypt(key, encrypted->iv, encrypted->ciphertext,
-                         sizeof(oath_credential_t), encrypted->tag,
-                         (uint8_t *)cred);
+bool decrypt_credential(const aes_gcm_ctx_t *gcm, const uint8_t *record,
+                        uint16_t record_len, oath_credential_t *cred) {
+  const oath_record_header_t *hdr = (const oath_record_header_t *)record;
+  uint8_t packed[OATH_PACKED_MAX_LEN];
+
+  if (record_len < sizeof(oath_record_header_t) + OATH_PACKED_FIXED_LEN ||
+      record_len > OATH_RECORD_MAX_LEN)
+    return false;
+
+  uint16_t packed_len = (uint16_t)(record_len - sizeof(oath_record_header_t));
+  bool ok = aes_gcm_ctx_decrypt(gcm, hdr->iv, record, OATH_RECORD_AAD_LEN,
+                                record + sizeof(*hdr), packed_len, hdr->tag,
+                                packed) &&
+            unpack_credential(packed, packed_len, cred);
+  memset(packed, 0, sizeof(packed));
+  return ok;
 }
 
 //--------------------------------------------------------------------+
-// File System Logic
+// Index Helpers
 //--------------------------------------------------------------------+
 
-static bool save_to_flash(void) {
-  uint8_t master_key[32];
-  if (!derive_and_validate_key(master_key))
+// Current record of a slot: the staged copy if a write is buffered,
+// otherwise the journal record.
+static const uint8_t *slot_record(int slot, uint16_t *len_out) {
+  const index_entry_t *e = &index_table[slot];
+  if (e->stage != OATH_STAGE_NONE) {
+    *len_out = staged[e->stage].len;
+    return staged[e->stage].data;
+  }
+  return flash_journal_payload(e->addr, len_out);
+}
+
+static uint32_t slot_record_size(int slot) {
+  uint16_t len;
+  slot_record(slot, &len);
+  return flash_journal_record_size(len);
+}
+
+// Live HOTP counter of a credential whose record stores `stored`
+static uint32_t live_counter(const oath_record_header_t *hdr,
+                             uint32_t stored) {
+  if (hdr->counter_cell == OATH_COUNTER_CELL_NONE)
+    return stored;
+  uint32_t cell_value = flash_counter_read(&counters, hdr->counter_cell);
+  return stored + (cell_value - hdr->counter_anchor);
+}
+
+static bool decrypt_slot(const aes_gcm_ctx_t *gcm, int slot,
+                         oath_credential_t *cred) {
+  uint16_t len;
+  const uint8_t *record = slot_record(slot, &len);
+  if (!decrypt_credential(gcm, record, len, cred))
     return false;
+  cred->counter =
+      live_counter((const oath_record_header_t *)record, cred->counter);
+  return true;
+}
 
-  printf("[STORAGE] Syncing encrypted index to flash...\n");
+// Returns a counter cell no other credential is bound to, or
+// OATH_COUNTER_CELL_NONE if all are taken (the counter then lives only in
+// the encrypted record).
+static uint8_t allocate_counter_cell(void) {
+  bool taken[FLASH_COUNTER_CELLS] = {false};
+  for (int i = 0; i < MAX_CREDENTIALS; i++) {
+    uint8_t cell = index_table[i].counter_cell;
+    if (index_table[i].used && cell < FLASH_COUNTER_CELLS)
+      taken[cell] = true;
+  }
+  for (uint8_t c = 0; c < FLASH_COUNTER_CELLS; c++) {
+    if (!taken[c])
+      return c;
+  }
+  return OATH_COUNTER_CELL_NONE;
+}
 
-  // 1. Prepare flash package
-  for (int i = 0; i < AES_IV_SIZE_BYTES / 4; i++) {
-    ((uint32_t *)flash_buffer.iv)[i] = get_rand_32();
+// Returns the slot holding `name`, or -1. Only slots whose name tag matches
+// are decrypted; the name is still compared in case of a truncated-tag
+// collision.
+static int find_credential(const aes_gcm_ctx_t *gcm, const char *name,
+                           const uint8_t *tag, oath_credential_t *out_cred) {
+  for (int i = 0; i < MAX_CREDENTIALS; i++) {
+    if (!index_table[i].used)
+      continue;
+    if (memcmp(index_table[i].name_tag, tag, OATH_NAME_TAG_LEN) != 0)
+      continue;
+
+    oath_credential_t cred;
+    if (decrypt_slot(gcm, i, &cred) &&
+        strncmp(cred.name, name, OATH_MAX_NAME_LEN) == 0) {
+      if (out_cred)
+        memcpy(out_cred, &cred, sizeof(oath_credential_t));
+      memset(&cred, 0, sizeof(cred));
+      return i;
+    }
+    memset(&cred, 0, sizeof(cred));
   }
+  return -1;
+}
 
-  // 2. Encrypt the entire index using AES-GCM (Authenticated Encryption)
-  // This ensures both confidentiality and integrity of the credential list.
-  uint8_t temp_aligned[PADDED_PERSIST_SIZE];
-  memset(temp_aligned, 0, PADDED_PERSIST_SIZE);
-  memcpy(temp_aligned, &ram_cache, sizeof(oath_persist_t));
+// Bytes of journal the current state needs, with `slot` taking
+// `slot_size` bytes instead of its current record.
+static uint32_t live_bytes_with(int slot, uint32_t slot_size) {
+  uint32_t total = flash_journal_record_size(sizeof(access_record_t));
+  for (int i = 0; i < MAX_CREDENTIALS; i++) {
+    if (i == slot)
+      total += slot_size;
+    else if (index_table[i].used)
+      total += slot_record_size(i);
+  }
+  return total;
+}
+
+//--------------------------------------------------------------------+
+// Journal Logic
+//--------------------------------------------------------------------+
+
+static void clear_index(void) {
+  memset(index_table, 0, sizeof(index_table));
+  for (int i = 0; i < MAX_CREDENTIALS; i++) {
+    index_table[i].counter_cell = OATH_COUNTER_CELL_NONE;
+    index_table[i].stage = OATH_STAGE_NONE;
+  }
+  memset(staged, 0, sizeof(staged));
+  memset(stage_busy, 0, sizeof(stage_busy));
+  memset(&access_state, 0, sizeof(access_state));
+  access_addr = 0;
+  access_dirty = false;
+  dirty = false;
+}
+
+// Pushes the flush deadline out by the idle window, capped at the maximum
+// delay since the first buffered mutation.
+static void touch_deadline(void) {
+  uint64_t now = time_us_64();
+  if (!dirty) {
+    dirty = true;
+    dirty_since_us = now;
+  }
+  flush_deadline_us = now + OATH_WRITEBACK_IDLE_US;
+  if (flush_deadline_us > dirty_since_us + OATH_WRITEBACK_MAX_US)
+    flush_deadline_us = dirty_since_us + OATH_WRITEBACK_MAX_US;
+}
 
-  bool success = aes_gcm_encrypt(master_key, flash_buffer.iv, temp_aligned,
-                                 PADDED_PERSIST_SIZE,
-                                 flash_buffer.encrypted_data, flash_buffer.tag);
+static void release_stage(int slot) {
+  index_entry_t *e = &index_table[slot];
+  if (e->stage != OATH_STAGE_NONE) {
+    memset(&staged[e->stage], 0, sizeof(staged_record_t));
+    stage_busy[e->stage] = false;
+    e->stage = OATH_STAGE_NONE;
+  }
+}
 
-  if (!success) {
-    printf("[STORAGE] Encryption failed during flash sync.\n");
+static bool record_is_live(void *ctx, const flash_journal_record_t *rec,
+                           uint32_t addr) {
+  (void)ctx;
+  switch (rec->type) {
+  case OATH_REC_CREDENTIAL:
+    return index_table[rec->key].addr == addr;
+  case OATH_REC_ACCESS:
+    return access_addr == addr;
+  default:
+    // Tombstones only shadow older records, and compaction always works on
+    // the oldest sector, so nothing they shadow survives them.
     return false;
   }
+}
+
+static void record_relocated(void *ctx, const flash_journal_record_t *rec,
+                             uint32_t old_addr, uint32_t new_addr) {
+  (void)ctx;
+  (void)old_addr;
+  if (rec->type == OATH_REC_CREDENTIAL)
+    index_table[rec->key].addr = new_addr;
+  else if (rec->type == OATH_REC_ACCESS)
+    access_addr = new_addr;
+}
+
+static void replay_record(void *ctx, const flash_journal_record_t *rec,
+                          const uint8_t *payload, uint32_t addr) {
+  const aes_gcm_ctx_t *gcm = (const aes_gcm_ctx_t *)ctx;
+
+  switch (rec->type) {
+  case OATH_REC_CREDENTIAL: {
+    if (rec->len < sizeof(oath_record_header_t) ||
+        rec->len > OATH_RECORD_MAX_LEN)
+      return;
+    const oath_record_header_t *hdr = (const oath_record_header_t *)payload;
+    index_entry_t *e = &index_table[rec->key];
+    memcpy(e->name_tag, hdr->name_tag, OATH_NAME_TAG_LEN);
+    e->counter_cell = hdr->counter_cell;
+    e->addr = addr;
+    e->used = true;
+    break;
+  }
+
+  case OATH_REC_DELETE: {
+    index_entry_t *e = &index_table[rec->key];
+    e->used = false;
+    e->addr = 0;
+    e->counter_cell = OATH_COUNTER_CELL_NONE;
+    break;
+  }
 
-  // 3. Hardware Write
-  uint32_t ints = save_and_disable_interrupts();
-  flash_range_erase(OATH_FLASH_SECTOR_OFFSET, FLASH_SECTOR_SIZE);
-  flash_range_program(OATH_FLASH_SECTOR_OFFSET, (const uint8_t *)&flash_buffer,
-                      sizeof(oath_flash_package_t));
-  restore_interrupts(ints);
+  case OATH_REC_ACCESS: {
+    if (rec->len != sizeof(access_record_t))
+      return;
+    const access_record_t *stored = (const access_record_t *)payload;
+    access_plain_t plain;
+    if (aes_gcm_ctx_decrypt(gcm, stored->iv, NULL, 0, stored->ciphertext,
+                            sizeof(plain), stored->tag, (uint8_t *)&plain)) {
+      memcpy(&access_state, &plain, sizeof(access_state));
+      access_addr = addr;
+    }
+    memset(&plain, 0, sizeof(plain));
+    break;
+  }
 
+  default:
+    break;
+  }
+}
+
+static bool append_credential(int slot, const uint8_t *record, uint16_t len) {
+  uint32_t addr;
+  if (!flash_journal_append(&journal, OATH_REC_CREDENTIAL, (uint8_t)slot,
+                            record, len, &addr))
+    return false;
+  index_table[slot].addr = addr;
   return true;
 }
 
-static bool load_from_flash(void) {
-  const oath_flash_package_t *stored =
-      (const oath_flash_package_t *)(XIP_BASE + OATH_FLASH_SECTOR_OFFSET);
+static bool append_delete(int slot) {
+  if (!flash_journal_append(&journal, OATH_REC_DELETE, (uint8_t)slot, NULL, 0,
+                            NULL))
+    return false;
+  index_table[slot].addr = 0;
+  return true;
+}
 
-  uint8_t master_key[32];
-  if (!derive_and_validate_key(master_key))
+static bool append_access_code(void) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
 
-  uint8_t temp_aligned[PADDED_PERSIST_SIZE];
-  bool decrypted =
-      aes_gcm_decrypt(master_key, stored->iv, stored->encrypted_data,
-                      PADDED_PERSIST_SIZE, stored->tag, temp_aligned);
-
-  if (decrypted) {
-    oath_persist_t *temp_persist = (oath_persist_t *)temp_aligned;
-    if (temp_persist->magic == STORAGE_MAGIC) {
-      memcpy(&ram_cache, temp_persist, sizeof(oath_persist_t));
-      printf("[STORAGE] Secure storage loaded. (%d credentials found)\n",
-             ram_cache
-                 .version); // Just using version field for logging temporarily
-      return true;
+  access_record_t record;
+  for (int i = 0; i < 12; i++)
+    record.iv[i] = (uint8_t)(get_rand_32() & 0xFF);
+
+  bool ok = aes_gcm_ctx_encrypt(gcm, record.iv, NULL, 0,
+                                (const uint8_t *)&access_state,
+                                sizeof(access_state), record.ciphertext,
+                                record.tag);
+
+  uint32_t addr;
+  if (!ok || !flash_journal_append(&journal, OATH_REC_ACCESS, 0,
+                                   (const uint8_t *)&record, sizeof(record),
+                                   &addr))
+    return false;
+  access_addr = addr;
+  return true;
+}
+
+bool oath_storage_commit(void) {
+  if (!dirty)
+    return true;
+
+  bool ok = true;
+  for (int i = 0; i < MAX_CREDENTIALS && ok; i++) {
+    index_entry_t *e = &index_table[i];
+    if (!e->dirty)
+      continue;
+    if (e->used) {
+      ok = append_credential(i, staged[e->stage].data, staged[e->stage].len);
+      if (ok)
+        release_stage(i);
+    } else if (e->addr != 0) {
+      ok = append_delete(i);
     }
+    // A slot that was filled and emptied within one window needs nothing
+    if (ok)
+      e->dirty = false;
+  }
+  if (ok && access_dirty) {
+    ok = append_access_code();
+    if (ok)
+      access_dirty = false;
   }
 
-  printf("[STORAGE] No valid encrypted storage found. Initializing factory "
-         "state.\n");
-  memset(&ram_cache, 0, sizeof(oath_persist_t));
-  ram_cache.magic = STORAGE_MAGIC;
-  ram_cache.version = STORAGE_VERSION;
-  return save_to_flash();
+  if (!ok) {
+    printf("[STORAGE] Flush failed, keeping changes buffered.\n");
+    return false;
+  }
+  dirty = false;
+  return true;
 }
 
-void oath_storage_init(void) { load_from_flash(); }
+// Stores `record` as the pending content of `slot`, flushing first if every
+// staging buffer is taken.
+static bool stage_record(int slot, const uint8_t *record, uint16_t len) {
+  index_entry_t *e = &index_table[slot];
+
+  if (e->stage == OATH_STAGE_NONE) {
+    int free_stage = -1;
+    for (int i = 0; i < OATH_STAGE_SLOTS && free_stage < 0; i++) {
+      if (!stage_busy[i])
+        free_stage = i;
+    }
+    if (free_stage < 0) {
+      if (!oath_storage_commit())
+        return false;
+      free_stage = 0;
+    }
+    stage_busy[free_stage] = true;
+    e->stage = (uint8_t)free_stage;
+  }
+
+  memcpy(staged[e->stage].data, record, len);
+  staged[e->stage].len = len;
+  e->dirty = true;
+  touch_deadline();
+  return true;
+}
+
+// Erases the journal so superseded secrets do not linger on flash. The index
+// must already be empty.
+static bool wipe_journal(void) {
+  printf("[STORAGE] Rewriting credential journal...\n");
+  return flash_journal_format(&journal);
+}
+
+void oath_storage_poll(void) {
+  if (dirty && time_us_64() >= flush_deadline_us)
+    oath_storage_commit();
+}
+
+bool oath_storage_is_dirty(void) { return dirty; }
+
+void oath_storage_init(void) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+
+  clear_index();
+  if (!gcm)
+    return;
+
+  if (!flash_journal_mount(&journal, replay_record, (void *)gcm)) {
+    printf("[STORAGE] Credential journal unusable. Initializing factory "
+           "state.\n");
+    clear_index();
+    flash_journal_format(&journal);
+  }
+  flash_counter_mount(&counters);
+
+  int count = 0;
+  for (int i = 0; i < MAX_CREDENTIALS; i++)
+    count += index_table[i].used ? 1 : 0;
+  printf("[STORAGE] Secure storage loaded. (%d credentials found)\n", count);
+}
 
 bool oath_storage_put(const char *name, const uint8_t *secret,
                       uint8_t secret_len, oath_type_t type, oath_algo_t algo,
@@ -170,97 +668,110 @@ bool oath_storage_put(const char *name, const uint8_t *secret,
   new_cred.digits = digits;
   new_cred.period = period;
   new_cred.touch_required = touch_required;
+  refresh_pads(&new_cred);
 
-  uint8_t key[32];
-  if (!derive_and_validate_key(key))
-    return false;
-
-  encrypted_credential_t encrypted;
-  if (!encrypt_credential(key, &new_cred, &encrypted))
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
 
-  // Slot Management logic
-  int i;
-  int free_slot = -1;
-
-  for (i = 0; i < MAX_CREDENTIALS; i++) {
-    if (ram_cache.slot_used[i]) {
-      oath_credential_t existing;
-      if (decrypt_credential(key, &ram_cache.encrypted_creds[i], &existing)) {
-        if (strcmp(existing.name, name) == 0) {
-          memcpy(&ram_cache.encrypted_creds[i], &encrypted, sizeof(encrypted));
-          return save_to_flash();
-        }
+  uint8_t record[OATH_RECORD_MAX_LEN];
+  oath_record_header_t *hdr = (oath_record_header_t *)record;
+  memset(hdr, 0, sizeof(*hdr));
+  compute_name_tag(new_cred.name, hdr->name_tag);
+
+  // Overwrite in place if the name already exists
+  int slot = find_credential(gcm, new_cred.name, hdr->name_tag, NULL);
+  if (slot < 0) {
+    for (int i = 0; i < MAX_CREDENTIALS; i++) {
+      if (!index_table[i].used) {
+        slot = i;
+        break;
       }
-    } else if (free_slot == -1) {
-      free_slot = i;
     }
   }
 
-  if (free_slot != -1) {
-    ram_cache.slot_used[free_slot] = true;
-    memcpy(&ram_cache.encrypted_creds[free_slot], &encrypted,
-           sizeof(encrypted));
-    return save_to_flash();
+  if (slot < 0)
+    return false;
+
+  // HOTP credentials keep their counter in a flash cell. A replaced
+  // credential keeps the cell it already had.
+  hdr->counter_cell = OATH_COUNTER_CELL_NONE;
+  if (type == OATH_TYPE_HOTP) {
+    uint8_t cell = index_table[slot].used ? index_table[slot].counter_cell
+                                          : OATH_COUNTER_CELL_NONE;
+    if (cell == OATH_COUNTER_CELL_NONE)
+      cell = allocate_counter_cell();
+    hdr->counter_cell = cell;
+    hdr->counter_anchor = flash_counter_read(&counters, cell);
   }
 
-  return false;
+  uint16_t len;
+  bool ok = encrypt_credential(gcm, &new_cred, record, &len);
+  memset(&new_cred, 0, sizeof(new_cred));
+  if (!ok)
+    return false;
+
+  if (live_bytes_with(slot, flash_journal_record_size(len)) >
+      flash_journal_capacity(&journal, OATH_RECORD_MAX_LEN)) {
+    printf("[STORAGE] Credential store full.\n");
+    return false;
+  }
+
+  if (!stage_record(slot, record, len))
+    return false;
+  index_entry_t *e = &index_table[slot];
+  memcpy(e->name_tag, hdr->name_tag, OATH_NAME_TAG_LEN);
+  e->counter_cell = hdr->counter_cell;
+  e->used = true;
+  return true;
 }
 
 bool oath_storage_delete(const char *name) {
-  uint8_t key[32];
-  if (!derive_and_validate_key(key))
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
 
-  for (int i = 0; i < MAX_CREDENTIALS; i++) {
-    if (ram_cache.slot_used[i]) {
-      oath_credential_t cred;
-      if (decrypt_credential(key, &ram_cache.encrypted_creds[i], &cred)) {
-        if (strcmp(cred.name, name) == 0) {
-          ram_cache.slot_used[i] = false;
-          memset(&ram_cache.encrypted_creds[i], 0,
-                 sizeof(encrypted_credential_t));
-          return save_to_flash();
-        }
-      }
-    }
-  }
-  return false;
+  uint8_t tag[OATH_NAME_TAG_LEN];
+  compute_name_tag(name, tag);
+  int slot = find_credential(gcm, name, tag, NULL);
+  if (slot < 0)
+    return false;
+
+  // The superseded record stays on flash, still encrypted, until compaction
+  // reclaims its sector.
+  index_entry_t *e = &index_table[slot];
+  release_stage(slot);
+  e->used = false;
+  e->counter_cell = OATH_COUNTER_CELL_NONE;
+  e->dirty = true;
+  touch_deadline();
+  return true;
 }
 
 bool oath_storage_get(const char *name, oath_credential_t *out_cred) {
-  uint8_t key[32];
-  if (!derive_and_validate_key(key))
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
 
-  for (int i = 0; i < MAX_CREDENTIALS; i++) {
-    if (ram_cache.slot_used[i]) {
-      oath_credential_t cred;
-      if (decrypt_credential(key, &ram_cache.encrypted_creds[i], &cred)) {
-        if (strcmp(cred.name, name) == 0) {
-          if (out_cred)
-            memcpy(out_cred, &cred, sizeof(oath_credential_t));
-          return true;
-        }
-      }
-    }
-  }
-  return false;
+  uint8_t tag[OATH_NAME_TAG_LEN];
+  compute_name_tag(name, tag);
+  return find_credential(gcm, name, tag, out_cred) >= 0;
 }
 
 const char *oath_storage_list(uint32_t index) {
   static char cached_name[OATH_MAX_NAME_LEN];
   uint32_t current_idx = 0;
-  uint8_t key[32];
-  if (!derive_and_validate_key(key))
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return NULL;
 
   for (int i = 0; i < MAX_CREDENTIALS; i++) {
-    if (ram_cache.slot_used[i]) {
+    if (index_table[i].used) {
       if (current_idx == index) {
         oath_credential_t cred;
-        if (decrypt_credential(key, &ram_cache.encrypted_creds[i], &cred)) {
+        if (decrypt_slot(gcm, i, &cred)) {
           strncpy(cached_name, cred.name, OATH_MAX_NAME_LEN - 1);
+          memset(&cred, 0, sizeof(cred));
           return cached_name;
         }
       }
@@ -270,35 +781,74 @@ const char *oath_storage_list(uint32_t index) {
   return NULL;
 }
 
+bool oath_storage_iter_begin(oath_storage_iter_t *it, uint16_t cursor) {
+  memset(it, 0, sizeof(*it));
+  it->gcm = security_get_storage_ctx();
+  if (!it->gcm)
+    return false;
+  it->cursor = cursor;
+  it->active = true;
+  return true;
+}
+
+bool oath_storage_iter_next(oath_storage_iter_t *it, oath_credential_t *out) {
+  while (it->active && it->cursor < MAX_CREDENTIALS) {
+    int slot = it->cursor++;
+    // Records that fail authentication are skipped, not fatal
+    if (index_table[slot].used && decrypt_slot(it->gcm, slot, out))
+      return true;
+  }
+  oath_storage_iter_end(it);
+  return false;
+}
+
+void oath_storage_iter_end(oath_storage_iter_t *it) {
+  it->gcm = NULL;
+  it->active = false;
+}
+
 void oath_storage_reset(void) {
-  memset(&ram_cache, 0, sizeof(oath_persist_t));
-  ram_cache.magic = STORAGE_MAGIC;
-  ram_cache.version = STORAGE_VERSION;
-  save_to_flash();
+  // Durable on return: the wipe must not sit in a write-back window
+  clear_index();
+  wipe_journal();
+  security_wipe_storage_keys();
 }
 
 bool oath_storage_update_counter(const char *name, uint32_t new_counter) {
-  uint8_t key[32];
-  if (!derive_and_validate_key(key))
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
 
-  for (int i = 0; i < MAX_CREDENTIALS; i++) {
-    if (ram_cache.slot_used[i]) {
-      oath_credential_t cred;
-      if (decrypt_credential(key, &ram_cache.encrypted_creds[i], &cred)) {
-        if (strcmp(cred.name, name) == 0) {
-          cred.counter = new_counter;
-          encrypted_credential_t encrypted;
-          if (encrypt_credential(key, &cred, &encrypted)) {
-            memcpy(&ram_cache.encrypted_creds[i], &encrypted,
-                   sizeof(encrypted));
-            return save_to_flash();
-          }
-        }
-      }
-    }
+  uint8_t tag[OATH_NAME_TAG_LEN];
+  compute_name_tag(name, tag);
+  oath_credential_t cred;
+  int slot = find_credential(gcm, name, tag, &cred);
+  if (slot < 0)
+    return false;
+
+  // Fast path: a +1 step only clears one bit in the credential's cell
+  uint8_t cell = index_table[slot].counter_cell;
+  if (cell != OATH_COUNTER_CELL_NONE && new_counter == cred.counter + 1) {
+    memset(&cred, 0, sizeof(cred));
+    return flash_counter_increment(&counters, cell);
   }
-  return false;
+
+  // Any other value is written into a new record, re-anchored to the cell
+  uint8_t record[OATH_RECORD_MAX_LEN];
+  oath_record_header_t *hdr = (oath_record_header_t *)record;
+  memset(hdr, 0, sizeof(*hdr));
+  memcpy(hdr->name_tag, tag, OATH_NAME_TAG_LEN);
+  hdr->counter_cell = cell;
+  hdr->counter_anchor = flash_counter_read(&counters, cell);
+
+  cred.counter = new_counter;
+  refresh_pads(&cred);
+  uint16_t len;
+  bool ok = encrypt_credential(gcm, &cred, record, &len);
+  memset(&cred, 0, sizeof(cred));
+  if (!ok)
+    return false;
+  return stage_record(slot, record, len);
 }
 
 bool oath_storage_set_password(const uint8_t *code, uint8_t len) {
@@ -307,13 +857,15 @@ bool oath_storage_set_password(const uint8_t *code, uint8_t len) {
   SHA256_CTX ctx;
   SHA256Init(&ctx);
   SHA256Update(&ctx, code, len);
-  SHA256Final(&ctx, ram_cache.access_code_hash);
-  ram_cache.access_code_set = 1;
-  return save_to_flash();
+  SHA256Final(&ctx, access_state.hash);
+  access_state.set = 1;
+  access_dirty = true;
+  touch_deadline();
+  return true;
 }
 
 bool oath_storage_verify_password(const uint8_t *code, uint8_t len) {
-  if (ram_cache.access_code_set == 0)
+  if (access_state.set == 0)
     return true;
   uint8_t hash[32];
   SHA256_CTX ctx;
@@ -323,34 +875,136 @@ bool oath_storage_verify_password(const uint8_t *code, uint8_t len) {
 
   volatile uint8_t diff = 0;
   for (int i = 0; i < 32; i++) {
-    diff |= hash[i] ^ ram_cache.access_code_hash[i];
+    diff |= hash[i] ^ access_state.hash[i];
   }
   return (diff == 0);
 }
 
-bool oath_storage_is_password_set(void) {
-  return (ram_cache.access_code_set == 1);
-}
+bool oath_storage_is_password_set(void) { return (access_state.set == 1); }
 
 bool oath_storage_export(uint8_t *buffer, uint16_t *len) {
   printf("[STORAGE] Exporting credentials...\n");
-  if (*len < sizeof(oath_persist_t)) {
+  if (*len < OATH_EXPORT_HEADER_LEN)
+    return false;
+
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
+
+  uint32_t off = 0;
+  put_le32(buffer + off, STORAGE_MAGIC);
+  put_le32(buffer + off + 4, STORAGE_VERSION);
+  off += 8;
+  buffer[off++] = access_state.set;
+  memcpy(buffer + off, access_state.hash, 32);
+  off += 32;
+  uint32_t count_off = off;
+  off += 2;
+
+  uint16_t count = 0;
+  for (int i = 0; i < MAX_CREDENTIALS; i++) {
+    if (!index_table[i].used)
+      continue;
+
+    // Fold the live HOTP counter into the record: cells are local state
+    oath_credential_t cred;
+    uint8_t record[OATH_RECORD_MAX_LEN];
+    oath_record_header_t *hdr = (oath_record_header_t *)record;
+    uint16_t rec_len;
+    if (!decrypt_slot(gcm, i, &cred))
+      continue;
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->name_tag, index_table[i].name_tag, OATH_NAME_TAG_LEN);
+    hdr->counter_cell = OATH_COUNTER_CELL_NONE;
+    bool ok = encrypt_credential(gcm, &cred, record, &rec_len);
+    memset(&cred, 0, sizeof(cred));
+
+    if (!ok || off + 2 + rec_len > *len)
+      return false;
+    buffer[off++] = (uint8_t)rec_len;
+    buffer[off++] = (uint8_t)(rec_len >> 8);
+    memcpy(buffer + off, record, rec_len);
+    off += rec_len;
+    count++;
   }
-  memcpy(buffer, &ram_cache, sizeof(oath_persist_t));
-  *len = sizeof(oath_persist_t);
+
+  buffer[count_off] = (uint8_t)count;
+  buffer[count_off + 1] = (uint8_t)(count >> 8);
+  *len = (uint16_t)off;
   return true;
 }
 
 bool oath_storage_import(const uint8_t *buffer, uint16_t len) {
   printf("[STORAGE] Importing credentials...\n");
-  if (len != sizeof(oath_persist_t)) {
+  if (len < OATH_EXPORT_HEADER_LEN || get_le32(buffer) != STORAGE_MAGIC ||
+      get_le32(buffer + 4) != STORAGE_VERSION)
+    return false;
+
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
     return false;
+
+  // Validate every record before touching flash
+  uint16_t count = (uint16_t)(buffer[41] | (buffer[42] << 8));
+  uint32_t off = OATH_EXPORT_HEADER_LEN;
+  uint32_t total = flash_journal_record_size(sizeof(access_record_t));
+  bool ok = count <= MAX_CREDENTIALS;
+  for (uint16_t i = 0; i < count && ok; i++) {
+    oath_credential_t cred;
+    uint16_t rec_len = off + 2 <= len
+                           ? (uint16_t)(buffer[off] | (buffer[off + 1] << 8))
+                           : 0;
+    ok = off + 2 + rec_len <= len &&
+         decrypt_credential(gcm, buffer + off + 2, rec_len, &cred);
+    if (ok) {
+      // Size as stored here, which may differ once the pads are rebuilt
+      refresh_pads(&cred);
+      total += flash_journal_record_size(credential_record_len(&cred));
+    }
+    memset(&cred, 0, sizeof(cred));
+    off += 2 + rec_len;
   }
-  oath_persist_t *imported = (oath_persist_t *)buffer;
-  if (imported->magic != STORAGE_MAGIC) {
+  if (!ok || off != len ||
+      total > flash_journal_capacity(&journal, OATH_RECORD_MAX_LEN))
     return false;
+
+  // Durable on return: one journal rewrite for the whole backup
+  clear_index();
+  ok = wipe_journal();
+  access_state.set = buffer[8];
+  memcpy(access_state.hash, buffer + 9, 32);
+
+  off = OATH_EXPORT_HEADER_LEN;
+  for (uint16_t i = 0; i < count && ok; i++) {
+    uint16_t rec_len = (uint16_t)(buffer[off] | (buffer[off + 1] << 8));
+    uint8_t record[OATH_RECORD_MAX_LEN];
+    oath_record_header_t *hdr = (oath_record_header_t *)record;
+    memcpy(record, buffer + off + 2, rec_len);
+    off += 2 + rec_len;
+
+    // Exported records carry their counter inside the ciphertext; HOTP
+    // credentials get a fresh cell anchored at its current value. Records
+    // are re-encrypted so their pad states match this build.
+    oath_credential_t cred;
+    if (!decrypt_credential(gcm, record, rec_len, &cred)) {
+      ok = false;
+      break;
+    }
+    hdr->counter_cell = cred.type == OATH_TYPE_HOTP ? allocate_counter_cell()
+                                                    : OATH_COUNTER_CELL_NONE;
+    hdr->counter_anchor = flash_counter_read(&counters, hdr->counter_cell);
+    refresh_pads(&cred);
+    ok = encrypt_credential(gcm, &cred, record, &rec_len);
+    memset(&cred, 0, sizeof(cred));
+
+    index_entry_t *e = &index_table[i];
+    memcpy(e->name_tag, hdr->name_tag, OATH_NAME_TAG_LEN);
+    e->counter_cell = hdr->counter_cell;
+    e->used = true;
+    ok = ok && append_credential(i, record, rec_len);
   }
-  memcpy(&ram_cache, buffer, sizeof(oath_persist_t));
-  return save_to_flash();
+
+  if (ok && access_state.set)
+    ok = append_access_code();
+  return ok;
 }
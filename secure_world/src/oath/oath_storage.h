@@ -2,11 +2,24 @@
 #define OATH_STORAGE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define MAX_CREDENTIALS 16
+#include "../crypto/aes_gcm.h"
+#include "../crypto/hmac.h"
+
+#define MAX_CREDENTIALS 256 // Slot numbers must fit the journal record key
 #define OATH_MAX_NAME_LEN 64
 #define OATH_MAX_SECRET_LEN 64 // Binary secret length (supports SHA512)
+#define OATH_NAME_TAG_LEN 8    // Truncated HMAC of the name (lookup index)
+#define OATH_COUNTER_CELL_NONE 0xFF // Credential has no flash counter cell
+
+// Keep each credential's HMAC pad states (see hmac_midstate_t) inside its
+// encrypted record, so a code costs two hash compressions instead of four.
+// Costs up to OATH_PADS_MAX_LEN bytes of flash per credential.
+#ifndef OATH_STORE_HMAC_PADS
+#define OATH_STORE_HMAC_PADS 1
+#endif
 
 typedef enum { OATH_TYPE_HOTP = 0x10, OATH_TYPE_TOTP = 0x20 } oath_type_t;
 
@@ -26,30 +39,83 @@ typedef struct {
   uint32_t counter;       // For HOTP
   uint32_t period;        // For TOTP (default 30)
   uint8_t touch_required; // 0x01 if touch required
+  // Algorithm `pads` were computed for, 0 if they are not valid. Pads that
+  // do not match `algorithm` are ignored and rebuilt on the next write.
+  uint8_t pads_algorithm;
+  hmac_midstate_t pads;
 } oath_credential_t;
 
-// Per-credential encryption structure
-typedef struct {
-  uint8_t iv[12];          // Initialization Vector (GCM)
-  uint8_t ciphertext[256]; // Encrypted data (enough for oath_credential_t)
-  uint8_t ciphertext_len;  // Length of ciphertext
-  uint8_t tag[16];         // Authentication tag
-} encrypted_credential_t;
-
-// Persistence structure
+// On-flash credential record: this header followed by the AES-GCM
+// ciphertext of the packed credential (see OATH_PACKED_MAX_LEN). Records are
+// only as long as their name and secret need.
 typedef struct {
-  uint32_t magic; // 0xDEADBEEF
-  uint32_t version;
-  uint8_t access_code_hash[32]; // SHA-256 hash of PIN
-  uint8_t access_code_set;      // 0 = not set, 1 = set
-  encrypted_credential_t encrypted_creds[MAX_CREDENTIALS];
-  bool slot_used[MAX_CREDENTIALS];
-  uint8_t master_key_salt[16]; // Salt for key derivation
-} oath_persist_t;
+  // HMAC-SHA256(index key, name) truncated to OATH_NAME_TAG_LEN. The index key
+  // is derived from the master key, so the tag reveals nothing about the name
+  // without it. Lookups compare tags and decrypt only the matching slot.
+  uint8_t name_tag[OATH_NAME_TAG_LEN];
+  // HOTP only: the encrypted counter is the value at the time the record was
+  // written. The live value is counter + (cell value - counter_anchor), so an
+  // increment only clears a bit in the cell (see flash_counter.h).
+  uint8_t counter_cell; // OATH_COUNTER_CELL_NONE if not bound to a cell
+  uint8_t reserved[3];
+  uint32_t counter_anchor;
+  uint8_t iv[12];  // Initialization Vector (GCM)
+  uint8_t tag[16]; // Authentication tag
+} oath_record_header_t;
+
+// Header bytes before the IV are authenticated with the ciphertext, so a
+// record cannot be moved to another name tag or counter cell on flash.
+#define OATH_RECORD_AAD_LEN offsetof(oath_record_header_t, iv)
+
+// Packed plaintext: name_len, name, secret_len, secret, type, algorithm,
+// digits, touch_required, counter (LE32), period (LE32), then optionally the
+// pad states: pads_algorithm followed by the inner and outer state words
+// (LE32, as many as the algorithm's state has).
+#define OATH_PACKED_FIXED_LEN 14
+#define OATH_PADS_MAX_LEN (1 + sizeof(hmac_midstate_t))
+#define OATH_PACKED_MAX_LEN                                                    \
+  (OATH_PACKED_FIXED_LEN + (OATH_MAX_NAME_LEN - 1) + OATH_MAX_SECRET_LEN +     \
+   OATH_PADS_MAX_LEN)
+#define OATH_RECORD_MAX_LEN (sizeof(oath_record_header_t) + OATH_PACKED_MAX_LEN)
+
+// Backup stream (oath_storage_export/import): magic, version, access code
+// flag and hash, record count, then per record a LE16 length and the record.
+// Records stay encrypted under the device master key.
+#define OATH_EXPORT_HEADER_LEN (4 + 4 + 1 + 32 + 2)
 
 // Initialize OATH storage
 void oath_storage_init(void);
 
+// Durability
+//
+// Mutations (put, delete, counter updates other than +1, access code) change
+// the RAM index and a small staging area and are written to the flash journal
+// later, so a burst of provisioning commands costs one flush. A buffered
+// change reaches flash:
+//  - when oath_storage_poll() runs after the write-back deadline (200 ms
+//    without further mutations, at most 2 s after the first one),
+//  - when a command that must not be replayed after power loss runs (HOTP
+//    CALCULATE commits before releasing a code),
+//  - on an explicit oath_storage_commit(),
+//  - when the staging area is full and another record must be buffered.
+// Reset and import are durable when they return. HOTP +1 steps are written
+// to their counter cell immediately and never wait for a flush. Power loss
+// inside the write-back window loses only the buffered changes. Each record
+// is written whole or not at all, but a flush goes slot by slot, not in the
+// order the commands ran: one torn by power loss can persist any subset of
+// the buffered records, e.g. a delete without a put that came before it.
+
+// Write all buffered mutations to flash. Returns false if the journal
+// rejected them; they stay buffered and will be retried.
+bool oath_storage_commit(void);
+
+// Flush buffered mutations if the write-back deadline has passed. Cheap when
+// nothing is buffered; meant to be called from the idle loop.
+void oath_storage_poll(void);
+
+// True if mutations are buffered in RAM only
+bool oath_storage_is_dirty(void);
+
 // Save a new credential
 bool oath_storage_put(const char *name, const uint8_t *secret,
                       uint8_t secret_len, oath_type_t type, oath_algo_t algo,
@@ -64,9 +130,32 @@ bool oath_storage_get(const char *name, oath_credential_t *out_cred);
 // List credentials (returns name at index)
 const char *oath_storage_list(uint32_t index);
 
+// Single-pass credential iterator. Each step decrypts exactly one record.
+// The cursor is a slot position, stable across unrelated mutations, so a
+// caller can stop, keep `cursor` and resume later from a fresh iterator.
+typedef struct {
+  uint16_t cursor;          // Next slot to visit
+  const aes_gcm_ctx_t *gcm; // Shared storage context (see security.h)
+  bool active;
+} oath_storage_iter_t;
+
+// Start a walk at `cursor` (0 for the first credential)
+bool oath_storage_iter_begin(oath_storage_iter_t *it, uint16_t cursor);
+
+// Yield the next credential (live HOTP counter included). Returns false at
+// the end, which also ends the iterator.
+bool oath_storage_iter_next(oath_storage_iter_t *it, oath_credential_t *out);
+
+// End a walk early
+void oath_storage_iter_end(oath_storage_iter_t *it);
+
 // Reset storage
 void oath_storage_reset(void);
 
+// Forget the cached name index key. Called by security_wipe_storage_keys();
+// the next lookup derives it again from the master key.
+void oath_storage_wipe_keys(void);
+
 // Update counter (for HOTP)
 bool oath_storage_update_counter(const char *name, uint32_t new_counter);
 
@@ -81,12 +170,15 @@ bool oath_storage_is_password_set(void);
 bool oath_storage_export(uint8_t *buffer, uint16_t *len);
 bool oath_storage_import(const uint8_t *buffer, uint16_t len);
 
-// Helper functions for credential encryption (implemented in aes_gcm.c or
-// oath_storage.c)
-bool encrypt_credential(const uint8_t *key, const oath_credential_t *cred,
-                        encrypted_credential_t *encrypted);
-bool decrypt_credential(const uint8_t *key,
-                        const encrypted_credential_t *encrypted,
-                        oath_credential_t *cred);
+// Serialize and encrypt a credential into `record` (header + ciphertext).
+// The caller fills name_tag, counter_cell and counter_anchor (and zeroes
+// reserved) first: they are authenticated along with the ciphertext.
+bool encrypt_credential(const aes_gcm_ctx_t *gcm,
+                        const oath_credential_t *cred, uint8_t *record,
+                        uint16_t *record_len);
+// Authenticate and decrypt a record produced by encrypt_credential. The
+// counter is the one stored in the record, not the live HOTP counter.
+bool decrypt_credential(const aes_gcm_ctx_t *gcm, const uint8_t *record,
+                        uint16_t record_len, oath_credential_t *cred);
 
 #endif // OATH_STORAGE_H
@@ -5,10 +5,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../security/hsm.h"
+
 // OpenPGP specific instructions
 #define INS_GET_DATA 0xCA
 #define INS_PUT_DATA 0xDA
 #define INS_VERIFY 0x20
+#define INS_PSO 0x2A
+#define INS_GENERATE_KEY 0x47
 
 // OpenPGP Data Objects (DOs)
 #define DO_AID 0x004F
@@ -16,11 +20,28 @@
 #define DO_CRD 0x0065       // Cardholder Related Data
 #define DO_ARD 0x006E       // Application Related Data
 #define DO_PW_STATUS 0x00C4 // PW Status Bytes
+#define DO_ALGO_SIG 0x00C1  // Algorithm attributes, signature key
+
+// Control reference template of the signature key (GENERATE KEY data)
+#define CRT_SIG 0xB6
+
+// PSO: COMPUTE DIGITAL SIGNATURE
+#define PSO_CDS 0x9E9A
+
+// PIN references (VERIFY P2)
+#define PW1 0x81    // PW1 for PSO:CDS
+#define PW1_82 0x82 // PW1 for other commands
+#define PW3 0x83
 
-// PIN IDs
-#define PW1 0x81
-#define PW1_83 0x83
-#define PW3 0x82
+// EdDSA (algorithm ID 22) on the Ed25519 curve, OID 1.3.6.1.4.1.11591.15.1
+static const uint8_t algo_ed25519[] = {0x16, 0x2B, 0x06, 0x01, 0x04,
+                                       0x01, 0xDA, 0x47, 0x0F, 0x01};
+
+// PIN state of the current selection. PW1 (81) is good for a single
+// PSO:CDS, as announced by the first PW status byte.
+static bool pw1_cds_verified;
+static bool pw1_verified;
+static bool pw3_verified;
 
 void openpgp_applet_init(void) {
   printf("OpenPGP: Initializing applet...\n");
@@ -33,6 +54,10 @@ static void handle_select(uint8_t *apdu_out, uint16_t *len_out) {
   uint8_t response[32];
   uint16_t pos = 0;
 
+  pw1_cds_verified = false;
+  pw1_verified = false;
+  pw3_verified = false;
+
   // ARD Template (0x6E)
   response[pos++] = 0x6E;
   response[pos++] = 10; // Simple fixed length for mock
@@ -48,24 +73,173 @@ static void handle_select(uint8_t *apdu_out, uint16_t *len_out) {
   iso7816_finalize_response(apdu_out, pos, len_out, SW_OK);
 }
 
-static void handle_verify(uint8_t p1, uint8_t p2, uint8_t *data, uint16_t lc,
-                          uint8_t *apdu_out, uint16_t *len_out) {
+static bool digest_equal(const uint8_t *a, const uint8_t *b) {
+  uint8_t diff = 0;
+  for (int i = 0; i < OPENPGP_PIN_DIGEST_LEN; i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+// VERIFY: P1 00 checks a PIN (or, without data, reports its state), P1 FF
+// logs it out. Each wrong PIN costs a retry, persisted before answering;
+// at zero the PIN is blocked.
+static void handle_verify(uint8_t p1, uint8_t p2, const uint8_t *data,
+                          uint16_t lc, uint8_t *apdu_out, uint16_t *len_out) {
   openpgp_data_t *pgp_data = openpgp_storage_get_data();
+  const uint8_t *digest;
+  uint8_t *retries;
+  uint16_t min_len;
+  bool *verified;
   printf("OpenPGP: VERIFY for PW 0x%02X\n", p2);
 
+  switch (p2) {
+  case PW1:
+  case PW1_82:
+    digest = pgp_data->pw1_digest;
+    retries = &pgp_data->pin_retry_counter[0];
+    min_len = OPENPGP_PW1_MIN_LEN;
+    verified = (p2 == PW1) ? &pw1_cds_verified : &pw1_verified;
+    break;
+  case PW3:
+    digest = pgp_data->pw3_digest;
+    retries = &pgp_data->pin_retry_counter[2];
+    min_len = OPENPGP_PW3_MIN_LEN;
+    verified = &pw3_verified;
+    break;
+  default:
+    iso7816_set_sw(apdu_out, len_out, SW_INCORRECT_P1P2);
+    return;
+  }
+
   if (p1 == 0xFF) {
     // Reset/Logout
     printf("OpenPGP: Logout for PW 0x%02X\n", p2);
+    *verified = false;
     iso7816_set_sw(apdu_out, len_out, SW_OK);
     return;
   }
+  if (p1 != 0x00) {
+    iso7816_set_sw(apdu_out, len_out, SW_INCORRECT_P1P2);
+    return;
+  }
 
-  // Placeholder for real PIN check
-  // For now, accept anything as mock (Success: 90 00)
-  printf("OpenPGP: PIN check (Mock Success)\n");
+  if (*retries == 0) {
+    *verified = false;
+    iso7816_set_sw(apdu_out, len_out, SW_AUTH_METHOD_BLOCKED);
+    return;
+  }
+  if (lc == 0) {
+    iso7816_set_sw(apdu_out, len_out,
+                   *verified ? SW_OK : SW_VERIFY_FAILED | *retries);
+    return;
+  }
+
+  *verified = false;
+  uint8_t candidate[OPENPGP_PIN_DIGEST_LEN];
+  openpgp_pin_digest(data, lc, candidate);
+  bool match = lc >= min_len && lc <= OPENPGP_PIN_MAX_LEN &&
+               digest_equal(candidate, digest);
+  memset(candidate, 0, sizeof(candidate));
+
+  if (!match) {
+    (*retries)--;
+    openpgp_storage_save();
+    printf("OpenPGP: Wrong PIN, %u tries left\n", *retries);
+    iso7816_set_sw(apdu_out, len_out, *retries ? SW_VERIFY_FAILED | *retries
+                                               : SW_AUTH_METHOD_BLOCKED);
+    return;
+  }
+
+  if (*retries != OPENPGP_PIN_RETRIES) {
+    *retries = OPENPGP_PIN_RETRIES;
+    openpgp_storage_save();
+  }
+  *verified = true;
   iso7816_set_sw(apdu_out, len_out, SW_OK);
 }
 
+// Public key template 7F49 { 86: the 32-byte Ed25519 point }
+static void send_public_key(const openpgp_data_t *pgp_data, uint8_t *apdu_out,
+                            uint16_t *len_out) {
+  uint16_t pos = 0;
+  apdu_out[pos++] = 0x7F;
+  apdu_out[pos++] = 0x49;
+  apdu_out[pos++] = 2 + OPENPGP_KEY_LEN;
+  apdu_out[pos++] = 0x86;
+  apdu_out[pos++] = OPENPGP_KEY_LEN;
+  memcpy(&apdu_out[pos], pgp_data->sig_public_key, OPENPGP_KEY_LEN);
+  pos += OPENPGP_KEY_LEN;
+  iso7816_finalize_response(apdu_out, pos, len_out, SW_OK);
+}
+
+// GENERATE ASYMMETRIC KEY PAIR: P1 80 generates (PW3), P1 81 reads the
+// public key. Only the signature key (CRT B6) exists, always Ed25519.
+static void handle_generate_key(uint8_t p1, const uint8_t *data, uint16_t lc,
+                                uint8_t *apdu_out, uint16_t *len_out) {
+  openpgp_data_t *pgp_data = openpgp_storage_get_data();
+
+  if (lc < 1 || data[0] != CRT_SIG) {
+    iso7816_set_sw(apdu_out, len_out, SW_WRONG_DATA);
+    return;
+  }
+
+  if (p1 == 0x80) {
+    if (!pw3_verified) {
+      iso7816_set_sw(apdu_out, len_out, SW_SECURITY_STATUS_NOT_SAT);
+      return;
+    }
+    printf("OpenPGP: Generating Ed25519 signature key\n");
+    if (hsm_generate_keypair(HSM_ALG_ED25519, pgp_data->sig_private_key,
+                             pgp_data->sig_public_key) != HSM_STATUS_OK) {
+      memset(pgp_data->sig_private_key, 0, OPENPGP_KEY_LEN);
+      pgp_data->sig_algorithm = HSM_ALG_NONE;
+      iso7816_set_sw(apdu_out, len_out, SW_UNKNOWN);
+      return;
+    }
+    pgp_data->sig_algorithm = HSM_ALG_ED25519;
+    openpgp_storage_save();
+  } else if (p1 != 0x81) {
+    iso7816_set_sw(apdu_out, len_out, SW_INCORRECT_P1P2);
+    return;
+  }
+
+  if (pgp_data->sig_algorithm == HSM_ALG_NONE) {
+    iso7816_set_sw(apdu_out, len_out, SW_FILE_NOT_FOUND);
+    return;
+  }
+  send_public_key(pgp_data, apdu_out, len_out);
+}
+
+// PSO: COMPUTE DIGITAL SIGNATURE. EdDSA signs the command data as given
+// (the host sends the OpenPGP hash) and returns R || S.
+static void handle_pso(uint8_t p1, uint8_t p2, const uint8_t *data,
+                       uint16_t lc, uint8_t *apdu_out, uint16_t *len_out) {
+  openpgp_data_t *pgp_data = openpgp_storage_get_data();
+
+  if (((p1 << 8) | p2) != PSO_CDS) {
+    iso7816_set_sw(apdu_out, len_out, SW_INCORRECT_P1P2);
+    return;
+  }
+  if (!pw1_cds_verified) {
+    iso7816_set_sw(apdu_out, len_out, SW_SECURITY_STATUS_NOT_SAT);
+    return;
+  }
+  if (pgp_data->sig_algorithm != HSM_ALG_ED25519) {
+    iso7816_set_sw(apdu_out, len_out, SW_CONDITIONS_NOT_SATISFIED);
+    return;
+  }
+  pw1_cds_verified = false;
+
+  uint16_t sig_len;
+  if (hsm_sign_with_key(HSM_ALG_ED25519, pgp_data->sig_private_key,
+                        pgp_data->sig_public_key, data, lc, apdu_out,
+                        &sig_len) != HSM_STATUS_OK) {
+    iso7816_set_sw(apdu_out, len_out, SW_UNKNOWN);
+    return;
+  }
+  iso7816_finalize_response(apdu_out, sig_len, len_out, SW_OK);
+}
+
 static void handle_get_data(uint8_t p1, uint8_t p2, uint8_t *apdu_out,
                             uint16_t *len_out) {
   uint16_t tag = (p1 << 8) | p2;
@@ -79,16 +253,26 @@ static void handle_get_data(uint8_t p1, uint8_t p2, uint8_t *apdu_out,
     break;
 
   case DO_PW_STATUS: {
-    // PW Status Bytes: [0] Forcing PIN, [1] User PIN length, [2] Admin PIN
-    // length, [3] PW1 retry, [4] PW2 retry (N/A), [5] PW3 retry
-    uint8_t status[] = {0x00, 0x08,
-                        0x08, pgp_data->pin_retry_counter[0],
-                        0x00, pgp_data->pin_retry_counter[2]};
+    // PW Status Bytes: [0] PW1 valid for one PSO:CDS only, [1] PW1, [2]
+    // reset code and [3] PW3 maximum lengths, [4] PW1, [5] reset code (N/A)
+    // and [6] PW3 retries
+    uint8_t status[] = {0x00,
+                        OPENPGP_PIN_MAX_LEN,
+                        0x00,
+                        OPENPGP_PIN_MAX_LEN,
+                        pgp_data->pin_retry_counter[0],
+                        0x00,
+                        pgp_data->pin_retry_counter[2]};
     memcpy(apdu_out, status, sizeof(status));
     iso7816_finalize_response(apdu_out, sizeof(status), len_out, SW_OK);
     break;
   }
 
+  case DO_ALGO_SIG:
+    memcpy(apdu_out, algo_ed25519, sizeof(algo_ed25519));
+    iso7816_finalize_response(apdu_out, sizeof(algo_ed25519), len_out, SW_OK);
+    break;
+
   case DO_LOGIN: {
     uint16_t name_len = strlen(pgp_data->name);
     memcpy(apdu_out, pgp_data->name, name_len);
@@ -154,8 +338,26 @@ void openpgp_applet_handle_apdu(uint8_t *apdu_in, uint16_t len_in,
     break;
 
   case INS_VERIFY: {
-    uint8_t lc = (len_in > 4) ? apdu_in[APDU_LC_POS] : 0;
-    handle_verify(p1, p2, &apdu_in[APDU_DATA_POS], lc, apdu_out, len_out);
+    iso7816_apdu_t apdu;
+    if (!iso7816_parse_apdu(apdu_in, len_in, &apdu)) {
+      iso7816_set_sw(apdu_out, len_out, SW_WRONG_LENGTH);
+      break;
+    }
+    handle_verify(p1, p2, apdu.data, apdu.lc, apdu_out, len_out);
+    break;
+  }
+
+  case INS_GENERATE_KEY:
+  case INS_PSO: {
+    iso7816_apdu_t apdu;
+    if (!iso7816_parse_apdu(apdu_in, len_in, &apdu)) {
+      iso7816_set_sw(apdu_out, len_out, SW_WRONG_LENGTH);
+      break;
+    }
+    if (ins == INS_GENERATE_KEY)
+      handle_generate_key(p1, apdu.data, apdu.lc, apdu_out, len_out);
+    else
+      handle_pso(p1, p2, apdu.data, apdu.lc, apdu_out, len_out);
     break;
   }
 
@@ -1,41 +1,93 @@
 #include "openpgp_storage.h"
 #include "../crypto/aes_gcm.h"
+#include "../crypto/sha256.h"
 #include "../security/security.h"
 #include <hardware/address_mapped.h>
 #include <hardware/flash.h>
 #include <hardware/sync.h>
+#include <pico/rand.h>
 #include <pico/stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 
-#define OPENPGP_MAGIC 0x50475033 // "PGP3"
+#define OPENPGP_MAGIC 0x50475035    // "PGP5"
+#define OPENPGP_MAGIC_V4 0x50475034 // "PGP4": no PINs
+#define OPENPGP_MAGIC_V3 0x50475033 // "PGP3": no signature key
 
 typedef struct {
   uint32_t magic;
-  openpgp_data_t data;
   uint8_t iv[12];
   uint8_t tag[16];
   uint8_t encrypted_data[sizeof(openpgp_data_t)];
 } openpgp_persist_t;
 
+// "PGP4" records share the layout, with the data ending before the PINs
+#define OPENPGP_V4_DATA_LEN offsetof(openpgp_data_t, pw1_digest)
+
+// The "PGP3" layout predates the signature key and also kept a plaintext
+// copy of the data in front of the ciphertext
+#define OPENPGP_V3_DATA_LEN offsetof(openpgp_data_t, sig_algorithm)
+
+typedef struct {
+  uint32_t magic;
+  uint8_t data[OPENPGP_V3_DATA_LEN];
+  uint8_t iv[12];
+  uint8_t tag[16];
+  uint8_t encrypted_data[OPENPGP_V3_DATA_LEN];
+} openpgp_persist_v3_t;
+
 static openpgp_data_t current_pgp_data;
 
+void openpgp_pin_digest(const uint8_t *pin, uint16_t len,
+                        uint8_t digest[OPENPGP_PIN_DIGEST_LEN]) {
+  SHA256_CTX ctx;
+  SHA256Init(&ctx);
+  SHA256Update(&ctx, pin, len);
+  SHA256Final(&ctx, digest);
+}
+
+// Factory PINs with full retry counters
+static void openpgp_reset_pins(void) {
+  openpgp_pin_digest((const uint8_t *)OPENPGP_PW1_DEFAULT,
+                     sizeof(OPENPGP_PW1_DEFAULT) - 1,
+                     current_pgp_data.pw1_digest);
+  openpgp_pin_digest((const uint8_t *)OPENPGP_PW3_DEFAULT,
+                     sizeof(OPENPGP_PW3_DEFAULT) - 1,
+                     current_pgp_data.pw3_digest);
+  current_pgp_data.pin_retry_counter[0] = OPENPGP_PIN_RETRIES;
+  current_pgp_data.pin_retry_counter[1] = OPENPGP_PIN_RETRIES;
+  current_pgp_data.pin_retry_counter[2] = OPENPGP_PIN_RETRIES;
+}
+
+static void openpgp_set_defaults(void) {
+  memset(&current_pgp_data, 0, sizeof(openpgp_data_t));
+  memcpy(current_pgp_data.serial, "\x00\x01\x02\x03\x04\x05", 6);
+  strcpy(current_pgp_data.name, "RP2350 User");
+  current_pgp_data.lang[0] = 'e';
+  current_pgp_data.lang[1] = 'n';
+  openpgp_reset_pins();
+}
+
 static void openpgp_save_to_flash(void) {
-  uint8_t master_key[32];
-  security_get_master_key(master_key);
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
+    return;
 
   openpgp_persist_t persist;
   persist.magic = OPENPGP_MAGIC;
-  persist.data = current_pgp_data;
 
-  // Generate random IV (or use simple counter for mock)
-  for (int i = 0; i < 12; i++)
-    persist.iv[i] = (uint8_t)i;
+  // Fresh IV for every save: the data now holds a private key
+  for (int i = 0; i < 12; i += 4) {
+    uint32_t r = get_rand_32();
+    memcpy(persist.iv + i, &r, 4);
+  }
 
-  if (!aes_gcm_encrypt(master_key, persist.iv, (uint8_t *)&persist.data,
-                       sizeof(openpgp_data_t), persist.tag,
-                       persist.encrypted_data)) {
+  if (!aes_gcm_ctx_encrypt(gcm, persist.iv, NULL, 0,
+                           (uint8_t *)&current_pgp_data,
+                           sizeof(openpgp_data_t), persist.encrypted_data,
+                           persist.tag)) {
     printf("OpenPGP Storage: Encryption failed!\n");
     return;
   }
@@ -49,33 +101,74 @@ static void openpgp_save_to_flash(void) {
   printf("OpenPGP Storage: Saved and encrypted to flash.\n");
 }
 
+// Decrypts the leading data_len bytes of an older record and rewrites it
+// in the current format with factory PINs. A "PGP3" record also leaves no
+// plaintext copy behind.
+static void openpgp_migrate(const aes_gcm_ctx_t *gcm, const uint8_t *iv,
+                            const uint8_t *tag, const uint8_t *encrypted,
+                            size_t data_len) {
+  memset(&current_pgp_data, 0, sizeof(openpgp_data_t));
+  if (!aes_gcm_ctx_decrypt(gcm, iv, NULL, 0, encrypted, data_len, tag,
+                           (uint8_t *)&current_pgp_data)) {
+    printf("OpenPGP Storage: Decryption failed! Re-initializing.\n");
+    openpgp_set_defaults();
+    return;
+  }
+  printf("OpenPGP Storage: Migrated %s data.\n",
+         data_len == OPENPGP_V3_DATA_LEN ? "PGP3" : "PGP4");
+  openpgp_reset_pins();
+  openpgp_save_to_flash();
+}
+
+static bool openpgp_magic_valid(uint32_t magic) {
+  return magic == OPENPGP_MAGIC || magic == OPENPGP_MAGIC_V4 ||
+         magic == OPENPGP_MAGIC_V3;
+}
+
 static void openpgp_load_from_flash(void) {
   const openpgp_persist_t *stored_data =
       (const openpgp_persist_t *)(XIP_BASE + OPENPGP_FLASH_OFFSET);
 
-  if (stored_data->magic != OPENPGP_MAGIC) {
+  // Older firmware shared the HSM sector; take its record over unless the
+  // HSM wrote there last
+  if (!openpgp_magic_valid(stored_data->magic)) {
+    const openpgp_persist_t *legacy =
+        (const openpgp_persist_t *)(XIP_BASE + OPENPGP_LEGACY_FLASH_OFFSET);
+    if (legacy->magic == OPENPGP_MAGIC_V4 ||
+        legacy->magic == OPENPGP_MAGIC_V3)
+      stored_data = legacy;
+  }
+
+  if (!openpgp_magic_valid(stored_data->magic)) {
     printf("OpenPGP Storage: No valid data in flash. Initializing defaults.\n");
-    memset(&current_pgp_data, 0, sizeof(openpgp_data_t));
-    memcpy(current_pgp_data.serial, "\x00\x01\x02\x03\x04\x05", 6);
-    strcpy(current_pgp_data.name, "RP2350 User");
-    current_pgp_data.lang[0] = 'e';
-    current_pgp_data.lang[1] = 'n';
-    current_pgp_data.pin_retry_counter[0] = 3;
-    current_pgp_data.pin_retry_counter[1] = 3;
-    current_pgp_data.pin_retry_counter[2] = 3;
+    openpgp_set_defaults();
     openpgp_save_to_flash();
     return;
   }
 
-  uint8_t master_key[32];
-  security_get_master_key(master_key);
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm)
+    return;
+
+  if (stored_data->magic == OPENPGP_MAGIC_V3) {
+    const openpgp_persist_v3_t *v3 = (const openpgp_persist_v3_t *)stored_data;
+    openpgp_migrate(gcm, v3->iv, v3->tag, v3->encrypted_data,
+                    OPENPGP_V3_DATA_LEN);
+    return;
+  }
+  if (stored_data->magic == OPENPGP_MAGIC_V4) {
+    openpgp_migrate(gcm, stored_data->iv, stored_data->tag,
+                    stored_data->encrypted_data, OPENPGP_V4_DATA_LEN);
+    return;
+  }
 
-  if (aes_gcm_decrypt(master_key, stored_data->iv, stored_data->encrypted_data,
-                      sizeof(openpgp_data_t), stored_data->tag,
-                      (uint8_t *)&current_pgp_data)) {
+  if (aes_gcm_ctx_decrypt(gcm, stored_data->iv, NULL, 0,
+                          stored_data->encrypted_data, sizeof(openpgp_data_t),
+                          stored_data->tag, (uint8_t *)&current_pgp_data)) {
     printf("OpenPGP Storage: Loaded and decrypted from flash.\n");
   } else {
     printf("OpenPGP Storage: Decryption failed! Re-initializing.\n");
+    openpgp_set_defaults();
   }
 }
 
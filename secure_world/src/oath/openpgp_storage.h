@@ -4,21 +4,40 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "../security/security_manager.h"
 
 // OpenPGP Storage Configuration
-// Using the 3rd to last 4KB sector of Flash
-#define OPENPGP_FLASH_OFFSET (2 * 1024 * 1024 - 12288)
+// One flash sector at OPENPGP_FLASH_OFFSET (security_manager.h)
 
 #define OPENPGP_MAX_NAME_LEN 32
 #define OPENPGP_MAX_SERIAL_LEN 6
+#define OPENPGP_KEY_LEN 32
+
+// PINs: PW1 (user) and PW3 (admin), kept as SHA-256 digests
+#define OPENPGP_PIN_DIGEST_LEN 32
+#define OPENPGP_PW1_MIN_LEN 6
+#define OPENPGP_PW3_MIN_LEN 8
+#define OPENPGP_PIN_MAX_LEN 127
+#define OPENPGP_PIN_RETRIES 3
+#define OPENPGP_PW1_DEFAULT "123456"
+#define OPENPGP_PW3_DEFAULT "12345678"
 
 typedef struct {
   uint8_t serial[OPENPGP_MAX_SERIAL_LEN];
   char name[OPENPGP_MAX_NAME_LEN];
   uint8_t lang[2];
   uint8_t sex;
-  uint8_t pin_retry_counter[3]; // PW1, PW1_83, PW3
-  // In a real app, we'd store hashed/encrypted PINs here
+  uint8_t pin_retry_counter[3]; // PW1, reset code (unused), PW3
+
+  // Signature key (Ed25519 seed and public key), sig_algorithm is
+  // HSM_ALG_NONE until one is generated
+  uint8_t sig_algorithm;
+  uint8_t sig_private_key[OPENPGP_KEY_LEN];
+  uint8_t sig_public_key[OPENPGP_KEY_LEN];
+
+  // SHA-256 of PW1 and PW3; the whole record is encrypted in flash
+  uint8_t pw1_digest[OPENPGP_PIN_DIGEST_LEN];
+  uint8_t pw3_digest[OPENPGP_PIN_DIGEST_LEN];
 } openpgp_data_t;
 
 /**
@@ -36,4 +55,10 @@ void openpgp_storage_save(void);
  */
 openpgp_data_t *openpgp_storage_get_data(void);
 
+/**
+ * @brief Digest a PIN is stored and compared as (SHA-256).
+ */
+void openpgp_pin_digest(const uint8_t *pin, uint16_t len,
+                        uint8_t digest[OPENPGP_PIN_DIGEST_LEN]);
+
 #endif // OPENPGP_STORAGE_H
@@ -61,9 +61,18 @@ secure_world_handler(secure_gateway_func_id_t func_id, uint8_t *in_data,
     result = SG_SUCCESS;
     break;
 
+  case SG_IDLE:
+    oath_storage_poll();
+    hsm_poll();
+    result = SG_SUCCESS;
+    break;
+
   case SG_OATH_HANDLE_APDU:
     if (!in_data || !out_data) {
       result = SG_ERR_INVALID_PARAM;
+    } else if (out_max_len < SG_APDU_MAX_LEN) {
+      // Applets size responses for a full SG_APDU_MAX_LEN buffer
+      result = SG_ERR_BUFFER_TOO_SMALL;
     } else {
       applet_manager_process_apdu(in_data, in_len, out_data, &out_len_val);
       result = (int32_t)out_len_val;
@@ -85,10 +94,12 @@ secure_world_handler(secure_gateway_func_id_t func_id, uint8_t *in_data,
     break;
 
   case SG_HSM_GEN_KEY:
+    // Slot, then an optional algorithm (P-256 when absent)
     if (in_len < 1 || !out_data || out_max_len < 1) {
       result = SG_ERR_INVALID_PARAM;
     } else {
-      out_data[0] = hsm_generate_key(in_data[0]);
+      out_data[0] = hsm_generate_key(in_data[0],
+                                     in_len >= 2 ? in_data[1] : HSM_ALG_P256);
       result = 1;
     }
     break;
@@ -117,19 +128,34 @@ secure_world_handler(secure_gateway_func_id_t func_id, uint8_t *in_data,
     break;
   }
 
+  case SG_HSM_VERIFY: {
+    // Public key, then (hash, signature) pairs; one result byte per pair
+    uint16_t count = (in_len > 64) ? (in_len - 64) / HSM_VERIFY_PAIR_SIZE : 0;
+    if (!in_data || !out_data || count == 0 ||
+        in_len != 64 + count * HSM_VERIFY_PAIR_SIZE || out_max_len < count) {
+      result = SG_ERR_INVALID_PARAM;
+    } else {
+      int valid = hsm_verify_multi(in_data, in_data + 64, count, out_data);
+      result = (valid < 0) ? SG_ERR_INVALID_PARAM : (int32_t)valid;
+    }
+    break;
+  }
+
   case SG_FIDO2_HANDLE_MSG: {
     if (in_data == NULL || out_data == NULL) {
       result = SG_ERR_INVALID_PARAM;
     } else {
       uint16_t out_len = 0;
-      fido2_applet_handle_msg(in_data, in_len, out_data, &out_len);
-      result = (int32_t)out_len;
+      if (fido2_applet_handle_msg(in_data, in_len, out_data, &out_len))
+        result = (int32_t)out_len;
+      else
+        result = SG_ERR_TOUCH_REQUIRED;
     }
     break;
   }
 
   case SG_OATH_BACKUP: {
-    if (out_data == NULL || out_max_len < sizeof(oath_persist_t)) {
+    if (out_data == NULL || out_max_len < OATH_EXPORT_HEADER_LEN) {
       result = SG_ERR_INVALID_PARAM;
     } else {
       uint16_t out_len = out_max_len;
@@ -143,7 +169,7 @@ secure_world_handler(secure_gateway_func_id_t func_id, uint8_t *in_data,
   }
 
   case SG_OATH_RESTORE: {
-    if (in_data == NULL || in_len != sizeof(oath_persist_t)) {
+    if (in_data == NULL || in_len < OATH_EXPORT_HEADER_LEN) {
       result = SG_ERR_INVALID_PARAM;
     } else {
       if (oath_storage_import(in_data, in_len)) {
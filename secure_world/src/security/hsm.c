@@ -1,5 +1,6 @@
 #include "hsm.h"
 #include "../crypto/aes_gcm.h"
+#include "../crypto/ed25519.h"
 #include "../crypto/uECC.h"
 #include "security.h"
 #include "security_manager.h"
@@ -18,8 +19,8 @@
 // HSM Slot definitions
 typedef struct {
   uint8_t private_key[32];
-  uint8_t public_key[64];
-  bool occupied;
+  uint8_t public_key[64]; // Ed25519 uses the first 32 bytes
+  uint8_t algorithm;      // HSM_ALG_*; P-256 matches the old occupied flag
 } hsm_slot_t;
 
 typedef struct {
@@ -33,7 +34,22 @@ typedef struct {
   uint8_t tag[16];
 } hsm_flash_data_t;
 
-static hsm_slot_t hsm_slots[HSM_MAX_SLOTS];
+// The slots live in the record they are saved as, so saving and loading
+// encrypt and decrypt in place instead of staging a copy on the stack
+static hsm_persist_t hsm_state;
+
+// Precomputed ECDSA nonces (1/k and r = x(kG)). hsm_poll() fills the pool
+// while the device is idle so a signature only costs the s = (e + rd) / k
+// step. Each entry is wiped as it is taken and never used twice.
+typedef struct {
+  uint8_t k_inverse[HSM_KEY_SIZE];
+  uint8_t r[HSM_KEY_SIZE];
+} hsm_nonce_t;
+
+static hsm_nonce_t nonce_pool[HSM_NONCE_POOL_SIZE];
+static uint8_t nonce_count;
+
+static hsm_sign_stats_t sign_stats;
 
 // Internal functions
 static void hsm_save_to_flash(void);
@@ -55,24 +71,22 @@ static int hsm_rng(uint8_t *dest, unsigned size) {
 }
 
 static void hsm_save_to_flash(void) {
-  uint8_t master_key[32];
-  if (!otp_read_master_key(master_key)) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm) {
     printf("HSM: ERROR - Could not read Master Key for encryption!\n");
     return;
   }
 
-  hsm_persist_t persist;
-  persist.magic = HSM_MAGIC;
-  memcpy(persist.slots, hsm_slots, sizeof(hsm_slots));
-
-  hsm_flash_data_t flash_data;
+  // Ciphertext only; static to keep it off the stack
+  static hsm_flash_data_t flash_data;
+  hsm_state.magic = HSM_MAGIC;
   for (int i = 0; i < 12; i++) {
     flash_data.iv[i] = (uint8_t)(get_rand_32() & 0xFF);
   }
 
-  if (!aes_gcm_encrypt(master_key, flash_data.iv, (const uint8_t *)&persist,
-                       sizeof(persist), flash_data.encrypted_data,
-                       flash_data.tag)) {
+  if (!aes_gcm_ctx_encrypt(gcm, flash_data.iv, NULL, 0,
+                           (const uint8_t *)&hsm_state, sizeof(hsm_state),
+                           flash_data.encrypted_data, flash_data.tag)) {
     printf("HSM: ERROR - Flash encryption failed!\n");
     return;
   }
@@ -90,52 +104,196 @@ static void hsm_load_from_flash(void) {
   const hsm_flash_data_t *stored_data =
       (const hsm_flash_data_t *)(XIP_BASE + HSM_FLASH_OFFSET);
 
-  uint8_t master_key[32];
-  if (!otp_read_master_key(master_key)) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  if (!gcm) {
     printf("HSM: WARNING - No master key, initializing empty HSM.\n");
-    memset(hsm_slots, 0, sizeof(hsm_slots));
+    memset(&hsm_state, 0, sizeof(hsm_state));
     return;
   }
 
-  hsm_persist_t persist;
-  if (aes_gcm_decrypt(master_key, stored_data->iv, stored_data->encrypted_data,
-                      sizeof(persist), stored_data->tag, (uint8_t *)&persist)) {
-    if (persist.magic == HSM_MAGIC) {
-      memcpy(hsm_slots, persist.slots, sizeof(hsm_slots));
-      printf("HSM: Loaded and decrypted from flash.\n");
-      return;
-    }
+  if (aes_gcm_ctx_decrypt(gcm, stored_data->iv, NULL, 0,
+                          stored_data->encrypted_data, sizeof(hsm_state),
+                          stored_data->tag, (uint8_t *)&hsm_state) &&
+      hsm_state.magic == HSM_MAGIC) {
+    printf("HSM: Loaded and decrypted from flash.\n");
+    return;
   }
 
   printf("HSM: Initializing empty state.\n");
-  memset(hsm_slots, 0, sizeof(hsm_slots));
+  memset(&hsm_state, 0, sizeof(hsm_state));
   hsm_save_to_flash();
 }
 
+static void wipe(void *buf, size_t len) {
+  volatile uint8_t *p = (volatile uint8_t *)buf;
+  while (len--)
+    *p++ = 0;
+}
+
+static void sign_stats_record(bool pooled, uint64_t start_us) {
+  uint32_t us = (uint32_t)(time_us_64() - start_us);
+  uint32_t bucket = 0;
+  while (us >>= 1)
+    bucket++;
+  (pooled ? sign_stats.pooled : sign_stats.unpooled)[bucket]++;
+
+#if HSM_SIGN_STATS
+  static uint32_t total;
+  if (++total % HSM_SIGN_STATS != 0)
+    return;
+  for (int pool = 1; pool >= 0; pool--) {
+    const uint32_t *hist = pool ? sign_stats.pooled : sign_stats.unpooled;
+    uint32_t n = 0;
+    for (int b = 0; b < HSM_SIGN_BUCKETS; b++)
+      n += hist[b];
+    if (n)
+      printf("HSM: sign %s pool: n=%lu p50<%luus p99<%luus\n",
+             pool ? "with" : "without", (unsigned long)n,
+             (unsigned long)hsm_sign_stats_percentile(hist, 50),
+             (unsigned long)hsm_sign_stats_percentile(hist, 99));
+  }
+#endif
+}
+
+void hsm_sign_stats_get(hsm_sign_stats_t *out) {
+  memcpy(out, &sign_stats, sizeof(sign_stats));
+}
+
+void hsm_sign_stats_reset(void) { memset(&sign_stats, 0, sizeof(sign_stats)); }
+
+uint32_t hsm_sign_stats_percentile(const uint32_t *hist, unsigned pct) {
+  uint64_t n = 0, seen = 0;
+  for (int b = 0; b < HSM_SIGN_BUCKETS; b++)
+    n += hist[b];
+  for (int b = 0; b < HSM_SIGN_BUCKETS && n; b++) {
+    seen += hist[b];
+    if (seen * 100 >= n * pct)
+      return b + 1 < HSM_SIGN_BUCKETS ? 1UL << (b + 1) : UINT32_MAX;
+  }
+  return 0;
+}
+
+// Signs with a pooled nonce when one is ready, otherwise computes k*G now
+static bool ecdsa_sign(const uint8_t *private_key, const uint8_t *hash,
+                       uint8_t *sig_out) {
+  uint64_t start_us = time_us_64();
+  bool pooled = nonce_count > 0;
+  bool ok = false;
+
+  if (pooled) {
+    hsm_nonce_t nonce;
+    nonce_count--;
+    memcpy(&nonce, &nonce_pool[nonce_count], sizeof(nonce));
+    wipe(&nonce_pool[nonce_count], sizeof(nonce));
+    ok = uECC_sign_with_precomputed(private_key, hash, 32, nonce.k_inverse,
+                                    nonce.r, sig_out, uECC_secp256r1());
+    wipe(&nonce, sizeof(nonce));
+  }
+  if (!ok)
+    ok = uECC_sign(private_key, hash, 32, sig_out, uECC_secp256r1());
+
+  sign_stats_record(pooled, start_us);
+  return ok;
+}
+
+// Creates a key pair of the given algorithm. An Ed25519 private key is the
+// 32-byte seed.
+static uint8_t make_keypair(uint8_t algorithm, uint8_t *private_key,
+                            uint8_t *pubkey) {
+  switch (algorithm) {
+  case HSM_ALG_P256:
+    if (!uECC_make_key(pubkey, private_key, uECC_secp256r1()))
+      return HSM_STATUS_ERROR;
+    return HSM_STATUS_OK;
+  case HSM_ALG_ED25519:
+    hsm_rng(private_key, HSM_KEY_SIZE);
+    ed25519_public_key(pubkey, private_key);
+    return HSM_STATUS_OK;
+  default:
+    return HSM_STATUS_UNSUPPORTED_ALG;
+  }
+}
+
+static uint16_t pubkey_size(uint8_t algorithm) {
+  return algorithm == HSM_ALG_ED25519 ? ED25519_PUBLIC_KEY_SIZE : 64;
+}
+
+// P-256 signs a 32-byte hash; Ed25519 signs the message itself and derives
+// the public key from the seed when pubkey is NULL
+static uint8_t sign_message(uint8_t algorithm, const uint8_t *private_key,
+                            const uint8_t *pubkey, const uint8_t *message,
+                            size_t message_len, uint8_t *sig_out) {
+  uint8_t derived[ED25519_PUBLIC_KEY_SIZE];
+
+  switch (algorithm) {
+  case HSM_ALG_P256:
+    if (message_len != 32 || !ecdsa_sign(private_key, message, sig_out))
+      return HSM_STATUS_ERROR;
+    return HSM_STATUS_OK;
+  case HSM_ALG_ED25519:
+    if (!pubkey) {
+      ed25519_public_key(derived, private_key);
+      pubkey = derived;
+    }
+    ed25519_sign(sig_out, message, message_len, private_key, pubkey);
+    return HSM_STATUS_OK;
+  default:
+    return HSM_STATUS_UNSUPPORTED_ALG;
+  }
+}
+
+void hsm_poll(void) {
+  if (nonce_count >= HSM_NONCE_POOL_SIZE)
+    return;
+
+  hsm_nonce_t *nonce = &nonce_pool[nonce_count];
+  if (uECC_sign_precompute(nonce->k_inverse, nonce->r, uECC_secp256r1()))
+    nonce_count++;
+  else
+    wipe(nonce, sizeof(*nonce));
+}
+
+void hsm_nonce_pool_clear(void) {
+  wipe(nonce_pool, sizeof(nonce_pool));
+  nonce_count = 0;
+}
+
 void hsm_init(void) {
-  printf("HSM: Initializing with real ECC (P-256)...\n");
+  printf("HSM: Initializing with real ECC (P-256, Ed25519)...\n");
 
   // Set the RNG function for micro-ecc
   uECC_set_rng(hsm_rng);
+  hsm_nonce_pool_clear();
 
   hsm_load_from_flash();
   printf("HSM: Ready with %d slots\n", HSM_MAX_SLOTS);
 }
 
-uint8_t hsm_generate_key(uint8_t slot) {
+uint8_t hsm_generate_key(uint8_t slot, uint8_t algorithm) {
   if (slot >= HSM_MAX_SLOTS)
     return HSM_STATUS_INVALID_SLOT;
+  if (algorithm != HSM_ALG_P256 && algorithm != HSM_ALG_ED25519)
+    return HSM_STATUS_UNSUPPORTED_ALG; // Leaves the slot as it was
 
-  printf("HSM: Generating P-256 key pair for slot %d\n", slot);
+  printf("HSM: Generating %s key pair for slot %d\n",
+         algorithm == HSM_ALG_ED25519 ? "Ed25519" : "P-256", slot);
 
-  if (!uECC_make_key(hsm_slots[slot].public_key, hsm_slots[slot].private_key,
-                     uECC_secp256r1())) {
+  // Built aside so a failure leaves the slot, in RAM and flash, as it was
+  hsm_slot_t fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  uint8_t status = make_keypair(algorithm, fresh.private_key, fresh.public_key);
+  if (status != HSM_STATUS_OK) {
     printf("HSM: Key generation failed!\n");
-    return HSM_STATUS_ERROR;
+    wipe(&fresh, sizeof(fresh));
+    return status;
   }
 
-  hsm_slots[slot].occupied = true;
+  fresh.algorithm = algorithm;
+  memcpy(&hsm_state.slots[slot], &fresh, sizeof(fresh));
+  wipe(&fresh, sizeof(fresh));
   hsm_save_to_flash();
+  // Nonces are not tied to a key, but none outlives a key change
+  hsm_nonce_pool_clear();
 
   printf("HSM: Key pair generated and saved\n");
   return HSM_STATUS_OK;
@@ -145,44 +303,94 @@ uint8_t hsm_get_pubkey(uint8_t slot, uint8_t *pubkey_out,
                        uint16_t *pubkey_len) {
   if (slot >= HSM_MAX_SLOTS)
     return HSM_STATUS_INVALID_SLOT;
-  if (!hsm_slots[slot].occupied)
+  if (hsm_state.slots[slot].algorithm == HSM_ALG_NONE)
     return HSM_STATUS_NO_KEY;
 
   printf("HSM: Exporting public key for slot %d\n", slot);
 
-  // Return uncompressed public key (X, Y)
-  memcpy(pubkey_out, hsm_slots[slot].public_key, 64);
-  *pubkey_len = 64;
+  // Uncompressed P-256 point (X, Y) or the encoded Ed25519 point
+  *pubkey_len = pubkey_size(hsm_state.slots[slot].algorithm);
+  memcpy(pubkey_out, hsm_state.slots[slot].public_key, *pubkey_len);
 
   return HSM_STATUS_OK;
 }
 
+uint8_t hsm_get_algorithm(uint8_t slot) {
+  if (slot >= HSM_MAX_SLOTS)
+    return HSM_ALG_NONE;
+  return hsm_state.slots[slot].algorithm;
+}
+
 uint8_t hsm_sign(uint8_t slot, const uint8_t *hash, uint8_t *sig_out,
                  uint16_t *sig_len) {
   if (slot >= HSM_MAX_SLOTS)
     return HSM_STATUS_INVALID_SLOT;
-  if (!hsm_slots[slot].occupied)
+  const hsm_slot_t *s = &hsm_state.slots[slot];
+  if (s->algorithm == HSM_ALG_NONE)
     return HSM_STATUS_NO_KEY;
 
-  printf("HSM: Signing hash with slot %d (ECDSA P-256)\n", slot);
+  printf("HSM: Signing hash with slot %d (%s)\n", slot,
+         s->algorithm == HSM_ALG_ED25519 ? "Ed25519" : "ECDSA P-256");
 
-  if (!uECC_sign(hsm_slots[slot].private_key, hash, 32, sig_out,
-                 uECC_secp256r1())) {
+  uint8_t status = sign_message(s->algorithm, s->private_key, s->public_key,
+                                hash, 32, sig_out);
+  if (status != HSM_STATUS_OK) {
     printf("HSM: Signing failed!\n");
-    return HSM_STATUS_ERROR;
+    return status;
   }
 
   *sig_len = 64;
   return HSM_STATUS_OK;
 }
 
+uint8_t hsm_verify(const uint8_t *pubkey, const uint8_t *hash,
+                   const uint8_t *sig) {
+  if (!uECC_valid_public_key(pubkey, uECC_secp256r1()))
+    return HSM_STATUS_INVALID_KEY;
+  if (!uECC_verify(pubkey, hash, 32, sig, uECC_secp256r1()))
+    return HSM_STATUS_BAD_SIGNATURE;
+  return HSM_STATUS_OK;
+}
+
+int hsm_verify_multi(const uint8_t *pubkey, const uint8_t *pairs,
+                     uint16_t count, uint8_t *results) {
+  if (!uECC_valid_public_key(pubkey, uECC_secp256r1()))
+    return -1;
+  return uECC_verify_multi(pubkey, pairs, count, 32, results,
+                           uECC_secp256r1());
+}
+
 uint8_t hsm_delete_key(uint8_t slot) {
   if (slot >= HSM_MAX_SLOTS)
     return HSM_STATUS_INVALID_SLOT;
 
   printf("HSM: Deleting key in slot %d\n", slot);
-  memset(&hsm_slots[slot], 0, sizeof(hsm_slot_t));
+  memset(&hsm_state.slots[slot], 0, sizeof(hsm_slot_t));
   hsm_save_to_flash();
+  hsm_nonce_pool_clear();
+
+  return HSM_STATUS_OK;
+}
 
+uint8_t hsm_generate_keypair(uint8_t algorithm, uint8_t *private_key_out,
+                             uint8_t *pubkey_out) {
+  uint8_t status = make_keypair(algorithm, private_key_out, pubkey_out);
+  if (status != HSM_STATUS_OK)
+    printf("HSM: Key generation failed!\n");
+  return status;
+}
+
+uint8_t hsm_sign_with_key(uint8_t algorithm, const uint8_t *private_key,
+                          const uint8_t *pubkey, const uint8_t *message,
+                          size_t message_len, uint8_t *sig_out,
+                          uint16_t *sig_len) {
+  uint8_t status = sign_message(algorithm, private_key, pubkey, message,
+                                message_len, sig_out);
+  if (status != HSM_STATUS_OK) {
+    printf("HSM: Signing failed!\n");
+    return status;
+  }
+
+  *sig_len = 64;
   return HSM_STATUS_OK;
 }
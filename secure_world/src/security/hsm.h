@@ -2,37 +2,117 @@
 #define HSM_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
 // HSM Slot definitions
 #define HSM_MAX_SLOTS 8
-#define HSM_KEY_SIZE 32 // 256-bit keys (e.g., P-256)
+#define HSM_KEY_SIZE 32 // 256-bit keys (P-256 scalar or Ed25519 seed)
+
+// Key algorithms. A slot holding HSM_ALG_NONE is empty.
+#define HSM_ALG_NONE 0x00
+#define HSM_ALG_P256 0x01    // ECDSA P-256, 64-byte public key (X, Y)
+#define HSM_ALG_ED25519 0x02 // Ed25519, 32-byte public key
+
+// Precomputed ECDSA nonces kept in secure RAM (64 bytes each)
+#ifndef HSM_NONCE_POOL_SIZE
+#define HSM_NONCE_POOL_SIZE 8
+#endif
+
+// Print signing latency percentiles every N signatures (0 = off)
+#ifndef HSM_SIGN_STATS
+#define HSM_SIGN_STATS 0
+#endif
 
 // HSM Status codes
 #define HSM_STATUS_OK 0x00
 #define HSM_STATUS_ERROR 0x01
 #define HSM_STATUS_INVALID_SLOT 0x02
 #define HSM_STATUS_NO_KEY 0x03
+#define HSM_STATUS_INVALID_KEY 0x04
+#define HSM_STATUS_BAD_SIGNATURE 0x05
+#define HSM_STATUS_UNSUPPORTED_ALG 0x06
 
 // HSM Initialize
 void hsm_init(void);
 
-// Generate a new key in a slot
-// Returns HSM_STATUS_OK on success
-uint8_t hsm_generate_key(uint8_t slot);
+// Refill the nonce pool by one entry. Called while the device is idle; one
+// call costs about one scalar multiplication.
+void hsm_poll(void);
+
+// Wipe all precomputed nonces. Key generation and deletion do this too.
+void hsm_nonce_pool_clear(void);
+
+// ECDSA signing latency, counted in log2 buckets: bucket b holds signatures
+// that took [2^b, 2^(b+1)) us, bucket 0 also those under 1 us
+#define HSM_SIGN_BUCKETS 32
+typedef struct {
+  uint32_t pooled[HSM_SIGN_BUCKETS];   // Signed with a precomputed nonce
+  uint32_t unpooled[HSM_SIGN_BUCKETS]; // Computed k*G on demand
+} hsm_sign_stats_t;
+
+// Read and clear the latency histograms
+void hsm_sign_stats_get(hsm_sign_stats_t *out);
+void hsm_sign_stats_reset(void);
+
+// Upper bound in us of the bucket reaching the pct-th percentile of a
+// histogram, or 0 if it is empty
+uint32_t hsm_sign_stats_percentile(const uint32_t *hist, unsigned pct);
+
+// Generate a new key of the given algorithm (HSM_ALG_*) in a slot
+// Returns HSM_STATUS_OK on success, HSM_STATUS_UNSUPPORTED_ALG for an
+// unknown algorithm
+uint8_t hsm_generate_key(uint8_t slot, uint8_t algorithm);
 
 // Get the public key for a slot
-// pubkey_out must be at least 64 bytes (X and Y coordinates for P-256)
+// pubkey_out must be at least 64 bytes (X and Y coordinates for P-256,
+// the 32-byte encoded point for Ed25519)
 uint8_t hsm_get_pubkey(uint8_t slot, uint8_t *pubkey_out, uint16_t *pubkey_len);
 
+// Get the algorithm of the key in a slot (HSM_ALG_NONE when empty)
+uint8_t hsm_get_algorithm(uint8_t slot);
+
 // Sign a hash with the key in a slot
-// hash must be 32 bytes (SHA-256)
+// hash must be 32 bytes (SHA-256). An Ed25519 key signs the 32 bytes as the
+// message (PureEdDSA).
 // sig_out must be at least 64 bytes (R and S components)
 uint8_t hsm_sign(uint8_t slot, const uint8_t *hash, uint8_t *sig_out,
                  uint16_t *sig_len);
 
+// Verify a P-256 ECDSA signature (R and S, 64 bytes) over a 32-byte hash.
+// pubkey is 64 bytes (X and Y). Returns HSM_STATUS_OK for a valid
+// signature, HSM_STATUS_INVALID_KEY if pubkey is not on the curve, or
+// HSM_STATUS_BAD_SIGNATURE.
+uint8_t hsm_verify(const uint8_t *pubkey, const uint8_t *hash,
+                   const uint8_t *sig);
+
+// Verify count (hash, signature) pairs signed by the same key, one by one
+// (see uECC_verify_multi): a convenience for HSM_VERIFY, about as fast per
+// pair as hsm_verify. Each pair is HSM_VERIFY_PAIR_SIZE bytes: the 32-byte
+// hash followed by the signature. results[i] is set to 1 when pair i is
+// valid, 0 otherwise. Returns the number of valid pairs, or -1 if pubkey is
+// not on the curve.
+#define HSM_VERIFY_PAIR_SIZE 96
+int hsm_verify_multi(const uint8_t *pubkey, const uint8_t *pairs,
+                     uint16_t count, uint8_t *results);
+
 // Delete a key in a slot
 uint8_t hsm_delete_key(uint8_t slot);
 
+// Generate a key pair that is not kept in a slot. The caller owns
+// private_key_out (32 bytes) and must wipe it; pubkey_out takes 64 bytes
+// for P-256 and 32 bytes for Ed25519.
+uint8_t hsm_generate_keypair(uint8_t algorithm, uint8_t *private_key_out,
+                             uint8_t *pubkey_out);
+
+// Sign with a caller-held private key (see hsm_generate_keypair). For P-256
+// the message is a 32-byte hash; Ed25519 signs the message itself. pubkey is
+// only used by Ed25519 and may be NULL, at the cost of deriving it again.
+// sig_out must be at least 64 bytes (R and S).
+uint8_t hsm_sign_with_key(uint8_t algorithm, const uint8_t *private_key,
+                          const uint8_t *pubkey, const uint8_t *message,
+                          size_t message_len, uint8_t *sig_out,
+                          uint16_t *sig_len);
+
 #endif // HSM_H
@@ -14,6 +14,9 @@
  * from OTP (simulated) and Secure Boot validation.
  */
 
+#include "../oath/fido2_applet.h"
+#include "../oath/fido2_storage.h"
+#include "../oath/oath_storage.h"
 #include "security_manager.h"
 
 /**
@@ -26,10 +29,18 @@
 // Global State
 static bool security_initialized = false;
 
+// Master key and the AES-GCM context derived from it, kept in secure SRAM
+static struct {
+  uint8_t master_key[MASTER_KEY_SIZE];
+  aes_gcm_ctx_t gcm;
+  bool loaded;
+} storage_keys;
+
 // Forward declarations
 static bool is_master_key_written(void);
 static void generate_random_key(uint8_t *key_out);
 static bool constant_time_is_empty(const uint8_t *data, size_t len);
+static bool load_storage_keys(void);
 
 //--------------------------------------------------------------------+
 // Security Implementation
@@ -101,6 +112,9 @@ bool otp_write_new_master_key(uint8_t *key_out) {
 
   restore_interrupts(interrupts);
 
+  // Anything cached belongs to the previous key
+  security_wipe_storage_keys();
+
   // 3. Lock the region
   if (otp_lock_master_key()) {
     printf("[OTP] Master key LOCKED and globally protected.\n");
@@ -126,6 +140,32 @@ bool otp_lock_master_key(void) {
   return true;
 }
 
+bool security_get_master_key(uint8_t *key_out) {
+  if (!load_storage_keys())
+    return false;
+  memcpy(key_out, storage_keys.master_key, MASTER_KEY_SIZE);
+  return true;
+}
+
+const aes_gcm_ctx_t *security_get_storage_ctx(void) {
+  if (!load_storage_keys())
+    return NULL;
+  return &storage_keys.gcm;
+}
+
+void security_wipe_storage_keys(void) {
+  volatile uint8_t *p = (volatile uint8_t *)storage_keys.master_key;
+  for (size_t i = 0; i < MASTER_KEY_SIZE; i++)
+    p[i] = 0;
+  aes_gcm_ctx_wipe(&storage_keys.gcm);
+  storage_keys.loaded = false;
+
+  // Keys the storage backends derived from the master key
+  oath_storage_wipe_keys();
+  fido2_storage_wipe_keys();
+  fido2_applet_wipe_keys();
+}
+
 bool secure_boot_check(void) {
   // In production, this would query the BootROM or check OTP_BOOT_FLAGS
   return true;
@@ -135,6 +175,26 @@ bool secure_boot_check(void) {
 // Private Helpers
 // --------------------------------------------------------------------
 
+static bool load_storage_keys(void) {
+  if (storage_keys.loaded)
+    return true;
+
+  uint8_t key[MASTER_KEY_SIZE];
+  if (!otp_read_master_key(key)) {
+    printf("[SECURITY] Master key missing. Attempting to provision...\n");
+    if (!otp_write_new_master_key(key)) {
+      printf("[SECURITY] CRITICAL: Hard failure provisioning master key.\n");
+      return false;
+    }
+  }
+
+  memcpy(storage_keys.master_key, key, MASTER_KEY_SIZE);
+  aes_gcm_ctx_init(&storage_keys.gcm, key);
+  storage_keys.loaded = true;
+  memset(key, 0, sizeof(key));
+  return true;
+}
+
 static bool is_master_key_written(void) {
   const uint8_t *otp_ptr =
       (const uint8_t *)(XIP_BASE + SIMULATED_OTP_BASE_ADDR +
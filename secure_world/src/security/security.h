@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "../crypto/aes_gcm.h"
+
 //--------------------------------------------------------------------+
 // Security API
 //--------------------------------------------------------------------+
@@ -55,4 +57,34 @@ bool secure_boot_check(void);
  */
 bool otp_lock_master_key(void);
 
+/**
+ * @brief Copies the master key from its secure SRAM cache.
+ *
+ * The key is read from OTP once, provisioning a new one on first boot, and
+ * then served from RAM until security_wipe_storage_keys() is called.
+ *
+ * @param key_out Pointer to a 32-byte buffer to store the key.
+ * @return true if a master key is available, false otherwise.
+ */
+bool security_get_master_key(uint8_t *key_out);
+
+/**
+ * @brief Returns the AES-GCM context keyed with the master key.
+ *
+ * Shared by every storage backend (OATH, FIDO2, OpenPGP, HSM) so the round
+ * keys and GHASH key are derived once rather than on every record.
+ *
+ * @return The context, or NULL if no master key is available.
+ */
+const aes_gcm_ctx_t *security_get_storage_ctx(void);
+
+/**
+ * @brief Erases the cached master key, storage context and the keys the
+ * storage backends derived from the master key.
+ *
+ * Called when the storage is reset or the master key changes. The next
+ * storage access rebuilds the cache from OTP.
+ */
+void security_wipe_storage_keys(void);
+
 #endif // _SECURITY_H_
@@ -9,7 +9,7 @@
  */
 
 // Flash Memory Layout (2MB Total)
-// We designate the last 128KB for secure persistent data
+// We designate the last 168KB for secure persistent data
 #define FLASH_SIZE_TOTAL (2 * 1024 * 1024)
 
 // Simulated OTP region (for Master Key)
@@ -18,13 +18,26 @@
 #define OTP_LOCK_FLAG_OFFSET (0x40)
 
 // OATH Storage region
-// Located 2nd to last sector
-#define OATH_FLASH_SECTOR_OFFSET (FLASH_SIZE_TOTAL - 8192)
+// Log-structured credential journal at the start of the secure data area
+#define OATH_JOURNAL_OFFSET (FLASH_SIZE_TOTAL - 131072)
+#define OATH_JOURNAL_SECTORS 24 // 96KB
+
+// FIDO2 discoverable credential journal, directly below the OATH journal
+#define FIDO2_JOURNAL_OFFSET (FLASH_SIZE_TOTAL - 172032)
+#define FIDO2_JOURNAL_SECTORS 10 // 40KB
+
+// OATH HOTP counter cells (two banks, one sector each)
+#define OATH_COUNTER_OFFSET (FLASH_SIZE_TOTAL - 24576)
 
 // HSM Storage region
 // Located 3rd to last sector
 #define HSM_FLASH_OFFSET (FLASH_SIZE_TOTAL - 12288)
 
+// OpenPGP applet data, 2nd to last sector. Older firmware kept it in the
+// HSM sector, where each overwrote the other.
+#define OPENPGP_FLASH_OFFSET (FLASH_SIZE_TOTAL - 8192)
+#define OPENPGP_LEGACY_FLASH_OFFSET HSM_FLASH_OFFSET
+
 // Security Constraints
 #define MAX_PIN_LENGTH 64
 #define ACCESS_CODE_HASH_SIZE 32
@@ -0,0 +1,78 @@
+// HSM P-256 verification, one signature at a time (hsm_verify) against the
+// pair counts a WebUSB HSM_VERIFY command can carry (hsm_verify_multi, which
+// shares only G + Q between the pairs, so expect the same rate).
+//
+// Checks that hsm_verify_multi agrees with single verification, including a
+// forged signature in the middle and a public key off the curve, then
+// reports verifications per second on the host.
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "flash_emu.h"
+#include "hsm.h"
+#include "test_util.h"
+#include "webusb_device.h"
+
+#define PAIRS WEBUSB_HSM_VERIFY_MAX_PAIRS
+#define ROUNDS 8
+
+static uint8_t pubkey[64];
+static uint8_t pairs[PAIRS][HSM_VERIFY_PAIR_SIZE];
+static uint8_t results[PAIRS];
+
+static void make_pairs(void) {
+  uint16_t len = 0;
+  flash_emu_reset();
+  hsm_init();
+  CHECK_EQ(hsm_generate_key(0, HSM_ALG_P256), HSM_STATUS_OK);
+  CHECK_EQ(hsm_get_pubkey(0, pubkey, &len), HSM_STATUS_OK);
+  for (int i = 0; i < PAIRS; i++) {
+    memset(pairs[i], i + 1, 32);
+    CHECK_EQ(hsm_sign(0, pairs[i], pairs[i] + 32, &len), HSM_STATUS_OK);
+  }
+}
+
+static void check_multi(void) {
+  CHECK_EQ(hsm_verify_multi(pubkey, pairs[0], PAIRS, results), PAIRS);
+  for (int i = 0; i < PAIRS; i++) {
+    CHECK_EQ(results[i], 1);
+    CHECK_EQ(hsm_verify(pubkey, pairs[i], pairs[i] + 32), HSM_STATUS_OK);
+  }
+
+  pairs[PAIRS / 2][40] ^= 1;
+  CHECK_EQ(hsm_verify_multi(pubkey, pairs[0], PAIRS, results), PAIRS - 1);
+  for (int i = 0; i < PAIRS; i++)
+    CHECK_EQ(results[i], i != PAIRS / 2);
+  CHECK_EQ(hsm_verify(pubkey, pairs[PAIRS / 2], pairs[PAIRS / 2] + 32),
+           HSM_STATUS_BAD_SIGNATURE);
+  pairs[PAIRS / 2][40] ^= 1;
+
+  uint8_t off_curve[64];
+  memcpy(off_curve, pubkey, sizeof(off_curve));
+  off_curve[63] ^= 1;
+  CHECK_EQ(hsm_verify_multi(off_curve, pairs[0], PAIRS, results), -1);
+  CHECK_EQ(hsm_verify(off_curve, pairs[0], pairs[0] + 32),
+           HSM_STATUS_INVALID_KEY);
+}
+
+int main(void) {
+  make_pairs();
+  check_multi();
+
+  double single_ns = BENCH_NS_PER_ITER(
+      ROUNDS * PAIRS,
+      CHECK_EQ(hsm_verify(pubkey, pairs[_i % PAIRS], pairs[_i % PAIRS] + 32),
+               HSM_STATUS_OK));
+  printf("P-256 verify  single      %7.0f/s\n", 1e9 / single_ns);
+
+  static const uint16_t sizes[] = {1, 4, 16, PAIRS};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    uint16_t n = sizes[s];
+    double ns = BENCH_NS_PER_ITER(
+        ROUNDS * PAIRS / n,
+        CHECK_EQ(hsm_verify_multi(pubkey, pairs[0], n, results), n));
+    printf("P-256 verify  multi, %2u   %7.0f/s\n", n, 1e9 * n / ns);
+  }
+  return 0;
+}
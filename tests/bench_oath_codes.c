@@ -0,0 +1,169 @@
+// OTP codes per second: the native binary engine against the libcotp path
+// it replaced.
+//
+// libcotp is not vendored in this tree, so its path is modelled step for
+// step as the old CALCULATE handler drove it: base32-encode the secret into
+// a string, decode it again inside the library, run a one-shot HMAC-SHA1
+// and return the code as a NUL-terminated string. The native engine runs
+// the HMAC on the binary secret, once from scratch and once from the pad
+// states stored with the credential. Every path must produce the same codes,
+// and the stored pads must spare every SHA-1 hash started from scratch
+// (SHA1Init is wrapped at link time to count them).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "hmac.h"
+#include "oath_compute.h"
+#include "sha1.h"
+#include "test_util.h"
+
+#define CODES 50000
+#define RUNS 5 // Best of, to keep scheduler noise out of the checks
+
+void __real_SHA1Init(SHA1_CTX *context);
+
+static uint32_t hash_inits;
+
+void __wrap_SHA1Init(SHA1_CTX *context) {
+  hash_inits++;
+  __real_SHA1Init(context);
+}
+
+static const char b32_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+static size_t base32_encode(const uint8_t *in, size_t len, char *out) {
+  size_t n = 0;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (size_t i = 0; i < len; i++) {
+    acc = (acc << 8) | in[i];
+    bits += 8;
+    while (bits >= 5) {
+      out[n++] = b32_alphabet[(acc >> (bits - 5)) & 31];
+      bits -= 5;
+    }
+  }
+  if (bits > 0)
+    out[n++] = b32_alphabet[(acc << (5 - bits)) & 31];
+  while (n % 8)
+    out[n++] = '=';
+  out[n] = '\0';
+  return n;
+}
+
+static size_t base32_decode(const char *in, uint8_t *out) {
+  size_t n = 0;
+  uint32_t acc = 0;
+  int bits = 0;
+  for (; *in && *in != '='; in++) {
+    const char *p = strchr(b32_alphabet, *in);
+    if (!p)
+      return 0;
+    acc = (acc << 5) | (uint32_t)(p - b32_alphabet);
+    bits += 5;
+    if (bits >= 8) {
+      out[n++] = (uint8_t)(acc >> (bits - 8));
+      bits -= 8;
+    }
+  }
+  return n;
+}
+
+// get_hotp_buf() equivalent: string secret in, string code out
+static bool cotp_path_code(const oath_credential_t *cred, uint64_t counter,
+                           char *otp, size_t otp_len) {
+  char b32[128];
+  uint8_t secret[OATH_MAX_SECRET_LEN];
+  uint8_t msg[8], mac[20];
+
+  base32_encode(cred->secret, cred->secret_len, b32);
+  size_t secret_len = base32_decode(b32, secret);
+  for (int i = 7; i >= 0; i--) {
+    msg[i] = (uint8_t)counter;
+    counter >>= 8;
+  }
+  if (!hmac_sha1(secret, secret_len, msg, sizeof(msg), mac))
+    return false;
+  uint8_t off = mac[19] & 0x0F;
+  uint32_t bin = ((uint32_t)(mac[off] & 0x7F) << 24) |
+                 ((uint32_t)mac[off + 1] << 16) |
+                 ((uint32_t)mac[off + 2] << 8) | mac[off + 3];
+  uint32_t mod = 1;
+  for (int i = 0; i < cred->digits; i++)
+    mod *= 10;
+  snprintf(otp, otp_len, "%0*u", cred->digits, bin % mod);
+  return true;
+}
+
+int main(void) {
+  oath_credential_t cred;
+  memset(&cred, 0, sizeof(cred));
+  memcpy(cred.secret, "12345678901234567890", 20);
+  cred.secret_len = 20;
+  cred.type = OATH_TYPE_TOTP;
+  cred.algorithm = OATH_ALGO_SHA1;
+  cred.digits = 6;
+
+  // All paths agree, starting with the RFC 4226 appendix D values
+  char otp[16], native[16];
+  uint32_t code;
+  CHECK(cotp_path_code(&cred, 0, otp, sizeof(otp)));
+  CHECK(strcmp(otp, "755224") == 0);
+  CHECK(cotp_path_code(&cred, 9, otp, sizeof(otp)));
+  CHECK(strcmp(otp, "520489") == 0);
+  oath_credential_t padded = cred;
+  CHECK(oath_compute_prepare(&padded));
+  uint32_t native_inits = 0, padded_inits = 0;
+  for (uint64_t c = 0; c < 1000; c++) {
+    CHECK(cotp_path_code(&cred, c * 7919, otp, sizeof(otp)));
+    hash_inits = 0;
+    CHECK(oath_compute(&cred, c * 7919, &code));
+    native_inits += hash_inits;
+    oath_format_code(code, cred.digits, native);
+    CHECK(strcmp(otp, native) == 0);
+    hash_inits = 0;
+    CHECK(oath_compute(&padded, c * 7919, &code));
+    padded_inits += hash_inits;
+    oath_format_code(code, cred.digits, native);
+    CHECK(strcmp(otp, native) == 0);
+  }
+
+  volatile uint32_t sink = 0;
+  double cotp_ns = 1e30, native_ns = 1e30, padded_ns = 1e30;
+  for (int run = 0; run < RUNS; run++) {
+    double ns = BENCH_NS_PER_ITER(CODES, {
+      cotp_path_code(&cred, _i, otp, sizeof(otp));
+      sink += (uint8_t)otp[0];
+    });
+    cotp_ns = ns < cotp_ns ? ns : cotp_ns;
+    ns = BENCH_NS_PER_ITER(CODES, {
+      oath_compute(&cred, _i, &code);
+      oath_format_code(code, cred.digits, native);
+      sink += (uint8_t)native[0];
+    });
+    native_ns = ns < native_ns ? ns : native_ns;
+    ns = BENCH_NS_PER_ITER(CODES, {
+      oath_compute(&padded, _i, &code);
+      oath_format_code(code, cred.digits, native);
+      sink += (uint8_t)native[0];
+    });
+    padded_ns = ns < padded_ns ? ns : padded_ns;
+  }
+  (void)sink;
+
+  printf("%-26s %12s %10s\n", "HOTP SHA-1, 6 digits", "codes/s", "ns/code");
+  printf("%-26s %12.0f %10.0f\n", "libcotp path (modelled)", 1e9 / cotp_ns,
+         cotp_ns);
+  printf("%-26s %12.0f %10.0f\n", "native", 1e9 / native_ns, native_ns);
+  printf("%-26s %12.0f %10.0f\n", "native, stored pads", 1e9 / padded_ns,
+         padded_ns);
+
+  // Pads resume both HMAC hashes from their midstates, halving the
+  // compressions per code; wall-clock ratios are left to the printout
+  CHECK(native_ns < cotp_ns);
+  CHECK(native_inits >= 2 * 1000);
+  CHECK_EQ(padded_inits, 0);
+  return 0;
+}
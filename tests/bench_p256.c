@@ -0,0 +1,127 @@
+// P-256 key generation, signing and verification with the uECC options this
+// binary is built with.
+//
+// CMake builds one copy per configuration (bench_p256_<name>): the
+// fixed-base comb for multiples of G (uECC_P256_COMB) against the co-Z
+// ladder, and the field arithmetic on 32-bit words (uECC_WORD_SIZE=4, the
+// C the RP2350 runs where it has no assembly) against the host's. Each
+// copy first checks the RFC 6979 vector, that key generation agrees with a
+// variable-base multiplication of G and that its signatures verify, then
+// reports host cycles per operation.
+#include <stdio.h>
+#include <string.h>
+
+#include "bench_util.h"
+#include "host_platform.h"
+#include "test_util.h"
+#include "uECC.h"
+
+#define KEYS 16
+#define ROUNDS 200
+
+static const uint8_t generator[64] = {
+    0x6B, 0x17, 0xD1, 0xF2, 0xE1, 0x2C, 0x42, 0x47, 0xF8, 0xBC, 0xE6,
+    0xE5, 0x63, 0xA4, 0x40, 0xF2, 0x77, 0x03, 0x7D, 0x81, 0x2D, 0xEB,
+    0x33, 0xA0, 0xF4, 0xA1, 0x39, 0x45, 0xD8, 0x98, 0xC2, 0x96, 0x4F,
+    0xE3, 0x42, 0xE2, 0xFE, 0x1A, 0x7F, 0x9B, 0x8E, 0xE7, 0xEB, 0x4A,
+    0x7C, 0x0F, 0x9E, 0x16, 0x2B, 0xCE, 0x33, 0x57, 0x6B, 0x31, 0x5E,
+    0xCE, 0xCB, 0xB6, 0x40, 0x68, 0x37, 0xBF, 0x51, 0xF5};
+
+// RFC 6979 A.2.5: P-256 key, SHA-256 of "sample" and its signature
+static const uint8_t kat_private[32] = {
+    0xC9, 0xAF, 0xA9, 0xD8, 0x45, 0xBA, 0x75, 0x16, 0x6B, 0x5C, 0x21,
+    0x57, 0x67, 0xB1, 0xD6, 0x93, 0x4E, 0x50, 0xC3, 0xDB, 0x36, 0xE8,
+    0x9B, 0x12, 0x7B, 0x8A, 0x62, 0x2B, 0x12, 0x0F, 0x67, 0x21};
+static const uint8_t kat_public[64] = {
+    0x60, 0xFE, 0xD4, 0xBA, 0x25, 0x5A, 0x9D, 0x31, 0xC9, 0x61, 0xEB,
+    0x74, 0xC6, 0x35, 0x6D, 0x68, 0xC0, 0x49, 0xB8, 0x92, 0x3B, 0x61,
+    0xFA, 0x6C, 0xE6, 0x69, 0x62, 0x2E, 0x60, 0xF2, 0x9F, 0xB6, 0x79,
+    0x03, 0xFE, 0x10, 0x08, 0xB8, 0xBC, 0x99, 0xA4, 0x1A, 0xE9, 0xE9,
+    0x56, 0x28, 0xBC, 0x64, 0xF2, 0xF1, 0xB2, 0x0C, 0x2D, 0x7E, 0x9F,
+    0x51, 0x77, 0xA3, 0xC2, 0x94, 0xD4, 0x46, 0x22, 0x99};
+static const uint8_t kat_hash[32] = {
+    0xAF, 0x2B, 0xDB, 0xE1, 0xAA, 0x9B, 0x6E, 0xC1, 0xE2, 0xAD, 0xE1,
+    0xD6, 0x94, 0xF4, 0x1F, 0xC7, 0x1A, 0x83, 0x1D, 0x02, 0x68, 0xE9,
+    0x89, 0x15, 0x62, 0x11, 0x3D, 0x8A, 0x62, 0xAD, 0xD1, 0xBF};
+static const uint8_t kat_signature[64] = {
+    0xEF, 0xD4, 0x8B, 0x2A, 0xAC, 0xB6, 0xA8, 0xFD, 0x11, 0x40, 0xDD,
+    0x9C, 0xD4, 0x5E, 0x81, 0xD6, 0x9D, 0x2C, 0x87, 0x7B, 0x56, 0xAA,
+    0xF9, 0x91, 0xC3, 0x4D, 0x0E, 0xA8, 0x4E, 0xAF, 0x37, 0x16, 0xF7,
+    0xCB, 0x1C, 0x94, 0x2D, 0x65, 0x7C, 0x41, 0xD4, 0x36, 0xC7, 0xA1,
+    0xB6, 0xE2, 0x9F, 0x65, 0xF3, 0xE9, 0x00, 0xDB, 0xB9, 0xAF, 0xF4,
+    0x06, 0x4D, 0xC4, 0xAB, 0x2F, 0x84, 0x3A, 0xCD, 0xA8};
+
+static int rng(uint8_t *dest, unsigned size) {
+  while (size >= 4) {
+    uint32_t r = get_rand_32();
+    memcpy(dest, &r, 4);
+    dest += 4;
+    size -= 4;
+  }
+  if (size) {
+    uint32_t r = get_rand_32();
+    memcpy(dest, &r, size);
+  }
+  return 1;
+}
+
+static uint8_t private_keys[KEYS][32];
+static uint8_t public_keys[KEYS][64];
+static uint8_t hash[32];
+static uint8_t signature[64];
+
+static void check_vector(uECC_Curve curve) {
+  uint8_t public_key[64];
+  CHECK(uECC_compute_public_key(kat_private, public_key, curve));
+  CHECK(memcmp(public_key, kat_public, sizeof(public_key)) == 0);
+  CHECK(uECC_verify(kat_public, kat_hash, sizeof(kat_hash), kat_signature,
+                    curve));
+}
+
+// Key pairs whose public keys match the ladder (ECDH with G), and
+// signatures that verify
+static void check_keys(uECC_Curve curve) {
+  for (int i = 0; i < KEYS; i++) {
+    uint8_t x[32];
+    CHECK(uECC_make_key(public_keys[i], private_keys[i], curve));
+    CHECK(uECC_shared_secret(generator, private_keys[i], x, curve));
+    CHECK(memcmp(x, public_keys[i], 32) == 0);
+    CHECK(uECC_valid_public_key(public_keys[i], curve));
+
+    memset(hash, i, sizeof(hash));
+    CHECK(uECC_sign(private_keys[i], hash, sizeof(hash), signature, curve));
+    CHECK(uECC_verify(public_keys[i], hash, sizeof(hash), signature, curve));
+    hash[0] ^= 1;
+    CHECK(!uECC_verify(public_keys[i], hash, sizeof(hash), signature, curve));
+  }
+}
+
+// Host cycles per call of `body`
+#define CYCLES_PER_OP(body)                                                    \
+  ({                                                                           \
+    uint64_t _c0 = bench_cycles();                                             \
+    for (uint32_t _r = 0; _r < ROUNDS; _r++) {                                 \
+      body;                                                                    \
+    }                                                                          \
+    (double)(bench_cycles() - _c0) / ROUNDS;                                   \
+  })
+
+int main(void) {
+  uECC_Curve curve = uECC_secp256r1();
+  uECC_set_rng(rng);
+  check_vector(curve);
+  check_keys(curve);
+
+  double keygen = CYCLES_PER_OP(
+      CHECK(uECC_make_key(public_keys[_r % KEYS], private_keys[_r % KEYS],
+                          curve)));
+  double sign = CYCLES_PER_OP(CHECK(uECC_sign(private_keys[_r % KEYS], hash,
+                                              sizeof(hash), signature,
+                                              curve)));
+  double verify = CYCLES_PER_OP(CHECK(uECC_verify(
+      kat_public, kat_hash, sizeof(kat_hash), kat_signature, curve)));
+
+  printf("P-256 %-7s  cycles: keygen %8.0f  sign %8.0f  verify %8.0f\n",
+         BENCH_P256_NAME, keygen, sign, verify);
+  return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @file bench_util.h
+ * @brief Wall-clock timing for the host benchmarks.
+ *
+ * Host timings only compare variants against each other; absolute numbers
+ * for the RP2350 come from the DWT cycle counter on target. Assertions in
+ * the benchmarks check operation counts, which do carry over.
+ */
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Host cycle counter (TSC), or nanoseconds where there is none
+static inline uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return bench_now_ns();
+#endif
+}
+
+// Runs `body` `iters` times and evaluates to nanoseconds per iteration
+#define BENCH_NS_PER_ITER(iters, body)                                         \
+  ({                                                                           \
+    uint64_t _t0 = bench_now_ns();                                             \
+    for (uint32_t _i = 0; _i < (uint32_t)(iters); _i++) {                      \
+      body;                                                                    \
+    }                                                                          \
+    (double)(bench_now_ns() - _t0) / (double)(iters);                          \
+  })
+
+#endif // BENCH_UTIL_H
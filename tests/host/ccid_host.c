@@ -0,0 +1,103 @@
+#include "ccid_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccid_device.h"
+#include "usb_emu.h"
+
+extern const usbd_class_driver_t ccid_driver;
+
+ccid_host_stats_t ccid_host_stats;
+
+// Interface, CCID functional and two bulk endpoint descriptors
+static const uint8_t ccid_desc[9 + 54 + 7 + 7] = {
+    9,    TUSB_DESC_INTERFACE, 0, 0, 2, 0x0B, 0, 0, 0,
+    [9] = 54, 0x21,
+    [63] = 7, TUSB_DESC_ENDPOINT, CCID_HOST_EP_OUT, 0x02, 64, 0, 0,
+    [70] = 7, TUSB_DESC_ENDPOINT, CCID_HOST_EP_IN, 0x02, 64, 0, 0,
+};
+
+void ccid_host_attach(void) {
+  usb_emu_attach(&ccid_driver, ccid_desc, sizeof(ccid_desc));
+}
+
+void ccid_host_poll(void) {
+  usb_emu_task();
+  ccid_task();
+}
+
+bool ccid_host_send(const uint8_t *msg, uint32_t len) {
+  uint32_t off = 0;
+  // No ZLP after a message that fills its last packet: the driver knows the
+  // length from the header
+  while (off < len) {
+    uint16_t n = len - off > USB_EMU_PACKET_SIZE ? USB_EMU_PACKET_SIZE
+                                                 : (uint16_t)(len - off);
+    int tries = 0;
+    while (!usb_emu_out(CCID_HOST_EP_OUT, msg + off, n)) {
+      if (++tries > CCID_HOST_PATIENCE) {
+        if (off == 0)
+          return false;
+        fprintf(stderr, "ccid_host: bulk-OUT stuck at byte %u of %u\n",
+                (unsigned)off, (unsigned)len);
+        exit(1);
+      }
+      ccid_host_poll();
+    }
+    off += n;
+  }
+  // Let the driver see the last packet
+  usb_emu_task();
+  return true;
+}
+
+int32_t ccid_host_recv(uint8_t *msg, uint32_t max) {
+  uint8_t packet[USB_EMU_PACKET_SIZE];
+  uint32_t len = 0;
+  ccid_host_stats.packets = 0;
+  ccid_host_stats.zlp = false;
+  for (;;) {
+    int n;
+    int tries = 0;
+    while ((n = usb_emu_in(CCID_HOST_EP_IN, packet)) < 0) {
+      if (++tries > CCID_HOST_PATIENCE) {
+        if (len == 0)
+          return -1;
+        fprintf(stderr, "ccid_host: bulk-IN stuck after %u bytes\n",
+                (unsigned)len);
+        exit(1);
+      }
+      ccid_host_poll();
+    }
+    ccid_host_stats.packets++;
+    if ((uint32_t)n > max - len) {
+      fprintf(stderr, "ccid_host: message longer than %u bytes\n",
+              (unsigned)max);
+      exit(1);
+    }
+    memcpy(msg + len, packet, (size_t)n);
+    len += (uint32_t)n;
+    if (n < USB_EMU_PACKET_SIZE) {
+      ccid_host_stats.zlp = n == 0;
+      usb_emu_task();
+      return (int32_t)len;
+    }
+  }
+}
+
+uint32_t ccid_host_msg(uint8_t *out, uint8_t type, uint8_t seq,
+                       const uint8_t *payload, uint32_t len) {
+  out[0] = type;
+  out[1] = (uint8_t)len;
+  out[2] = (uint8_t)(len >> 8);
+  out[3] = (uint8_t)(len >> 16);
+  out[4] = (uint8_t)(len >> 24);
+  out[5] = 0; // bSlot
+  out[6] = seq;
+  out[7] = out[8] = out[9] = 0;
+  if (payload)
+    memcpy(out + CCID_HEADER_SIZE, payload, len);
+  return CCID_HEADER_SIZE + len;
+}
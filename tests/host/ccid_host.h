@@ -0,0 +1,60 @@
+#ifndef CCID_HOST_H
+#define CCID_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file ccid_host.h
+ * @brief Replays CCID traffic against the Non-Secure CCID driver, the way
+ * a PC/SC reader driver talks to the token over bulk endpoints.
+ *
+ * Messages are cut into full-speed packets on bulk-OUT and reassembled from
+ * bulk-IN until a short or zero-length packet. Whenever an endpoint NAKs,
+ * the device main loop (tud_task, then ccid_task) runs once, so commands
+ * can be pipelined and the slot back-pressure observed.
+ */
+
+#define CCID_HOST_EP_OUT 0x02
+#define CCID_HOST_EP_IN 0x82
+
+// Main loop passes before a NAKing endpoint counts as stuck
+#define CCID_HOST_PATIENCE 16
+
+typedef struct {
+  uint32_t packets; // IN packets of the last message, ZLP included
+  bool zlp;         // Last message ended with a zero-length packet
+} ccid_host_stats_t;
+
+extern ccid_host_stats_t ccid_host_stats;
+
+/** @brief Resets the driver and enumerates the CCID interface. */
+void ccid_host_attach(void);
+
+/** @brief One device main loop pass: tud_task, then ccid_task. */
+void ccid_host_poll(void);
+
+/**
+ * @brief Sends one message on bulk-OUT.
+ *
+ * @return false if its first packet stays NAKed (every slot busy); a NAK
+ * after that is a test failure.
+ */
+bool ccid_host_send(const uint8_t *msg, uint32_t len);
+
+/**
+ * @brief Receives one message from bulk-IN.
+ *
+ * @return Its length, or -1 if nothing arrives.
+ */
+int32_t ccid_host_recv(uint8_t *msg, uint32_t max);
+
+/**
+ * @brief Builds a PC_to_RDR message with `len` payload bytes.
+ *
+ * @return Message length.
+ */
+uint32_t ccid_host_msg(uint8_t *out, uint8_t type, uint8_t seq,
+                       const uint8_t *payload, uint32_t len);
+
+#endif // CCID_HOST_H
@@ -0,0 +1,119 @@
+#include "ctap_client.h"
+
+#include <string.h>
+
+#include "cbor.h"
+#include "fido2_applet.h"
+#include "host_platform.h"
+
+#define CTAP_CMD_MAKE_CREDENTIAL 0x01
+#define CTAP_CMD_GET_ASSERTION 0x02
+
+// rpIdHash, flags, signCount, AAGUID, then the credential ID length
+#define ATTESTED_ID_OFFSET (32 + 1 + 4 + 16 + 2)
+
+static const uint8_t client_data_hash[32] = {
+    0xc0, 0xff, 0xee, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+    0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d};
+
+// The user holds the button down for the request
+static uint8_t submit(uint8_t *req, uint16_t len, ctap_response_t *resp) {
+  memset(resp, 0, sizeof(*resp));
+  host_gpio_set(FIDO2_TOUCH_PIN, false);
+  bool answered = fido2_applet_handle_msg(req, len, resp->data, &resp->len);
+  host_gpio_set(FIDO2_TOUCH_PIN, true);
+  return answered && resp->len > 2 ? resp->data[0] : 0xFF;
+}
+
+uint8_t ctap_make_credential(const char *rp_id, bool rk, int cose_alg,
+                             uint8_t *cred_id_out, ctap_response_t *resp) {
+  static const uint8_t user_id[8] = {'u', 's', 'e', 'r', '-', 'i', 'd', 0};
+  uint8_t req[512];
+  uint8_t *p = req;
+
+  *p++ = CTAP_CMD_MAKE_CREDENTIAL;
+  p = cbor_encode_map(p, rk ? 5 : 4);
+  p = cbor_encode_uint(p, 0x01);
+  p = cbor_encode_bytes(p, client_data_hash, sizeof(client_data_hash));
+  p = cbor_encode_uint(p, 0x02);
+  p = cbor_encode_map(p, 1);
+  p = cbor_encode_text(p, "id");
+  p = cbor_encode_text(p, rp_id);
+  p = cbor_encode_uint(p, 0x03);
+  p = cbor_encode_map(p, 2);
+  p = cbor_encode_text(p, "id");
+  p = cbor_encode_bytes(p, user_id, sizeof(user_id));
+  p = cbor_encode_text(p, "name");
+  p = cbor_encode_text(p, "user");
+  p = cbor_encode_uint(p, 0x04);
+  p = cbor_encode_array(p, 1);
+  p = cbor_encode_map(p, 2);
+  p = cbor_encode_text(p, "alg");
+  p = cbor_encode_nint(p, (uint64_t)(-1 - cose_alg));
+  p = cbor_encode_text(p, "type");
+  p = cbor_encode_text(p, "public-key");
+  if (rk) {
+    p = cbor_encode_uint(p, 0x07);
+    p = cbor_encode_map(p, 1);
+    p = cbor_encode_text(p, "rk");
+    p = cbor_encode_bool(p, true);
+  }
+
+  uint8_t status = submit(req, (uint16_t)(p - req), resp);
+  if (status != 0 || cred_id_out == NULL)
+    return status;
+
+  // {1: fmt, 2: authData, 3: attStmt}
+  cbor_parser_t parser = {
+      .buffer = resp->data + 1, .size = resp->len - 3, .offset = 0};
+  size_t entries;
+  if (!cbor_parse_map(&parser, &entries))
+    return 0xFF;
+  for (size_t i = 0; i < entries; i++) {
+    uint64_t key;
+    if (!cbor_parse_uint(&parser, &key))
+      return 0xFF;
+    if (key == 0x02) {
+      const uint8_t *auth_data;
+      size_t ad_len;
+      if (!cbor_parse_bytes(&parser, &auth_data, &ad_len) ||
+          ad_len < ATTESTED_ID_OFFSET + FIDO2_ID_LEN)
+        return 0xFF;
+      memcpy(cred_id_out, auth_data + ATTESTED_ID_OFFSET, FIDO2_ID_LEN);
+      return status;
+    }
+    if (!cbor_skip(&parser))
+      return 0xFF;
+  }
+  return 0xFF;
+}
+
+uint16_t ctap_get_assertion_request(uint8_t *req, const char *rp_id,
+                                    const uint8_t *cred_id) {
+  uint8_t *p = req;
+
+  *p++ = CTAP_CMD_GET_ASSERTION;
+  p = cbor_encode_map(p, cred_id ? 3 : 2);
+  p = cbor_encode_uint(p, 0x01);
+  p = cbor_encode_text(p, rp_id);
+  p = cbor_encode_uint(p, 0x02);
+  p = cbor_encode_bytes(p, client_data_hash, sizeof(client_data_hash));
+  if (cred_id) {
+    p = cbor_encode_uint(p, 0x03);
+    p = cbor_encode_array(p, 1);
+    p = cbor_encode_map(p, 2);
+    p = cbor_encode_text(p, "id");
+    p = cbor_encode_bytes(p, cred_id, FIDO2_ID_LEN);
+    p = cbor_encode_text(p, "type");
+    p = cbor_encode_text(p, "public-key");
+  }
+  return (uint16_t)(p - req);
+}
+
+uint8_t ctap_get_assertion(const char *rp_id, const uint8_t *cred_id,
+                           ctap_response_t *resp) {
+  uint8_t req[512];
+  uint16_t len = ctap_get_assertion_request(req, rp_id, cred_id);
+  return submit(req, len, resp);
+}
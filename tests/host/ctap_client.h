@@ -0,0 +1,55 @@
+#ifndef CTAP_CLIENT_H
+#define CTAP_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fido2_storage.h"
+
+/**
+ * @file ctap_client.h
+ * @brief Builds CTAP2 requests and feeds them to fido2_applet_handle_msg.
+ *
+ * Responses are the CTAP status byte, the CBOR body and the ISO 7816 status
+ * word, as the applet returns them. The user presence button is held down
+ * while a request is processed.
+ */
+
+#define CTAP_COSE_ES256 (-7)
+#define CTAP_COSE_EDDSA (-8)
+
+typedef struct {
+  uint8_t data[1024];
+  uint16_t len;
+} ctap_response_t;
+
+/**
+ * @brief authenticatorMakeCredential for `rp_id`.
+ *
+ * @param cred_id_out Optional, receives the credential ID from the
+ *                    attested credential data.
+ * @return The CTAP status byte.
+ */
+uint8_t ctap_make_credential(const char *rp_id, bool rk, int cose_alg,
+                             uint8_t *cred_id_out, ctap_response_t *resp);
+
+/**
+ * @brief authenticatorGetAssertion for `rp_id`, with a one-entry allowList
+ * when `cred_id` is given and none (discoverable credentials) otherwise.
+ *
+ * @return The CTAP status byte.
+ */
+uint8_t ctap_get_assertion(const char *rp_id, const uint8_t *cred_id,
+                           ctap_response_t *resp);
+
+/**
+ * @brief Encodes the authenticatorGetAssertion request ctap_get_assertion
+ * sends, for submission over another transport.
+ *
+ * @param req At least 512 bytes.
+ * @return Request length.
+ */
+uint16_t ctap_get_assertion_request(uint8_t *req, const char *rp_id,
+                                    const uint8_t *cred_id);
+
+#endif // CTAP_CLIENT_H
@@ -0,0 +1,146 @@
+#include "ctaphid_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usb_emu.h"
+
+extern const usbd_class_driver_t fido2_driver;
+
+static uint32_t cid_read(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void cid_write(uint8_t *p, uint32_t cid) {
+  p[0] = (uint8_t)(cid >> 24);
+  p[1] = (uint8_t)(cid >> 16);
+  p[2] = (uint8_t)(cid >> 8);
+  p[3] = (uint8_t)cid;
+}
+
+// Interface, HID and two interrupt endpoint descriptors
+static const uint8_t fido2_desc[9 + 9 + 7 + 7] = {
+    9,    TUSB_DESC_INTERFACE, 0, 0, 2, 0x03, 0, 0, 0,
+    9,    0x21, 0x11, 0x01, 0, 1, 0x22, 0x34, 0,
+    7,    TUSB_DESC_ENDPOINT, CTAPHID_HOST_EP_OUT, 0x03, 64, 0, 10,
+    7,    TUSB_DESC_ENDPOINT, CTAPHID_HOST_EP_IN, 0x03, 64, 0, 10,
+};
+
+void ctaphid_host_attach(void) {
+  usb_emu_attach(&fido2_driver, fido2_desc, sizeof(fido2_desc));
+}
+
+void ctaphid_host_poll(void) {
+  usb_emu_task();
+  fido2_task();
+}
+
+uint32_t ctaphid_host_frame(uint8_t reports[][FIDO2_REPORT_SIZE], uint32_t cid,
+                            uint8_t cmd, const uint8_t *data, uint16_t len) {
+  uint8_t *r = reports[0];
+  memset(r, 0, FIDO2_REPORT_SIZE);
+  cid_write(r, cid);
+  r[4] = cmd | CTAPHID_FRAME;
+  r[5] = (uint8_t)(len >> 8);
+  r[6] = (uint8_t)len;
+  uint16_t chunk = len < FIDO2_INIT_PAYLOAD ? len : FIDO2_INIT_PAYLOAD;
+  if (chunk)
+    memcpy(r + 7, data, chunk);
+
+  uint32_t n = 1;
+  for (uint16_t off = chunk; off < len; off += chunk, n++) {
+    r = reports[n];
+    memset(r, 0, FIDO2_REPORT_SIZE);
+    cid_write(r, cid);
+    r[4] = (uint8_t)(n - 1);
+    chunk = (uint16_t)(len - off);
+    if (chunk > FIDO2_CONT_PAYLOAD)
+      chunk = FIDO2_CONT_PAYLOAD;
+    memcpy(r + 5, data + off, chunk);
+  }
+  return n;
+}
+
+// The driver rearms OUT from its completion, so tud_task runs between
+// reports; the report is handled before this returns
+void ctaphid_host_report(const uint8_t *report) {
+  for (int tries = 0;
+       !usb_emu_out(CTAPHID_HOST_EP_OUT, report, FIDO2_REPORT_SIZE);
+       tries++) {
+    if (tries == CTAPHID_HOST_PATIENCE) {
+      fprintf(stderr, "ctaphid_host: OUT endpoint stuck\n");
+      exit(1);
+    }
+    usb_emu_task();
+  }
+  usb_emu_task();
+}
+
+void ctaphid_host_send(uint32_t cid, uint8_t cmd, const uint8_t *data,
+                       uint16_t len) {
+  static uint8_t reports[CTAPHID_HOST_MAX_REPORTS][FIDO2_REPORT_SIZE];
+  uint32_t n = ctaphid_host_frame(reports, cid, cmd, data, len);
+  for (uint32_t i = 0; i < n; i++)
+    ctaphid_host_report(reports[i]);
+}
+
+// Next IN report, running the main loop while the endpoint NAKs
+static bool next_report(uint8_t *report) {
+  for (int tries = 0; usb_emu_in(CTAPHID_HOST_EP_IN, report) < 0; tries++) {
+    if (tries == CTAPHID_HOST_PATIENCE)
+      return false;
+    ctaphid_host_poll();
+  }
+  return true;
+}
+
+bool ctaphid_host_recv(ctaphid_msg_t *msg) {
+  uint8_t report[FIDO2_REPORT_SIZE];
+  if (!next_report(report))
+    return false;
+  if (!(report[4] & CTAPHID_FRAME)) {
+    fprintf(stderr, "ctaphid_host: continuation report without a message\n");
+    exit(1);
+  }
+  msg->cid = cid_read(report);
+  msg->cmd = report[4] & (uint8_t)~CTAPHID_FRAME;
+  msg->len = (uint16_t)((report[5] << 8) | report[6]);
+  if (msg->len > sizeof(msg->data)) {
+    fprintf(stderr, "ctaphid_host: %u byte message\n", msg->len);
+    exit(1);
+  }
+  uint16_t got = msg->len < FIDO2_INIT_PAYLOAD ? msg->len : FIDO2_INIT_PAYLOAD;
+  memcpy(msg->data, report + 7, got);
+
+  // The driver queues whole messages, so continuations follow directly
+  for (uint8_t seq = 0; got < msg->len; seq++) {
+    if (!next_report(report) || cid_read(report) != msg->cid ||
+        report[4] != seq) {
+      fprintf(stderr, "ctaphid_host: broken message on 0x%08X at byte %u\n",
+              (unsigned)msg->cid, got);
+      exit(1);
+    }
+    uint16_t chunk = (uint16_t)(msg->len - got);
+    if (chunk > FIDO2_CONT_PAYLOAD)
+      chunk = FIDO2_CONT_PAYLOAD;
+    memcpy(msg->data + got, report + 5, chunk);
+    got += chunk;
+  }
+  return true;
+}
+
+uint32_t ctaphid_host_init(void) {
+  static const uint8_t nonce[FIDO2_INIT_DATA_SIZE] = {1, 2, 3, 4, 5, 6, 7, 8};
+  static ctaphid_msg_t msg;
+  ctaphid_host_send(FIDO2_BROADCAST_CHANNEL, CTAPHID_INIT, nonce,
+                    sizeof(nonce));
+  if (!ctaphid_host_recv(&msg) || msg.cid != FIDO2_BROADCAST_CHANNEL ||
+      msg.cmd != CTAPHID_INIT || msg.len < 12 ||
+      memcmp(msg.data, nonce, sizeof(nonce)) != 0) {
+    fprintf(stderr, "ctaphid_host: INIT failed\n");
+    exit(1);
+  }
+  return cid_read(msg.data + 8);
+}
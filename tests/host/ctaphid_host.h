@@ -0,0 +1,72 @@
+#ifndef CTAPHID_HOST_H
+#define CTAPHID_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fido2_device.h"
+
+/**
+ * @file ctaphid_host.h
+ * @brief Replays CTAPHID traffic against the Non-Secure FIDO HID driver, the
+ * way one or more platform clients share the authenticator.
+ *
+ * The FIDO class driver sits on the USB endpoint emulator (usb_emu.h).
+ * Messages are cut into 64-byte reports on the OUT endpoint and reassembled
+ * from the IN endpoint. Whenever the IN endpoint NAKs, the device main loop
+ * (tud_task, then fido2_task) runs once.
+ */
+
+#define CTAPHID_HOST_EP_OUT 0x04
+#define CTAPHID_HOST_EP_IN 0x84
+
+// Main loop passes before a NAKing IN endpoint counts as idle
+#define CTAPHID_HOST_PATIENCE 16
+
+// Reports of the largest message
+#define CTAPHID_HOST_MAX_REPORTS 20
+
+typedef struct {
+  uint32_t cid;
+  uint8_t cmd; // Without the frame bit
+  uint16_t len;
+  uint8_t data[FIDO2_MAX_MSG_SIZE];
+} ctaphid_msg_t;
+
+/** @brief Resets the emulator and opens the FIDO HID interface. */
+void ctaphid_host_attach(void);
+
+/** @brief One device main loop pass: tud_task, then fido2_task. */
+void ctaphid_host_poll(void);
+
+/**
+ * @brief Cuts a message into an initialization report and its continuation
+ * reports, so a test can interleave them with other traffic.
+ *
+ * @return Number of reports.
+ */
+uint32_t ctaphid_host_frame(uint8_t reports[][FIDO2_REPORT_SIZE], uint32_t cid,
+                            uint8_t cmd, const uint8_t *data, uint16_t len);
+
+/** @brief Sends one report on the OUT endpoint. */
+void ctaphid_host_report(const uint8_t *report);
+
+/** @brief Sends a whole message. */
+void ctaphid_host_send(uint32_t cid, uint8_t cmd, const uint8_t *data,
+                       uint16_t len);
+
+/**
+ * @brief Receives one message from the IN endpoint.
+ *
+ * @return false if nothing arrives.
+ */
+bool ctaphid_host_recv(ctaphid_msg_t *msg);
+
+/**
+ * @brief Allocates a channel with INIT on the broadcast CID.
+ *
+ * @return The new CID.
+ */
+uint32_t ctaphid_host_init(void);
+
+#endif // CTAPHID_HOST_H
@@ -0,0 +1,48 @@
+#include "flash_emu.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "hardware/flash.h"
+
+uint8_t flash_emu_mem[FLASH_EMU_SIZE];
+flash_emu_stats_t flash_emu_stats;
+
+void flash_emu_reset(void) {
+  memset(flash_emu_mem, 0xFF, sizeof(flash_emu_mem));
+  flash_emu_clear_stats();
+}
+
+void flash_emu_clear_stats(void) {
+  memset(&flash_emu_stats, 0, sizeof(flash_emu_stats));
+}
+
+uint32_t flash_emu_erases_in(uint32_t offset, uint32_t len) {
+  uint32_t total = 0;
+  for (uint32_t s = offset / FLASH_SECTOR_SIZE;
+       s < (offset + len) / FLASH_SECTOR_SIZE; s++)
+    total += flash_emu_stats.sector_erases[s];
+  return total;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+  assert(flash_offs % FLASH_SECTOR_SIZE == 0);
+  assert(count % FLASH_SECTOR_SIZE == 0);
+  assert(flash_offs + count <= FLASH_EMU_SIZE);
+  memset(flash_emu_mem + flash_offs, 0xFF, count);
+  for (size_t s = 0; s < count / FLASH_SECTOR_SIZE; s++)
+    flash_emu_stats.sector_erases[flash_offs / FLASH_SECTOR_SIZE + s]++;
+  flash_emu_stats.erases += (uint32_t)(count / FLASH_SECTOR_SIZE);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count) {
+  assert(flash_offs + count <= FLASH_EMU_SIZE);
+  if (flash_offs % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0)
+    flash_emu_stats.unaligned++;
+  for (size_t i = 0; i < count; i++)
+    flash_emu_mem[flash_offs + i] &= data[i];
+  flash_emu_stats.programs++;
+  flash_emu_stats.pages +=
+      (uint32_t)((count + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE);
+}
@@ -0,0 +1,46 @@
+#ifndef FLASH_EMU_H
+#define FLASH_EMU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file flash_emu.h
+ * @brief RAM-backed stand-in for the RP2350 QSPI flash used by host tests.
+ *
+ * Erase sets a sector to 0xFF, program ANDs data into it the way NOR flash
+ * does, and XIP_BASE points at the array so code reading flash through XIP
+ * sees the same bytes. Every operation is counted so tests can assert on
+ * wear and write amplification.
+ */
+
+#define FLASH_EMU_SIZE (2 * 1024 * 1024)
+
+typedef struct {
+  uint32_t erases;         // Sectors erased
+  uint32_t programs;       // flash_range_program calls
+  uint32_t pages;          // 256-byte pages programmed
+  uint32_t unaligned;      // Programs not on a page boundary
+  uint32_t sector_erases[FLASH_EMU_SIZE / 4096];
+} flash_emu_stats_t;
+
+extern uint8_t flash_emu_mem[FLASH_EMU_SIZE];
+extern flash_emu_stats_t flash_emu_stats;
+
+/**
+ * @brief Erases the whole device and clears the counters.
+ */
+void flash_emu_reset(void);
+
+/**
+ * @brief Clears the counters, keeping the contents.
+ */
+void flash_emu_clear_stats(void);
+
+/**
+ * @brief Erases in [offset, offset + len) counted since the last reset.
+ */
+uint32_t flash_emu_erases_in(uint32_t offset, uint32_t len);
+
+#endif // FLASH_EMU_H
@@ -0,0 +1,87 @@
+#include "host_platform.h"
+
+uint64_t host_time_us;
+uint32_t host_gpio_in = 0xFFFFFFFFu;
+
+static uint64_t rand_state = 0x9E3779B97F4A7C15ull;
+
+#define HOST_ALARMS 8
+
+static struct {
+  alarm_id_t id; // 0 if the entry is free
+  uint64_t due;
+  alarm_callback_t callback;
+  void *user_data;
+} alarms[HOST_ALARMS];
+static alarm_id_t next_alarm_id = 1;
+
+// Earliest alarm due at or before `until`, or -1
+static int next_due(uint64_t until) {
+  int next = -1;
+  for (int i = 0; i < HOST_ALARMS; i++) {
+    if (alarms[i].id && alarms[i].due <= until &&
+        (next < 0 || alarms[i].due < alarms[next].due))
+      next = i;
+  }
+  return next;
+}
+
+void host_advance_us(uint64_t us) {
+  uint64_t target = host_time_us + us;
+  int i;
+  while ((i = next_due(target)) >= 0) {
+    if (alarms[i].due > host_time_us)
+      host_time_us = alarms[i].due;
+    alarm_id_t id = alarms[i].id;
+    int64_t again = alarms[i].callback(id, alarms[i].user_data);
+    // The callback may have cancelled its own alarm
+    if (alarms[i].id != id)
+      continue;
+    if (again > 0)
+      alarms[i].due += (uint64_t)again;
+    else if (again < 0)
+      alarms[i].due = host_time_us + (uint64_t)-again;
+    else
+      alarms[i].id = 0;
+  }
+  host_time_us = target;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past) {
+  (void)fire_if_past;
+  for (int i = 0; i < HOST_ALARMS; i++) {
+    if (alarms[i].id == 0) {
+      alarms[i].id = next_alarm_id++;
+      alarms[i].due = host_time_us + ms * 1000ull;
+      alarms[i].callback = callback;
+      alarms[i].user_data = user_data;
+      return alarms[i].id;
+    }
+  }
+  return -1;
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+  for (int i = 0; i < HOST_ALARMS; i++) {
+    if (alarms[i].id == alarm_id && alarm_id != 0) {
+      alarms[i].id = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void host_seed_rand(uint32_t seed) {
+  rand_state = 0x9E3779B97F4A7C15ull ^ seed;
+}
+
+// xorshift64*: reproducible, not secure
+uint64_t get_rand_64(void) {
+  rand_state ^= rand_state >> 12;
+  rand_state ^= rand_state << 25;
+  rand_state ^= rand_state >> 27;
+  return rand_state * 0x2545F4914F6CDD1Dull;
+}
+
+uint32_t get_rand_32(void) { return (uint32_t)(get_rand_64() >> 32); }
@@ -0,0 +1,82 @@
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file host_platform.h
+ * @brief The slice of the Pico SDK the firmware sources use, for host builds.
+ *
+ * Time only moves when a test advances it, and the RNG is a seeded
+ * generator, so runs are reproducible.
+ */
+
+#define XIP_BASE ((uintptr_t)flash_emu_mem)
+#define FLASH_SECTOR_SIZE 4096u
+#define FLASH_PAGE_SIZE 256u
+
+extern uint8_t flash_emu_mem[];
+
+typedef uint64_t absolute_time_t;
+typedef struct repeating_timer repeating_timer_t;
+typedef int32_t alarm_id_t;
+
+// Simulated clock. Advancing it runs the alarms that fall due on the way,
+// at their due times, as the timer interrupt would.
+extern uint64_t host_time_us;
+void host_advance_us(uint64_t us);
+void host_seed_rand(uint32_t seed);
+
+static inline uint64_t time_us_64(void) { return host_time_us; }
+static inline uint32_t time_us_32(void) { return (uint32_t)host_time_us; }
+static inline absolute_time_t get_absolute_time(void) { return host_time_us; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+  return (uint32_t)(t / 1000);
+}
+static inline void sleep_ms(uint32_t ms) { host_advance_us(ms * 1000ull); }
+static inline void sleep_us(uint64_t us) { host_advance_us(us); }
+static inline void busy_wait_us(uint64_t us) { host_advance_us(us); }
+static inline void tight_loop_contents(void) {}
+
+// Alarm callback: a positive return re-arms that many microseconds after the
+// previous due time, a negative one that many after now, zero stops
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+
+uint32_t get_rand_32(void);
+uint64_t get_rand_64(void);
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count);
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { (void)status; }
+
+#define GPIO_IN false
+#define GPIO_OUT true
+static inline void gpio_init(unsigned gpio) { (void)gpio; }
+static inline void gpio_set_dir(unsigned gpio, bool out) {
+  (void)gpio;
+  (void)out;
+}
+static inline void gpio_pull_up(unsigned gpio) { (void)gpio; }
+
+// Input levels, one bit per pin. All pins read high (pulled up, buttons
+// released) until a test drives them.
+extern uint32_t host_gpio_in;
+static inline bool gpio_get(unsigned gpio) {
+  return (host_gpio_in >> gpio) & 1u;
+}
+static inline void host_gpio_set(unsigned gpio, bool level) {
+  if (level)
+    host_gpio_in |= 1u << gpio;
+  else
+    host_gpio_in &= ~(1u << gpio);
+}
+
+#endif // HOST_PLATFORM_H
@@ -0,0 +1,6 @@
+#ifndef HOST_HARDWARE_ADDRESS_MAPPED_H
+#define HOST_HARDWARE_ADDRESS_MAPPED_H
+
+#include "host_platform.h"
+
+#endif // HOST_HARDWARE_ADDRESS_MAPPED_H
@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_RAND_H
+#define HOST_PICO_RAND_H
+
+#include "host_platform.h"
+
+#endif // HOST_PICO_RAND_H
@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include "host_platform.h"
+
+#endif // HOST_PICO_STDLIB_H
@@ -0,0 +1,12 @@
+#include "drivers/led_driver.h"
+
+// The WS2812 driver needs PIO; host tests only see the last color set
+uint8_t host_led_rgb[3];
+
+void led_driver_init(void) {}
+
+void led_set_color(uint8_t r, uint8_t g, uint8_t b) {
+  host_led_rgb[0] = r;
+  host_led_rgb[1] = g;
+  host_led_rgb[2] = b;
+}
@@ -0,0 +1,32 @@
+#ifndef HOST_USBD_PVT_H
+#define HOST_USBD_PVT_H
+
+#include "tusb.h"
+
+/**
+ * @file usbd_pvt.h
+ * @brief Custom class driver interface, as in TinyUSB's device/usbd_pvt.h.
+ */
+
+typedef struct {
+  char const *name;
+  void (*init)(void);
+  void (*reset)(uint8_t rhport);
+  uint16_t (*open)(uint8_t rhport, tusb_desc_interface_t const *desc_intf,
+                   uint16_t max_len);
+  bool (*control_xfer_cb)(uint8_t rhport, uint8_t stage,
+                          tusb_control_request_t const *request);
+  bool (*xfer_cb)(uint8_t rhport, uint8_t ep_addr, xfer_result_t result,
+                  uint32_t xferred_bytes);
+  // Optional. Runs in interrupt context as the transfer completes, with the
+  // endpoint already released; returning false defers to xfer_cb.
+  bool (*xfer_isr)(uint8_t rhport, uint8_t ep_addr, xfer_result_t result,
+                   uint32_t xferred_bytes);
+  void (*sof)(uint8_t rhport, uint32_t frame_count);
+} usbd_class_driver_t;
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep);
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer,
+                    uint16_t total_bytes, bool is_isr);
+
+#endif // HOST_USBD_PVT_H
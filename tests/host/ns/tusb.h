@@ -0,0 +1,88 @@
+#ifndef HOST_TUSB_H
+#define HOST_TUSB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tusb_config.h"
+
+/**
+ * @file tusb.h
+ * @brief The slice of the TinyUSB device API the Non-Secure drivers use,
+ * backed by the endpoint emulator in usb_emu.c.
+ */
+
+typedef enum {
+  XFER_RESULT_SUCCESS = 0,
+  XFER_RESULT_FAILED,
+  XFER_RESULT_STALLED,
+  XFER_RESULT_TIMEOUT,
+} xfer_result_t;
+
+enum {
+  TUSB_REQ_TYPE_STANDARD = 0,
+  TUSB_REQ_TYPE_CLASS,
+  TUSB_REQ_TYPE_VENDOR,
+};
+
+enum {
+  TUSB_REQ_GET_DESCRIPTOR = 6,
+};
+
+enum {
+  CONTROL_STAGE_IDLE = 0,
+  CONTROL_STAGE_SETUP,
+  CONTROL_STAGE_DATA,
+  CONTROL_STAGE_ACK,
+};
+
+#define TUSB_DESC_INTERFACE 0x04
+#define TUSB_DESC_ENDPOINT 0x05
+
+typedef struct __attribute__((packed)) {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bInterfaceNumber;
+  uint8_t bAlternateSetting;
+  uint8_t bNumEndpoints;
+  uint8_t bInterfaceClass;
+  uint8_t bInterfaceSubClass;
+  uint8_t bInterfaceProtocol;
+  uint8_t iInterface;
+} tusb_desc_interface_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bEndpointAddress;
+  uint8_t bmAttributes;
+  uint16_t wMaxPacketSize;
+  uint8_t bInterval;
+} tusb_desc_endpoint_t;
+
+typedef struct __attribute__((packed)) {
+  union {
+    struct __attribute__((packed)) {
+      uint8_t recipient : 5;
+      uint8_t type : 2;
+      uint8_t direction : 1;
+    } bmRequestType_bit;
+    uint8_t bmRequestType;
+  };
+  uint8_t bRequest;
+  uint16_t wValue;
+  uint16_t wIndex;
+  uint16_t wLength;
+} tusb_control_request_t;
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request,
+                      void *buffer, uint16_t len);
+
+// Vendor
+uint32_t tud_vendor_write(void const *buffer, uint32_t bufsize);
+
+#include "device/usbd_pvt.h"
+
+#endif // HOST_TUSB_H
@@ -0,0 +1,30 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @file test_util.h
+ * @brief Minimal assertion helpers shared by the host tests and benchmarks.
+ */
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do {                                                                         \
+    long long _a = (long long)(a), _b = (long long)(b);                        \
+    if (_a != _b) {                                                            \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s == %s (%lld vs %lld)\n",     \
+              __FILE__, __LINE__, #a, #b, _a, _b);                             \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+#endif // TEST_UTIL_H
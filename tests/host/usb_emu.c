@@ -0,0 +1,155 @@
+#include "usb_emu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  bool open;
+  bool busy;       // Transfer queued by the driver
+  bool completing; // Transfer done, completion not yet delivered
+  uint8_t *buf;
+  uint16_t len;
+  uint16_t done;
+} emu_ep_t;
+
+#define EMU_EVENTS 16
+
+static struct {
+  const usbd_class_driver_t *driver;
+  emu_ep_t ep[16][2]; // [number][direction]
+  struct {
+    uint8_t ep_addr;
+    xfer_result_t result;
+    uint32_t xferred;
+  } events[EMU_EVENTS];
+  uint8_t head, count;
+} emu;
+
+static emu_ep_t *ep_of(uint8_t ep_addr) {
+  return &emu.ep[ep_addr & 0x0F][ep_addr >> 7];
+}
+
+static void fail(const char *what, uint8_t ep_addr) {
+  fprintf(stderr, "usb_emu: %s on endpoint 0x%02x\n", what, ep_addr);
+  exit(1);
+}
+
+// USB interrupt side of a completion: xfer_isr first, else queue the event
+// for usb_emu_task
+static void complete(uint8_t ep_addr, emu_ep_t *ep, xfer_result_t result) {
+  if (emu.driver->xfer_isr) {
+    ep->busy = false;
+    if (emu.driver->xfer_isr(0, ep_addr, result, ep->done))
+      return;
+    ep->busy = true;
+  }
+  if (emu.count == EMU_EVENTS)
+    fail("event queue overflow", ep_addr);
+  uint8_t slot = (uint8_t)((emu.head + emu.count++) % EMU_EVENTS);
+  emu.events[slot].ep_addr = ep_addr;
+  emu.events[slot].result = result;
+  emu.events[slot].xferred = ep->done;
+  ep->completing = true;
+}
+
+void usb_emu_attach(const usbd_class_driver_t *driver, const uint8_t *desc,
+                    uint16_t desc_len) {
+  memset(&emu, 0, sizeof(emu));
+  emu.driver = driver;
+  if (driver->init)
+    driver->init();
+  if (driver->reset)
+    driver->reset(0);
+  if (driver->open(0, (const tusb_desc_interface_t *)desc, desc_len) == 0)
+    fail("driver refused the interface", 0);
+}
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep) {
+  (void)rhport;
+  ep_of(desc_ep->bEndpointAddress)->open = true;
+  return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer,
+                    uint16_t total_bytes, bool is_isr) {
+  (void)rhport;
+  (void)is_isr;
+  emu_ep_t *ep = ep_of(ep_addr);
+  if (!ep->open)
+    fail("transfer on a closed endpoint", ep_addr);
+  if (ep->busy)
+    return false;
+  ep->busy = true;
+  ep->completing = false;
+  ep->buf = buffer;
+  ep->len = total_bytes;
+  ep->done = 0;
+  return true;
+}
+
+bool usb_emu_out(uint8_t ep_addr, const uint8_t *packet, uint16_t len) {
+  emu_ep_t *ep = ep_of(ep_addr);
+  if (len > USB_EMU_PACKET_SIZE)
+    fail("oversized OUT packet", ep_addr);
+  if (!ep->busy || ep->completing)
+    return false;
+  if (len > ep->len - ep->done)
+    fail("OUT packet overruns the queued transfer", ep_addr);
+  memcpy(ep->buf + ep->done, packet, len);
+  ep->done = (uint16_t)(ep->done + len);
+  // A short packet ends the transfer early
+  if (ep->done == ep->len || len < USB_EMU_PACKET_SIZE)
+    complete(ep_addr, ep, XFER_RESULT_SUCCESS);
+  return true;
+}
+
+int usb_emu_in(uint8_t ep_addr, uint8_t *packet) {
+  emu_ep_t *ep = ep_of(ep_addr);
+  if (!ep->busy || ep->completing)
+    return -1;
+  uint16_t n = (uint16_t)(ep->len - ep->done);
+  if (n > USB_EMU_PACKET_SIZE)
+    n = USB_EMU_PACKET_SIZE;
+  if (n)
+    memcpy(packet, ep->buf + ep->done, n);
+  ep->done = (uint16_t)(ep->done + n);
+  if (ep->done == ep->len)
+    complete(ep_addr, ep, XFER_RESULT_SUCCESS);
+  return n;
+}
+
+void usb_emu_fail(uint8_t ep_addr) {
+  emu_ep_t *ep = ep_of(ep_addr);
+  if (!ep->busy || ep->completing)
+    fail("no transfer to fail", ep_addr);
+  complete(ep_addr, ep, XFER_RESULT_FAILED);
+}
+
+int usb_emu_task(void) {
+  int delivered = 0;
+  while (emu.count > 0) {
+    uint8_t ep_addr = emu.events[emu.head].ep_addr;
+    xfer_result_t result = emu.events[emu.head].result;
+    uint32_t xferred = emu.events[emu.head].xferred;
+    emu.head = (uint8_t)((emu.head + 1) % EMU_EVENTS);
+    emu.count--;
+    emu_ep_t *ep = ep_of(ep_addr);
+    ep->busy = false;
+    ep->completing = false;
+    emu.driver->xfer_cb(0, ep_addr, result, xferred);
+    delivered++;
+  }
+  return delivered;
+}
+
+bool usb_emu_busy(uint8_t ep_addr) { return ep_of(ep_addr)->busy; }
+
+bool tud_control_xfer(uint8_t rhport, tusb_control_request_t const *request,
+                      void *buffer, uint16_t len) {
+  (void)rhport;
+  (void)request;
+  (void)buffer;
+  (void)len;
+  return true;
+}
@@ -0,0 +1,63 @@
+#ifndef USB_EMU_H
+#define USB_EMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device/usbd_pvt.h"
+
+/**
+ * @file usb_emu.h
+ * @brief Host side of a full-speed USB device, at the level of the TinyUSB
+ * endpoint API the class drivers use.
+ *
+ * The test plays the host: it offers OUT packets and polls IN packets one
+ * max-packet at a time, and the emulator fills or drains the transfer the
+ * driver queued with usbd_edpt_xfer(). As in TinyUSB, an endpoint stays busy
+ * until usb_emu_task() (standing in for tud_task) has delivered its
+ * completion to the driver's xfer_cb; until then OUT packets and IN polls
+ * are NAKed. A driver's xfer_isr sees the completion first, as the USB
+ * interrupt would, and may take it there instead.
+ */
+
+#define USB_EMU_PACKET_SIZE 64
+
+/**
+ * @brief Resets the emulator and opens `driver` on the interface in `desc`
+ * (interface descriptor followed by its class and endpoint descriptors).
+ */
+void usb_emu_attach(const usbd_class_driver_t *driver, const uint8_t *desc,
+                    uint16_t desc_len);
+
+/**
+ * @brief Host sends one OUT packet of at most USB_EMU_PACKET_SIZE bytes.
+ *
+ * @return false if the endpoint NAKed (no transfer queued, or the last one
+ * not yet reaped by usb_emu_task).
+ */
+bool usb_emu_out(uint8_t ep_addr, const uint8_t *packet, uint16_t len);
+
+/**
+ * @brief Host polls one IN packet.
+ *
+ * @return Packet length (0 for a zero-length packet), or -1 on NAK.
+ */
+int usb_emu_in(uint8_t ep_addr, uint8_t *packet);
+
+/**
+ * @brief Ends the transfer queued on the endpoint with XFER_RESULT_FAILED,
+ * as after a bus reset or a host-side abort.
+ */
+void usb_emu_fail(uint8_t ep_addr);
+
+/**
+ * @brief Delivers pending transfer completions to the driver, in order.
+ *
+ * @return Number of completions delivered.
+ */
+int usb_emu_task(void);
+
+/** @brief true while a transfer is queued on the endpoint. */
+bool usb_emu_busy(uint8_t ep_addr);
+
+#endif // USB_EMU_H
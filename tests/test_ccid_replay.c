@@ -0,0 +1,305 @@
+// CCID transport replayed end to end: host packets through the Non-Secure
+// CCID driver and the gateway into the Secure World applets.
+//
+// Covers messages spanning several packets in both directions, responses
+// ending on a packet boundary (ZLP), pipelined commands and the slot
+// back-pressure behind them, malformed lengths, and time extensions during
+// a slow Secure World call (secure_world_handler is wrapped to take time).
+#include <stdio.h>
+#include <string.h>
+
+#include "apdu_protocol.h"
+#include "ccid_device.h"
+#include "ccid_host.h"
+#include "ccid_protocol.h"
+#include "flash_emu.h"
+#include "oath_storage.h"
+#include "pico/time.h"
+#include "secure_gateway.h"
+#include "test_util.h"
+#include "time_sync.h"
+#include "usb_emu.h"
+
+int32_t __real_secure_world_handler(secure_gateway_func_id_t func_id,
+                                    uint8_t *in_data, uint16_t in_len,
+                                    uint8_t *out_data, uint16_t out_max_len);
+
+static uint64_t call_us; // Simulated duration of each Secure World call
+
+// Bulk-IN blocks the host read while a call was running; the host keeps a
+// read pending during a command, so it picks them up within a millisecond
+#define MAX_WTX 16
+static uint8_t wtx_blocks[MAX_WTX][USB_EMU_PACKET_SIZE];
+static int wtx_count;
+
+int32_t __wrap_secure_world_handler(secure_gateway_func_id_t func_id,
+                                    uint8_t *in_data, uint16_t in_len,
+                                    uint8_t *out_data, uint16_t out_max_len) {
+  for (uint64_t t = 0; t < call_us; t += 1000) {
+    host_advance_us(1000);
+    uint8_t packet[USB_EMU_PACKET_SIZE];
+    if (usb_emu_in(CCID_HOST_EP_IN, packet) >= 0) {
+      CHECK(wtx_count < MAX_WTX);
+      memcpy(wtx_blocks[wtx_count++], packet, sizeof(packet));
+    }
+  }
+  return __real_secure_world_handler(func_id, in_data, in_len, out_data,
+                                     out_max_len);
+}
+
+static uint8_t cmd[6000];
+static uint8_t rsp[CCID_MAX_MESSAGE_LEN];
+
+static uint32_t rsp_length(void) {
+  return (uint32_t)rsp[1] | (uint32_t)rsp[2] << 8 | (uint32_t)rsp[3] << 16 |
+         (uint32_t)rsp[4] << 24;
+}
+
+// Reads one response and checks its framing against the command's sequence
+static int32_t expect(uint8_t type, uint8_t seq) {
+  int32_t len = ccid_host_recv(rsp, sizeof(rsp));
+  CHECK(len >= CCID_HEADER_SIZE);
+  CHECK_EQ(rsp[0], type);
+  CHECK_EQ(rsp[6], seq);
+  CHECK_EQ((uint32_t)len, CCID_HEADER_SIZE + rsp_length());
+  return len;
+}
+
+static uint16_t apdu_sw(int32_t len) {
+  return (uint16_t)(rsp[len - 2] << 8 | rsp[len - 1]);
+}
+
+static int32_t xfr(uint8_t seq, const uint8_t *apdu, uint32_t len) {
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_XFRBLOCK, seq, apdu,
+                                          len)));
+  return expect(RDR_TO_PC_DATABLOCK, seq);
+}
+
+static void select_oath(uint8_t seq) {
+  uint8_t apdu[5 + OATH_AID_LEN] = {0x00, INS_SELECT, 0x04, 0x00,
+                                    OATH_AID_LEN};
+  memcpy(apdu + 5, OATH_AID, OATH_AID_LEN);
+  int32_t len = xfr(seq, apdu, sizeof(apdu));
+  CHECK_EQ(apdu_sw(len), SW_OK);
+  CHECK_EQ(rsp[CCID_HEADER_SIZE], 0x79);
+}
+
+// CALCULATE of a missing name `name_len` bytes long
+static uint32_t calculate_apdu(uint8_t *apdu, uint8_t name_len) {
+  apdu[0] = 0x00;
+  apdu[1] = INS_CALCULATE;
+  apdu[2] = apdu[3] = 0x00;
+  apdu[4] = (uint8_t)(2 + name_len);
+  apdu[5] = OATH_TAG_NAME;
+  apdu[6] = name_len;
+  memset(apdu + 7, 'x', name_len);
+  return 7u + name_len;
+}
+
+static void setup(void) {
+  flash_emu_reset();
+  call_us = 0;
+  secure_gateway_init();
+  time_sync_set_timestamp(59);
+  ccid_host_attach();
+}
+
+static void test_power_on(void) {
+  setup();
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_ICCPOWERON, 0, NULL,
+                                          0)));
+  int32_t len = expect(RDR_TO_PC_DATABLOCK, 0);
+  CHECK_EQ(len, CCID_HEADER_SIZE + 18);
+  CHECK_EQ(rsp[CCID_HEADER_SIZE], 0x3B);
+  select_oath(1);
+}
+
+// Commands of one full packet, one packet and a byte, and several packets
+static void test_multi_packet_commands(void) {
+  setup();
+  select_oath(0);
+  static const uint8_t name_lens[] = {47, 48, 63};
+  uint8_t apdu[80];
+  for (uint8_t i = 0; i < sizeof(name_lens); i++) {
+    uint32_t len = calculate_apdu(apdu, name_lens[i]);
+    int32_t r = xfr((uint8_t)(1 + i), apdu, len);
+    CHECK_EQ(apdu_sw(r), SW_FILE_NOT_FOUND);
+  }
+
+  // An extended APDU of several kilobytes arrives whole: the applet parses
+  // it and answers for the name TLV at its start
+  uint8_t big[3000];
+  memset(big, 0, sizeof(big));
+  big[1] = INS_CALCULATE;
+  uint16_t lc = (uint16_t)(sizeof(big) - 7);
+  big[5] = (uint8_t)(lc >> 8);
+  big[6] = (uint8_t)lc;
+  big[7] = OATH_TAG_NAME;
+  big[8] = 4;
+  memcpy(big + 9, "none", 4);
+  int32_t r = xfr(9, big, sizeof(big));
+  CHECK_EQ(apdu_sw(r), SW_FILE_NOT_FOUND);
+}
+
+// Responses over several packets and transfers, and one ending exactly on a
+// packet boundary, which needs a ZLP
+static void test_multi_packet_responses(void) {
+  static const uint8_t secret[20] = "12345678901234567890";
+  char name[OATH_MAX_NAME_LEN];
+
+  // Two entries of 48 + 10 bytes, the status word and the header: 128 bytes
+  setup();
+  for (int i = 0; i < 2; i++) {
+    memset(name, 'a' + i, 48);
+    name[48] = '\0';
+    CHECK(oath_storage_put(name, secret, sizeof(secret), OATH_TYPE_TOTP,
+                           OATH_ALGO_SHA1, 6, 30, 0));
+  }
+  CHECK(oath_storage_commit());
+  select_oath(0);
+  uint8_t calc_all[] = {0x00, INS_CALCULATE_ALL, 0x00, 0x00};
+  int32_t len = xfr(1, calc_all, sizeof(calc_all));
+  CHECK_EQ(len, 128);
+  CHECK_EQ(apdu_sw(len), SW_OK);
+  CHECK(ccid_host_stats.zlp);
+  CHECK_EQ(ccid_host_stats.packets, 3);
+
+  // Forty entries in one extended response, over several bulk-IN transfers
+  for (int i = 2; i < 40; i++) {
+    snprintf(name, sizeof(name), "account-%02d@example.com", i);
+    CHECK(oath_storage_put(name, secret, sizeof(secret), OATH_TYPE_TOTP,
+                           OATH_ALGO_SHA1, 6, 30, 0));
+  }
+  CHECK(oath_storage_commit());
+  uint8_t calc_all_ext[] = {0x00, INS_CALCULATE_ALL, 0x00, 0x00,
+                            0x00, 0x00,              0x00};
+  len = xfr(2, calc_all_ext, sizeof(calc_all_ext));
+  CHECK_EQ(apdu_sw(len), SW_OK);
+  CHECK(len > 1024);
+  CHECK_EQ(ccid_host_stats.packets, (uint32_t)len / 64 + 1);
+  CHECK_EQ(ccid_host_stats.zlp, len % 64 == 0);
+}
+
+// Two commands in flight fill both slots; a third waits behind bulk-OUT
+// NAKs until a response is read, and responses keep the command order
+static void test_pipelined(void) {
+  setup();
+  select_oath(0);
+  uint8_t apdu[80];
+  uint32_t len = calculate_apdu(apdu, 63);
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_XFRBLOCK, 1, apdu,
+                                          len)));
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_GETSLOTSTATUS, 2,
+                                          NULL, 0)));
+  uint32_t third = ccid_host_msg(cmd, PC_TO_RDR_GETPARAMETERS, 3, NULL, 0);
+  CHECK(!ccid_host_send(cmd, third));
+
+  int32_t r = expect(RDR_TO_PC_DATABLOCK, 1);
+  CHECK_EQ(apdu_sw(r), SW_FILE_NOT_FOUND);
+  CHECK(ccid_host_send(cmd, third));
+  expect(RDR_TO_PC_SLOTSTATUS, 2);
+  r = expect(RDR_TO_PC_PARAMETERS, 3);
+  CHECK_EQ(r, CCID_HEADER_SIZE + 7);
+}
+
+// Oversized and truncated messages are rejected with bError pointing at
+// dwLength, and the reader keeps working
+static void test_bad_lengths(void) {
+  setup();
+  uint32_t len = ccid_host_msg(cmd, PC_TO_RDR_XFRBLOCK, 1, NULL,
+                               MAX_APDU_SIZE + 500);
+  memset(cmd + CCID_HEADER_SIZE, 0xAA, len - CCID_HEADER_SIZE);
+  CHECK(ccid_host_send(cmd, len));
+  expect(RDR_TO_PC_SLOTSTATUS, 1);
+  CHECK_EQ(rsp[7], 0x40); // Command failed
+  CHECK_EQ(rsp[8], 1);    // Offset of dwLength
+
+  // Header claims 200 bytes, a short packet ends it at 100
+  ccid_host_msg(cmd, PC_TO_RDR_XFRBLOCK, 2, NULL, 200);
+  CHECK(ccid_host_send(cmd, 100));
+  expect(RDR_TO_PC_SLOTSTATUS, 2);
+  CHECK_EQ(rsp[8], 1);
+
+  select_oath(3);
+}
+
+// A Secure World call gets a time extension block for the same sequence
+// number on every wait tick, then its response
+static void test_time_extension(void) {
+  setup();
+  select_oath(0);
+  call_us = 350 * 1000;
+  wtx_count = 0;
+  uint8_t apdu[80];
+  uint32_t len = calculate_apdu(apdu, 8);
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_XFRBLOCK, 1, apdu,
+                                          len)));
+  int32_t r = expect(RDR_TO_PC_DATABLOCK, 1);
+  CHECK_EQ(apdu_sw(r), SW_FILE_NOT_FOUND);
+
+  printf("time extensions during a 350 ms call: %d\n", wtx_count);
+  CHECK_EQ(wtx_count, 350 / SG_WAIT_INTERVAL_MS);
+  for (int i = 0; i < wtx_count; i++) {
+    CHECK_EQ(wtx_blocks[i][0], RDR_TO_PC_DATABLOCK);
+    CHECK_EQ(wtx_blocks[i][6], 1);
+    CHECK_EQ(wtx_blocks[i][7], 0x80); // Time extension
+    CHECK_EQ(wtx_blocks[i][8], 10);   // Multiplier
+  }
+  call_us = 0;
+  select_oath(2);
+}
+
+// A failed bulk-IN transfer abandons that response instead of leaving the
+// endpoint marked busy, so later commands are still answered
+static void test_failed_response(void) {
+  setup();
+  CHECK(ccid_host_send(cmd, ccid_host_msg(cmd, PC_TO_RDR_ICCPOWERON, 0, NULL,
+                                          0)));
+  for (int i = 0; i < CCID_HOST_PATIENCE && !usb_emu_busy(CCID_HOST_EP_IN);
+       i++)
+    ccid_host_poll();
+  usb_emu_fail(CCID_HOST_EP_IN);
+  ccid_host_poll();
+  select_oath(1);
+}
+
+// HSM key generation and signing tick the wait callback like APDUs do
+static int gateway_ticks;
+
+static void count_tick(void *ctx) {
+  (void)ctx;
+  gateway_ticks++;
+}
+
+static void test_hsm_waits(void) {
+  setup();
+  call_us = 250 * 1000;
+  uint8_t status = 0xFF;
+  gateway_ticks = 0;
+  secure_gateway_on_wait(count_tick, NULL);
+  CHECK(secure_gateway_hsm_gen_key(0, SG_HSM_ALG_P256, &status));
+  CHECK_EQ(status, 0);
+  CHECK_EQ(gateway_ticks, 2);
+
+  uint8_t hash[32] = {1}, sig[64];
+  uint16_t sig_len = 0;
+  gateway_ticks = 0;
+  secure_gateway_on_wait(count_tick, NULL);
+  CHECK(secure_gateway_hsm_sign(0, hash, sig, &sig_len));
+  CHECK_EQ(sig_len, 64);
+  CHECK_EQ(gateway_ticks, 2);
+  call_us = 0;
+}
+
+int main(void) {
+  test_power_on();
+  test_multi_packet_commands();
+  test_multi_packet_responses();
+  test_pipelined();
+  test_bad_lengths();
+  test_time_extension();
+  test_failed_response();
+  test_hsm_waits();
+  printf("test_ccid_replay: ok\n");
+  return 0;
+}
@@ -0,0 +1,202 @@
+// CTAPHID channels shared by several clients: allocation and LRU eviction,
+// and one request reassembling while other channels keep talking
+#include <stdio.h>
+#include <string.h>
+
+#include "ctaphid_host.h"
+#include "pico/time.h"
+#include "test_util.h"
+
+static ctaphid_msg_t msg;
+static uint8_t reports[CTAPHID_HOST_MAX_REPORTS][FIDO2_REPORT_SIZE];
+static uint8_t payload[FIDO2_MAX_MSG_SIZE];
+
+static void fill(uint16_t len, uint8_t salt) {
+  for (uint16_t i = 0; i < len; i++)
+    payload[i] = (uint8_t)(i * 7 + salt);
+}
+
+// Expects the next message to be an echo of `payload`
+static void expect_ping(uint32_t cid, uint16_t len) {
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cid, cid);
+  CHECK_EQ(msg.cmd, CTAPHID_PING);
+  CHECK_EQ(msg.len, len);
+  CHECK(memcmp(msg.data, payload, len) == 0);
+}
+
+static void expect_error(uint32_t cid, uint8_t error) {
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cid, cid);
+  CHECK_EQ(msg.cmd, CTAPHID_ERROR);
+  CHECK_EQ(msg.len, 1);
+  CHECK_EQ(msg.data[0], error);
+}
+
+static void ping(uint32_t cid, uint16_t len) {
+  fill(len, (uint8_t)cid);
+  ctaphid_host_send(cid, CTAPHID_PING, payload, len);
+  expect_ping(cid, len);
+}
+
+// Every message has been answered
+static void expect_quiet(void) { CHECK(!ctaphid_host_recv(&msg)); }
+
+// A full table evicts the channel idle the longest; the one reassembling a
+// request is never evicted
+static void test_eviction(void) {
+  uint32_t cids[FIDO2_MAX_CHANNELS];
+  ctaphid_host_attach();
+  for (int i = 0; i < FIDO2_MAX_CHANNELS; i++) {
+    cids[i] = ctaphid_host_init();
+    CHECK(cids[i] != 0 && cids[i] != FIDO2_BROADCAST_CHANNEL);
+    for (int j = 0; j < i; j++)
+      CHECK(cids[i] != cids[j]);
+    host_advance_us(1000);
+  }
+  // Use every channel but the first, newest last
+  for (int i = 1; i < FIDO2_MAX_CHANNELS; i++) {
+    ping(cids[i], 10);
+    host_advance_us(1000);
+  }
+
+  uint32_t extra = ctaphid_host_init();
+  ctaphid_host_send(cids[0], CTAPHID_PING, payload, 1);
+  expect_error(cids[0], CTAP1_ERR_INVALID_CHANNEL);
+  for (int i = 1; i < FIDO2_MAX_CHANNELS; i++) {
+    ping(cids[i], 1);
+    host_advance_us(1000);
+  }
+  ping(extra, 1);
+  host_advance_us(1000);
+
+  // cids[1] starts a request, then every other channel is heard from, so
+  // the busy channel becomes the least recently used one
+  fill(200, 1);
+  uint32_t n = ctaphid_host_frame(reports, cids[1], CTAPHID_PING, payload, 200);
+  ctaphid_host_report(reports[0]);
+  host_advance_us(1000);
+  for (int i = 2; i < FIDO2_MAX_CHANNELS; i++) {
+    ctaphid_host_send(cids[i], CTAPHID_WINK, NULL, 0);
+    expect_error(cids[i], CTAP1_ERR_CHANNEL_BUSY);
+    host_advance_us(1000);
+  }
+  ctaphid_host_send(extra, CTAPHID_WINK, NULL, 0);
+  expect_error(extra, CTAP1_ERR_CHANNEL_BUSY);
+
+  // Two more channels evict the two oldest idle ones
+  uint32_t a = ctaphid_host_init();
+  uint32_t b = ctaphid_host_init();
+  CHECK(a != cids[1] && b != cids[1]);
+  ctaphid_host_send(cids[2], CTAPHID_PING, payload, 1);
+  expect_error(cids[2], CTAP1_ERR_INVALID_CHANNEL);
+  ctaphid_host_send(cids[3], CTAPHID_PING, payload, 1);
+  expect_error(cids[3], CTAP1_ERR_INVALID_CHANNEL);
+  for (uint32_t i = 1; i < n; i++)
+    ctaphid_host_report(reports[i]);
+  expect_ping(cids[1], 200);
+  expect_quiet();
+}
+
+// While one channel reassembles, other channels get CHANNEL_BUSY, their
+// stray continuations are ignored and INIT is still answered; none of it
+// reaches the request in progress
+static void test_interleaved(void) {
+  ctaphid_host_attach();
+  uint32_t a = ctaphid_host_init();
+  uint32_t b = ctaphid_host_init();
+
+  fill(300, 0xA5);
+  uint32_t n = ctaphid_host_frame(reports, a, CTAPHID_PING, payload, 300);
+  CHECK_EQ(n, 6);
+  ctaphid_host_report(reports[0]);
+  ctaphid_host_report(reports[1]);
+
+  static uint8_t other[FIDO2_REPORT_SIZE];
+  static const uint8_t junk[100] = {0xEE};
+  static uint8_t b_reports[2][FIDO2_REPORT_SIZE];
+  CHECK_EQ(ctaphid_host_frame(b_reports, b, CTAPHID_PING, junk, sizeof(junk)),
+           2);
+  ctaphid_host_report(b_reports[0]);
+  expect_error(b, CTAP1_ERR_CHANNEL_BUSY);
+  ctaphid_host_report(b_reports[1]);
+  expect_quiet();
+
+  ctaphid_host_report(reports[2]);
+
+  // Resync on the other channel, and a brand new channel
+  static const uint8_t nonce[FIDO2_INIT_DATA_SIZE] = {9, 9, 9};
+  ctaphid_host_frame((uint8_t(*)[FIDO2_REPORT_SIZE])other, b, CTAPHID_INIT,
+                     nonce, sizeof(nonce));
+  ctaphid_host_report(other);
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cid, b);
+  CHECK_EQ(msg.cmd, CTAPHID_INIT);
+  CHECK(memcmp(msg.data, nonce, sizeof(nonce)) == 0);
+  uint32_t c = ctaphid_host_init();
+
+  // A continuation of the busy channel's sequence number on another CID
+  memcpy(other, reports[3], sizeof(other));
+  other[0] ^= 0x55;
+  ctaphid_host_report(other);
+  expect_quiet();
+
+  for (uint32_t i = 3; i < n; i++)
+    ctaphid_host_report(reports[i]);
+  expect_ping(a, 300);
+
+  ping(b, 100);
+  ping(c, 100);
+  expect_quiet();
+}
+
+// Broken reassembly frees the channel for everyone else
+static void test_broken_requests(void) {
+  ctaphid_host_attach();
+  uint32_t a = ctaphid_host_init();
+  uint32_t b = ctaphid_host_init();
+
+  fill(150, 3);
+  uint32_t n = ctaphid_host_frame(reports, a, CTAPHID_PING, payload, 150);
+  CHECK_EQ(n, 3);
+
+  // Sequence skipped
+  ctaphid_host_report(reports[0]);
+  ctaphid_host_report(reports[2]);
+  expect_error(a, CTAP1_ERR_INVALID_SEQUENCE);
+  ping(b, 20);
+
+  // A new request on the same channel before the last one completed
+  ctaphid_host_report(reports[0]);
+  ctaphid_host_send(a, CTAPHID_WINK, NULL, 0);
+  expect_error(a, CTAP1_ERR_INVALID_SEQUENCE);
+  ping(b, 20);
+
+  // Continuations stop: the transaction times out, from fido2_task
+  ctaphid_host_report(reports[0]);
+  ctaphid_host_report(reports[1]);
+  host_advance_us((FIDO2_TRANSACTION_TIMEOUT_MS - 1) * 1000ull);
+  ctaphid_host_poll();
+  ctaphid_host_send(b, CTAPHID_PING, payload, 1);
+  expect_error(b, CTAP1_ERR_CHANNEL_BUSY);
+  host_advance_us(1000);
+  ctaphid_host_poll();
+  expect_error(a, CTAP1_ERR_TIMEOUT);
+  ping(b, 20);
+  ping(a, 150);
+
+  // CANCEL drops the request being received, without a reply
+  ctaphid_host_report(reports[0]);
+  ctaphid_host_send(a, CTAPHID_CANCEL, NULL, 0);
+  expect_quiet();
+  ping(b, 20);
+  expect_quiet();
+}
+
+int main(void) {
+  test_eviction();
+  test_interleaved();
+  test_broken_requests();
+  printf("test_ctaphid_channels: ok\n");
+  return 0;
+}
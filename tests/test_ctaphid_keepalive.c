@@ -0,0 +1,184 @@
+// CTAPHID keepalives around Secure World calls: PROCESSING from the gateway
+// tick while a call blocks (secure_world_handler is wrapped to take time),
+// and UPNEEDED while a request waits for the user presence button, which
+// CANCEL and the user presence timeout both end.
+#include <stdio.h>
+#include <string.h>
+
+#include "ctap_client.h"
+#include "ctaphid_host.h"
+#include "fido2_applet.h"
+#include "flash_emu.h"
+#include "pico/time.h"
+#include "secure_gateway.h"
+#include "test_util.h"
+#include "usb_emu.h"
+
+int32_t __real_secure_world_handler(secure_gateway_func_id_t func_id,
+                                    uint8_t *in_data, uint16_t in_len,
+                                    uint8_t *out_data, uint16_t out_max_len);
+
+static uint64_t call_us; // Simulated duration of each Secure World call
+static int calls;
+
+// IN reports the host picked up while a call was running, and when; the
+// host keeps a read pending, so it gets them within a millisecond
+#define MAX_DURING 16
+static uint8_t during[MAX_DURING][FIDO2_REPORT_SIZE];
+static uint64_t during_us[MAX_DURING];
+static int during_count;
+
+int32_t __wrap_secure_world_handler(secure_gateway_func_id_t func_id,
+                                    uint8_t *in_data, uint16_t in_len,
+                                    uint8_t *out_data, uint16_t out_max_len) {
+  uint64_t start = host_time_us;
+  calls++;
+  for (uint64_t t = 0; t < call_us; t += 1000) {
+    host_advance_us(1000);
+    uint8_t report[FIDO2_REPORT_SIZE];
+    if (usb_emu_in(CTAPHID_HOST_EP_IN, report) == FIDO2_REPORT_SIZE) {
+      CHECK(during_count < MAX_DURING);
+      memcpy(during[during_count], report, sizeof(report));
+      during_us[during_count++] = host_time_us - start;
+    }
+  }
+  return __real_secure_world_handler(func_id, in_data, in_len, out_data,
+                                     out_max_len);
+}
+
+static ctaphid_msg_t msg;
+static uint8_t req[512];
+
+static const uint8_t get_info = 0x04;
+
+static uint32_t setup(void) {
+  flash_emu_reset();
+  call_us = 0;
+  secure_gateway_init();
+  ctaphid_host_attach();
+  host_gpio_set(FIDO2_TOUCH_PIN, true);
+  during_count = 0;
+  return ctaphid_host_init();
+}
+
+static void expect_keepalive(const uint8_t *report, uint32_t cid,
+                             uint8_t status) {
+  CHECK_EQ(((uint32_t)report[0] << 24 | (uint32_t)report[1] << 16 |
+            (uint32_t)report[2] << 8 | report[3]),
+           cid);
+  CHECK_EQ(report[4], CTAPHID_KEEPALIVE | CTAPHID_FRAME);
+  CHECK_EQ(report[6], 1);
+  CHECK_EQ(report[7], status);
+}
+
+static void expect_cbor(uint32_t cid, uint8_t status) {
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cid, cid);
+  CHECK_EQ(msg.cmd, CTAPHID_CBOR);
+  CHECK(msg.len >= 1);
+  CHECK_EQ(msg.data[0], status);
+}
+
+// One PROCESSING keepalive per interval of the call, each an interval after
+// the previous one: the endpoint is freed in interrupt context once the host
+// has read it, without waiting for the main loop
+static void expect_processing(uint32_t cid) {
+  int intervals = (int)(call_us / (FIDO2_KEEPALIVE_INTERVAL_MS * 1000ull));
+  CHECK(during_count >= intervals);
+  for (int i = 0; i < during_count; i++) {
+    expect_keepalive(during[i], cid, CTAP2_KEEPALIVE_STATUS_PROCESSING);
+    CHECK(during_us[i] >= (i + 1) * FIDO2_KEEPALIVE_INTERVAL_MS * 1000ull);
+  }
+}
+
+// The tick sends PROCESSING every interval of the call, also when the
+// request arrived behind a long queued response
+static void test_processing(void) {
+  uint32_t cid = setup();
+  call_us = 350000;
+  ctaphid_host_send(cid, CTAPHID_CBOR, &get_info, 1);
+  expect_cbor(cid, 0);
+  CHECK_EQ(during_count, 3);
+  expect_processing(cid);
+
+  call_us = 10 * FIDO2_KEEPALIVE_INTERVAL_MS * 1000ull;
+  during_count = 0;
+  ctaphid_host_send(cid, CTAPHID_CBOR, &get_info, 1);
+  expect_cbor(cid, 0);
+  expect_processing(cid);
+  call_us = 350000;
+
+  static uint8_t payload[FIDO2_MAX_MSG_SIZE];
+  memset(payload, 0x5A, sizeof(payload));
+  during_count = 0;
+  ctaphid_host_send(cid, CTAPHID_PING, payload, sizeof(payload));
+  ctaphid_host_send(cid, CTAPHID_CBOR, &get_info, 1);
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cmd, CTAPHID_PING);
+  CHECK_EQ(msg.len, sizeof(payload));
+  expect_cbor(cid, 0);
+  CHECK_EQ(during_count, 3);
+  expect_processing(cid);
+
+  // Quick calls get no keepalive
+  call_us = 0;
+  during_count = 0;
+  ctaphid_host_send(cid, CTAPHID_CBOR, &get_info, 1);
+  expect_cbor(cid, 0);
+  CHECK(!ctaphid_host_recv(&msg));
+}
+
+// Receives an UPNEEDED keepalive per interval for `ms`, each one after a
+// submission of the waiting request
+static void wait_for_user(uint32_t cid, uint32_t ms) {
+  int before = calls;
+  for (uint32_t t = 0; t < ms; t += FIDO2_KEEPALIVE_INTERVAL_MS) {
+    CHECK(ctaphid_host_recv(&msg));
+    CHECK_EQ(msg.cid, cid);
+    CHECK_EQ(msg.cmd, CTAPHID_KEEPALIVE);
+    CHECK_EQ(msg.data[0], CTAP2_KEEPALIVE_STATUS_UPNEEDED);
+    host_advance_us(FIDO2_KEEPALIVE_INTERVAL_MS * 1000ull);
+  }
+  CHECK_EQ(calls - before, ms / FIDO2_KEEPALIVE_INTERVAL_MS);
+}
+
+static void test_user_presence(void) {
+  uint32_t cid = setup();
+  uint16_t len = ctap_get_assertion_request(req, "example.com", NULL);
+
+  // Pressed after a while: the next submission goes through
+  ctaphid_host_send(cid, CTAPHID_CBOR, req, len);
+  wait_for_user(cid, 500);
+  host_gpio_set(FIDO2_TOUCH_PIN, false);
+  expect_cbor(cid, 0x2E); // CTAP2_ERR_NO_CREDENTIALS, past the UP check
+  host_gpio_set(FIDO2_TOUCH_PIN, true);
+  CHECK(!ctaphid_host_recv(&msg));
+
+  // Other channels are told the device is busy meanwhile; CANCEL ends it
+  uint32_t other = ctaphid_host_init();
+  ctaphid_host_send(cid, CTAPHID_CBOR, req, len);
+  wait_for_user(cid, 200);
+  ctaphid_host_send(other, CTAPHID_CBOR, &get_info, 1);
+  CHECK(ctaphid_host_recv(&msg));
+  CHECK_EQ(msg.cid, other);
+  CHECK_EQ(msg.cmd, CTAPHID_ERROR);
+  CHECK_EQ(msg.data[0], CTAP1_ERR_CHANNEL_BUSY);
+  ctaphid_host_send(cid, CTAPHID_CANCEL, NULL, 0);
+  expect_cbor(cid, 0x2D); // CTAP2_ERR_KEEPALIVE_CANCEL
+  CHECK(!ctaphid_host_recv(&msg));
+
+  // Nobody presses
+  ctaphid_host_send(cid, CTAPHID_CBOR, req, len);
+  wait_for_user(cid, FIDO2_UP_TIMEOUT_MS);
+  expect_cbor(cid, 0x2F); // CTAP2_ERR_USER_ACTION_TIMEOUT
+  CHECK(!ctaphid_host_recv(&msg));
+  ctaphid_host_send(other, CTAPHID_CBOR, &get_info, 1);
+  expect_cbor(other, 0);
+}
+
+int main(void) {
+  test_processing();
+  test_user_presence();
+  printf("test_ctaphid_keepalive: ok\n");
+  return 0;
+}
@@ -0,0 +1,58 @@
+// Ed25519 against the RFC 8032 section 7.1 vectors: public key from the
+// seed, and the signature, also with the signature written over the message
+#include <stdio.h>
+#include <string.h>
+
+#include "ed25519.h"
+#include "test_util.h"
+
+static const struct {
+  const char *seed, *public_key, *message, *signature;
+} vectors[] = {
+    {"9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+     "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+     "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+     "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b"},
+    {"4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+     "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+     "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+     "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00"},
+    {"c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+     "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+     "af82",
+     "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+     "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a"},
+};
+
+static size_t unhex(const char *hex, uint8_t *out) {
+  size_t n = 0;
+  for (; hex[0] && hex[1]; hex += 2) {
+    unsigned byte;
+    CHECK(sscanf(hex, "%2x", &byte) == 1);
+    out[n++] = (uint8_t)byte;
+  }
+  return n;
+}
+
+int main(void) {
+  for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+    uint8_t seed[32], public_key[32], message[64], expected[64];
+    uint8_t derived[32], signature[64];
+    CHECK_EQ(unhex(vectors[i].seed, seed), 32);
+    CHECK_EQ(unhex(vectors[i].public_key, public_key), 32);
+    size_t message_len = unhex(vectors[i].message, message);
+    CHECK_EQ(unhex(vectors[i].signature, expected), 64);
+
+    ed25519_public_key(derived, seed);
+    CHECK(memcmp(derived, public_key, 32) == 0);
+
+    ed25519_sign(signature, message, message_len, seed, public_key);
+    CHECK(memcmp(signature, expected, 64) == 0);
+
+    // In place: the message buffer receives the signature
+    ed25519_sign(message, message, message_len, seed, public_key);
+    CHECK(memcmp(message, expected, 64) == 0);
+  }
+  printf("test_ed25519: ok\n");
+  return 0;
+}
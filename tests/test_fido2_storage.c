@@ -0,0 +1,258 @@
+// FIDO2 discoverable credential store: a full store of credentials across
+// many RPs, replacement of a user's credential, the per-RP lookup cursor,
+// and the signature counter's leases, which keep assertions off the erase
+// path and values increasing across remounts
+#include <stdio.h>
+#include <string.h>
+
+#include "applet_manager.h"
+#include "ctap_client.h"
+#include "fido2_applet.h"
+#include "fido2_storage.h"
+#include "flash_emu.h"
+#include "hardware/flash.h"
+#include "security_manager.h"
+#include "sha256.h"
+#include "test_util.h"
+
+#define RPS 10
+#define USERS_PER_RP 12
+
+static void rp_hash(int rp, uint8_t *hash) {
+  memset(hash, 0, FIDO2_RP_ID_HASH_LEN);
+  hash[0] = 0xA0;
+  hash[1] = (uint8_t)rp;
+}
+
+// Credential ID and user handle both name (rp, user); `gen` tells
+// replacements apart
+static void make_cred(int rp, int user, uint8_t gen, fido2_credential_t *c) {
+  memset(c, 0, sizeof(*c));
+  c->credential_id[0] = (uint8_t)rp;
+  c->credential_id[1] = (uint8_t)user;
+  c->credential_id[2] = gen;
+  c->user_id_len = (uint8_t)snprintf((char *)c->user_id, FIDO2_USER_ID_MAX,
+                                     "user-%03d", user);
+}
+
+static bool put(int rp, int user, uint8_t gen) {
+  uint8_t hash[FIDO2_RP_ID_HASH_LEN];
+  fido2_credential_t cred;
+  rp_hash(rp, hash);
+  make_cred(rp, user, gen, &cred);
+  return fido2_storage_put(hash, &cred);
+}
+
+// Walks the RP's credentials with the cursor and records the generation of
+// each user's credential (0 if not found); returns how many it saw
+static int walk(int rp, uint8_t *gens) {
+  uint8_t hash[FIDO2_RP_ID_HASH_LEN];
+  fido2_credential_t cred;
+  uint32_t cursor = 0;
+  int seen = 0;
+  rp_hash(rp, hash);
+  memset(gens, 0, USERS_PER_RP + 1);
+  while (fido2_storage_find(hash, &cursor, &cred)) {
+    int user = cred.credential_id[1];
+    CHECK_EQ(cred.credential_id[0], rp);
+    CHECK(user <= USERS_PER_RP);
+    CHECK_EQ(gens[user], 0); // Each credential once
+    fido2_credential_t expected;
+    make_cred(rp, user, cred.credential_id[2], &expected);
+    CHECK(memcmp(&cred, &expected, sizeof(cred)) == 0);
+    gens[user] = cred.credential_id[2];
+    seen++;
+  }
+  return seen;
+}
+
+static uint32_t journal_erases(void) {
+  return flash_emu_erases_in(FIDO2_JOURNAL_OFFSET,
+                             FIDO2_JOURNAL_SECTORS * FLASH_SECTOR_SIZE);
+}
+
+// RPS * USERS_PER_RP credentials, each RP's found through the cursor, before
+// and after a remount; then the store fills up
+static void test_many_credentials(void) {
+  uint8_t gens[USERS_PER_RP + 1];
+  CHECK(RPS * USERS_PER_RP >= 100);
+  flash_emu_reset();
+  fido2_storage_init();
+  CHECK_EQ(fido2_storage_count(), 0);
+
+  flash_emu_clear_stats();
+  for (int user = 0; user < USERS_PER_RP; user++) {
+    for (int rp = 0; rp < RPS; rp++)
+      CHECK(put(rp, user, 1));
+  }
+  printf("%d puts: %u erases, %u programs\n", RPS * USERS_PER_RP,
+         flash_emu_stats.erases, flash_emu_stats.programs);
+  // A record spans at most two pages, and the only erases are of sectors
+  // the head moves into; nothing is compacted
+  CHECK(flash_emu_stats.programs <= 2 * RPS * USERS_PER_RP);
+  CHECK(flash_emu_stats.erases < FIDO2_JOURNAL_SECTORS);
+  CHECK_EQ(fido2_storage_count(), RPS * USERS_PER_RP);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int rp = 0; rp < RPS; rp++) {
+      CHECK_EQ(walk(rp, gens), USERS_PER_RP);
+      for (int user = 0; user < USERS_PER_RP; user++)
+        CHECK_EQ(gens[user], 1);
+    }
+    uint8_t hash[FIDO2_RP_ID_HASH_LEN];
+    fido2_credential_t cred;
+    uint32_t cursor = 0;
+    rp_hash(RPS, hash);
+    CHECK(!fido2_storage_find(hash, &cursor, &cred));
+    fido2_storage_init();
+    CHECK_EQ(fido2_storage_count(), RPS * USERS_PER_RP);
+  }
+
+  // Fill the store: a new credential is refused, a replacement is not
+  int extra = 0;
+  while (fido2_storage_count() < FIDO2_MAX_RESIDENT)
+    CHECK(put(RPS, extra++, 1));
+  CHECK(!put(RPS, extra, 1));
+  CHECK(put(0, 0, 2));
+  CHECK_EQ(fido2_storage_count(), FIDO2_MAX_RESIDENT);
+}
+
+// The same user registering again with an RP replaces their credential; a
+// new user, or the same user at another RP, adds one
+static void test_replace(void) {
+  uint8_t gens[USERS_PER_RP + 1];
+  flash_emu_reset();
+  fido2_storage_init();
+  CHECK(put(0, 1, 1));
+  CHECK(put(0, 2, 1));
+  CHECK(put(1, 1, 1));
+  CHECK_EQ(fido2_storage_count(), 3);
+
+  flash_emu_clear_stats();
+  CHECK(put(0, 1, 2));
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK_EQ(fido2_storage_count(), 3);
+  CHECK_EQ(walk(0, gens), 2);
+  CHECK_EQ(gens[1], 2);
+  CHECK_EQ(gens[2], 1);
+  CHECK_EQ(walk(1, gens), 1);
+  CHECK_EQ(gens[1], 1);
+
+  // The replaced record stays dead after a remount
+  fido2_storage_init();
+  CHECK_EQ(fido2_storage_count(), 3);
+  CHECK_EQ(walk(0, gens), 2);
+  CHECK_EQ(gens[1], 2);
+
+  // Churning one user's credential compacts the journal without losing the
+  // others
+  for (int gen = 3; gen < 250; gen++)
+    CHECK(put(0, 1, (uint8_t)gen));
+  CHECK(journal_erases() > 0);
+  CHECK_EQ(fido2_storage_count(), 3);
+  CHECK_EQ(walk(0, gens), 2);
+  CHECK_EQ(gens[1], 249);
+  CHECK_EQ(gens[2], 1);
+  fido2_storage_init();
+  CHECK_EQ(walk(1, gens), 1);
+}
+
+// Counter values increase strictly, one journal append per lease. A remount
+// gives up the rest of the current lease and continues above it.
+static void test_counter(void) {
+  uint32_t value, last = 0, lease = 0;
+  flash_emu_reset();
+  fido2_storage_init();
+
+  // The lease is the distance between two appends
+  flash_emu_clear_stats();
+  for (int i = 0; i < 200; i++) {
+    uint32_t programs = flash_emu_stats.programs;
+    CHECK(fido2_storage_next_counter(&value));
+    CHECK(value > last);
+    last = value;
+    if (flash_emu_stats.programs != programs && programs != 0 && lease == 0)
+      lease = value - 1;
+  }
+  CHECK(lease > 1);
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK_EQ(flash_emu_stats.programs, (200 + lease - 1) / lease);
+
+  // Mid-lease: the reserved values above `last` are skipped
+  CHECK(last % lease != 0);
+  fido2_storage_init();
+  CHECK(fido2_storage_next_counter(&value));
+  CHECK_EQ(value, (last / lease + 1) * lease + 1);
+  last = value;
+
+  // At a lease boundary nothing is skipped
+  while (last % lease != 0)
+    CHECK(fido2_storage_next_counter(&last));
+  fido2_storage_init();
+  CHECK(fido2_storage_next_counter(&value));
+  CHECK_EQ(value, last + 1);
+
+  // Many remounts, each costing a lease, still never repeat a value
+  for (int i = 0; i < 50; i++) {
+    last = value;
+    fido2_storage_init();
+    CHECK(fido2_storage_next_counter(&value));
+    CHECK(value > last);
+  }
+}
+
+// signCount in the authData of a GetAssertion response
+static uint32_t sign_count(const ctap_response_t *resp, const uint8_t *hash) {
+  for (uint16_t i = 0; i + 37 <= resp->len; i++) {
+    if (memcmp(resp->data + i, hash, 32) == 0) {
+      const uint8_t *c = resp->data + i + 33;
+      return ((uint32_t)c[0] << 24) | ((uint32_t)c[1] << 16) |
+             ((uint32_t)c[2] << 8) | c[3];
+    }
+  }
+  CHECK(!"authData not found");
+  return 0;
+}
+
+// Assertions with a discoverable credential never erase a sector, and their
+// sign counts keep increasing across a restart
+static void test_assertions(void) {
+  static const char rp_id[] = "example.com";
+  uint8_t hash[32];
+  SHA256_CTX sha;
+  SHA256Init(&sha);
+  SHA256Update(&sha, (const uint8_t *)rp_id, strlen(rp_id));
+  SHA256Final(&sha, hash);
+
+  ctap_response_t resp;
+  uint8_t cred_id[FIDO2_ID_LEN];
+  flash_emu_reset();
+  applet_manager_init();
+  CHECK_EQ(ctap_make_credential(rp_id, true, CTAP_COSE_ES256, cred_id, &resp),
+           0);
+  CHECK_EQ(fido2_storage_count(), 1);
+
+  uint32_t last = 0;
+  flash_emu_clear_stats();
+  for (int i = 0; i < 100; i++) {
+    if (i == 50)
+      fido2_applet_init();
+    CHECK_EQ(ctap_get_assertion(rp_id, NULL, &resp), 0);
+    uint32_t count = sign_count(&resp, hash);
+    CHECK(count > last);
+    last = count;
+  }
+  printf("100 assertions: %u erases, %u programs\n", flash_emu_stats.erases,
+         flash_emu_stats.programs);
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK(flash_emu_stats.programs < 10);
+}
+
+int main(void) {
+  test_many_credentials();
+  test_replace();
+  test_counter();
+  test_assertions();
+  printf("test_fido2_storage: ok\n");
+  return 0;
+}
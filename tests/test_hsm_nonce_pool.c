@@ -0,0 +1,201 @@
+// HSM ECDSA nonce pool: signatures take a precomputed nonce when one is
+// ready and fall back to a full signature otherwise, key changes empty the
+// pool, and the latency histograms tell the two paths apart. A failed key
+// generation leaves the slot it targeted alone.
+//
+// Both uECC signing entry points are wrapped at link time to count calls
+// and take a fixed simulated time; key generation to inject a failure.
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_emu.h"
+#include "hsm.h"
+#include "pico/time.h"
+#include "test_util.h"
+#include "uECC.h"
+
+#define POOLED_US 100
+#define UNPOOLED_US 3000
+
+int __real_uECC_sign(const uint8_t *private_key, const uint8_t *message_hash,
+                     unsigned hash_size, uint8_t *signature, uECC_Curve curve);
+int __real_uECC_sign_with_precomputed(const uint8_t *private_key,
+                                      const uint8_t *message_hash,
+                                      unsigned hash_size,
+                                      const uint8_t *k_inverse,
+                                      const uint8_t *r, uint8_t *signature,
+                                      uECC_Curve curve);
+
+int __real_uECC_make_key(uint8_t *public_key, uint8_t *private_key,
+                         uECC_Curve curve);
+
+static uint32_t full_signs, pooled_signs;
+static bool fail_make_key;
+
+int __wrap_uECC_make_key(uint8_t *public_key, uint8_t *private_key,
+                         uECC_Curve curve) {
+  if (fail_make_key) {
+    // Leave garbage behind, as an aborted generation could
+    memset(public_key, 0xEE, 64);
+    memset(private_key, 0xEE, 32);
+    return 0;
+  }
+  return __real_uECC_make_key(public_key, private_key, curve);
+}
+
+int __wrap_uECC_sign(const uint8_t *private_key, const uint8_t *message_hash,
+                     unsigned hash_size, uint8_t *signature, uECC_Curve curve) {
+  full_signs++;
+  host_advance_us(UNPOOLED_US);
+  return __real_uECC_sign(private_key, message_hash, hash_size, signature,
+                          curve);
+}
+
+int __wrap_uECC_sign_with_precomputed(const uint8_t *private_key,
+                                      const uint8_t *message_hash,
+                                      unsigned hash_size,
+                                      const uint8_t *k_inverse,
+                                      const uint8_t *r, uint8_t *signature,
+                                      uECC_Curve curve) {
+  pooled_signs++;
+  host_advance_us(POOLED_US);
+  return __real_uECC_sign_with_precomputed(private_key, message_hash,
+                                           hash_size, k_inverse, r, signature,
+                                           curve);
+}
+
+static void fill_pool(void) {
+  for (int i = 0; i < HSM_NONCE_POOL_SIZE + 2; i++)
+    hsm_poll();
+}
+
+// Signs with slot 0 and checks the signature. Returns true if it took a
+// pooled nonce.
+static bool sign(uint8_t *sig) {
+  uint8_t hash[32], pubkey[64];
+  uint16_t sig_len = 0, pubkey_len = 0;
+  uint32_t before = pooled_signs;
+  memset(hash, 0x5A, sizeof(hash));
+  full_signs = 0;
+  CHECK_EQ(hsm_sign(0, hash, sig, &sig_len), HSM_STATUS_OK);
+  CHECK_EQ(sig_len, 64);
+  CHECK_EQ(hsm_get_pubkey(0, pubkey, &pubkey_len), HSM_STATUS_OK);
+  CHECK_EQ(hsm_verify(pubkey, hash, sig), HSM_STATUS_OK);
+  bool pooled = pooled_signs != before;
+  CHECK_EQ(full_signs, pooled ? 0 : 1);
+  return pooled;
+}
+
+static void setup(void) {
+  flash_emu_reset();
+  hsm_init();
+  CHECK_EQ(hsm_generate_key(0, HSM_ALG_P256), HSM_STATUS_OK);
+  hsm_sign_stats_reset();
+}
+
+// The pool serves HSM_NONCE_POOL_SIZE signatures, each with its own nonce,
+// then signing falls back to computing k*G
+static void test_drain(void) {
+  uint8_t sigs[HSM_NONCE_POOL_SIZE][64], sig[64];
+  setup();
+  CHECK(!sign(sig));
+
+  fill_pool();
+  for (int i = 0; i < HSM_NONCE_POOL_SIZE; i++) {
+    CHECK(sign(sigs[i]));
+    for (int j = 0; j < i; j++)
+      CHECK(memcmp(sigs[i], sigs[j], 32) != 0);
+  }
+  CHECK(!sign(sig));
+}
+
+// Generating or deleting any key leaves no nonce behind
+static void test_key_changes_clear(void) {
+  uint8_t sig[64];
+  setup();
+  fill_pool();
+  CHECK_EQ(hsm_generate_key(1, HSM_ALG_P256), HSM_STATUS_OK);
+  CHECK(!sign(sig));
+
+  fill_pool();
+  CHECK_EQ(hsm_delete_key(1), HSM_STATUS_OK);
+  CHECK(!sign(sig));
+
+  fill_pool();
+  hsm_nonce_pool_clear();
+  CHECK(!sign(sig));
+}
+
+// The old key keeps signing, and is still the one in flash
+static void test_failed_generation(void) {
+  uint8_t before[64], after[64], sig[64];
+  uint16_t len;
+  setup();
+  CHECK_EQ(hsm_get_pubkey(0, before, &len), HSM_STATUS_OK);
+
+  fail_make_key = true;
+  CHECK_EQ(hsm_generate_key(0, HSM_ALG_P256), HSM_STATUS_ERROR);
+  fail_make_key = false;
+  CHECK_EQ(hsm_get_algorithm(0), HSM_ALG_P256);
+  CHECK_EQ(hsm_get_pubkey(0, after, &len), HSM_STATUS_OK);
+  CHECK(memcmp(before, after, sizeof(before)) == 0);
+  sign(sig);
+
+  hsm_init();
+  CHECK_EQ(hsm_get_pubkey(0, after, &len), HSM_STATUS_OK);
+  CHECK(memcmp(before, after, sizeof(before)) == 0);
+}
+
+static uint32_t total(const uint32_t *hist) {
+  uint32_t n = 0;
+  for (int b = 0; b < HSM_SIGN_BUCKETS; b++)
+    n += hist[b];
+  return n;
+}
+
+// Each path lands in its own histogram, in the log2 bucket of its latency
+static void test_stats(void) {
+  uint8_t sig[64];
+  hsm_sign_stats_t stats;
+  setup();
+  hsm_sign_stats_get(&stats);
+  CHECK_EQ(total(stats.pooled), 0);
+  CHECK_EQ(total(stats.unpooled), 0);
+  CHECK_EQ(hsm_sign_stats_percentile(stats.pooled, 50), 0);
+
+  fill_pool();
+  for (int i = 0; i < HSM_NONCE_POOL_SIZE; i++)
+    CHECK(sign(sig));
+  CHECK(!sign(sig));
+  CHECK(!sign(sig));
+
+  hsm_sign_stats_get(&stats);
+  CHECK_EQ(total(stats.pooled), HSM_NONCE_POOL_SIZE);
+  CHECK_EQ(total(stats.unpooled), 2);
+  CHECK_EQ(stats.pooled[6], HSM_NONCE_POOL_SIZE); // 100 us in [64, 128)
+  CHECK_EQ(stats.unpooled[11], 2);                // 3000 us in [2048, 4096)
+  CHECK_EQ(hsm_sign_stats_percentile(stats.pooled, 50), 128);
+  CHECK_EQ(hsm_sign_stats_percentile(stats.pooled, 99), 128);
+  CHECK_EQ(hsm_sign_stats_percentile(stats.unpooled, 99), 4096);
+
+  // Mixed: 8 fast and 2 slow, so p50 is fast and p99 is slow
+  uint32_t mixed[HSM_SIGN_BUCKETS] = {0};
+  mixed[6] = 8;
+  mixed[11] = 2;
+  CHECK_EQ(hsm_sign_stats_percentile(mixed, 50), 128);
+  CHECK_EQ(hsm_sign_stats_percentile(mixed, 80), 128);
+  CHECK_EQ(hsm_sign_stats_percentile(mixed, 99), 4096);
+
+  hsm_sign_stats_reset();
+  hsm_sign_stats_get(&stats);
+  CHECK_EQ(total(stats.pooled) + total(stats.unpooled), 0);
+}
+
+int main(void) {
+  test_drain();
+  test_key_changes_clear();
+  test_stats();
+  test_failed_generation();
+  printf("test_hsm_nonce_pool: ok\n");
+  return 0;
+}
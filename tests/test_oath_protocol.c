@@ -0,0 +1,198 @@
+// OATH APDU handling: CALCULATE / CALCULATE ALL responses and listing chunks,
+// and the self-test gate on every code path (APDUs and the HID keyboard)
+#include <stdio.h>
+#include <string.h>
+
+#include "apdu_protocol.h"
+#include "flash_emu.h"
+#include "hid_keyboard.h"
+#include "oath_compute.h"
+#include "oath_protocol.h"
+#include "oath_storage.h"
+#include "test_util.h"
+#include "time_sync.h"
+
+static const uint8_t secret[20] = "12345678901234567890";
+
+// The engine self-test, wrapped at link time so a failure can be injected
+bool __real_oath_compute_self_test(void);
+
+static bool fail_self_test;
+
+bool __wrap_oath_compute_self_test(void) {
+  return !fail_self_test && __real_oath_compute_self_test();
+}
+
+static uint8_t resp[1024];
+static uint16_t resp_len;
+
+static uint16_t sw(void) {
+  CHECK(resp_len >= 2);
+  return (uint16_t)((resp[resp_len - 2] << 8) | resp[resp_len - 1]);
+}
+
+// Sends a short APDU; `le` 0 leaves Le out
+static uint16_t send_apdu(uint8_t ins, uint8_t p1, const uint8_t *data,
+                          uint8_t lc, uint8_t le) {
+  uint8_t apdu[5 + 255 + 1] = {0x00, ins, p1, 0x00};
+  uint16_t len = 4;
+  if (lc) {
+    apdu[len++] = lc;
+    memcpy(apdu + len, data, lc);
+    len += lc;
+  }
+  if (le)
+    apdu[len++] = le;
+  oath_handle_apdu(apdu, len, resp, &resp_len);
+  return sw();
+}
+
+static uint16_t calculate(const char *name) {
+  uint8_t data[2 + OATH_MAX_NAME_LEN] = {OATH_TAG_NAME, (uint8_t)strlen(name)};
+  memcpy(data + 2, name, strlen(name));
+  return send_apdu(INS_CALCULATE, 0, data, (uint8_t)(2 + strlen(name)), 0);
+}
+
+// Finds the response TLV following the name TLV of `name` in a listing
+static const uint8_t *find_entry(const uint8_t *buf, uint16_t len,
+                                 const char *name) {
+  uint16_t off = 0;
+  while (off + 2 <= len) {
+    CHECK_EQ(buf[off], OATH_TAG_NAME);
+    uint8_t n_len = buf[off + 1];
+    uint16_t next = (uint16_t)(off + 2 + n_len);
+    CHECK(next + 2 <= len);
+    if (n_len == strlen(name) && memcmp(buf + off + 2, name, n_len) == 0)
+      return buf + next;
+    off = (uint16_t)(next + 2 + buf[next + 1]);
+  }
+  return NULL;
+}
+
+static uint32_t counter_of(const char *name) {
+  oath_credential_t cred;
+  CHECK(oath_storage_get(name, &cred));
+  return cred.counter;
+}
+
+static void setup(void) {
+  flash_emu_reset();
+  oath_init();
+  CHECK(oath_storage_put("totp", secret, sizeof(secret), OATH_TYPE_TOTP,
+                         OATH_ALGO_SHA1, 8, 30, 0));
+  CHECK(oath_storage_put("hotp", secret, sizeof(secret), OATH_TYPE_HOTP,
+                         OATH_ALGO_SHA1, 6, 0, 0));
+  CHECK(oath_storage_put("touch", secret, sizeof(secret), OATH_TYPE_TOTP,
+                         OATH_ALGO_SHA1, 8, 30, 1));
+  CHECK(oath_storage_commit());
+  // RFC 6238 T = 59 s
+  time_sync_set_timestamp(59);
+}
+
+// CALCULATE ALL only returns codes it may issue: HOTP and touch credentials
+// are flagged, and no HOTP counter moves
+static void test_calculate_all(void) {
+  setup();
+  CHECK_EQ(send_apdu(INS_CALCULATE_ALL, 0, NULL, 0, 0), SW_OK);
+  uint16_t body = (uint16_t)(resp_len - 2);
+
+  const uint8_t *tlv = find_entry(resp, body, "totp");
+  CHECK(tlv);
+  CHECK_EQ(tlv[0], OATH_TAG_TRUNCATED);
+  CHECK_EQ(tlv[1], 8);
+  CHECK(memcmp(tlv + 2, "94287082", 8) == 0);
+
+  tlv = find_entry(resp, body, "hotp");
+  CHECK(tlv);
+  CHECK_EQ(tlv[0], OATH_TAG_HOTP);
+  CHECK_EQ(tlv[1], 0);
+  CHECK_EQ(counter_of("hotp"), 0);
+
+  tlv = find_entry(resp, body, "touch");
+  CHECK(tlv);
+  CHECK_EQ(tlv[0], OATH_TAG_TOUCH);
+  CHECK_EQ(tlv[1], 0);
+
+  // The HOTP code comes from CALCULATE, which steps the counter first
+  CHECK_EQ(calculate("hotp"), SW_OK);
+  CHECK_EQ(resp[0], OATH_TAG_TRUNCATED);
+  CHECK(memcmp(resp + 2, "755224", 6) == 0);
+  CHECK_EQ(counter_of("hotp"), 1);
+  CHECK_EQ(calculate("hotp"), SW_OK);
+  CHECK(memcmp(resp + 2, "287082", 6) == 0);
+  CHECK_EQ(counter_of("hotp"), 2);
+}
+
+// An Le below the next entry gets 6Cxx with the entry length instead of an
+// oversized response, and the same command succeeds with that Le. Chunks
+// never split an entry.
+static void test_listing_le(void) {
+  setup();
+  uint8_t seen[64];
+  uint16_t seen_len = 0;
+  uint8_t ins = INS_CALCULATE_ALL;
+  uint8_t le = 4;
+  int wrong_le = 0;
+  for (;;) {
+    uint16_t status = send_apdu(ins, 0, NULL, 0, le);
+    if ((status & 0xFF00) == SW_WRONG_LE) {
+      CHECK_EQ(resp_len, 2);
+      CHECK((status & 0xFF) > le);
+      le = (uint8_t)(status & 0xFF);
+      wrong_le++;
+      continue;
+    }
+    CHECK(resp_len - 2 <= le);
+    CHECK(seen_len + resp_len - 2 <= sizeof(seen));
+    memcpy(seen + seen_len, resp, resp_len - 2);
+    seen_len = (uint16_t)(seen_len + resp_len - 2);
+    if (status == SW_OK)
+      break;
+    CHECK_EQ(status, SW_BYTES_REMAINING);
+    ins = INS_SEND_REMAINING;
+  }
+  CHECK(wrong_le >= 1);
+  CHECK(find_entry(seen, seen_len, "totp"));
+  CHECK(find_entry(seen, seen_len, "hotp"));
+  CHECK(find_entry(seen, seen_len, "touch"));
+
+  // No listing is pending after the last chunk
+  CHECK_EQ(send_apdu(INS_SEND_REMAINING, 0, NULL, 0, 0),
+           SW_CONDITIONS_NOT_SATISFIED);
+}
+
+// After a failed self-test no code goes out, but names still list
+static void test_self_test_failure(void) {
+  fail_self_test = true;
+  setup();
+  CHECK_EQ(calculate("totp"), SW_UNKNOWN);
+  CHECK_EQ(resp_len, 2);
+  CHECK_EQ(calculate("hotp"), SW_UNKNOWN);
+  CHECK_EQ(counter_of("hotp"), 0);
+  CHECK_EQ(send_apdu(INS_CALCULATE_ALL, 0, NULL, 0, 0), SW_UNKNOWN);
+  CHECK_EQ(resp_len, 2);
+  CHECK_EQ(send_apdu(INS_LIST, 0, NULL, 0, 0), SW_OK);
+  CHECK(find_entry(resp, (uint16_t)(resp_len - 2), "totp"));
+
+  // The HID keyboard neither types a code nor steps the counter
+  hid_keyboard_init();
+  hid_keyboard_set_mode(true);
+  while (strcmp(hid_keyboard_get_current_credential(), "hotp") != 0)
+    hid_keyboard_next_credential();
+  CHECK(!hid_keyboard_generate_code());
+  CHECK_EQ(counter_of("hotp"), 0);
+
+  fail_self_test = false;
+  setup();
+  CHECK_EQ(calculate("totp"), SW_OK);
+  CHECK(hid_keyboard_generate_code());
+  CHECK_EQ(counter_of("hotp"), 1);
+}
+
+int main(void) {
+  test_calculate_all();
+  test_listing_le();
+  test_self_test_failure();
+  printf("test_oath_protocol: ok\n");
+  return 0;
+}
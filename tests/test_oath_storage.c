@@ -0,0 +1,203 @@
+// OATH credential journal: flash wear per mutation and state across remounts
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_emu.h"
+#include "flash_journal.h"
+#include "hardware/flash.h"
+#include "oath_storage.h"
+#include "security.h"
+#include "security_manager.h"
+#include "test_util.h"
+
+static const uint8_t secret[20] = "12345678901234567890";
+
+static void put_totp(const char *name) {
+  CHECK(oath_storage_put(name, secret, sizeof(secret), OATH_TYPE_TOTP,
+                         OATH_ALGO_SHA1, 6, 30, 0));
+}
+
+static uint32_t journal_erases(void) {
+  return flash_emu_erases_in(OATH_JOURNAL_OFFSET,
+                             OATH_JOURNAL_SECTORS * FLASH_SECTOR_SIZE);
+}
+
+// A single put or delete is one small append: no erase, a page or two
+static void test_mutation_cost(void) {
+  char name[16];
+  for (int i = 0; i < 16; i++) {
+    snprintf(name, sizeof(name), "acct%d", i);
+    put_totp(name);
+  }
+  CHECK(oath_storage_commit());
+
+  flash_emu_clear_stats();
+  put_totp("one-more");
+  CHECK(oath_storage_commit());
+  printf("put:    %u erases, %u programs, %u pages\n", flash_emu_stats.erases,
+         flash_emu_stats.programs, flash_emu_stats.pages);
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK(flash_emu_stats.pages <= 2);
+
+  flash_emu_clear_stats();
+  CHECK(oath_storage_delete("acct3"));
+  CHECK(oath_storage_commit());
+  printf("delete: %u erases, %u programs, %u pages\n", flash_emu_stats.erases,
+         flash_emu_stats.programs, flash_emu_stats.pages);
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK(flash_emu_stats.pages <= 1);
+  CHECK_EQ(flash_emu_stats.unaligned, 0);
+}
+
+// HOTP +1 clears bits in a counter cell and never touches the journal
+static void test_counter_cost(void) {
+  CHECK(oath_storage_put("hotp", secret, sizeof(secret), OATH_TYPE_HOTP,
+                         OATH_ALGO_SHA1, 6, 0, 0));
+  CHECK(oath_storage_commit());
+
+  flash_emu_clear_stats();
+  for (uint32_t c = 1; c <= 100; c++)
+    CHECK(oath_storage_update_counter("hotp", c));
+  printf("100 HOTP steps: %u erases, %u programs\n", flash_emu_stats.erases,
+         flash_emu_stats.programs);
+  CHECK_EQ(flash_emu_stats.erases, 0);
+  CHECK_EQ(flash_emu_stats.programs, 100);
+  CHECK_EQ(journal_erases(), 0);
+
+  oath_credential_t cred;
+  CHECK(oath_storage_get("hotp", &cred));
+  CHECK_EQ(cred.counter, 100);
+}
+
+// Sustained churn wraps the ring; erases stay a small fraction of mutations
+// and are spread across the sectors
+static void test_churn(void) {
+  flash_emu_clear_stats();
+  const int rounds = 3000;
+  char name[16];
+  for (int i = 0; i < rounds; i++) {
+    snprintf(name, sizeof(name), "acct%d", i % 16);
+    oath_storage_delete(name);
+    put_totp(name);
+    CHECK(oath_storage_commit());
+  }
+  uint32_t erases = journal_erases();
+  uint32_t worst = 0;
+  for (uint32_t s = 0; s < OATH_JOURNAL_SECTORS; s++) {
+    uint32_t e = flash_emu_erases_in(
+        OATH_JOURNAL_OFFSET + s * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    if (e > worst)
+      worst = e;
+  }
+  printf("%d rewrites: %u journal erases, busiest sector %u\n", rounds * 2,
+         erases, worst);
+  CHECK(erases > 0);
+  CHECK(erases * 20 < (uint32_t)rounds);
+  CHECK(worst <= erases / OATH_JOURNAL_SECTORS + 2);
+}
+
+// A backup round-trips; a damaged one is rejected before flash is touched
+static void test_export_import(void) {
+  static uint8_t backup[16384];
+  uint16_t len = sizeof(backup);
+  CHECK(oath_storage_commit());
+  CHECK(oath_storage_export(backup, &len));
+
+  // Flip a ciphertext byte of the second record
+  uint32_t off = OATH_EXPORT_HEADER_LEN;
+  off += 2 + (backup[off] | (backup[off + 1] << 8));
+  uint16_t rec_len = (uint16_t)(backup[off] | (backup[off + 1] << 8));
+  uint32_t victim = off + 2 + sizeof(oath_record_header_t) + 3;
+  CHECK(victim < off + 2 + rec_len);
+  backup[victim] ^= 0x40;
+
+  flash_emu_clear_stats();
+  CHECK(!oath_storage_import(backup, len));
+  CHECK_EQ(flash_emu_stats.erases + flash_emu_stats.programs, 0);
+
+  // Declared length running past the end of the stream
+  backup[victim] ^= 0x40;
+  uint16_t short_len = (uint16_t)(off + 2 + rec_len - 1);
+  CHECK(!oath_storage_import(backup, short_len));
+  CHECK_EQ(flash_emu_stats.erases + flash_emu_stats.programs, 0);
+
+  CHECK(oath_storage_import(backup, len));
+  oath_credential_t cred;
+  CHECK(oath_storage_get("hotp", &cred));
+  CHECK_EQ(cred.counter, 100);
+  CHECK(oath_storage_get("acct7", &cred));
+}
+
+// Everything committed survives a remount (reboot)
+static void test_remount(void) {
+  CHECK(oath_storage_set_password((const uint8_t *)"pw", 2));
+  CHECK(oath_storage_commit());
+
+  oath_storage_init();
+  oath_credential_t cred;
+  CHECK(oath_storage_get("acct7", &cred));
+  CHECK_EQ(cred.secret_len, sizeof(secret));
+  CHECK(memcmp(cred.secret, secret, sizeof(secret)) == 0);
+  CHECK(oath_storage_get("one-more", &cred));
+  CHECK(oath_storage_get("hotp", &cred));
+  CHECK_EQ(cred.counter, 100);
+  CHECK(oath_storage_is_password_set());
+  CHECK(oath_storage_verify_password((const uint8_t *)"pw", 2));
+
+  oath_storage_reset();
+  oath_storage_init();
+  CHECK(!oath_storage_get("acct7", &cred));
+  CHECK(!oath_storage_is_password_set());
+}
+
+// The plaintext header is bound to the ciphertext: a record moved to
+// another name tag or counter cell fails to authenticate
+static void test_header_authenticated(void) {
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  CHECK(gcm != NULL);
+
+  oath_credential_t cred, out;
+  memset(&cred, 0, sizeof(cred));
+  strcpy(cred.name, "bound");
+  memcpy(cred.secret, secret, sizeof(secret));
+  cred.secret_len = sizeof(secret);
+  cred.type = OATH_TYPE_HOTP;
+  cred.algorithm = OATH_ALGO_SHA1;
+  cred.digits = 6;
+
+  uint8_t record[OATH_RECORD_MAX_LEN];
+  oath_record_header_t *hdr = (oath_record_header_t *)record;
+  memset(hdr, 0, sizeof(*hdr));
+  memset(hdr->name_tag, 0xA5, sizeof(hdr->name_tag));
+  hdr->counter_cell = 3;
+  hdr->counter_anchor = 17;
+  uint16_t len;
+  CHECK(encrypt_credential(gcm, &cred, record, &len));
+  CHECK(decrypt_credential(gcm, record, len, &out));
+  CHECK(strcmp(out.name, "bound") == 0);
+
+  hdr->counter_anchor = 16;
+  CHECK(!decrypt_credential(gcm, record, len, &out));
+  hdr->counter_anchor = 17;
+  hdr->counter_cell = 4;
+  CHECK(!decrypt_credential(gcm, record, len, &out));
+  hdr->counter_cell = 3;
+  hdr->name_tag[0] ^= 1;
+  CHECK(!decrypt_credential(gcm, record, len, &out));
+  hdr->name_tag[0] ^= 1;
+  CHECK(decrypt_credential(gcm, record, len, &out));
+}
+
+int main(void) {
+  flash_emu_reset();
+  oath_storage_init();
+
+  test_header_authenticated();
+  test_mutation_cost();
+  test_counter_cost();
+  test_churn();
+  test_export_import();
+  test_remount();
+  printf("test_oath_storage: OK\n");
+  return 0;
+}
@@ -0,0 +1,206 @@
+// OpenPGP applet: PW1 and PW3 checked against their stored digests with
+// persistent retry counters, GENERATE and PSO:CDS refused without them,
+// and the applet record kept in its own flash sector, apart from the HSM
+#include <stdio.h>
+#include <string.h>
+
+#include "aes_gcm.h"
+#include "apdu_protocol.h"
+#include "ed25519.h"
+#include "flash_emu.h"
+#include "hardware/flash.h"
+#include "hsm.h"
+#include "iso7816_4.h"
+#include "openpgp_applet.h"
+#include "openpgp_storage.h"
+#include "security.h"
+#include "test_util.h"
+
+#define INS_VERIFY 0x20
+#define INS_PSO 0x2A
+#define INS_GENERATE_KEY 0x47
+#define INS_GET_DATA 0xCA
+
+static const uint8_t crt_sig[] = {0xB6, 0x00};
+
+static uint8_t resp[1024];
+static uint16_t resp_len;
+
+static uint16_t send_apdu(uint8_t ins, uint8_t p1, uint8_t p2,
+                          const void *data, uint8_t lc) {
+  uint8_t apdu[5 + 255] = {0x00, ins, p1, p2};
+  uint16_t len = 4;
+  if (lc) {
+    apdu[len++] = lc;
+    memcpy(apdu + len, data, lc);
+    len += lc;
+  }
+  openpgp_applet_handle_apdu(apdu, len, resp, &resp_len);
+  CHECK(resp_len >= 2);
+  return (uint16_t)((resp[resp_len - 2] << 8) | resp[resp_len - 1]);
+}
+
+static uint16_t verify(uint8_t pw, const char *pin) {
+  return send_apdu(INS_VERIFY, 0x00, pw, pin, (uint8_t)strlen(pin));
+}
+
+static uint16_t select_applet(void) {
+  return send_apdu(INS_SELECT, 0x04, 0x00, OPENPGP_AID, OPENPGP_AID_LEN);
+}
+
+// Retry counters from the PW status bytes: PW1, PW3
+static void retries(uint8_t *pw1, uint8_t *pw3) {
+  CHECK_EQ(send_apdu(INS_GET_DATA, 0x00, 0xC4, NULL, 0), SW_OK);
+  CHECK_EQ(resp_len, 7 + 2);
+  *pw1 = resp[4];
+  *pw3 = resp[6];
+}
+
+static void setup(void) {
+  flash_emu_reset();
+  hsm_init();
+  openpgp_applet_init();
+  CHECK_EQ(select_applet(), SW_OK);
+}
+
+// A wrong PIN costs a try, the right one restores them; PW1 (81) allows a
+// single signature, PW1 (82) none
+static void test_pins(void) {
+  uint8_t pw1, pw3;
+  setup();
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x80, 0x00, crt_sig, 2),
+           SW_SECURITY_STATUS_NOT_SAT);
+
+  CHECK_EQ(verify(0x83, "87654321"), SW_VERIFY_FAILED | 2);
+  CHECK_EQ(send_apdu(INS_VERIFY, 0x00, 0x83, NULL, 0), SW_VERIFY_FAILED | 2);
+  CHECK_EQ(verify(0x83, "123456"), SW_VERIFY_FAILED | 1); // Too short
+  retries(&pw1, &pw3);
+  CHECK_EQ(pw1, 3);
+  CHECK_EQ(pw3, 1);
+  CHECK_EQ(verify(0x83, OPENPGP_PW3_DEFAULT), SW_OK);
+  CHECK_EQ(send_apdu(INS_VERIFY, 0x00, 0x83, NULL, 0), SW_OK);
+  retries(&pw1, &pw3);
+  CHECK_EQ(pw3, 3);
+
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x80, 0x00, crt_sig, 2), SW_OK);
+  CHECK_EQ(resp_len, 5 + 32 + 2);
+
+  static const char message[] = "OpenPGP hash";
+  CHECK_EQ(send_apdu(INS_PSO, 0x9E, 0x9A, message, sizeof(message)),
+           SW_SECURITY_STATUS_NOT_SAT);
+  CHECK_EQ(verify(0x82, OPENPGP_PW1_DEFAULT), SW_OK);
+  CHECK_EQ(send_apdu(INS_PSO, 0x9E, 0x9A, message, sizeof(message)),
+           SW_SECURITY_STATUS_NOT_SAT);
+
+  CHECK_EQ(verify(0x81, OPENPGP_PW1_DEFAULT), SW_OK);
+  CHECK_EQ(send_apdu(INS_PSO, 0x9E, 0x9A, message, sizeof(message)), SW_OK);
+  CHECK_EQ(resp_len, 64 + 2);
+  const openpgp_data_t *pgp = openpgp_storage_get_data();
+  uint8_t expected[64];
+  ed25519_sign(expected, (const uint8_t *)message, sizeof(message),
+               pgp->sig_private_key, pgp->sig_public_key);
+  CHECK(memcmp(resp, expected, sizeof(expected)) == 0);
+  CHECK_EQ(send_apdu(INS_PSO, 0x9E, 0x9A, message, sizeof(message)),
+           SW_SECURITY_STATUS_NOT_SAT);
+
+  // Logging PW3 out, or selecting again, drops it
+  CHECK_EQ(send_apdu(INS_VERIFY, 0xFF, 0x83, NULL, 0), SW_OK);
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x80, 0x00, crt_sig, 2),
+           SW_SECURITY_STATUS_NOT_SAT);
+  CHECK_EQ(verify(0x83, OPENPGP_PW3_DEFAULT), SW_OK);
+  CHECK_EQ(select_applet(), SW_OK);
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x80, 0x00, crt_sig, 2),
+           SW_SECURITY_STATUS_NOT_SAT);
+
+  CHECK_EQ(send_apdu(INS_VERIFY, 0x00, 0x84, NULL, 0), SW_INCORRECT_P1P2);
+}
+
+// Three wrong PINs block PW1 for good, across a restart
+static void test_blocked(void) {
+  uint8_t pw1, pw3;
+  setup();
+  CHECK_EQ(verify(0x81, "000000"), SW_VERIFY_FAILED | 2);
+  CHECK_EQ(verify(0x82, "000000"), SW_VERIFY_FAILED | 1);
+  CHECK_EQ(verify(0x81, "000000"), SW_AUTH_METHOD_BLOCKED);
+  CHECK_EQ(verify(0x81, OPENPGP_PW1_DEFAULT), SW_AUTH_METHOD_BLOCKED);
+
+  openpgp_applet_init();
+  CHECK_EQ(select_applet(), SW_OK);
+  CHECK_EQ(verify(0x82, OPENPGP_PW1_DEFAULT), SW_AUTH_METHOD_BLOCKED);
+  CHECK_EQ(send_apdu(INS_VERIFY, 0x00, 0x81, NULL, 0), SW_AUTH_METHOD_BLOCKED);
+  retries(&pw1, &pw3);
+  CHECK_EQ(pw1, 0);
+  CHECK_EQ(pw3, 3);
+  CHECK_EQ(verify(0x83, OPENPGP_PW3_DEFAULT), SW_OK);
+}
+
+// OpenPGP and HSM saves no longer overwrite each other
+static void test_flash_layout(void) {
+  uint8_t pgp_key[32], hsm_key[64], reloaded[64];
+  uint16_t len;
+  setup();
+  CHECK(OPENPGP_FLASH_OFFSET != HSM_FLASH_OFFSET);
+
+  CHECK_EQ(verify(0x83, OPENPGP_PW3_DEFAULT), SW_OK);
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x80, 0x00, crt_sig, 2), SW_OK);
+  memcpy(pgp_key, resp + 5, sizeof(pgp_key));
+  CHECK_EQ(hsm_generate_key(0, HSM_ALG_P256), HSM_STATUS_OK);
+  CHECK_EQ(hsm_get_pubkey(0, hsm_key, &len), HSM_STATUS_OK);
+  CHECK_EQ(verify(0x81, "999999"), SW_VERIFY_FAILED | 2); // Saves again
+
+  hsm_init();
+  openpgp_applet_init();
+  CHECK_EQ(select_applet(), SW_OK);
+  CHECK_EQ(hsm_get_pubkey(0, reloaded, &len), HSM_STATUS_OK);
+  CHECK(memcmp(reloaded, hsm_key, sizeof(hsm_key)) == 0);
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x81, 0x00, crt_sig, 2), SW_OK);
+  CHECK(memcmp(resp + 5, pgp_key, sizeof(pgp_key)) == 0);
+}
+
+// A "PGP4" record left in the old, shared sector moves to the new one and
+// gets the factory PINs
+static void test_legacy_record(void) {
+  struct {
+    uint32_t magic;
+    uint8_t iv[12];
+    uint8_t tag[16];
+    uint8_t encrypted_data[offsetof(openpgp_data_t, pw1_digest)];
+  } record = {.magic = 0x50475034, .iv = {1, 2, 3}};
+  openpgp_data_t data;
+  memset(&data, 0, sizeof(data));
+  strcpy(data.name, "Legacy User");
+  data.sig_algorithm = HSM_ALG_ED25519;
+  memset(data.sig_public_key, 0x42, sizeof(data.sig_public_key));
+
+  flash_emu_reset();
+  const aes_gcm_ctx_t *gcm = security_get_storage_ctx();
+  CHECK(gcm);
+  CHECK(aes_gcm_ctx_encrypt(gcm, record.iv, NULL, 0, (const uint8_t *)&data,
+                            sizeof(record.encrypted_data),
+                            record.encrypted_data, record.tag));
+  flash_range_program(OPENPGP_LEGACY_FLASH_OFFSET, (const uint8_t *)&record,
+                      (sizeof(record) + FLASH_PAGE_SIZE - 1) /
+                          FLASH_PAGE_SIZE * FLASH_PAGE_SIZE);
+
+  openpgp_applet_init();
+  CHECK_EQ(select_applet(), SW_OK);
+  CHECK_EQ(send_apdu(INS_GET_DATA, 0x00, 0x5E, NULL, 0), SW_OK);
+  CHECK_EQ(resp_len, strlen("Legacy User") + 2);
+  CHECK(memcmp(resp, "Legacy User", strlen("Legacy User")) == 0);
+  CHECK_EQ(send_apdu(INS_GENERATE_KEY, 0x81, 0x00, crt_sig, 2), SW_OK);
+  CHECK_EQ(resp[5], 0x42);
+  CHECK_EQ(verify(0x81, OPENPGP_PW1_DEFAULT), SW_OK);
+
+  const uint32_t *moved =
+      (const uint32_t *)(flash_emu_mem + OPENPGP_FLASH_OFFSET);
+  CHECK_EQ(*moved, 0x50475035);
+}
+
+int main(void) {
+  test_pins();
+  test_blocked();
+  test_flash_layout();
+  test_legacy_record();
+  printf("test_openpgp_applet: ok\n");
+  return 0;
+}
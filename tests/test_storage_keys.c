@@ -0,0 +1,102 @@
+// Keys derived from the master key are dropped with it: after a master key
+// change nothing derived from the old key is still usable
+#include <string.h>
+
+#include "applet_manager.h"
+#include "ctap_client.h"
+#include "fido2_applet.h"
+#include "flash_emu.h"
+#include "hardware/flash.h"
+#include "hmac.h"
+#include "oath_storage.h"
+#include "security.h"
+#include "security_manager.h"
+#include "test_util.h"
+
+static const uint8_t secret[20] = "12345678901234567890";
+
+// Provisions a fresh master key, as a device with a replaced OTP would
+static void rotate_master_key(void) {
+  flash_range_erase(SIMULATED_OTP_BASE_ADDR, FLASH_SECTOR_SIZE);
+  security_wipe_storage_keys();
+}
+
+// Bytes a precompute does not write must not depend on what was there
+static void test_midstates_deterministic(void) {
+  static const uint8_t key[20] = "precompute-key";
+  hmac_midstate_t a, b;
+
+  memset(&a, 0x00, sizeof(a));
+  memset(&b, 0xAA, sizeof(b));
+  hmac_sha1_precompute(key, sizeof(key), &a);
+  hmac_sha1_precompute(key, sizeof(key), &b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+
+  memset(&b, 0xAA, sizeof(b));
+  hmac_sha256_precompute(key, sizeof(key), &a);
+  hmac_sha256_precompute(key, sizeof(key), &b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+
+  memset(&b, 0xAA, sizeof(b));
+  hmac_sha512_precompute(key, sizeof(key), &a);
+  hmac_sha512_precompute(key, sizeof(key), &b);
+  CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+}
+
+// Name tag of `name` as it appears in an export
+static void exported_tag(const char *name, uint8_t *tag) {
+  static uint8_t backup[4096];
+  uint16_t len = sizeof(backup);
+  oath_storage_reset();
+  oath_storage_init();
+  CHECK(oath_storage_put(name, secret, sizeof(secret), OATH_TYPE_TOTP,
+                         OATH_ALGO_SHA1, 6, 30, 0));
+  CHECK(oath_storage_export(backup, &len));
+  CHECK(len > OATH_EXPORT_HEADER_LEN + 2 + OATH_NAME_TAG_LEN);
+  memcpy(tag, backup + OATH_EXPORT_HEADER_LEN + 2, OATH_NAME_TAG_LEN);
+}
+
+static void test_oath_name_index(void) {
+  uint8_t before[OATH_NAME_TAG_LEN], again[OATH_NAME_TAG_LEN];
+  uint8_t after[OATH_NAME_TAG_LEN];
+  exported_tag("alice@example.com", before);
+  exported_tag("alice@example.com", again);
+  CHECK(memcmp(before, again, sizeof(before)) == 0);
+
+  rotate_master_key();
+  exported_tag("alice@example.com", after);
+  CHECK(memcmp(before, after, sizeof(before)) != 0);
+}
+
+static void test_fido2_keys(void) {
+  ctap_response_t resp;
+  uint8_t cred_id[FIDO2_ID_LEN];
+
+  applet_manager_init();
+  CHECK_EQ(ctap_make_credential("example.com", true, CTAP_COSE_ES256, cred_id,
+                                &resp),
+           0);
+  CHECK_EQ(ctap_get_assertion("example.com", cred_id, &resp), 0);
+  CHECK_EQ(ctap_get_assertion("example.com", NULL, &resp), 0);
+
+  // The wrapping key and RP index key belong to the old master key
+  rotate_master_key();
+  CHECK(ctap_get_assertion("example.com", cred_id, &resp) != 0);
+  CHECK(ctap_get_assertion("example.com", NULL, &resp) != 0);
+
+  // New credentials work under the new key
+  CHECK_EQ(ctap_make_credential("example.com", false, CTAP_COSE_ES256,
+                                cred_id, &resp),
+           0);
+  CHECK_EQ(ctap_get_assertion("example.com", cred_id, &resp), 0);
+}
+
+int main(void) {
+  flash_emu_reset();
+  oath_storage_init();
+
+  test_midstates_deterministic();
+  test_oath_name_index();
+  test_fido2_keys();
+  return 0;
+}
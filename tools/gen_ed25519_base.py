@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Generates secure_world/src/crypto/ed25519_base_table.inc, the fixed-base
+table used by ed25519.c for scalar multiplication by the Ed25519 base point B.
+
+Entry [i][j] is (j + 1) * 256^i * B for 0 <= i < 32 and 0 <= j < 8, stored
+as (y + x, y - x, 2 * d * x * y) mod p. Each coordinate is packed into eight
+little-endian 32-bit words, 96 bytes per entry, and unpacked into the
+radix 2^25.5 representation after the constant-time selection.
+
+Usage:
+    python3 tools/gen_ed25519_base.py > secure_world/src/crypto/ed25519_base_table.inc
+"""
+
+P = 2**255 - 19
+D = -121665 * pow(121666, -1, P) % P
+BY = 4 * pow(5, -1, P) % P
+
+
+def recover_x(y):
+    xx = (y * y - 1) * pow(D * y * y + 1, -1, P) % P
+    x = pow(xx, (P + 3) // 8, P)
+    if (x * x - xx) % P:
+        x = x * pow(2, (P - 1) // 4, P) % P
+    if x & 1:
+        x = P - x
+    return x
+
+
+def add(p1, p2):
+    (x1, y1), (x2, y2) = p1, p2
+    t = D * x1 * x2 * y1 * y2 % P
+    x3 = (x1 * y2 + x2 * y1) * pow(1 + t, -1, P) % P
+    y3 = (y1 * y2 + x1 * x2) * pow(1 - t, -1, P) % P
+    return (x3, y3)
+
+
+def words(value):
+    return ["0x%08x" % (value >> (32 * i) & 0xFFFFFFFF) for i in range(8)]
+
+
+def main():
+    base = (recover_x(BY), BY)
+
+    print("/* Generated by tools/gen_ed25519_base.py - do not edit. */")
+    print()
+    print("/* [i][j] = (j + 1) * 256^i * B as (y + x, y - x, 2dxy), each as")
+    print("   eight little-endian words. */")
+    print("static const uint32_t ed25519_base[32][8][24] = {")
+    row = base
+    for i in range(32):
+        print("  {")
+        point = row
+        for j in range(8):
+            x, y = point
+            values = words((y + x) % P) + words((y - x) % P) + \
+                words(2 * D * x * y % P)
+            lines = []
+            for k in range(0, 24, 6):
+                lines.append(", ".join(values[k:k + 6]))
+            print("    {" + ",\n     ".join(lines) + "}" +
+                  ("," if j < 7 else ""))
+            point = add(point, row)
+        print("  }" + ("," if i < 31 else ""))
+        for _ in range(8):
+            row = add(row, row)
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Generates secure_world/src/crypto/p256_comb_table.inc, the fixed-base comb
+table used by p256_comb.inc for secp256r1 scalar multiplication by G.
+
+With comb width W and D = ceil(256 / W) columns, entry j (0 <= j < 2^W) is
+
+    T[j] = sum(bit b of j * 2^(b * D) for b < W) * G + R
+
+where R is a fixed offset point. Folding R into every entry means no entry
+is the point at infinity, so each comb step is one doubling and one mixed
+addition of real points. After D steps the result carries (2^D - 1) * R,
+which is removed with the last entry, -(2^D - 1) * R.
+
+Usage:
+    python3 tools/gen_p256_comb.py > secure_world/src/crypto/p256_comb_table.inc
+"""
+import hashlib
+
+P = 0xFFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF
+N = 0xFFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632551
+A = P - 3
+GX = 0x6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296
+GY = 0x4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5
+
+W = 5
+D = (256 + W - 1) // W
+
+
+def add(p1, p2):
+    if p1 is None:
+        return p2
+    if p2 is None:
+        return p1
+    (x1, y1), (x2, y2) = p1, p2
+    if x1 == x2:
+        if (y1 + y2) % P == 0:
+            return None
+        lam = (3 * x1 * x1 + A) * pow(2 * y1, -1, P) % P
+    else:
+        lam = (y2 - y1) * pow(x2 - x1, -1, P) % P
+    x3 = (lam * lam - x1 - x2) % P
+    return (x3, (lam * (x1 - x3) - y1) % P)
+
+
+def mul(k, point):
+    result = None
+    while k:
+        if k & 1:
+            result = add(result, point)
+        point = add(point, point)
+        k >>= 1
+    return result
+
+
+def words(value):
+    # Little-endian bytes in the BYTES_TO_WORDS_8 layout of curve-specific.inc
+    data = value.to_bytes(32, "little")
+    groups = []
+    for i in range(0, 32, 8):
+        groups.append("BYTES_TO_WORDS_8(%s)" %
+                      ", ".join("%02X" % b for b in data[i:i + 8]))
+    return groups
+
+
+def emit_point(point, last):
+    lines = ["    { { " + ",\n          ".join(words(point[0])) + " },",
+             "      { " + ",\n          ".join(words(point[1])) + " } }" +
+             ("" if last else ",")]
+    return "\n".join(lines)
+
+
+def main():
+    g = (GX, GY)
+    r = int.from_bytes(hashlib.sha256(b"RP2350 P-256 comb offset").digest(),
+                       "big") % N
+    offset = mul(r, g)
+
+    entries = []
+    for j in range(1 << W):
+        k = sum(1 << (b * D) for b in range(W) if j >> b & 1)
+        entries.append(add(mul(k, g) if k else None, offset))
+    total = mul((1 << D) - 1, offset)
+    entries.append((total[0], (P - total[1]) % P))
+
+    print("/* Generated by tools/gen_p256_comb.py - do not edit. */")
+    print()
+    print("#define P256_COMB_WIDTH %d" % W)
+    print("#define P256_COMB_COLUMNS %d" % D)
+    print()
+    print("/* Entries 0 .. 2^W - 1: comb points plus the offset R. The last")
+    print("   entry is -(2^D - 1) * R. Affine (x, y). */")
+    print("static const uECC_word_t")
+    print("    p256_comb_table[(1 << P256_COMB_WIDTH) + 1][2]"
+          "[num_words_secp256r1] = {")
+    for i, point in enumerate(entries):
+        print(emit_point(point, i == len(entries) - 1))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()